@@ -0,0 +1,75 @@
+#define REDISMODULE_MAIN
+#include "../redismodule.h"
+#include "../rmutil/mock_redis.h"
+#include "../rmutil/bench.h"
+
+/* Benchmark driver for the example module. The module is loaded into the in-process mock host and
+ * its command handlers are called directly, so the numbers (and any perf profile of this binary)
+ * reflect handler CPU cost without network or protocol overhead. */
+
+int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
+
+typedef struct {
+  RedisModuleString **argv;
+  int argc;
+} benchCommand;
+
+static benchCommand *newBenchCommand(int argc, const char **args) {
+  benchCommand *c = malloc(sizeof(*c));
+  c->argc = argc;
+  c->argv = malloc(argc * sizeof(RedisModuleString *));
+  for (int i = 0; i < argc; i++) {
+    c->argv[i] = RedisModule_CreateString(NULL, args[i], strlen(args[i]));
+  }
+  return c;
+}
+
+static void freeBenchCommand(benchCommand *c) {
+  for (int i = 0; i < c->argc; i++) RedisModule_FreeString(NULL, c->argv[i]);
+  free(c->argv);
+  free(c);
+}
+
+void benchCommandExecute(void *arg, uint64_t iters) {
+  benchCommand *c = arg;
+  for (uint64_t i = 0; i < iters; i++) {
+    BENCH_SINK(RMUtilMock_Execute(c->argv, c->argc));
+  }
+}
+
+BENCH_MAIN({
+  if (RMUtilMock_LoadModule(RedisModule_OnLoad, NULL, 0) != REDISMODULE_OK) {
+    fprintf(stderr, "Failed loading the module\n");
+    return 1;
+  }
+
+  // make sure the module works in the mock host before measuring it
+  RedisModuleCallReply *r = RMUtilMock_Call("example.test", "");
+  int type = r ? RedisModule_CallReplyType(r) : REDISMODULE_REPLY_UNKNOWN;
+  size_t len = 0;
+  const char *s = NULL;
+  if (type == REDISMODULE_REPLY_STRING || type == REDISMODULE_REPLY_ERROR) {
+    s = RedisModule_CallReplyStringPtr(r, &len);
+  }
+  if (type != REDISMODULE_REPLY_STRING || !s || len != 4 || memcmp(s, "PASS", 4)) {
+    if (s) {
+      fprintf(stderr, "example.test failed: %.*s\n", (int)len, s);
+    } else {
+      fprintf(stderr, "example.test failed: reply of type %d\n", type);
+    }
+    if (r) RedisModule_FreeCallReply(r);
+    return 1;
+  }
+  RedisModule_FreeCallReply(r);
+  RMUtilMock_FlushAll();
+
+  const char *parse[] = {"example.parse", "SUM", "5", "2"};
+  benchCommand *c = newBenchCommand(4, parse);
+  BENCH_RUN("example.parse", benchCommandExecute, c);
+  freeBenchCommand(c);
+
+  const char *hgetset[] = {"example.hgetset", "foo", "bar", "baz"};
+  c = newBenchCommand(4, hgetset);
+  BENCH_RUN("example.hgetset", benchCommandExecute, c);
+  freeBenchCommand(c);
+});
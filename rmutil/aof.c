@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include "aof.h"
+#include "alloc.h"
+
+typedef struct {
+  RedisModuleIO *aof;
+  RedisModuleString *key;
+  const char *createCmd;
+  const char *appendCmd;
+  RedisModuleString **argv;
+  size_t argc;
+  size_t emitted;
+} aofChunk;
+
+static void aofChunk_Flush(aofChunk *c) {
+  const char *cmd = c->emitted ? c->appendCmd : c->createCmd;
+  RedisModule_EmitAOF(c->aof, cmd, "sv", c->key, c->argv, c->argc);
+
+  for (size_t i = 0; i < c->argc; i++) {
+    RedisModule_FreeString(NULL, c->argv[i]);
+  }
+  c->argc = 0;
+  c->emitted++;
+}
+
+size_t RMUtil_ChunkedAofRewrite(RedisModuleIO *aof, RedisModuleString *key,
+                                const RMUtilAofChunkOptions *opts, RMUtilAofNextFunc next,
+                                void *iter) {
+  if (opts == NULL || opts->createCmd == NULL || next == NULL) {
+    return 0;
+  }
+
+  size_t perElement = opts->argsPerElement ? opts->argsPerElement : 1;
+  size_t maxElements = opts->maxElements ? opts->maxElements : RMUTIL_AOF_DEFAULT_ELEMENTS_PER_CMD;
+  size_t maxBytes = opts->maxBytes ? opts->maxBytes : RMUTIL_AOF_DEFAULT_BYTES_PER_CMD;
+
+  aofChunk c = {
+      .aof = aof,
+      .key = key,
+      .createCmd = opts->createCmd,
+      .appendCmd = opts->appendCmd ? opts->appendCmd : opts->createCmd,
+      .argv = malloc(maxElements * perElement * sizeof(RedisModuleString *)),
+  };
+
+  size_t bytes = 0;
+  const char *buf;
+  size_t len;
+  while (next(iter, &buf, &len)) {
+    c.argv[c.argc++] = RedisModule_CreateString(NULL, buf, len);
+    bytes += len;
+
+    // only cut the chunk on element boundaries
+    if (c.argc % perElement) continue;
+    if (c.argc == maxElements * perElement || bytes >= maxBytes) {
+      aofChunk_Flush(&c);
+      bytes = 0;
+    }
+  }
+
+  // flush the remainder, or emit the bare create command for an empty value
+  if (c.argc || !c.emitted) {
+    aofChunk_Flush(&c);
+  }
+
+  free(c.argv);
+  return c.emitted;
+}
@@ -0,0 +1,55 @@
+#ifndef __RMUTIL_AOF_H__
+#define __RMUTIL_AOF_H__
+
+#include <redismodule.h>
+
+/** aof.h - Chunked AOF rewrite helper for large module values.
+ *
+ * RMUtil_DefaultAofRewrite serializes the entire value with DUMP and emits a single RESTORE, which
+ * holds the whole value in memory twice and produces one huge AOF command. Instead, the helper
+ * below walks the value with a module-supplied iterator and emits a "create" command followed by
+ * "append" commands, each carrying a bounded number of elements and bytes:
+ *
+ *    MYTYPE.CREATE key e1 e2 ... e64
+ *    MYTYPE.ADD key e65 e66 ... e128
+ *    ...
+ *
+ * The module's create/append commands must accept the key followed by zero or more elements.
+ */
+
+/* Default maximal number of elements per emitted command (same as Redis' own rewrite) */
+#define RMUTIL_AOF_DEFAULT_ELEMENTS_PER_CMD 64
+/* Default maximal payload size in bytes per emitted command */
+#define RMUTIL_AOF_DEFAULT_BYTES_PER_CMD (1024 * 1024)
+
+/* RMUtilAofNextFunc - iterator callback walking the module value. Each call should set *buf and
+ * *len to the next argument and return 1, or return 0 when the value is exhausted. The buffer only
+ * needs to stay valid until the next call, as the helper copies it. */
+typedef int (*RMUtilAofNextFunc)(void *iter, const char **buf, size_t *len);
+
+typedef struct {
+  /* Command emitted for the first chunk, e.g. "MYTYPE.CREATE". Required. */
+  const char *createCmd;
+  /* Command emitted for every following chunk, e.g. "MYTYPE.ADD". If NULL, createCmd is used */
+  const char *appendCmd;
+  /* How many consecutive arguments form a single element (e.g. 2 for field/value pairs). Chunks
+   * never split an element. 0 means 1 */
+  size_t argsPerElement;
+  /* Maximal number of elements per command. 0 means RMUTIL_AOF_DEFAULT_ELEMENTS_PER_CMD */
+  size_t maxElements;
+  /* Maximal payload bytes per command. A single element larger than this is still emitted whole.
+   * 0 means RMUTIL_AOF_DEFAULT_BYTES_PER_CMD */
+  size_t maxBytes;
+} RMUtilAofChunkOptions;
+
+/**
+ * Rewrite a module value into the AOF as a sequence of bounded-size commands. Call it from your
+ * type's aof_rewrite callback, passing an iterator over the value.
+ * The create command is always emitted, even for an empty value, so the key gets recreated.
+ * Returns the number of commands emitted, or 0 if the options are invalid.
+ */
+size_t RMUtil_ChunkedAofRewrite(RedisModuleIO *aof, RedisModuleString *key,
+                                const RMUtilAofChunkOptions *opts, RMUtilAofNextFunc next,
+                                void *iter);
+
+#endif
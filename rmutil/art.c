@@ -0,0 +1,783 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "art.h"
+#include "alloc.h"
+
+/* Number of prefix bytes stored in a node. Longer prefixes are checked optimistically on lookup,
+ * and against a leaf on insertion */
+#define ART_MAX_PREFIX 10
+
+enum { ART_NODE4 = 1, ART_NODE16, ART_NODE48, ART_NODE256 };
+
+typedef struct {
+  void *val;
+  uint32_t len;
+  unsigned char key[];
+} artLeaf;
+
+/* Children are either nodes or leaves tagged with their lowest bit */
+#define ART_IS_LEAF(p) ((uintptr_t)(p)&1)
+#define ART_LEAF(p) ((artLeaf *)((uintptr_t)(p) & ~(uintptr_t)1))
+#define ART_TAG_LEAF(l) ((void *)((uintptr_t)(l) | 1))
+
+typedef struct {
+  uint8_t type;
+  uint16_t numChildren;
+  uint32_t partialLen;
+  unsigned char partial[ART_MAX_PREFIX];
+  /* the key ending at this node, if any */
+  artLeaf *leaf;
+} artNode;
+
+typedef struct {
+  artNode n;
+  unsigned char keys[4];
+  void *children[4];
+} artNode4;
+
+typedef struct {
+  artNode n;
+  unsigned char keys[16];
+  void *children[16];
+} artNode16;
+
+typedef struct {
+  artNode n;
+  /* child index + 1 per key byte, 0 for none */
+  unsigned char index[256];
+  void *children[48];
+} artNode48;
+
+typedef struct {
+  artNode n;
+  void *children[256];
+} artNode256;
+
+struct RMUtilArt {
+  void *root;
+  size_t size;
+  size_t mem;
+};
+
+static const size_t artNodeSizes[] = {0, sizeof(artNode4), sizeof(artNode16), sizeof(artNode48),
+                                      sizeof(artNode256)};
+
+#define ART_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static artNode *art_newNode(RMUtilArt *t, int type) {
+  artNode *n = calloc(1, artNodeSizes[type]);
+  n->type = type;
+  t->mem += artNodeSizes[type];
+  return n;
+}
+
+static void art_freeNode(RMUtilArt *t, artNode *n) {
+  t->mem -= artNodeSizes[n->type];
+  free(n);
+}
+
+static artLeaf *art_newLeaf(RMUtilArt *t, const unsigned char *key, size_t len, void *val) {
+  artLeaf *l = malloc(sizeof(*l) + len);
+  l->val = val;
+  l->len = len;
+  memcpy(l->key, key, len);
+  t->mem += sizeof(*l) + len;
+  t->size++;
+  return l;
+}
+
+static void art_freeLeaf(RMUtilArt *t, artLeaf *l) {
+  t->mem -= sizeof(*l) + l->len;
+  t->size--;
+  free(l);
+}
+
+static inline int art_leafMatches(const artLeaf *l, const unsigned char *key, size_t len) {
+  return l->len == len && !memcmp(l->key, key, len);
+}
+
+static int art_leafCompare(const artLeaf *l, const unsigned char *key, size_t len) {
+  int cmp = memcmp(l->key, key, ART_MIN(l->len, len));
+  if (cmp) return cmp;
+  return l->len < len ? -1 : l->len > len;
+}
+
+/* Bit i is set if keys[i] == c, for the first n keys */
+static inline unsigned art_match16(const unsigned char *keys, int n, unsigned char c) {
+#ifdef __SSE2__
+  __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(c), _mm_loadu_si128((const __m128i *)keys));
+  return _mm_movemask_epi8(cmp) & ((1u << n) - 1);
+#else
+  unsigned mask = 0;
+  for (int i = 0; i < n; i++) mask |= (unsigned)(keys[i] == c) << i;
+  return mask;
+#endif
+}
+
+/* Bit i is set if keys[i] > c, for the first n keys */
+static inline unsigned art_greater16(const unsigned char *keys, int n, unsigned char c) {
+#ifdef __SSE2__
+  // there is no unsigned byte compare, so flip the sign bits and compare signed
+  __m128i bias = _mm_set1_epi8((char)0x80);
+  __m128i k = _mm_xor_si128(_mm_loadu_si128((const __m128i *)keys), bias);
+  __m128i cmp = _mm_cmpgt_epi8(k, _mm_xor_si128(_mm_set1_epi8(c), bias));
+  return _mm_movemask_epi8(cmp) & ((1u << n) - 1);
+#else
+  unsigned mask = 0;
+  for (int i = 0; i < n; i++) mask |= (unsigned)(keys[i] > c) << i;
+  return mask;
+#endif
+}
+
+static void **art_findChild(artNode *n, unsigned char c) {
+  switch (n->type) {
+    case ART_NODE4: {
+      artNode4 *n4 = (artNode4 *)n;
+      for (int i = 0; i < n->numChildren; i++) {
+        if (n4->keys[i] == c) return &n4->children[i];
+      }
+      return NULL;
+    }
+    case ART_NODE16: {
+      artNode16 *n16 = (artNode16 *)n;
+      unsigned mask = art_match16(n16->keys, n->numChildren, c);
+      return mask ? &n16->children[__builtin_ctz(mask)] : NULL;
+    }
+    case ART_NODE48: {
+      artNode48 *n48 = (artNode48 *)n;
+      return n48->index[c] ? &n48->children[n48->index[c] - 1] : NULL;
+    }
+    default: {
+      artNode256 *n256 = (artNode256 *)n;
+      return n256->children[c] ? &n256->children[c] : NULL;
+    }
+  }
+}
+
+/* Return the smallest leaf under p */
+static artLeaf *art_minimum(void *p) {
+  while (p && !ART_IS_LEAF(p)) {
+    artNode *n = p;
+    if (n->leaf) return n->leaf;
+    switch (n->type) {
+      case ART_NODE4:
+        p = ((artNode4 *)n)->children[0];
+        break;
+      case ART_NODE16:
+        p = ((artNode16 *)n)->children[0];
+        break;
+      case ART_NODE48: {
+        artNode48 *n48 = (artNode48 *)n;
+        int i = 0;
+        while (!n48->index[i]) i++;
+        p = n48->children[n48->index[i] - 1];
+        break;
+      }
+      default: {
+        artNode256 *n256 = (artNode256 *)n;
+        int i = 0;
+        while (!n256->children[i]) i++;
+        p = n256->children[i];
+        break;
+      }
+    }
+  }
+  return p ? ART_LEAF(p) : NULL;
+}
+
+static void art_copyHeader(artNode *dst, artNode *src) {
+  dst->numChildren = src->numChildren;
+  dst->partialLen = src->partialLen;
+  dst->leaf = src->leaf;
+  memcpy(dst->partial, src->partial, ART_MIN(src->partialLen, ART_MAX_PREFIX));
+}
+
+static void art_addChild(RMUtilArt *t, artNode *n, void **ref, unsigned char c, void *child);
+
+static void art_addChild256(artNode256 *n, unsigned char c, void *child) {
+  n->children[c] = child;
+  n->n.numChildren++;
+}
+
+static void art_addChild48(RMUtilArt *t, artNode48 *n, void **ref, unsigned char c, void *child) {
+  if (n->n.numChildren < 48) {
+    int pos = 0;
+    while (n->children[pos]) pos++;
+    n->children[pos] = child;
+    n->index[c] = pos + 1;
+    n->n.numChildren++;
+    return;
+  }
+  artNode256 *nn = (artNode256 *)art_newNode(t, ART_NODE256);
+  for (int i = 0; i < 256; i++) {
+    if (n->index[i]) nn->children[i] = n->children[n->index[i] - 1];
+  }
+  art_copyHeader(&nn->n, &n->n);
+  *ref = nn;
+  art_freeNode(t, &n->n);
+  art_addChild256(nn, c, child);
+}
+
+static void art_addChild16(RMUtilArt *t, artNode16 *n, void **ref, unsigned char c, void *child) {
+  int num = n->n.numChildren;
+  if (num < 16) {
+    unsigned mask = art_greater16(n->keys, num, c);
+    int pos = mask ? __builtin_ctz(mask) : num;
+    memmove(n->keys + pos + 1, n->keys + pos, num - pos);
+    memmove(n->children + pos + 1, n->children + pos, (num - pos) * sizeof(void *));
+    n->keys[pos] = c;
+    n->children[pos] = child;
+    n->n.numChildren++;
+    return;
+  }
+  artNode48 *nn = (artNode48 *)art_newNode(t, ART_NODE48);
+  memcpy(nn->children, n->children, num * sizeof(void *));
+  for (int i = 0; i < num; i++) nn->index[n->keys[i]] = i + 1;
+  art_copyHeader(&nn->n, &n->n);
+  *ref = nn;
+  art_freeNode(t, &n->n);
+  art_addChild48(t, nn, ref, c, child);
+}
+
+static void art_addChild4(RMUtilArt *t, artNode4 *n, void **ref, unsigned char c, void *child) {
+  int num = n->n.numChildren;
+  if (num < 4) {
+    int pos = 0;
+    while (pos < num && n->keys[pos] < c) pos++;
+    memmove(n->keys + pos + 1, n->keys + pos, num - pos);
+    memmove(n->children + pos + 1, n->children + pos, (num - pos) * sizeof(void *));
+    n->keys[pos] = c;
+    n->children[pos] = child;
+    n->n.numChildren++;
+    return;
+  }
+  artNode16 *nn = (artNode16 *)art_newNode(t, ART_NODE16);
+  memcpy(nn->keys, n->keys, num);
+  memcpy(nn->children, n->children, num * sizeof(void *));
+  art_copyHeader(&nn->n, &n->n);
+  *ref = nn;
+  art_freeNode(t, &n->n);
+  art_addChild16(t, nn, ref, c, child);
+}
+
+/* Add child under byte c of n, replacing n in *ref if it has to grow */
+static void art_addChild(RMUtilArt *t, artNode *n, void **ref, unsigned char c, void *child) {
+  switch (n->type) {
+    case ART_NODE4:
+      art_addChild4(t, (artNode4 *)n, ref, c, child);
+      break;
+    case ART_NODE16:
+      art_addChild16(t, (artNode16 *)n, ref, c, child);
+      break;
+    case ART_NODE48:
+      art_addChild48(t, (artNode48 *)n, ref, c, child);
+      break;
+    default:
+      art_addChild256((artNode256 *)n, c, child);
+      break;
+  }
+}
+
+/* Put a leaf under a fresh node, whose prefix ends at depth */
+static void art_attachLeaf(RMUtilArt *t, artNode *n, artLeaf *l, size_t depth) {
+  if (l->len == depth) {
+    n->leaf = l;
+  } else {
+    void *ref = n;
+    art_addChild(t, n, &ref, l->key[depth], ART_TAG_LEAF(l));
+  }
+}
+
+/* Number of leading prefix bytes of n matching key at depth. Checks the full prefix, reading the
+ * bytes not stored in the node from one of its leaves */
+static size_t art_prefixMismatch(artNode *n, const unsigned char *key, size_t len, size_t depth) {
+  size_t max = ART_MIN(ART_MIN(n->partialLen, ART_MAX_PREFIX), len - depth);
+  size_t i;
+  for (i = 0; i < max; i++) {
+    if (n->partial[i] != key[depth + i]) return i;
+  }
+  if (n->partialLen > ART_MAX_PREFIX) {
+    artLeaf *l = art_minimum(n);
+    max = ART_MIN(ART_MIN(l->len, len) - depth, n->partialLen);
+    for (; i < max; i++) {
+      if (l->key[depth + i] != key[depth + i]) return i;
+    }
+  }
+  return i;
+}
+
+/* Optimistic prefix check: only compares the stored bytes, the leaf is checked in the end */
+static inline int art_prefixMatches(artNode *n, const unsigned char *key, size_t len,
+                                    size_t depth) {
+  size_t stored = ART_MIN(n->partialLen, ART_MAX_PREFIX);
+  if (depth + n->partialLen > len) return 0;
+  return !memcmp(n->partial, key + depth, stored);
+}
+
+RMUtilArt *RMUtilArt_New(void) {
+  RMUtilArt *t = calloc(1, sizeof(*t));
+  return t;
+}
+
+static void art_freeTree(RMUtilArt *t, void *p, void (*freeVal)(void *)) {
+  if (!p) return;
+  if (ART_IS_LEAF(p)) {
+    if (freeVal) freeVal(ART_LEAF(p)->val);
+    art_freeLeaf(t, ART_LEAF(p));
+    return;
+  }
+  artNode *n = p;
+  if (n->leaf) art_freeTree(t, ART_TAG_LEAF(n->leaf), freeVal);
+  switch (n->type) {
+    case ART_NODE4:
+      for (int i = 0; i < n->numChildren; i++) {
+        art_freeTree(t, ((artNode4 *)n)->children[i], freeVal);
+      }
+      break;
+    case ART_NODE16:
+      for (int i = 0; i < n->numChildren; i++) {
+        art_freeTree(t, ((artNode16 *)n)->children[i], freeVal);
+      }
+      break;
+    case ART_NODE48:
+      for (int i = 0; i < 48; i++) art_freeTree(t, ((artNode48 *)n)->children[i], freeVal);
+      break;
+    default:
+      for (int i = 0; i < 256; i++) art_freeTree(t, ((artNode256 *)n)->children[i], freeVal);
+      break;
+  }
+  art_freeNode(t, n);
+}
+
+void RMUtilArt_Free(RMUtilArt *t, void (*freeVal)(void *)) {
+  art_freeTree(t, t->root, freeVal);
+  free(t);
+}
+
+size_t RMUtilArt_Size(RMUtilArt *t) {
+  return t->size;
+}
+
+size_t RMUtilArt_MemUsage(RMUtilArt *t) {
+  return sizeof(*t) + t->mem;
+}
+
+void *RMUtilArt_Find(RMUtilArt *t, const char *k, size_t len) {
+  const unsigned char *key = (const unsigned char *)k;
+  void *p = t->root;
+  size_t depth = 0;
+  while (p) {
+    if (ART_IS_LEAF(p)) {
+      artLeaf *l = ART_LEAF(p);
+      return art_leafMatches(l, key, len) ? l->val : NULL;
+    }
+    artNode *n = p;
+    if (n->partialLen) {
+      if (!art_prefixMatches(n, key, len, depth)) return NULL;
+      depth += n->partialLen;
+    }
+    if (depth == len) {
+      return n->leaf && art_leafMatches(n->leaf, key, len) ? n->leaf->val : NULL;
+    }
+    void **child = art_findChild(n, key[depth]);
+    p = child ? *child : NULL;
+    depth++;
+  }
+  return NULL;
+}
+
+int RMUtilArt_Insert(RMUtilArt *t, const char *k, size_t len, void *val, void **oldval) {
+  const unsigned char *key = (const unsigned char *)k;
+  void **ref = &t->root;
+  size_t depth = 0;
+  for (;;) {
+    void *p = *ref;
+    if (!p) {
+      *ref = ART_TAG_LEAF(art_newLeaf(t, key, len, val));
+      return 1;
+    }
+
+    if (ART_IS_LEAF(p)) {
+      artLeaf *l = ART_LEAF(p);
+      if (art_leafMatches(l, key, len)) {
+        if (oldval) *oldval = l->val;
+        l->val = val;
+        return 0;
+      }
+      // split the leaf: a new node holding the common prefix, with both leaves under it
+      artNode *nn = art_newNode(t, ART_NODE4);
+      size_t max = ART_MIN(l->len, len), lcp = depth;
+      while (lcp < max && l->key[lcp] == key[lcp]) lcp++;
+      nn->partialLen = lcp - depth;
+      memcpy(nn->partial, key + depth, ART_MIN(nn->partialLen, ART_MAX_PREFIX));
+      art_attachLeaf(t, nn, l, lcp);
+      art_attachLeaf(t, nn, art_newLeaf(t, key, len, val), lcp);
+      *ref = nn;
+      return 1;
+    }
+
+    artNode *n = p;
+    if (n->partialLen) {
+      size_t diff = art_prefixMismatch(n, key, len, depth);
+      if (diff < n->partialLen) {
+        // split the prefix: a new node holding its matching part, with n and the key under it
+        artNode *nn = art_newNode(t, ART_NODE4);
+        nn->partialLen = diff;
+        memcpy(nn->partial, n->partial, ART_MIN(diff, ART_MAX_PREFIX));
+        unsigned char c;
+        if (n->partialLen <= ART_MAX_PREFIX) {
+          c = n->partial[diff];
+          n->partialLen -= diff + 1;
+          memmove(n->partial, n->partial + diff + 1, n->partialLen);
+        } else {
+          artLeaf *l = art_minimum(n);
+          c = l->key[depth + diff];
+          n->partialLen -= diff + 1;
+          memcpy(n->partial, l->key + depth + diff + 1, ART_MIN(n->partialLen, ART_MAX_PREFIX));
+        }
+        void *nnref = nn;
+        art_addChild(t, nn, &nnref, c, n);
+        art_attachLeaf(t, nn, art_newLeaf(t, key, len, val), depth + diff);
+        *ref = nn;
+        return 1;
+      }
+      depth += n->partialLen;
+    }
+
+    if (depth == len) {
+      if (n->leaf) {
+        if (oldval) *oldval = n->leaf->val;
+        n->leaf->val = val;
+        return 0;
+      }
+      n->leaf = art_newLeaf(t, key, len, val);
+      return 1;
+    }
+
+    void **child = art_findChild(n, key[depth]);
+    if (!child) {
+      art_addChild(t, n, ref, key[depth], ART_TAG_LEAF(art_newLeaf(t, key, len, val)));
+      return 1;
+    }
+    ref = child;
+    depth++;
+  }
+}
+
+/* Replace a node4 that is left with a single child and no key of its own by the child, merging
+ * their prefixes, or one with no children by its key's leaf */
+static void art_compact(RMUtilArt *t, void **ref) {
+  artNode4 *n = *ref;
+  if (n->n.numChildren == 0) {
+    *ref = n->n.leaf ? ART_TAG_LEAF(n->n.leaf) : NULL;
+    art_freeNode(t, &n->n);
+    return;
+  }
+  if (n->n.numChildren > 1 || n->n.leaf) return;
+
+  void *child = n->children[0];
+  if (!ART_IS_LEAF(child)) {
+    artNode *c = child;
+    unsigned char buf[ART_MAX_PREFIX];
+    size_t len = ART_MIN(n->n.partialLen, ART_MAX_PREFIX);
+    memcpy(buf, n->n.partial, len);
+    if (len < ART_MAX_PREFIX) buf[len++] = n->keys[0];
+    size_t more = ART_MIN(c->partialLen, ART_MAX_PREFIX - len);
+    memcpy(buf + len, c->partial, more);
+    len += more;
+    memcpy(c->partial, buf, len);
+    c->partialLen += n->n.partialLen + 1;
+  }
+  *ref = child;
+  art_freeNode(t, &n->n);
+}
+
+static void art_removeChild(RMUtilArt *t, artNode *n, void **ref, unsigned char c, void **slot) {
+  switch (n->type) {
+    case ART_NODE4: {
+      artNode4 *n4 = (artNode4 *)n;
+      int pos = slot - n4->children, num = n->numChildren;
+      memmove(n4->keys + pos, n4->keys + pos + 1, num - pos - 1);
+      memmove(n4->children + pos, n4->children + pos + 1, (num - pos - 1) * sizeof(void *));
+      n->numChildren--;
+      art_compact(t, ref);
+      break;
+    }
+    case ART_NODE16: {
+      artNode16 *n16 = (artNode16 *)n;
+      int pos = slot - n16->children, num = n->numChildren;
+      memmove(n16->keys + pos, n16->keys + pos + 1, num - pos - 1);
+      memmove(n16->children + pos, n16->children + pos + 1, (num - pos - 1) * sizeof(void *));
+      if (--n->numChildren == 3) {
+        artNode4 *nn = (artNode4 *)art_newNode(t, ART_NODE4);
+        art_copyHeader(&nn->n, n);
+        memcpy(nn->keys, n16->keys, 3);
+        memcpy(nn->children, n16->children, 3 * sizeof(void *));
+        *ref = nn;
+        art_freeNode(t, n);
+      }
+      break;
+    }
+    case ART_NODE48: {
+      artNode48 *n48 = (artNode48 *)n;
+      n48->children[n48->index[c] - 1] = NULL;
+      n48->index[c] = 0;
+      if (--n->numChildren == 12) {
+        artNode16 *nn = (artNode16 *)art_newNode(t, ART_NODE16);
+        art_copyHeader(&nn->n, n);
+        int j = 0;
+        for (int i = 0; i < 256; i++) {
+          if (!n48->index[i]) continue;
+          nn->keys[j] = i;
+          nn->children[j++] = n48->children[n48->index[i] - 1];
+        }
+        *ref = nn;
+        art_freeNode(t, n);
+      }
+      break;
+    }
+    default: {
+      artNode256 *n256 = (artNode256 *)n;
+      n256->children[c] = NULL;
+      // shrink a bit below the node48 capacity, so we don't flip-flop around it
+      if (--n->numChildren == 37) {
+        artNode48 *nn = (artNode48 *)art_newNode(t, ART_NODE48);
+        art_copyHeader(&nn->n, n);
+        int j = 0;
+        for (int i = 0; i < 256; i++) {
+          if (!n256->children[i]) continue;
+          nn->children[j] = n256->children[i];
+          nn->index[i] = ++j;
+        }
+        *ref = nn;
+        art_freeNode(t, n);
+      }
+      break;
+    }
+  }
+}
+
+int RMUtilArt_Delete(RMUtilArt *t, const char *k, size_t len, void **oldval) {
+  const unsigned char *key = (const unsigned char *)k;
+  void **ref = &t->root;
+  size_t depth = 0;
+  for (;;) {
+    void *p = *ref;
+    if (!p) return 0;
+    if (ART_IS_LEAF(p)) {
+      // only reached for a root leaf, others are removed from their parent below
+      artLeaf *l = ART_LEAF(p);
+      if (!art_leafMatches(l, key, len)) return 0;
+      if (oldval) *oldval = l->val;
+      art_freeLeaf(t, l);
+      *ref = NULL;
+      return 1;
+    }
+
+    artNode *n = p;
+    if (n->partialLen) {
+      if (!art_prefixMatches(n, key, len, depth)) return 0;
+      depth += n->partialLen;
+    }
+    if (depth == len) {
+      artLeaf *l = n->leaf;
+      if (!l || !art_leafMatches(l, key, len)) return 0;
+      if (oldval) *oldval = l->val;
+      art_freeLeaf(t, l);
+      n->leaf = NULL;
+      if (n->type == ART_NODE4) art_compact(t, ref);
+      return 1;
+    }
+
+    void **child = art_findChild(n, key[depth]);
+    if (!child) return 0;
+    if (ART_IS_LEAF(*child)) {
+      artLeaf *l = ART_LEAF(*child);
+      if (!art_leafMatches(l, key, len)) return 0;
+      if (oldval) *oldval = l->val;
+      art_freeLeaf(t, l);
+      art_removeChild(t, n, ref, key[depth], child);
+      return 1;
+    }
+    ref = child;
+    depth++;
+  }
+}
+
+int RMUtilArt_InsertString(RMUtilArt *t, RedisModuleString *key, void *val, void **oldval) {
+  size_t len;
+  const char *k = RedisModule_StringPtrLen(key, &len);
+  return RMUtilArt_Insert(t, k, len, val, oldval);
+}
+
+void *RMUtilArt_FindString(RMUtilArt *t, RedisModuleString *key) {
+  size_t len;
+  const char *k = RedisModule_StringPtrLen(key, &len);
+  return RMUtilArt_Find(t, k, len);
+}
+
+int RMUtilArt_DeleteString(RMUtilArt *t, RedisModuleString *key, void **oldval) {
+  size_t len;
+  const char *k = RedisModule_StringPtrLen(key, &len);
+  return RMUtilArt_Delete(t, k, len, oldval);
+}
+
+/* An iterator is a stack of the nodes being walked, each with the position of its next child:
+ * -1 before the node's own key, then an index into keys for node4/16, or a key byte for 48/256 */
+typedef struct {
+  void *node;
+  int pos;
+} artFrame;
+
+struct RMUtilArtIterator {
+  artFrame *stack;
+  size_t depth, cap;
+  /* stop at the first key not starting with it, if set */
+  unsigned char *prefix;
+  size_t prefixLen;
+};
+
+static void art_push(RMUtilArtIterator *it, void *node, int pos) {
+  if (it->depth == it->cap) {
+    it->cap = it->cap ? it->cap * 2 : 16;
+    it->stack = realloc(it->stack, it->cap * sizeof(artFrame));
+  }
+  it->stack[it->depth++] = (artFrame){node, pos};
+}
+
+/* Return the next child of n at or after *pos in key order, advancing *pos past it */
+static void *art_nextChild(artNode *n, int *pos) {
+  switch (n->type) {
+    case ART_NODE4:
+      return *pos < n->numChildren ? ((artNode4 *)n)->children[(*pos)++] : NULL;
+    case ART_NODE16:
+      return *pos < n->numChildren ? ((artNode16 *)n)->children[(*pos)++] : NULL;
+    case ART_NODE48: {
+      artNode48 *n48 = (artNode48 *)n;
+      while (*pos < 256) {
+        int b = (*pos)++;
+        if (n48->index[b]) return n48->children[n48->index[b] - 1];
+      }
+      return NULL;
+    }
+    default: {
+      artNode256 *n256 = (artNode256 *)n;
+      while (*pos < 256) {
+        int b = (*pos)++;
+        if (n256->children[b]) return n256->children[b];
+      }
+      return NULL;
+    }
+  }
+}
+
+/* Position of the first child of n with a key byte greater than c */
+static int art_posAfter(artNode *n, unsigned char c) {
+  switch (n->type) {
+    case ART_NODE4: {
+      int i = 0;
+      while (i < n->numChildren && ((artNode4 *)n)->keys[i] <= c) i++;
+      return i;
+    }
+    case ART_NODE16: {
+      unsigned mask = art_greater16(((artNode16 *)n)->keys, n->numChildren, c);
+      return mask ? __builtin_ctz(mask) : n->numChildren;
+    }
+    default:
+      return c + 1;
+  }
+}
+
+/* Set up the stack so that the first key returned is the smallest one >= key */
+static void art_seek(RMUtilArtIterator *it, void *p, const unsigned char *key, size_t len) {
+  size_t depth = 0;
+  while (p) {
+    if (ART_IS_LEAF(p)) {
+      if (art_leafCompare(ART_LEAF(p), key, len) >= 0) art_push(it, p, -1);
+      return;
+    }
+    artNode *n = p;
+    if (n->partialLen) {
+      const unsigned char *prefix =
+          n->partialLen <= ART_MAX_PREFIX ? n->partial : art_minimum(n)->key + depth;
+      size_t m = ART_MIN(n->partialLen, len - depth);
+      int cmp = memcmp(key + depth, prefix, m);
+      // all the keys under n are greater than key, or all of them are smaller
+      if (cmp < 0 || (cmp == 0 && m < n->partialLen)) {
+        art_push(it, n, -1);
+        return;
+      }
+      if (cmp > 0) return;
+      depth += n->partialLen;
+    }
+    if (depth == len) {
+      art_push(it, n, -1);
+      return;
+    }
+    // n's own key is shorter than key, so smaller: resume after the child we descend into
+    unsigned char c = key[depth];
+    art_push(it, n, art_posAfter(n, c));
+    void **child = art_findChild(n, c);
+    if (!child) return;
+    p = *child;
+    depth++;
+  }
+}
+
+RMUtilArtIterator *RMUtilArt_IterateFrom(RMUtilArt *t, const char *key, size_t len) {
+  RMUtilArtIterator *it = calloc(1, sizeof(*it));
+  art_seek(it, t->root, (const unsigned char *)key, len);
+  return it;
+}
+
+RMUtilArtIterator *RMUtilArt_IteratePrefix(RMUtilArt *t, const char *prefix, size_t len) {
+  RMUtilArtIterator *it = RMUtilArt_IterateFrom(t, prefix, len);
+  it->prefix = malloc(len ? len : 1);
+  memcpy(it->prefix, prefix, len);
+  it->prefixLen = len;
+  return it;
+}
+
+static int art_emit(RMUtilArtIterator *it, artLeaf *l, const char **key, size_t *len, void **val) {
+  if (it->prefix && (l->len < it->prefixLen || memcmp(l->key, it->prefix, it->prefixLen))) {
+    // keys come in order, so nothing after this one has the prefix either
+    it->depth = 0;
+    return 0;
+  }
+  if (key) *key = (const char *)l->key;
+  if (len) *len = l->len;
+  if (val) *val = l->val;
+  return 1;
+}
+
+int RMUtilArtIterator_Next(RMUtilArtIterator *it, const char **key, size_t *len, void **val) {
+  while (it->depth) {
+    artFrame *f = &it->stack[it->depth - 1];
+    if (ART_IS_LEAF(f->node)) {
+      it->depth--;
+      return art_emit(it, ART_LEAF(f->node), key, len, val);
+    }
+    artNode *n = f->node;
+    if (f->pos < 0) {
+      f->pos = 0;
+      if (n->leaf) return art_emit(it, n->leaf, key, len, val);
+    }
+    void *child = art_nextChild(n, &f->pos);
+    if (!child) {
+      it->depth--;
+      continue;
+    }
+    art_push(it, child, -1);
+  }
+  return 0;
+}
+
+void RMUtilArtIterator_Free(RMUtilArtIterator *it) {
+  free(it->stack);
+  free(it->prefix);
+  free(it);
+}
@@ -0,0 +1,72 @@
+#ifndef __RMUTIL_ART_H__
+#define __RMUTIL_ART_H__
+
+#include <stddef.h>
+#include <redismodule.h>
+
+/** art.h - an adaptive radix tree, mapping binary string keys to pointers, kept in key order.
+ *
+ * Inner nodes branch on one key byte and come in four sizes - 4, 16, 48 and 256 children - grown
+ * and shrunk as children are added and removed, so sparse nodes stay small. Runs of bytes shared
+ * by all the keys under a node are collapsed into the node's prefix, and a key ending at a node
+ * (a prefix of longer keys) is kept in the node itself. Lookups take O(key length), independently
+ * of the number of keys, and node16 searches its children with SSE2 when available.
+ *
+ * Keys are copied into the tree's leaves. The RedisModuleString variants only read the string's
+ * buffer, without copying it for the lookup. Iterators walk the keys in lexicographic (memcmp)
+ * order, either from a lower bound or over a prefix, which makes prefix and autocomplete queries
+ * proportional to the number of results.
+ *
+ *    RMUtilArt *t = RMUtilArt_New();
+ *    RMUtilArt_Insert(t, "hello", 5, val, NULL);
+ *    RMUtilArtIterator *it = RMUtilArt_IteratePrefix(t, "he", 2);
+ *    const char *key; size_t len; void *v;
+ *    while (RMUtilArtIterator_Next(it, &key, &len, &v)) ...
+ *    RMUtilArtIterator_Free(it);
+ */
+
+/* RMUtilArt - opaque tree */
+typedef struct RMUtilArt RMUtilArt;
+
+/* RMUtilArtIterator - opaque iterator */
+typedef struct RMUtilArtIterator RMUtilArtIterator;
+
+RMUtilArt *RMUtilArt_New(void);
+
+/* Free the tree, calling freeVal on every value if not NULL */
+void RMUtilArt_Free(RMUtilArt *t, void (*freeVal)(void *));
+
+/* Set key to val. Returns 1 if the key was added, or 0 if it existed, in which case its previous
+ * value is stored in *oldval if oldval is not NULL */
+int RMUtilArt_Insert(RMUtilArt *t, const char *key, size_t len, void *val, void **oldval);
+
+/* Return key's value, or NULL if it's not in the tree */
+void *RMUtilArt_Find(RMUtilArt *t, const char *key, size_t len);
+
+/* Remove key. Returns 1 if it was found, storing its value in *oldval if oldval is not NULL */
+int RMUtilArt_Delete(RMUtilArt *t, const char *key, size_t len, void **oldval);
+
+/* Variants taking RedisModuleString keys */
+int RMUtilArt_InsertString(RMUtilArt *t, RedisModuleString *key, void *val, void **oldval);
+void *RMUtilArt_FindString(RMUtilArt *t, RedisModuleString *key);
+int RMUtilArt_DeleteString(RMUtilArt *t, RedisModuleString *key, void **oldval);
+
+/* Return the number of keys in the tree */
+size_t RMUtilArt_Size(RMUtilArt *t);
+
+/* Return the number of bytes allocated by the tree, excluding the values */
+size_t RMUtilArt_MemUsage(RMUtilArt *t);
+
+/* Iterate over all the keys greater than or equal to key, in order */
+RMUtilArtIterator *RMUtilArt_IterateFrom(RMUtilArt *t, const char *key, size_t len);
+
+/* Iterate over all the keys starting with prefix, in order */
+RMUtilArtIterator *RMUtilArt_IteratePrefix(RMUtilArt *t, const char *prefix, size_t len);
+
+/* Get the next key and value. The key is not NUL terminated, and stays valid until it's removed
+ * from the tree. Returns 0 when done. The tree must not be modified while iterating */
+int RMUtilArtIterator_Next(RMUtilArtIterator *it, const char **key, size_t *len, void **val);
+
+void RMUtilArtIterator_Free(RMUtilArtIterator *it);
+
+#endif
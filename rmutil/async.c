@@ -0,0 +1,113 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "async.h"
+#include "alloc.h"
+
+struct RMUtilAsyncJob {
+  RedisModuleBlockedClient *bc;
+  RedisModuleCtx *tsctx;
+  RMUtilAsyncWorkFunc work;
+  RMUtilAsyncReplyFunc reply;
+  RMUtilAsyncFreeFunc freePrivdata;
+  void *privdata;
+  int cancelled;
+};
+
+static void async_freeJob(RMUtilAsyncJob *job) {
+  if (job->freePrivdata) job->freePrivdata(job->privdata);
+  free(job);
+}
+
+static void async_cancel(RMUtilAsyncJob *job) {
+  if (job) __atomic_store_n(&job->cancelled, 1, __ATOMIC_RELAXED);
+}
+
+/* Called by redis on the main thread once the worker has unblocked the client, whether the reply
+ * was sent, the client timed out or it disconnected */
+static void async_freePrivdata(RedisModuleCtx *ctx, void *pd) {
+  if (pd) async_freeJob(pd);
+}
+
+static int async_reply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  RMUtilAsyncJob *job = RedisModule_GetBlockedClientPrivateData(ctx);
+  return job->reply(ctx, job->privdata);
+}
+
+/* The job is only attached to the blocked client up front if the server has
+ * RedisModule_BlockClientSetPrivateData, otherwise it's NULL here and we can't flag it */
+static int async_timeout(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  async_cancel(RedisModule_GetBlockedClientPrivateData(ctx));
+  return RedisModule_ReplyWithError(ctx, RMUTIL_ASYNC_TIMEOUT_ERROR);
+}
+
+static void async_disconnected(RedisModuleCtx *ctx, RedisModuleBlockedClient *bc) {
+  async_cancel(RedisModule_BlockClientGetPrivateData(bc));
+}
+
+static void async_run(void *arg) {
+  RMUtilAsyncJob *job = arg;
+  if (RedisModule_BlockedClientMeasureTimeStart) RedisModule_BlockedClientMeasureTimeStart(job->bc);
+  job->work(job, job->privdata);
+  if (RedisModule_BlockedClientMeasureTimeEnd) RedisModule_BlockedClientMeasureTimeEnd(job->bc);
+
+  if (job->tsctx) {
+    RedisModule_FreeThreadSafeContext(job->tsctx);
+    job->tsctx = NULL;
+  }
+  // from here on the job belongs to redis, which frees it with async_freePrivdata
+  RedisModule_UnblockClient(job->bc, job);
+}
+
+static void *async_threadMain(void *arg) {
+  async_run(arg);
+  return NULL;
+}
+
+static int async_spawn(RMUtilAsyncJob *job) {
+  pthread_t tid;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int rc = pthread_create(&tid, &attr, async_threadMain, job);
+  pthread_attr_destroy(&attr);
+  return rc == 0 ? REDISMODULE_OK : REDISMODULE_ERR;
+}
+
+int RMUtil_AsyncCommand(RedisModuleCtx *ctx, RMUtilThreadPool *pool, RMUtilAsyncWorkFunc work,
+                        RMUtilAsyncReplyFunc reply, RMUtilAsyncFreeFunc freePrivdata,
+                        void *privdata, long long timeout_ms) {
+  RMUtilAsyncJob *job = calloc(1, sizeof(*job));
+  job->work = work;
+  job->reply = reply;
+  job->freePrivdata = freePrivdata;
+  job->privdata = privdata;
+
+  job->bc = RedisModule_BlockClient(ctx, async_reply, async_timeout, async_freePrivdata, timeout_ms);
+  if (!job->bc) {
+    async_freeJob(job);
+    RedisModule_ReplyWithError(ctx, "ERR could not block client");
+    return REDISMODULE_ERR;
+  }
+  if (RedisModule_BlockClientSetPrivateData) RedisModule_BlockClientSetPrivateData(job->bc, job);
+  if (RedisModule_SetDisconnectCallback)
+    RedisModule_SetDisconnectCallback(job->bc, async_disconnected);
+
+  int rc = pool ? RMUtilThreadPool_Submit(pool, async_run, job) : async_spawn(job);
+  if (rc != REDISMODULE_OK) {
+    // aborting unblocks with NULL private data, so the job is still ours to free
+    RedisModule_AbortBlock(job->bc);
+    async_freeJob(job);
+    RedisModule_ReplyWithError(ctx, "ERR could not start background work");
+    return REDISMODULE_ERR;
+  }
+  return REDISMODULE_OK;
+}
+
+int RMUtilAsync_Cancelled(RMUtilAsyncJob *job) {
+  return __atomic_load_n(&job->cancelled, __ATOMIC_RELAXED);
+}
+
+RedisModuleCtx *RMUtilAsync_GetContext(RMUtilAsyncJob *job) {
+  if (!job->tsctx) job->tsctx = RedisModule_GetThreadSafeContext(job->bc);
+  return job->tsctx;
+}
@@ -0,0 +1,71 @@
+#ifndef __RMUTIL_ASYNC_H__
+#define __RMUTIL_ASYNC_H__
+
+#include <redismodule.h>
+#include "threadpool.h"
+
+/** async.h - run a command's work off the main thread and reply when it's done.
+ *
+ * RMUtil_AsyncCommand wraps the sequence described in BLOCK.md: it blocks the client, runs the
+ * work function on a thread pool (or a dedicated thread), unblocks the client, and calls the reply
+ * function on the main thread. On top of that it:
+ *
+ *  - Owns the private data from the moment it's passed in, and frees it exactly once with the
+ *    given free function - whether the client got its reply, timed out or disconnected.
+ *  - Replies with an error on timeout, and flags the job as cancelled on timeout or disconnect,
+ *    so long running work can stop early (see RMUtilAsync_Cancelled).
+ *  - Measures the offloaded time with RedisModule_BlockedClientMeasureTimeStart/End, so it's
+ *    accounted for in the slowlog and command stats, if the server supports it.
+ *
+ * Example:
+ *
+ *    void countWork(RMUtilAsyncJob *job, void *pd) {
+ *      ... heavy computation, filling pd ...
+ *    }
+ *    int countReply(RedisModuleCtx *ctx, void *pd) {
+ *      return RedisModule_ReplyWithLongLong(ctx, ((countState *)pd)->count);
+ *    }
+ *    int CountCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+ *      countState *st = ...;
+ *      return RMUtil_AsyncCommand(ctx, pool, countWork, countReply, free, st, 5000);
+ *    }
+ */
+
+/* RMUtilAsyncJob - opaque handle of a running async command, passed to the work function */
+typedef struct RMUtilAsyncJob RMUtilAsyncJob;
+
+/* Runs on a worker thread. The keyspace must not be touched without locking a thread safe
+ * context (see RMUtilAsync_GetContext) */
+typedef void (*RMUtilAsyncWorkFunc)(RMUtilAsyncJob *job, void *privdata);
+
+/* Runs on the main thread once the work is done, and should reply to the client */
+typedef int (*RMUtilAsyncReplyFunc)(RedisModuleCtx *ctx, void *privdata);
+
+/* Frees the private data */
+typedef void (*RMUtilAsyncFreeFunc)(void *privdata);
+
+#define RMUTIL_ASYNC_TIMEOUT_ERROR "ERR command timed out"
+
+/**
+ * Run `work` off the main thread and reply with `reply` when it's done. Call it from a command
+ * handler and return its return value.
+ * @param pool the pool to run on, or NULL to run on a new detached thread
+ * @param freePrivdata called to free privdata, may be NULL
+ * @param timeout_ms reply with RMUTIL_ASYNC_TIMEOUT_ERROR if the work takes longer, 0 for none
+ * @return REDISMODULE_OK. If the client could not be blocked, privdata is freed, an error is
+ * replied and REDISMODULE_ERR is returned.
+ */
+int RMUtil_AsyncCommand(RedisModuleCtx *ctx, RMUtilThreadPool *pool, RMUtilAsyncWorkFunc work,
+                        RMUtilAsyncReplyFunc reply, RMUtilAsyncFreeFunc freePrivdata,
+                        void *privdata, long long timeout_ms);
+
+/* Return 1 if the client is no longer waiting for the result, because it timed out or
+ * disconnected. The work function may poll this to stop early */
+int RMUtilAsync_Cancelled(RMUtilAsyncJob *job);
+
+/* Return a thread safe context bound to the blocked client, created on first use and released
+ * when the work function returns. Lock it with RedisModule_ThreadSafeContextLock before touching
+ * the keyspace */
+RedisModuleCtx *RMUtilAsync_GetContext(RMUtilAsyncJob *job);
+
+#endif
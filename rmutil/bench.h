@@ -0,0 +1,147 @@
+#ifndef __RMUTIL_BENCH_H__
+#define __RMUTIL_BENCH_H__
+
+/* bench.h - a tiny microbenchmark harness, the timing counterpart of test.h.
+ *
+ * A benchmark is a function running `iters` iterations of the measured operation:
+ *
+ *    void benchVectorPush(void *arg, uint64_t iters) {
+ *      for (uint64_t i = 0; i < iters; i++) ...
+ *    }
+ *
+ *    BENCH_MAIN({ BENCHFUNC(benchVectorPush, NULL); });
+ *
+ * Benchmarks with parameters can be run once per parameter, each under its own name, with
+ * BENCH_RUN(name, f, arg).
+ *
+ * Each benchmark is warmed up, then the iteration count is scaled so that a single sample takes
+ * about BENCH_SAMPLE_NS, and BENCH_SAMPLES samples are taken. Every result is printed to stdout
+ * as one JSON object per line (with ns/op percentiles over the samples, ops/sec and, on x86,
+ * cycles/op from rdtsc), and as a human readable line to stderr.
+ *
+ * Setting the BENCH_FILTER environment variable runs only the benchmarks whose name contains it.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_RDTSC 1
+#endif
+
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES 30
+#endif
+
+#ifndef BENCH_SAMPLE_NS
+#define BENCH_SAMPLE_NS 10000000ULL /* 10ms */
+#endif
+
+#ifndef BENCH_WARMUP_NS
+#define BENCH_WARMUP_NS 100000000ULL /* 100ms */
+#endif
+
+typedef void (*BenchFunc)(void *arg, uint64_t iters);
+
+/* Keep the compiler from optimizing away a computed value */
+static volatile uint64_t __bench_sink;
+#define BENCH_SINK(x) (__bench_sink += (uint64_t)(x))
+
+static int numBenchmarks = 0;
+
+static inline uint64_t __bench_nsec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t __bench_cycles() {
+#ifdef BENCH_HAVE_RDTSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int __bench_cmpDouble(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile over sorted samples */
+static double __bench_percentile(const double *sorted, int n, double p) {
+  int idx = (int)(p / 100.0 * n + 0.5) - 1;
+  if (idx < 0) idx = 0;
+  if (idx >= n) idx = n - 1;
+  return sorted[idx];
+}
+
+static void __bench_run(const char *name, BenchFunc f, void *arg) {
+  const char *filter = getenv("BENCH_FILTER");
+  if (filter && !strstr(name, filter)) return;
+
+  // warmup, doubling the iteration count until a single run is long enough to be measurable and
+  // the whole warmup has taken at least BENCH_WARMUP_NS
+  uint64_t iters = 1, elapsed = 0, warmup = 0;
+  for (;;) {
+    uint64_t start = __bench_nsec();
+    f(arg, iters);
+    elapsed = __bench_nsec() - start;
+    warmup += elapsed;
+    if (warmup >= BENCH_WARMUP_NS && elapsed >= BENCH_SAMPLE_NS / 10) break;
+    if (elapsed < BENCH_SAMPLE_NS) iters *= 2;
+  }
+
+  // scale the iteration count so each sample takes about BENCH_SAMPLE_NS
+  iters = (uint64_t)((double)iters * BENCH_SAMPLE_NS / (elapsed ? elapsed : 1));
+  if (iters == 0) iters = 1;
+
+  double ns[BENCH_SAMPLES];
+  double cycles = 0, total = 0;
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    uint64_t c0 = __bench_cycles();
+    uint64_t t0 = __bench_nsec();
+    f(arg, iters);
+    uint64_t t1 = __bench_nsec();
+    uint64_t c1 = __bench_cycles();
+    ns[i] = (double)(t1 - t0) / iters;
+    cycles += (double)(c1 - c0) / iters;
+    total += ns[i];
+  }
+  qsort(ns, BENCH_SAMPLES, sizeof(double), __bench_cmpDouble);
+
+  double mean = total / BENCH_SAMPLES;
+  numBenchmarks++;
+  printf("{\"name\":\"%s\",\"iterations\":%llu,\"samples\":%d,\"ns_per_op\":{\"min\":%.3f,"
+         "\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},"
+         "\"cycles_per_op\":%.3f,\"ops_per_sec\":%.1f}\n",
+         name, (unsigned long long)iters, BENCH_SAMPLES, ns[0], mean,
+         __bench_percentile(ns, BENCH_SAMPLES, 50), __bench_percentile(ns, BENCH_SAMPLES, 90),
+         __bench_percentile(ns, BENCH_SAMPLES, 99), ns[BENCH_SAMPLES - 1],
+         cycles / BENCH_SAMPLES, mean > 0 ? 1e9 / mean : 0);
+  fflush(stdout);
+  fprintf(stderr, "  %-40s %12.2f ns/op (p50 %.2f, p99 %.2f) %14.0f ops/sec\n", name, mean,
+          __bench_percentile(ns, BENCH_SAMPLES, 50), __bench_percentile(ns, BENCH_SAMPLES, 99),
+          mean > 0 ? 1e9 / mean : 0);
+}
+
+/* Run a benchmark named after its function */
+#define BENCHFUNC(f, arg) __bench_run(__STRING(f), f, arg)
+
+/* Run a benchmark under a given name, e.g. one built at runtime for each parameter it's run with */
+#define BENCH_RUN(name, f, arg) __bench_run(name, f, arg)
+
+/* Define main() running the body. The body may contain commas, e.g. in initializers */
+#define BENCH_MAIN(...)                                         \
+  int main(int argc, char **argv) {                             \
+    fprintf(stderr, "Starting Benchmark '%s'...\n", argv[0]);   \
+    __VA_ARGS__;                                                \
+    fprintf(stderr, "\nTotal: %d benchmarks\n", numBenchmarks); \
+    fprintf(stderr, "\n--------------------\n\n");              \
+    return 0;                                                   \
+  }
+
+#endif
@@ -0,0 +1,642 @@
+#define REDISMODULE_MAIN
+#include <redismodule.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vector.h"
+#include "heap.h"
+#include "priority_queue.h"
+#include "sds.h"
+#include "strings.h"
+#include "util.h"
+#include "hashmap.h"
+#include "btree.h"
+#include "roaring.h"
+#include "setops.h"
+#include "filter.h"
+#include "sketch.h"
+#include "quantile.h"
+#include "ring.h"
+#include "cache.h"
+#include "postings.h"
+#include "bench.h"
+
+/* Minimal stand-ins for the RedisModuleString API, so the string and arg parsing helpers can be
+ * measured outside of redis */
+struct RedisModuleString {
+  size_t len;
+  char buf[];
+};
+
+static RedisModuleString *benchString(const char *s) {
+  size_t len = strlen(s);
+  RedisModuleString *ret = malloc(sizeof(*ret) + len + 1);
+  ret->len = len;
+  memcpy(ret->buf, s, len + 1);
+  return ret;
+}
+
+static const char *benchStringPtrLen(const RedisModuleString *s, size_t *len) {
+  if (len) *len = s->len;
+  return s->buf;
+}
+
+static int benchStringToLongLong(const RedisModuleString *s, long long *ll) {
+  char *end;
+  *ll = strtoll(s->buf, &end, 10);
+  return *end ? REDISMODULE_ERR : REDISMODULE_OK;
+}
+
+static int benchStringToDouble(const RedisModuleString *s, double *d) {
+  char *end;
+  *d = strtod(s->buf, &end);
+  return *end ? REDISMODULE_ERR : REDISMODULE_OK;
+}
+
+static int cmpInt(void *a, void *b) {
+  return *(int *)a - *(int *)b;
+}
+
+/* xorshift - cheap enough not to dominate the measured operations */
+static uint32_t benchRand(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+void benchVectorPush(void *arg, uint64_t iters) {
+  Vector *v = NewVector(int, 0);
+  for (uint64_t i = 0; i < iters; i++) {
+    Vector_Push(v, (int)i);
+  }
+  BENCH_SINK(Vector_Size(v));
+  Vector_Free(v);
+}
+
+void benchVectorGet(void *arg, uint64_t iters) {
+  Vector *v = arg;
+  size_t n = Vector_Size(v);
+  for (uint64_t i = 0; i < iters; i++) {
+    int x;
+    Vector_Get(v, i % n, &x);
+    BENCH_SINK(x);
+  }
+}
+
+/* one op = a push followed by a pop on a heap of fixed size */
+void benchHeapPushPop(void *arg, uint64_t iters) {
+  Vector *v = arg;
+  uint32_t seed = 2463534242;
+  for (uint64_t i = 0; i < iters; i++) {
+    Vector_Push(v, (int)(benchRand(&seed) & 0xffffff));
+    Heap_Push(v, 0, v->top, cmpInt);
+    Heap_Pop(v, 0, v->top, cmpInt);
+    v->top--;
+  }
+}
+
+/* one op = Make_Heap over 1024 elements */
+void benchHeapMake(void *arg, uint64_t iters) {
+  Vector *v = arg;
+  uint32_t seed = 2463534242;
+  for (uint64_t i = 0; i < iters; i++) {
+    int *data = (int *)v->data;
+    data[i % v->top] = benchRand(&seed) & 0xffffff;
+    Make_Heap(v, 0, v->top, cmpInt);
+  }
+}
+
+/* one op = a push followed by a pop on a queue of fixed size */
+void benchPriorityQueuePushPop(void *arg, uint64_t iters) {
+  PriorityQueue *pq = arg;
+  uint32_t seed = 2463534242;
+  for (uint64_t i = 0; i < iters; i++) {
+    Priority_Queue_Push(pq, (int)(benchRand(&seed) & 0xffffff));
+    Priority_Queue_Pop(pq);
+  }
+}
+
+void benchSdsNewFree(void *arg, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    sds s = sdsnewlen("hello world", 11);
+    BENCH_SINK(sdslen(s));
+    sdsfree(s);
+  }
+}
+
+void benchSdsCatLen(void *arg, uint64_t iters) {
+  sds s = sdsempty();
+  for (uint64_t i = 0; i < iters; i++) {
+    s = sdscatlen(s, "0123456789abcdef", 16);
+    if (sdslen(s) >= 1 << 20) sdsclear(s);
+  }
+  sdsfree(s);
+}
+
+void benchSdsCatPrintf(void *arg, uint64_t iters) {
+  sds s = sdsempty();
+  for (uint64_t i = 0; i < iters; i++) {
+    s = sdscatprintf(s, "%llu:", (unsigned long long)i);
+    if (sdslen(s) >= 1 << 20) sdsclear(s);
+  }
+  sdsfree(s);
+}
+
+typedef struct {
+  RedisModuleString **argv;
+  int argc;
+} benchArgs;
+
+void benchStringEqualsCaseC(void *arg, uint64_t iters) {
+  benchArgs *a = arg;
+  for (uint64_t i = 0; i < iters; i++) {
+    BENCH_SINK(RMUtil_StringEqualsCaseC(a->argv[i % a->argc], "limit"));
+  }
+}
+
+void benchArgIndex(void *arg, uint64_t iters) {
+  benchArgs *a = arg;
+  for (uint64_t i = 0; i < iters; i++) {
+    BENCH_SINK(RMUtil_ArgIndex("LIMIT", a->argv, a->argc));
+  }
+}
+
+void benchParseArgs(void *arg, uint64_t iters) {
+  benchArgs *a = arg;
+  for (uint64_t i = 0; i < iters; i++) {
+    long long l;
+    double d;
+    char *c;
+    RMUtil_ParseArgs(a->argv, a->argc, 1, "lcd", &l, &c, &d);
+    BENCH_SINK(l);
+  }
+}
+
+void benchParseArgsAfter(void *arg, uint64_t iters) {
+  benchArgs *a = arg;
+  for (uint64_t i = 0; i < iters; i++) {
+    long long offset, limit;
+    RMUtil_ParseArgsAfter("LIMIT", a->argv, a->argc, "ll", &offset, &limit);
+    BENCH_SINK(offset + limit);
+  }
+}
+
+#define intHash(k) RMUtilHash_U64(k)
+#define intEq(a, b) ((a) == (b))
+RMUTIL_HASHMAP_DEFINE(BenchMap, uint64_t, uint64_t, intHash, intEq)
+
+#define BENCH_MAP_SIZE (1 << 20)
+
+void benchHashMapGet(void *arg, uint64_t iters) {
+  BenchMap *m = arg;
+  uint32_t seed = 2463534242;
+  for (uint64_t i = 0; i < iters; i++) {
+    BENCH_SINK(*BenchMap_Get(m, benchRand(&seed) & (BENCH_MAP_SIZE - 1)));
+  }
+}
+
+void benchHashMapGetMiss(void *arg, uint64_t iters) {
+  BenchMap *m = arg;
+  uint32_t seed = 2463534242;
+  for (uint64_t i = 0; i < iters; i++) {
+    BENCH_SINK(BenchMap_Get(m, BENCH_MAP_SIZE + benchRand(&seed)) != NULL);
+  }
+}
+
+void benchHashMapPutDel(void *arg, uint64_t iters) {
+  BenchMap *m = arg;
+  for (uint64_t i = 0; i < iters; i++) {
+    BenchMap_Put(m, BENCH_MAP_SIZE + i, i);
+    BenchMap_Del(m, BENCH_MAP_SIZE + i, NULL, NULL);
+  }
+}
+
+#define BENCH_BTREE_SIZE (1 << 20)
+
+void benchBTreeFind(void *arg, uint64_t iters) {
+  RMUtilBTree *t = arg;
+  uint32_t seed = 2463534242;
+  for (uint64_t i = 0; i < iters; i++) {
+    BENCH_SINK(RMUtilBTree_Find(t, benchRand(&seed) & (BENCH_BTREE_SIZE - 1), NULL));
+  }
+}
+
+void benchBTreeInsertDel(void *arg, uint64_t iters) {
+  RMUtilBTree *t = arg;
+  uint32_t seed = 2463534242;
+  for (uint64_t i = 0; i < iters; i++) {
+    double key = (benchRand(&seed) & (BENCH_BTREE_SIZE - 1)) + 0.5;
+    RMUtilBTree_Insert(t, key, NULL, NULL);
+    RMUtilBTree_Delete(t, key, NULL);
+  }
+}
+
+/* Each iteration loads the whole vector, BENCH_BTREE_SIZE keys */
+void benchBTreeBulkLoad(void *arg, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) RMUtilBTree_Free(RMUtilBTree_BulkLoad(arg), NULL);
+}
+
+typedef struct {
+  RMUtilRoaring *a, *b;
+} benchRoaringPair;
+
+void benchRoaringAnd(void *arg, uint64_t iters) {
+  benchRoaringPair *p = arg;
+  for (uint64_t i = 0; i < iters; i++) {
+    RMUtilRoaring *r = RMUtilRoaring_And(p->a, p->b);
+    BENCH_SINK(RMUtilRoaring_Cardinality(r));
+    RMUtilRoaring_Free(r);
+  }
+}
+
+void benchRoaringOr(void *arg, uint64_t iters) {
+  benchRoaringPair *p = arg;
+  for (uint64_t i = 0; i < iters; i++) {
+    RMUtilRoaring *r = RMUtilRoaring_Or(p->a, p->b);
+    BENCH_SINK(RMUtilRoaring_Cardinality(r));
+    RMUtilRoaring_Free(r);
+  }
+}
+
+typedef size_t (*benchIntersectFunc)(const uint32_t *, size_t, const uint32_t *, size_t,
+                                     uint32_t *);
+
+typedef struct {
+  uint32_t *a, *b, *out;
+  size_t na, nb;
+  benchIntersectFunc f;
+} benchIntersectArgs;
+
+void benchIntersect(void *arg, uint64_t iters) {
+  benchIntersectArgs *p = arg;
+  for (uint64_t i = 0; i < iters; i++) BENCH_SINK(p->f(p->a, p->na, p->b, p->nb, p->out));
+}
+
+/* Fill arr with n increasing ids spread over [0, max) */
+static void benchSortedIds(uint32_t *arr, size_t n, uint32_t max, uint32_t *seed) {
+  uint32_t gap = max / n, x = 0;
+  for (size_t i = 0; i < n; i++) {
+    x += 1 + benchRand(seed) % (2 * gap - 1);
+    arr[i] = x;
+  }
+}
+
+/* Filters hold BENCH_FILTER_SIZE keys, and are queried for as many that were never added */
+#define BENCH_FILTER_SIZE (1 << 22)
+
+void benchBloomContains(void *arg, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    BENCH_SINK(RMUtilBloom_ContainsHash(arg, RMUtilHash_U64(i % (2 * BENCH_FILTER_SIZE))));
+  }
+}
+
+void benchCuckooContains(void *arg, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    BENCH_SINK(RMUtilCuckoo_ContainsHash(arg, RMUtilHash_U64(i % (2 * BENCH_FILTER_SIZE))));
+  }
+}
+
+void benchCountMinAdd(void *arg, uint64_t iters) {
+  uint32_t seed = 88172645;
+  for (uint64_t i = 0; i < iters; i++) {
+    BENCH_SINK(RMUtilCountMin_AddHash(arg, RMUtilHash_U64(benchRand(&seed) % 100000), 1));
+  }
+}
+
+void benchHLLAdd(void *arg, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) BENCH_SINK(RMUtilHLL_AddHash(arg, RMUtilHash_U64(i)));
+}
+
+/* A skewed stream: a tenth of the events go to 10 heavy keys */
+void benchTopKAdd(void *arg, uint64_t iters) {
+  uint32_t seed = 88172645;
+  char key[32];
+  for (uint64_t i = 0; i < iters; i++) {
+    uint32_t r = benchRand(&seed);
+    int len = sprintf(key, "key:%u", r % 10 ? r % 100000 : r % 100 / 10);
+    BENCH_SINK(RMUtilTopK_Add(arg, key, len));
+  }
+}
+
+/* Latency like values, from 1 to 1M */
+static double benchValue(uint32_t *seed) {
+  return 1 + (double)(benchRand(seed) % 1000) * (benchRand(seed) % 1000);
+}
+
+void benchTDigestAdd(void *arg, uint64_t iters) {
+  uint32_t seed = 88172645;
+  for (uint64_t i = 0; i < iters; i++) RMUtilTDigest_Add(arg, benchValue(&seed));
+}
+
+void benchTDigestQuantile(void *arg, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) BENCH_SINK(RMUtilTDigest_Quantile(arg, 0.99));
+}
+
+void benchDDSketchAdd(void *arg, uint64_t iters) {
+  uint32_t seed = 88172645;
+  for (uint64_t i = 0; i < iters; i++) RMUtilDDSketch_Add(arg, benchValue(&seed));
+}
+
+void benchDDSketchQuantile(void *arg, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) BENCH_SINK(RMUtilDDSketch_Quantile(arg, 0.99));
+}
+
+void benchSPSCPushPop(void *arg, uint64_t iters) {
+  void *item;
+  for (uint64_t i = 0; i < iters; i++) {
+    RMUtilSPSCRing_Push(arg, &item);
+    BENCH_SINK(RMUtilSPSCRing_Pop(arg, &item));
+  }
+}
+
+void benchMPMCPushPop(void *arg, uint64_t iters) {
+  void *item;
+  for (uint64_t i = 0; i < iters; i++) {
+    RMUtilMPMCRing_Push(arg, &item);
+    BENCH_SINK(RMUtilMPMCRing_Pop(arg, &item));
+  }
+}
+
+#define BENCH_RING_BATCH 32
+
+typedef struct {
+  void *ring;
+  uint64_t iters;
+} benchRingArgs;
+
+static void *benchSPSCConsumer(void *arg) {
+  benchRingArgs *a = arg;
+  void *items[BENCH_RING_BATCH];
+  for (uint64_t n = 0; n < a->iters;) {
+    n += RMUtilSPSCRing_PopWait(a->ring, items, BENCH_RING_BATCH);
+  }
+  return NULL;
+}
+
+/* Items moved from this thread to another one, in batches */
+void benchSPSCTransfer(void *arg, uint64_t iters) {
+  benchRingArgs a = {arg, iters};
+  void *items[BENCH_RING_BATCH] = {0};
+  pthread_t t;
+  pthread_create(&t, NULL, benchSPSCConsumer, &a);
+  for (uint64_t i = 0; i < iters; i += BENCH_RING_BATCH) {
+    uint64_t n = iters - i < BENCH_RING_BATCH ? iters - i : BENCH_RING_BATCH;
+    RMUtilSPSCRing_PushWait(arg, items, n);
+  }
+  pthread_join(t, NULL);
+}
+
+static void *benchMPMCConsumer(void *arg) {
+  benchRingArgs *a = arg;
+  void *items[BENCH_RING_BATCH];
+  for (uint64_t n = 0; n < a->iters;) {
+    n += RMUtilMPMCRing_PopWait(a->ring, items, BENCH_RING_BATCH);
+  }
+  return NULL;
+}
+
+void benchMPMCTransfer(void *arg, uint64_t iters) {
+  benchRingArgs a = {arg, iters};
+  void *items[BENCH_RING_BATCH] = {0};
+  pthread_t t;
+  pthread_create(&t, NULL, benchMPMCConsumer, &a);
+  for (uint64_t i = 0; i < iters; i += BENCH_RING_BATCH) {
+    uint64_t n = iters - i < BENCH_RING_BATCH ? iters - i : BENCH_RING_BATCH;
+    RMUtilMPMCRing_PushWait(arg, items, n);
+  }
+  pthread_join(t, NULL);
+}
+
+#define BENCH_CACHE_KEYS 10000
+
+void benchCacheGet(void *arg, uint64_t iters) {
+  uint32_t seed = 88172645;
+  char key[32];
+  for (uint64_t i = 0; i < iters; i++) {
+    int len = sprintf(key, "query:%u", benchRand(&seed) % BENCH_CACHE_KEYS);
+    BENCH_SINK(RMUtilCache_Get(arg, key, len));
+  }
+}
+
+/* Inserts into a full cache, each evicting an entry */
+void benchCacheSetEvict(void *arg, uint64_t iters) {
+  uint32_t seed = 88172645;
+  char key[32];
+  for (uint64_t i = 0; i < iters; i++) {
+    int len = sprintf(key, "other:%u", benchRand(&seed));
+    RMUtilCache_Set(arg, key, len, key, 100);
+  }
+}
+
+#define BENCH_POSTINGS_COUNT (1 << 20)
+
+/* Decodes a block of 128 values per iteration */
+static void benchPostingsDecode(RMUtilPostings *p, uint64_t iters) {
+  uint64_t out[RMUTIL_POSTINGS_BLOCK];
+  size_t numBlocks = RMUtilPostings_NumBlocks(p);
+  for (uint64_t i = 0; i < iters; i++) {
+    RMUtilPostings_DecodeBlock(p, i % numBlocks, out);
+    BENCH_SINK(out[RMUTIL_POSTINGS_BLOCK - 1]);
+  }
+}
+
+void benchPostingsDecodeBitpack(void *arg, uint64_t iters) {
+  benchPostingsDecode(((RMUtilPostings **)arg)[RMUTIL_POSTINGS_BITPACK], iters);
+}
+
+void benchPostingsDecodeStreamVByte(void *arg, uint64_t iters) {
+  benchPostingsDecode(((RMUtilPostings **)arg)[RMUTIL_POSTINGS_STREAMVBYTE], iters);
+}
+
+void benchPostingsDecodeVarint(void *arg, uint64_t iters) {
+  benchPostingsDecode(((RMUtilPostings **)arg)[RMUTIL_POSTINGS_VARINT], iters);
+}
+
+/* Seeks about 1000 values ahead, as when intersecting with a list 1000 times shorter */
+void benchPostingsSkipTo(void *arg, uint64_t iters) {
+  RMUtilPostings *p = ((RMUtilPostings **)arg)[RMUTIL_POSTINGS_BITPACK];
+  RMUtilPostingsIterator *it = RMUtilPostings_Iterate(p);
+  uint32_t seed = 88172645;
+  uint64_t target = 0, x = 0;
+  for (uint64_t i = 0; i < iters; i++) {
+    target += benchRand(&seed) % 16000;
+    if (!RMUtilPostingsIterator_SkipTo(it, target, &x)) {
+      RMUtilPostingsIterator_Free(it);
+      it = RMUtilPostings_Iterate(p);
+      target = 0;
+    }
+    BENCH_SINK(x);
+  }
+  RMUtilPostingsIterator_Free(it);
+}
+
+BENCH_MAIN({
+  RedisModule_StringPtrLen = benchStringPtrLen;
+  RedisModule_StringToLongLong = benchStringToLongLong;
+  RedisModule_StringToDouble = benchStringToDouble;
+
+  BENCHFUNC(benchVectorPush, NULL);
+
+  Vector *v = NewVector(int, 1 << 16);
+  for (int i = 0; i < 1 << 16; i++) Vector_Push(v, i);
+  BENCHFUNC(benchVectorGet, v);
+  Vector_Free(v);
+
+  uint32_t seed = 88172645;
+  v = NewVector(int, 1 << 16);
+  for (int i = 0; i < 1 << 16; i++) Vector_Push(v, (int)(benchRand(&seed) & 0xffffff));
+  Make_Heap(v, 0, v->top, cmpInt);
+  BENCHFUNC(benchHeapPushPop, v);
+  Vector_Free(v);
+
+  v = NewVector(int, 1024);
+  for (int i = 0; i < 1024; i++) Vector_Push(v, i);
+  BENCHFUNC(benchHeapMake, v);
+  Vector_Free(v);
+
+  PriorityQueue *pq = NewPriorityQueue(int, 1 << 16, cmpInt);
+  for (int i = 0; i < 1 << 16; i++) Priority_Queue_Push(pq, (int)(benchRand(&seed) & 0xffffff));
+  BENCHFUNC(benchPriorityQueuePushPop, pq);
+  Priority_Queue_Free(pq);
+
+  BenchMap *m = BenchMap_New(BENCH_MAP_SIZE);
+  for (uint64_t i = 0; i < BENCH_MAP_SIZE; i++) BenchMap_Put(m, i, i);
+  BENCHFUNC(benchHashMapGet, m);
+  BENCHFUNC(benchHashMapGetMiss, m);
+  BENCHFUNC(benchHashMapPutDel, m);
+  BenchMap_Free(m);
+
+  v = NewVector(RMUtilBTreeEntry, BENCH_BTREE_SIZE);
+  RMUtilBTreeEntry *entries = (RMUtilBTreeEntry *)v->data;
+  for (int i = 0; i < BENCH_BTREE_SIZE; i++) entries[i] = (RMUtilBTreeEntry){i, NULL};
+  v->top = BENCH_BTREE_SIZE;
+  RMUtilBTree *bt = RMUtilBTree_BulkLoad(v);
+  BENCHFUNC(benchBTreeFind, bt);
+  BENCHFUNC(benchBTreeInsertDel, bt);
+  BENCHFUNC(benchBTreeBulkLoad, v);
+  RMUtilBTree_Free(bt, NULL);
+  Vector_Free(v);
+
+  // 1M ids, a dense and a sparse set
+  benchRoaringPair rp = {RMUtilRoaring_New(), RMUtilRoaring_New()};
+  for (uint32_t i = 0; i < 1 << 20; i++) {
+    if (benchRand(&seed) % 2) RMUtilRoaring_Add(rp.a, i);
+    if (benchRand(&seed) % 64 == 0) RMUtilRoaring_Add(rp.b, i);
+  }
+  BENCHFUNC(benchRoaringAnd, &rp);
+  BENCHFUNC(benchRoaringOr, &rp);
+  RMUtilRoaring_Free(rp.a);
+  RMUtilRoaring_Free(rp.b);
+
+  // every intersection kernel for a range of size ratios, with the large side fixed at 64K ids
+  struct {
+    const char *name;
+    benchIntersectFunc f;
+  } kernels[] = {{"Merge", RMUtil_IntersectMergeU32},
+                 {"SIMD", RMUtil_IntersectSIMDU32},
+                 {"Gallop", RMUtil_IntersectGallopU32},
+                 {"", RMUtil_IntersectU32}};
+  int ratios[] = {1, 4, 16, 32, 64, 256};
+  benchIntersectArgs ia = {.nb = 1 << 16};
+  ia.a = malloc(ia.nb * sizeof(uint32_t));
+  ia.b = malloc(ia.nb * sizeof(uint32_t));
+  ia.out = malloc(ia.nb * sizeof(uint32_t));
+  benchSortedIds(ia.b, ia.nb, 1 << 20, &seed);
+  for (int r = 0; r < sizeof(ratios) / sizeof(ratios[0]); r++) {
+    ia.na = ia.nb / ratios[r];
+    benchSortedIds(ia.a, ia.na, 1 << 20, &seed);
+    for (int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+      char name[64];
+      snprintf(name, sizeof(name), "benchIntersect%s/%d", kernels[k].name, ratios[r]);
+      ia.f = kernels[k].f;
+      BENCH_RUN(name, benchIntersect, &ia);
+    }
+  }
+  free(ia.a);
+  free(ia.b);
+  free(ia.out);
+
+  RMUtilBloom *bloom = RMUtilBloom_New(BENCH_FILTER_SIZE, 0.01);
+  RMUtilCuckoo *cuckoo = RMUtilCuckoo_New(BENCH_FILTER_SIZE);
+  for (uint64_t i = 0; i < BENCH_FILTER_SIZE; i++) {
+    RMUtilBloom_AddHash(bloom, RMUtilHash_U64(i));
+    RMUtilCuckoo_AddHash(cuckoo, RMUtilHash_U64(i));
+  }
+  BENCHFUNC(benchBloomContains, bloom);
+  BENCHFUNC(benchCuckooContains, cuckoo);
+  RMUtilBloom_Free(bloom);
+  RMUtilCuckoo_Free(cuckoo);
+
+  RMUtilCountMin *cm = RMUtilCountMin_NewForError(0.001, 0.01);
+  BENCHFUNC(benchCountMinAdd, cm);
+  RMUtilCountMin_Free(cm);
+  RMUtilHLL *hll = RMUtilHLL_New(14);
+  BENCHFUNC(benchHLLAdd, hll);
+  RMUtilHLL_Free(hll);
+  RMUtilTopK *topk = RMUtilTopK_New(10, 80, 4, 0.9);
+  BENCHFUNC(benchTopKAdd, topk);
+  RMUtilTopK_Free(topk);
+
+  RMUtilTDigest *td = RMUtilTDigest_New(100);
+  BENCHFUNC(benchTDigestAdd, td);
+  BENCHFUNC(benchTDigestQuantile, td);
+  RMUtilTDigest_Free(td);
+  RMUtilDDSketch *dd = RMUtilDDSketch_New(0.01, 2048);
+  BENCHFUNC(benchDDSketchAdd, dd);
+  BENCHFUNC(benchDDSketchQuantile, dd);
+  RMUtilDDSketch_Free(dd);
+
+  RMUtilSPSCRing *spsc = RMUtilSPSCRing_New(1024, 0);
+  BENCHFUNC(benchSPSCPushPop, spsc);
+  BENCHFUNC(benchSPSCTransfer, spsc);
+  RMUtilSPSCRing_Free(spsc);
+  RMUtilMPMCRing *mpmc = RMUtilMPMCRing_New(1024, 0);
+  BENCHFUNC(benchMPMCPushPop, mpmc);
+  BENCHFUNC(benchMPMCTransfer, mpmc);
+  RMUtilMPMCRing_Free(mpmc);
+
+  RMUtilCacheOptions cacheOpts = {.maxBytes = BENCH_CACHE_KEYS * 256};
+  RMUtilCache *cache = RMUtilCache_New("bench", NULL, &cacheOpts);
+  for (int i = 0; i < BENCH_CACHE_KEYS; i++) {
+    char key[32];
+    int len = sprintf(key, "query:%d", i);
+    RMUtilCache_Set(cache, key, len, cache, 100);
+  }
+  BENCHFUNC(benchCacheGet, cache);
+  BENCHFUNC(benchCacheSetEvict, cache);
+  RMUtilCache_Free(cache);
+
+  // ids 16 apart on average, most deltas taking 4 or 5 bits
+  uint64_t *ids = malloc(BENCH_POSTINGS_COUNT * sizeof(uint64_t));
+  uint32_t idSeed = 88172645;
+  for (uint64_t i = 0, id = 0; i < BENCH_POSTINGS_COUNT; i++) {
+    id += benchRand(&idSeed) % 32;
+    ids[i] = id;
+  }
+  RMUtilPostings *postings[3];
+  for (int c = 0; c < 3; c++) postings[c] = RMUtilPostings_Encode(ids, BENCH_POSTINGS_COUNT, c);
+  free(ids);
+  BENCHFUNC(benchPostingsDecodeBitpack, postings);
+  BENCHFUNC(benchPostingsDecodeStreamVByte, postings);
+  BENCHFUNC(benchPostingsDecodeVarint, postings);
+  BENCHFUNC(benchPostingsSkipTo, postings);
+  for (int c = 0; c < 3; c++) RMUtilPostings_Free(postings[c]);
+
+  BENCHFUNC(benchSdsNewFree, NULL);
+  BENCHFUNC(benchSdsCatLen, NULL);
+  BENCHFUNC(benchSdsCatPrintf, NULL);
+
+  const char *args[] = {"CMD", "1337", "hello", "3.14", "FOO", "BAR", "LIMIT", "10", "20"};
+  benchArgs a = {.argc = sizeof(args) / sizeof(*args)};
+  a.argv = calloc(a.argc, sizeof(RedisModuleString *));
+  for (int i = 0; i < a.argc; i++) a.argv[i] = benchString(args[i]);
+  BENCHFUNC(benchStringEqualsCaseC, &a);
+  BENCHFUNC(benchArgIndex, &a);
+  BENCHFUNC(benchParseArgs, &a);
+  BENCHFUNC(benchParseArgsAfter, &a);
+  for (int i = 0; i < a.argc; i++) free(a.argv[i]);
+  free(a.argv);
+});
@@ -0,0 +1,518 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "btree.h"
+#include "alloc.h"
+
+#define BTREE_FANOUT RMUTIL_BTREE_FANOUT
+/* Nodes with fewer keys or children than this are merged with or refilled from a sibling */
+#define BTREE_MIN (BTREE_FANOUT / 4)
+
+/* The keys come first, so that the searched array starts at the node's allocation */
+typedef struct {
+  double keys[BTREE_FANOUT];
+  /* number of keys of a leaf, or children of an inner node */
+  uint32_t num;
+  uint32_t leaf;
+} btreeNode;
+
+typedef struct btreeLeaf {
+  btreeNode n;
+  void *vals[BTREE_FANOUT];
+  struct btreeLeaf *prev, *next;
+} btreeLeaf;
+
+/* keys[i] is a lower bound of the keys under children[i], and an upper bound (exclusive) of those
+ * under children[i - 1]. keys[0] is not used for searching */
+typedef struct {
+  btreeNode n;
+  btreeNode *children[BTREE_FANOUT];
+  /* number of keys under each child */
+  size_t counts[BTREE_FANOUT];
+} btreeInner;
+
+struct RMUtilBTree {
+  btreeNode *root;
+  size_t size;
+  size_t mem;
+};
+
+struct RMUtilBTreeCursor {
+  btreeLeaf *leaf;
+  int pos;
+  int reverse;
+  double min, max;
+};
+
+/* Count the keys of a sorted array comparing op to k, which is also the index of the first one
+ * that doesn't. The count is branchless, which beats a binary search at this size */
+#ifdef __SSE2__
+/* Matching lanes of the compare are all ones, i.e. -1, so subtracting them counts the matches */
+#define BTREE_COUNT_FUNC(name, op, simdop)                                           \
+  static inline int name(const double *keys, int n, double k) {                     \
+    __m128d kk = _mm_set1_pd(k);                                                     \
+    __m128i acc = _mm_setzero_si128();                                               \
+    int i = 0;                                                                       \
+    for (; i + 2 <= n; i += 2) {                                                     \
+      __m128d cmp = simdop(_mm_loadu_pd(keys + i), kk);                              \
+      acc = _mm_sub_epi64(acc, _mm_castpd_si128(cmp));                               \
+    }                                                                                \
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi64(acc, acc));                          \
+    int count = _mm_cvtsi128_si32(acc);                                              \
+    if (i < n) count += keys[i] op k;                                                \
+    return count;                                                                    \
+  }
+#else
+#define BTREE_COUNT_FUNC(name, op, simdop)                                           \
+  static inline int name(const double *keys, int n, double k) {                     \
+    int count = 0;                                                                   \
+    for (int i = 0; i < n; i++) count += keys[i] op k;                               \
+    return count;                                                                    \
+  }
+#endif
+
+BTREE_COUNT_FUNC(btree_countLess, <, _mm_cmplt_pd)
+BTREE_COUNT_FUNC(btree_countLessEq, <=, _mm_cmple_pd)
+
+/* Index of the child of n that may hold key */
+static inline int btree_childIndex(btreeInner *n, double key) {
+  return btree_countLessEq(n->n.keys + 1, n->n.num - 1, key);
+}
+
+static btreeNode *btree_newNode(RMUtilBTree *t, int leaf) {
+  size_t size = leaf ? sizeof(btreeLeaf) : sizeof(btreeInner);
+  btreeNode *n = malloc(size);
+  n->num = 0;
+  n->leaf = leaf;
+  if (leaf) ((btreeLeaf *)n)->prev = ((btreeLeaf *)n)->next = NULL;
+  t->mem += size;
+  return n;
+}
+
+static void btree_freeNode(RMUtilBTree *t, btreeNode *n) {
+  t->mem -= n->leaf ? sizeof(btreeLeaf) : sizeof(btreeInner);
+  free(n);
+}
+
+/* Number of keys under n */
+static size_t btree_count(btreeNode *n) {
+  if (n->leaf) return n->num;
+  size_t count = 0;
+  for (uint32_t i = 0; i < n->num; i++) count += ((btreeInner *)n)->counts[i];
+  return count;
+}
+
+RMUtilBTree *RMUtilBTree_New(void) {
+  RMUtilBTree *t = calloc(1, sizeof(*t));
+  t->root = btree_newNode(t, 1);
+  return t;
+}
+
+RMUtilBTree *RMUtilBTree_BulkLoad(Vector *entries) {
+  size_t n = Vector_Size(entries);
+  RMUtilBTreeEntry *e = (RMUtilBTreeEntry *)entries->data;
+  if (entries->elemSize != sizeof(*e)) return NULL;
+  if (n && isnan(e[0].key)) return NULL;
+  for (size_t i = 1; i < n; i++) {
+    if (!(e[i - 1].key < e[i].key)) return NULL;
+  }
+
+  RMUtilBTree *t = RMUtilBTree_New();
+  if (!n) return t;
+
+  // fill the leaves, spreading the keys evenly so that the last one is not underfull
+  size_t numNodes = (n + BTREE_FANOUT - 1) / BTREE_FANOUT, from = 0;
+  btreeNode **level = malloc(numNodes * sizeof(*level));
+  btreeLeaf *prev = NULL;
+  for (size_t i = 0; i < numNodes; i++) {
+    btreeLeaf *l = i ? (btreeLeaf *)btree_newNode(t, 1) : (btreeLeaf *)t->root;
+    size_t count = n / numNodes + (i < n % numNodes);
+    for (size_t j = 0; j < count; j++) {
+      l->n.keys[j] = e[from + j].key;
+      l->vals[j] = e[from + j].val;
+    }
+    l->n.num = count;
+    l->prev = prev;
+    if (prev) prev->next = l;
+    prev = l;
+    level[i] = &l->n;
+    from += count;
+  }
+
+  // then each level of inner nodes above the previous one, until there's a single root
+  while (numNodes > 1) {
+    size_t numParents = (numNodes + BTREE_FANOUT - 1) / BTREE_FANOUT;
+    from = 0;
+    for (size_t i = 0; i < numParents; i++) {
+      btreeInner *in = (btreeInner *)btree_newNode(t, 0);
+      size_t count = numNodes / numParents + (i < numNodes % numParents);
+      for (size_t j = 0; j < count; j++) {
+        btreeNode *child = level[from + j];
+        // keys[0] of the nodes built here is their smallest key
+        in->n.keys[j] = child->keys[0];
+        in->children[j] = child;
+        in->counts[j] = btree_count(child);
+      }
+      in->n.num = count;
+      level[i] = &in->n;
+      from += count;
+    }
+    numNodes = numParents;
+  }
+  t->root = level[0];
+  t->size = n;
+  free(level);
+  return t;
+}
+
+static void btree_freeRec(RMUtilBTree *t, btreeNode *n, void (*freeVal)(void *)) {
+  if (n->leaf) {
+    if (freeVal) {
+      for (uint32_t i = 0; i < n->num; i++) freeVal(((btreeLeaf *)n)->vals[i]);
+    }
+  } else {
+    for (uint32_t i = 0; i < n->num; i++) btree_freeRec(t, ((btreeInner *)n)->children[i], freeVal);
+  }
+  btree_freeNode(t, n);
+}
+
+void RMUtilBTree_Free(RMUtilBTree *t, void (*freeVal)(void *)) {
+  btree_freeRec(t, t->root, freeVal);
+  free(t);
+}
+
+size_t RMUtilBTree_Size(RMUtilBTree *t) {
+  return t->size;
+}
+
+size_t RMUtilBTree_MemUsage(RMUtilBTree *t) {
+  return sizeof(*t) + t->mem;
+}
+
+static btreeLeaf *btree_findLeaf(RMUtilBTree *t, double key) {
+  btreeNode *n = t->root;
+  while (!n->leaf) n = ((btreeInner *)n)->children[btree_childIndex((btreeInner *)n, key)];
+  return (btreeLeaf *)n;
+}
+
+int RMUtilBTree_Find(RMUtilBTree *t, double key, void **val) {
+  btreeLeaf *l = btree_findLeaf(t, key);
+  int pos = btree_countLess(l->n.keys, l->n.num, key);
+  if (pos == l->n.num || l->n.keys[pos] != key) return 0;
+  if (val) *val = l->vals[pos];
+  return 1;
+}
+
+/* A node split off while inserting, to be added to the parent after the node it came from */
+typedef struct {
+  btreeNode *right;
+  double sep;
+} btreeSplit;
+
+static int btree_insertLeaf(RMUtilBTree *t, btreeLeaf *l, double key, void *val, void **oldval,
+                            btreeSplit *split) {
+  int pos = btree_countLess(l->n.keys, l->n.num, key);
+  if (pos < l->n.num && l->n.keys[pos] == key) {
+    if (oldval) *oldval = l->vals[pos];
+    l->vals[pos] = val;
+    return 0;
+  }
+
+  if (l->n.num == BTREE_FANOUT) {
+    btreeLeaf *r = (btreeLeaf *)btree_newNode(t, 1);
+    int half = BTREE_FANOUT / 2;
+    memcpy(r->n.keys, l->n.keys + half, (BTREE_FANOUT - half) * sizeof(double));
+    memcpy(r->vals, l->vals + half, (BTREE_FANOUT - half) * sizeof(void *));
+    r->n.num = BTREE_FANOUT - half;
+    l->n.num = half;
+    r->prev = l;
+    r->next = l->next;
+    if (l->next) l->next->prev = r;
+    l->next = r;
+    split->right = &r->n;
+    if (pos > half) {
+      l = r;
+      pos -= half;
+    }
+  }
+
+  int num = l->n.num;
+  memmove(l->n.keys + pos + 1, l->n.keys + pos, (num - pos) * sizeof(double));
+  memmove(l->vals + pos + 1, l->vals + pos, (num - pos) * sizeof(void *));
+  l->n.keys[pos] = key;
+  l->vals[pos] = val;
+  l->n.num++;
+  if (split->right) split->sep = split->right->keys[0];
+  t->size++;
+  return 1;
+}
+
+static int btree_insertRec(RMUtilBTree *t, btreeNode *n, double key, void *val, void **oldval,
+                           btreeSplit *split) {
+  split->right = NULL;
+  if (n->leaf) return btree_insertLeaf(t, (btreeLeaf *)n, key, val, oldval, split);
+
+  btreeInner *in = (btreeInner *)n;
+  int i = btree_childIndex(in, key);
+  btreeSplit sub;
+  int added = btree_insertRec(t, in->children[i], key, val, oldval, &sub);
+  in->counts[i] += added;
+  if (!sub.right) return added;
+
+  // the child was split, add its right half after it
+  size_t count = btree_count(sub.right);
+  in->counts[i] -= count;
+  if (in->n.num == BTREE_FANOUT) {
+    btreeInner *r = (btreeInner *)btree_newNode(t, 0);
+    int half = BTREE_FANOUT / 2;
+    memcpy(r->n.keys, in->n.keys + half, (BTREE_FANOUT - half) * sizeof(double));
+    memcpy(r->children, in->children + half, (BTREE_FANOUT - half) * sizeof(btreeNode *));
+    memcpy(r->counts, in->counts + half, (BTREE_FANOUT - half) * sizeof(size_t));
+    r->n.num = BTREE_FANOUT - half;
+    in->n.num = half;
+    split->right = &r->n;
+    split->sep = r->n.keys[0];
+    if (i + 1 > half) {
+      in = r;
+      i -= half;
+    }
+  }
+  int num = in->n.num, pos = i + 1;
+  memmove(in->n.keys + pos + 1, in->n.keys + pos, (num - pos) * sizeof(double));
+  memmove(in->children + pos + 1, in->children + pos, (num - pos) * sizeof(btreeNode *));
+  memmove(in->counts + pos + 1, in->counts + pos, (num - pos) * sizeof(size_t));
+  in->n.keys[pos] = sub.sep;
+  in->children[pos] = sub.right;
+  in->counts[pos] = count;
+  in->n.num++;
+  return added;
+}
+
+int RMUtilBTree_Insert(RMUtilBTree *t, double key, void *val, void **oldval) {
+  btreeSplit split;
+  int added = btree_insertRec(t, t->root, key, val, oldval, &split);
+  if (split.right) {
+    // the root was split, grow a level
+    btreeInner *root = (btreeInner *)btree_newNode(t, 0);
+    root->n.keys[0] = -INFINITY;
+    root->n.keys[1] = split.sep;
+    root->children[0] = t->root;
+    root->children[1] = split.right;
+    root->counts[1] = btree_count(split.right);
+    root->counts[0] = t->size - root->counts[1];
+    root->n.num = 2;
+    t->root = &root->n;
+  }
+  return added;
+}
+
+/* Move the last m keys of leaf l to the front of r, or the first -m keys of r to the end of l */
+static void btree_moveLeaf(btreeLeaf *l, btreeLeaf *r, int m) {
+  int ln = l->n.num, rn = r->n.num;
+  if (m > 0) {
+    memmove(r->n.keys + m, r->n.keys, rn * sizeof(double));
+    memmove(r->vals + m, r->vals, rn * sizeof(void *));
+    memcpy(r->n.keys, l->n.keys + ln - m, m * sizeof(double));
+    memcpy(r->vals, l->vals + ln - m, m * sizeof(void *));
+  } else {
+    m = -m;
+    memcpy(l->n.keys + ln, r->n.keys, m * sizeof(double));
+    memcpy(l->vals + ln, r->vals, m * sizeof(void *));
+    memmove(r->n.keys, r->n.keys + m, (rn - m) * sizeof(double));
+    memmove(r->vals, r->vals + m, (rn - m) * sizeof(void *));
+    m = -m;
+  }
+  l->n.num -= m;
+  r->n.num += m;
+}
+
+/* Same for inner nodes. sep is the separator of r in the parent, updated to r's new lower bound.
+ * Returns the number of keys moved from l to r (negative if from r to l) */
+static long btree_moveInner(btreeInner *l, btreeInner *r, int m, double *sep) {
+  int ln = l->n.num, rn = r->n.num;
+  long moved = 0;
+  if (m > 0) {
+    memmove(r->n.keys + m, r->n.keys, rn * sizeof(double));
+    memmove(r->children + m, r->children, rn * sizeof(btreeNode *));
+    memmove(r->counts + m, r->counts, rn * sizeof(size_t));
+    r->n.keys[m] = *sep;
+    memcpy(r->n.keys, l->n.keys + ln - m, m * sizeof(double));
+    memcpy(r->children, l->children + ln - m, m * sizeof(btreeNode *));
+    memcpy(r->counts, l->counts + ln - m, m * sizeof(size_t));
+    *sep = r->n.keys[0];
+    for (int i = 0; i < m; i++) moved += r->counts[i];
+  } else {
+    m = -m;
+    l->n.keys[ln] = *sep;
+    memcpy(l->n.keys + ln + 1, r->n.keys + 1, (m - 1) * sizeof(double));
+    memcpy(l->children + ln, r->children, m * sizeof(btreeNode *));
+    memcpy(l->counts + ln, r->counts, m * sizeof(size_t));
+    *sep = r->n.keys[m];
+    memmove(r->n.keys, r->n.keys + m, (rn - m) * sizeof(double));
+    memmove(r->children, r->children + m, (rn - m) * sizeof(btreeNode *));
+    memmove(r->counts, r->counts + m, (rn - m) * sizeof(size_t));
+    for (int i = 0; i < m; i++) moved -= l->counts[ln + i];
+    m = -m;
+  }
+  l->n.num -= m;
+  r->n.num += m;
+  return moved;
+}
+
+/* Fix the underfull child i of p, by merging it with a sibling if they fit in a node, or else
+ * moving keys over from the sibling so that both are half full */
+static void btree_rebalance(RMUtilBTree *t, btreeInner *p, int i) {
+  if (p->n.num < 2) return;
+  int j = i + 1 < p->n.num ? i : i - 1;
+  btreeNode *l = p->children[j], *r = p->children[j + 1];
+  int ln = l->num, rn = r->num;
+
+  if (ln + rn > BTREE_FANOUT) {
+    int m = ln - (ln + rn) / 2;
+    if (l->leaf) {
+      btree_moveLeaf((btreeLeaf *)l, (btreeLeaf *)r, m);
+      p->n.keys[j + 1] = r->keys[0];
+      p->counts[j] -= m;
+      p->counts[j + 1] += m;
+    } else {
+      long moved = btree_moveInner((btreeInner *)l, (btreeInner *)r, m, &p->n.keys[j + 1]);
+      p->counts[j] -= moved;
+      p->counts[j + 1] += moved;
+    }
+    return;
+  }
+
+  if (l->leaf) {
+    btreeLeaf *ll = (btreeLeaf *)l, *rl = (btreeLeaf *)r;
+    memcpy(ll->n.keys + ln, rl->n.keys, rn * sizeof(double));
+    memcpy(ll->vals + ln, rl->vals, rn * sizeof(void *));
+    ll->next = rl->next;
+    if (rl->next) rl->next->prev = ll;
+  } else {
+    btreeInner *li = (btreeInner *)l, *ri = (btreeInner *)r;
+    li->n.keys[ln] = p->n.keys[j + 1];
+    memcpy(li->n.keys + ln + 1, ri->n.keys + 1, (rn - 1) * sizeof(double));
+    memcpy(li->children + ln, ri->children, rn * sizeof(btreeNode *));
+    memcpy(li->counts + ln, ri->counts, rn * sizeof(size_t));
+  }
+  l->num += rn;
+  p->counts[j] += p->counts[j + 1];
+  btree_freeNode(t, r);
+
+  int num = p->n.num;
+  memmove(p->n.keys + j + 1, p->n.keys + j + 2, (num - j - 2) * sizeof(double));
+  memmove(p->children + j + 1, p->children + j + 2, (num - j - 2) * sizeof(btreeNode *));
+  memmove(p->counts + j + 1, p->counts + j + 2, (num - j - 2) * sizeof(size_t));
+  p->n.num--;
+}
+
+static int btree_deleteRec(RMUtilBTree *t, btreeNode *n, double key, void **oldval) {
+  if (n->leaf) {
+    btreeLeaf *l = (btreeLeaf *)n;
+    int pos = btree_countLess(n->keys, n->num, key), num = n->num;
+    if (pos == num || n->keys[pos] != key) return 0;
+    if (oldval) *oldval = l->vals[pos];
+    memmove(n->keys + pos, n->keys + pos + 1, (num - pos - 1) * sizeof(double));
+    memmove(l->vals + pos, l->vals + pos + 1, (num - pos - 1) * sizeof(void *));
+    n->num--;
+    t->size--;
+    return 1;
+  }
+
+  btreeInner *in = (btreeInner *)n;
+  int i = btree_childIndex(in, key);
+  if (!btree_deleteRec(t, in->children[i], key, oldval)) return 0;
+  in->counts[i]--;
+  if (in->children[i]->num < BTREE_MIN) btree_rebalance(t, in, i);
+  return 1;
+}
+
+int RMUtilBTree_Delete(RMUtilBTree *t, double key, void **oldval) {
+  if (!btree_deleteRec(t, t->root, key, oldval)) return 0;
+  if (!t->root->leaf && t->root->num == 1) {
+    // the root is left with a single child, drop a level
+    btreeNode *child = ((btreeInner *)t->root)->children[0];
+    btree_freeNode(t, t->root);
+    t->root = child;
+  }
+  return 1;
+}
+
+size_t RMUtilBTree_Rank(RMUtilBTree *t, double key) {
+  btreeNode *n = t->root;
+  size_t rank = 0;
+  while (!n->leaf) {
+    btreeInner *in = (btreeInner *)n;
+    int i = btree_childIndex(in, key);
+    for (int j = 0; j < i; j++) rank += in->counts[j];
+    n = in->children[i];
+  }
+  return rank + btree_countLess(n->keys, n->num, key);
+}
+
+int RMUtilBTree_Select(RMUtilBTree *t, size_t rank, double *key, void **val) {
+  if (rank >= t->size) return 0;
+  btreeNode *n = t->root;
+  while (!n->leaf) {
+    btreeInner *in = (btreeInner *)n;
+    int i = 0;
+    while (rank >= in->counts[i]) rank -= in->counts[i++];
+    n = in->children[i];
+  }
+  if (key) *key = n->keys[rank];
+  if (val) *val = ((btreeLeaf *)n)->vals[rank];
+  return 1;
+}
+
+RMUtilBTreeCursor *RMUtilBTree_Range(RMUtilBTree *t, double min, double max, int reverse) {
+  RMUtilBTreeCursor *c = malloc(sizeof(*c));
+  c->min = min;
+  c->max = max;
+  c->reverse = reverse;
+  // the separators only bound the keys of a child, so the first key may be in the next leaf
+  c->leaf = btree_findLeaf(t, reverse ? max : min);
+  if (!reverse) {
+    c->pos = btree_countLess(c->leaf->n.keys, c->leaf->n.num, min);
+    if (c->pos == c->leaf->n.num) {
+      c->leaf = c->leaf->next;
+      c->pos = 0;
+    }
+  } else {
+    c->pos = btree_countLessEq(c->leaf->n.keys, c->leaf->n.num, max) - 1;
+    if (c->pos < 0) {
+      c->leaf = c->leaf->prev;
+      if (c->leaf) c->pos = c->leaf->n.num - 1;
+    }
+  }
+  return c;
+}
+
+int RMUtilBTreeCursor_Next(RMUtilBTreeCursor *c, double *key, void **val) {
+  if (!c->leaf) return 0;
+  double k = c->leaf->n.keys[c->pos];
+  if (c->reverse ? k < c->min : k > c->max) {
+    c->leaf = NULL;
+    return 0;
+  }
+  if (key) *key = k;
+  if (val) *val = c->leaf->vals[c->pos];
+
+  if (c->reverse) {
+    if (--c->pos < 0) {
+      c->leaf = c->leaf->prev;
+      if (c->leaf) c->pos = c->leaf->n.num - 1;
+    }
+  } else if (++c->pos == c->leaf->n.num) {
+    c->leaf = c->leaf->next;
+    c->pos = 0;
+  }
+  return 1;
+}
+
+void RMUtilBTreeCursor_Free(RMUtilBTreeCursor *c) {
+  free(c);
+}
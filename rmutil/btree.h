@@ -0,0 +1,89 @@
+#ifndef __RMUTIL_BTREE_H__
+#define __RMUTIL_BTREE_H__
+
+#include <stddef.h>
+#include "vector.h"
+
+/** btree.h - an ordered map from double keys to pointers, implemented as a B+tree.
+ *
+ * Nodes hold RMUTIL_BTREE_FANOUT keys in a contiguous array at the start of the node, so a node
+ * search reads a few adjacent cache lines instead of chasing a pointer per key like a skiplist
+ * does, and the search itself is a branchless SSE2 count over the array. The values live in the
+ * leaves, which are linked both ways, so range cursors walk them in either direction without going
+ * back up the tree. Inner nodes also keep the number of keys under each child, which gives
+ * O(log n) rank and select (order statistic) queries.
+ *
+ * Keys are unique, and must not be NaN. A sorted index with duplicate scores can either keep a
+ * list of values per key, or make keys unique by construction.
+ *
+ *    RMUtilBTree *t = RMUtilBTree_New();
+ *    RMUtilBTree_Insert(t, 3.5, val, NULL);
+ *    RMUtilBTreeCursor *c = RMUtilBTree_Range(t, 0, 10, 0);
+ *    double key; void *v;
+ *    while (RMUtilBTreeCursor_Next(c, &key, &v)) ...
+ *    RMUtilBTreeCursor_Free(c);
+ */
+
+/* Maximal number of keys in a leaf, and of children of an inner node. The default puts a node's
+ * keys in two 64 byte cache lines, which the adjacent line prefetcher fetches together: in
+ * bench_rmutil, 16 made inserts and deletes about 20% faster than 32 with the same lookup time,
+ * while 8 (a single line) made the tree too deep */
+#ifndef RMUTIL_BTREE_FANOUT
+#define RMUTIL_BTREE_FANOUT 16
+#endif
+
+/* RMUtilBTree - opaque tree */
+typedef struct RMUtilBTree RMUtilBTree;
+
+/* RMUtilBTreeCursor - opaque range cursor */
+typedef struct RMUtilBTreeCursor RMUtilBTreeCursor;
+
+/* An element of the vectors passed to RMUtilBTree_BulkLoad */
+typedef struct {
+  double key;
+  void *val;
+} RMUtilBTreeEntry;
+
+RMUtilBTree *RMUtilBTree_New(void);
+
+/* Build a tree from a vector of RMUtilBTreeEntry, sorted by strictly increasing keys. The tree is
+ * built bottom up, with full nodes, which is much faster than inserting the entries one by one.
+ * Returns NULL if the entries are not sorted */
+RMUtilBTree *RMUtilBTree_BulkLoad(Vector *entries);
+
+/* Free the tree, calling freeVal on every value if not NULL */
+void RMUtilBTree_Free(RMUtilBTree *t, void (*freeVal)(void *));
+
+/* Set key to val. Returns 1 if the key was added, or 0 if it existed, in which case its previous
+ * value is stored in *oldval if oldval is not NULL */
+int RMUtilBTree_Insert(RMUtilBTree *t, double key, void *val, void **oldval);
+
+/* Look up key, storing its value in *val if val is not NULL. Returns 1 if found */
+int RMUtilBTree_Find(RMUtilBTree *t, double key, void **val);
+
+/* Remove key. Returns 1 if it was found, storing its value in *oldval if oldval is not NULL */
+int RMUtilBTree_Delete(RMUtilBTree *t, double key, void **oldval);
+
+/* Return the number of keys in the tree */
+size_t RMUtilBTree_Size(RMUtilBTree *t);
+
+/* Return the number of bytes allocated by the tree, excluding the values */
+size_t RMUtilBTree_MemUsage(RMUtilBTree *t);
+
+/* Return the number of keys smaller than key, which is key's 0 based rank if it's in the tree */
+size_t RMUtilBTree_Rank(RMUtilBTree *t, double key);
+
+/* Get the key and value of 0 based rank. Returns 0 if rank is not smaller than the size */
+int RMUtilBTree_Select(RMUtilBTree *t, size_t rank, double *key, void **val);
+
+/* Iterate over the keys between min and max, inclusive, in increasing order, or in decreasing
+ * order if reverse is set. Use -INFINITY and INFINITY for unbounded ranges */
+RMUtilBTreeCursor *RMUtilBTree_Range(RMUtilBTree *t, double min, double max, int reverse);
+
+/* Get the next key and value. Returns 0 when done. The tree must not be modified while
+ * iterating */
+int RMUtilBTreeCursor_Next(RMUtilBTreeCursor *c, double *key, void **val);
+
+void RMUtilBTreeCursor_Free(RMUtilBTreeCursor *c);
+
+#endif
@@ -0,0 +1,301 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "hashmap.h"
+#include "alloc.h"
+
+#define CACHE_DEFAULT_SHARDS 16
+#define CACHE_MAX_SHARDS 256
+#define CACHE_DEFAULT_PROTECTED 0.8
+#define CACHE_DEFAULT_WATERMARK 0.8
+
+typedef struct cacheLink {
+  struct cacheLink *prev, *next;
+} cacheLink;
+
+enum { CACHE_PROBATION, CACHE_PROTECTED };
+
+typedef struct {
+  /* first, so a list link is its entry */
+  cacheLink link;
+  void *value;
+  /* the bytes charged for the entry */
+  size_t charge;
+  uint64_t hash;
+  uint32_t len;
+  uint8_t segment;
+  char key[];
+} cacheEntry;
+
+/* Map keys point to the key bytes of their entry, or to the caller's on lookups */
+typedef struct {
+  const char *key;
+  size_t len;
+  uint64_t hash;
+} cacheKey;
+
+#define cacheKeyHash(k) ((k).hash)
+#define cacheKeyEq(a, b) \
+  ((a).hash == (b).hash && (a).len == (b).len && !memcmp((a).key, (b).key, (a).len))
+RMUTIL_HASHMAP_DEFINE(cacheMap, cacheKey, cacheEntry *, cacheKeyHash, cacheKeyEq)
+
+#define CACHE_ENTRY_OVERHEAD (sizeof(cacheEntry) + sizeof(cacheMap_Entry) + 1)
+
+typedef struct {
+  pthread_mutex_t lock;
+  cacheMap *map;
+  /* circular lists, most recently used first */
+  cacheLink lists[2];
+  size_t bytes, protectedBytes;
+  uint64_t hits, misses, evictions;
+  char pad[64];
+} cacheShard;
+
+struct RMUtilCache {
+  char *name;
+  RMUtilCacheType type;
+  size_t maxBytes;
+  /* the current budget, lowered under memory pressure */
+  size_t limit;
+  double protectedRatio, memoryWatermark;
+  int numShards;
+  cacheShard *shards;
+};
+
+static inline void cache_listInit(cacheLink *l) {
+  l->prev = l->next = l;
+}
+
+static inline void cache_unlink(cacheLink *l) {
+  l->prev->next = l->next;
+  l->next->prev = l->prev;
+}
+
+static inline void cache_pushFront(cacheLink *list, cacheLink *l) {
+  l->next = list->next;
+  l->prev = list;
+  list->next->prev = l;
+  list->next = l;
+}
+
+RMUtilCache *RMUtilCache_New(const char *name, const RMUtilCacheType *type,
+                             const RMUtilCacheOptions *opts) {
+  RMUtilCache *c = calloc(1, sizeof(*c));
+  c->name = strdup(name);
+  if (type) c->type = *type;
+  c->maxBytes = c->limit = opts->maxBytes;
+  c->protectedRatio = opts->protectedRatio > 0 ? opts->protectedRatio : CACHE_DEFAULT_PROTECTED;
+  c->memoryWatermark =
+      opts->memoryWatermark > 0 ? opts->memoryWatermark : CACHE_DEFAULT_WATERMARK;
+  int want = opts->numShards > 0 ? opts->numShards : CACHE_DEFAULT_SHARDS;
+  if (want > CACHE_MAX_SHARDS) want = CACHE_MAX_SHARDS;
+  c->numShards = 1;
+  while (c->numShards < want) c->numShards *= 2;
+
+  c->shards = calloc(c->numShards, sizeof(cacheShard));
+  for (int i = 0; i < c->numShards; i++) {
+    cacheShard *s = &c->shards[i];
+    pthread_mutex_init(&s->lock, NULL);
+    s->map = cacheMap_New(0);
+    cache_listInit(&s->lists[CACHE_PROBATION]);
+    cache_listInit(&s->lists[CACHE_PROTECTED]);
+  }
+  return c;
+}
+
+/* The map uses the low bits of the hash, shards the high ones */
+static inline cacheShard *cache_shard(RMUtilCache *c, uint64_t hash) {
+  return &c->shards[(hash >> 56) & (c->numShards - 1)];
+}
+
+static inline size_t cache_shardLimit(RMUtilCache *c) {
+  return __atomic_load_n(&c->limit, __ATOMIC_RELAXED) / c->numShards;
+}
+
+/* Unlink an entry from its list and the map, and free it */
+static void cache_remove(RMUtilCache *c, cacheShard *s, cacheEntry *e) {
+  cache_unlink(&e->link);
+  cacheMap_Del(s->map, (cacheKey){e->key, e->len, e->hash}, NULL, NULL);
+  s->bytes -= e->charge;
+  if (e->segment == CACHE_PROTECTED) s->protectedBytes -= e->charge;
+  if (c->type.free) c->type.free(e->value);
+  free(e);
+}
+
+/* Evict entries until the shard is within limit, least recently used probation ones first */
+static void cache_evict(RMUtilCache *c, cacheShard *s, size_t limit) {
+  while (s->bytes > limit) {
+    cacheLink *list = &s->lists[CACHE_PROBATION];
+    if (list->prev == list) list = &s->lists[CACHE_PROTECTED];
+    cache_remove(c, s, (cacheEntry *)list->prev);
+    s->evictions++;
+  }
+}
+
+/* Record a hit: promote a probation entry, demoting the least recently used protected ones if
+ * the segment gets too large */
+static void cache_touch(RMUtilCache *c, cacheShard *s, cacheEntry *e) {
+  cache_unlink(&e->link);
+  cache_pushFront(&s->lists[CACHE_PROTECTED], &e->link);
+  if (e->segment == CACHE_PROTECTED) return;
+
+  e->segment = CACHE_PROTECTED;
+  s->protectedBytes += e->charge;
+  size_t max = cache_shardLimit(c) * c->protectedRatio;
+  cacheLink *prot = &s->lists[CACHE_PROTECTED];
+  while (s->protectedBytes > max && prot->prev != &e->link) {
+    cacheEntry *old = (cacheEntry *)prot->prev;
+    cache_unlink(&old->link);
+    cache_pushFront(&s->lists[CACHE_PROBATION], &old->link);
+    old->segment = CACHE_PROBATION;
+    s->protectedBytes -= old->charge;
+  }
+}
+
+void *RMUtilCache_Get(RMUtilCache *c, const char *key, size_t len) {
+  uint64_t h = RMUtilHash_Bytes(key, len, 0);
+  cacheShard *s = cache_shard(c, h);
+  void *value = NULL;
+  pthread_mutex_lock(&s->lock);
+  cacheEntry **e = cacheMap_Get(s->map, (cacheKey){key, len, h});
+  if (e) {
+    cache_touch(c, s, *e);
+    value = (*e)->value;
+    if (c->type.retain) c->type.retain(value);
+    s->hits++;
+  } else {
+    s->misses++;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return value;
+}
+
+int RMUtilCache_Set(RMUtilCache *c, const char *key, size_t len, void *value, size_t size) {
+  uint64_t h = RMUtilHash_Bytes(key, len, 0);
+  cacheShard *s = cache_shard(c, h);
+  size_t charge = CACHE_ENTRY_OVERHEAD + len + size;
+  pthread_mutex_lock(&s->lock);
+  // a value that can't be cached leaves the current one in place
+  size_t limit = cache_shardLimit(c);
+  if (charge > limit || len > UINT32_MAX) {
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+  }
+  cacheEntry **old = cacheMap_Get(s->map, (cacheKey){key, len, h});
+  if (old) cache_remove(c, s, *old);
+
+  cacheEntry *e = malloc(sizeof(*e) + len);
+  e->value = value;
+  e->charge = charge;
+  e->hash = h;
+  e->len = len;
+  e->segment = CACHE_PROBATION;
+  memcpy(e->key, key, len);
+  cacheMap_Put(s->map, (cacheKey){e->key, len, h}, e);
+  cache_pushFront(&s->lists[CACHE_PROBATION], &e->link);
+  s->bytes += charge;
+  // the new entry is the most recently used, and fits by itself
+  cache_evict(c, s, limit);
+  pthread_mutex_unlock(&s->lock);
+  return 1;
+}
+
+int RMUtilCache_Del(RMUtilCache *c, const char *key, size_t len) {
+  uint64_t h = RMUtilHash_Bytes(key, len, 0);
+  cacheShard *s = cache_shard(c, h);
+  pthread_mutex_lock(&s->lock);
+  cacheEntry **e = cacheMap_Get(s->map, (cacheKey){key, len, h});
+  if (e) cache_remove(c, s, *e);
+  pthread_mutex_unlock(&s->lock);
+  return e != NULL;
+}
+
+static void cache_clearShard(RMUtilCache *c, cacheShard *s) {
+  for (int i = 0; i < 2; i++) {
+    cacheLink *list = &s->lists[i];
+    for (cacheLink *l = list->next, *next; l != list; l = next) {
+      next = l->next;
+      cacheEntry *e = (cacheEntry *)l;
+      if (c->type.free) c->type.free(e->value);
+      free(e);
+    }
+    cache_listInit(list);
+  }
+  cacheMap_Clear(s->map);
+  s->bytes = s->protectedBytes = 0;
+}
+
+void RMUtilCache_Clear(RMUtilCache *c) {
+  for (int i = 0; i < c->numShards; i++) {
+    cacheShard *s = &c->shards[i];
+    pthread_mutex_lock(&s->lock);
+    cache_clearShard(c, s);
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+void RMUtilCache_Free(RMUtilCache *c) {
+  for (int i = 0; i < c->numShards; i++) {
+    cacheShard *s = &c->shards[i];
+    cache_clearShard(c, s);
+    cacheMap_Free(s->map);
+    pthread_mutex_destroy(&s->lock);
+  }
+  free(c->shards);
+  free(c->name);
+  free(c);
+}
+
+size_t RMUtilCache_CheckMemory(RMUtilCache *c) {
+  // 0 when there is no maxmemory
+  double ratio = RedisModule_GetUsedMemoryRatio ? RedisModule_GetUsedMemoryRatio() : 0;
+  size_t limit = c->maxBytes;
+  if (ratio > c->memoryWatermark) {
+    double scale = (1 - ratio) / (1 - c->memoryWatermark);
+    limit = scale > 0 ? (size_t)(c->maxBytes * scale) : 0;
+  }
+  __atomic_store_n(&c->limit, limit, __ATOMIC_RELAXED);
+
+  size_t freed = 0;
+  for (int i = 0; i < c->numShards; i++) {
+    cacheShard *s = &c->shards[i];
+    pthread_mutex_lock(&s->lock);
+    size_t before = s->bytes;
+    cache_evict(c, s, limit / c->numShards);
+    freed += before - s->bytes;
+    pthread_mutex_unlock(&s->lock);
+  }
+  return freed;
+}
+
+void RMUtilCache_GetStats(RMUtilCache *c, RMUtilCacheStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (int i = 0; i < c->numShards; i++) {
+    cacheShard *s = &c->shards[i];
+    pthread_mutex_lock(&s->lock);
+    stats->hits += s->hits;
+    stats->misses += s->misses;
+    stats->evictions += s->evictions;
+    stats->entries += cacheMap_Size(s->map);
+    stats->bytes += s->bytes;
+    pthread_mutex_unlock(&s->lock);
+  }
+  stats->limit = __atomic_load_n(&c->limit, __ATOMIC_RELAXED);
+}
+
+void RMUtilCache_AddInfo(RedisModuleInfoCtx *ctx, RMUtilCache *c) {
+  RMUtilCacheStats st;
+  RMUtilCache_GetStats(c, &st);
+  uint64_t lookups = st.hits + st.misses;
+  RedisModule_InfoBeginDictField(ctx, c->name);
+  RedisModule_InfoAddFieldULongLong(ctx, "hits", st.hits);
+  RedisModule_InfoAddFieldULongLong(ctx, "misses", st.misses);
+  RedisModule_InfoAddFieldDouble(ctx, "hit_ratio", lookups ? (double)st.hits / lookups : 0);
+  RedisModule_InfoAddFieldULongLong(ctx, "evictions", st.evictions);
+  RedisModule_InfoAddFieldULongLong(ctx, "entries", st.entries);
+  RedisModule_InfoAddFieldULongLong(ctx, "bytes", st.bytes);
+  RedisModule_InfoAddFieldULongLong(ctx, "limit_bytes", st.limit);
+  RedisModule_InfoEndDictField(ctx);
+}
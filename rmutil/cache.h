@@ -0,0 +1,93 @@
+#ifndef __RMUTIL_CACHE_H__
+#define __RMUTIL_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <redismodule.h>
+
+/** cache.h - a concurrent, memory-bounded cache of derived values (parsed queries, compiled
+ * scripts...) keyed by byte strings.
+ *
+ * The cache is split into shards by key hash, each with its own lock, hash map (hashmap.h) and
+ * eviction lists, so threads mostly work on different shards. All operations are O(1).
+ *
+ * Eviction is segmented LRU: new entries go to a probation segment, and entries hit again are
+ * promoted to a protected segment holding up to protectedRatio of the bytes. Entries are evicted
+ * from the probation segment first, so a scan of keys used once can't flush the entries that are
+ * used often, and a protected entry must go unused for a while to be demoted back to probation.
+ *
+ * Each entry is charged the size of its value as given by the caller, plus its key and about 80
+ * bytes of overhead, against a byte budget. RMUtilCache_CheckMemory shrinks the budget as redis
+ * gets close to maxmemory (by RedisModule_GetUsedMemoryRatio): linearly from the full budget when
+ * used memory reaches memoryWatermark of maxmemory, down to nothing at maxmemory. Call it
+ * periodically from the main thread, e.g. from a timer.
+ *
+ * Hits, misses and evictions are counted, and exported to INFO by RMUtilCache_AddInfo.
+ */
+
+typedef struct {
+  /* Release the cache's reference to a value when it is evicted, replaced, deleted, or the cache
+   * is freed. Called with a shard lock held, so it must not call into the cache. May be NULL */
+  void (*free)(void *value);
+  /* Take a reference to a value for the caller of RMUtilCache_Get, with the shard lock held. This
+   * keeps the value valid if another thread evicts it, and is required when the cache is used by
+   * several threads (e.g. with refcounted values). If NULL, a value returned by Get is only valid
+   * until the next call that can evict it */
+  void (*retain)(void *value);
+} RMUtilCacheType;
+
+typedef struct {
+  /* The byte budget */
+  size_t maxBytes;
+  /* Number of shards, rounded up to a power of two. 0 means 16 */
+  int numShards;
+  /* Fraction of the budget the protected segment may hold. 0 means 0.8 */
+  double protectedRatio;
+  /* Ratio of used memory to maxmemory at which the budget starts shrinking. 0 means 0.8, 1 or
+   * more disables shrinking */
+  double memoryWatermark;
+} RMUtilCacheOptions;
+
+typedef struct {
+  uint64_t hits, misses, evictions;
+  size_t entries;
+  /* the bytes charged for all the entries, and the current budget */
+  size_t bytes, limit;
+} RMUtilCacheStats;
+
+/* RMUtilCache - opaque cache */
+typedef struct RMUtilCache RMUtilCache;
+
+/* Create a cache. name is used in INFO. type may be NULL if values need no freeing */
+RMUtilCache *RMUtilCache_New(const char *name, const RMUtilCacheType *type,
+                             const RMUtilCacheOptions *opts);
+
+/* Free the cache and all its values */
+void RMUtilCache_Free(RMUtilCache *c);
+
+/* Return the value of key, or NULL if it's not cached */
+void *RMUtilCache_Get(RMUtilCache *c, const char *key, size_t len);
+
+/* Cache a non NULL value taking size bytes under key, replacing the current one if any, and
+ * evicting entries to stay within the budget. The cache takes ownership of value and returns 1,
+ * or returns 0 without taking it if the entry alone is more than a shard's share of the budget,
+ * in which case the current value is left cached */
+int RMUtilCache_Set(RMUtilCache *c, const char *key, size_t len, void *value, size_t size);
+
+/* Remove key from the cache. Returns 1 if it was cached */
+int RMUtilCache_Del(RMUtilCache *c, const char *key, size_t len);
+
+/* Remove all the entries */
+void RMUtilCache_Clear(RMUtilCache *c);
+
+/* Adjust the budget to the memory usage of redis, and evict entries past it. Main thread only.
+ * Returns the number of bytes evicted */
+size_t RMUtilCache_CheckMemory(RMUtilCache *c);
+
+void RMUtilCache_GetStats(RMUtilCache *c, RMUtilCacheStats *stats);
+
+/* Add the stats of the cache to INFO, as a dict field named after the cache. Call this from the
+ * module's info callback, after RedisModule_InfoAddSection */
+void RMUtilCache_AddInfo(RedisModuleInfoCtx *ctx, RMUtilCache *c);
+
+#endif
@@ -0,0 +1,110 @@
+#include <string.h>
+#include <time.h>
+#include "cmdstats.h"
+#include "alloc.h"
+
+typedef struct {
+  char *name;
+  RedisModuleCmdFunc func;
+  RMUtilHistogram hist;
+} cmdStats;
+
+static cmdStats *cmdstats[RMUTIL_CMDSTATS_MAX_COMMANDS];
+static int numCmdStats = 0;
+static uint64_t latencyThresholdNs = 0;
+
+static inline uint64_t cmdstats_nsec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int cmdstats_run(int idx, RedisModuleCtx *ctx, RedisModuleString **argv,
+                               int argc) {
+  cmdStats *s = cmdstats[idx];
+  uint64_t start = cmdstats_nsec();
+  int rc = s->func(ctx, argv, argc);
+  uint64_t elapsed = cmdstats_nsec() - start;
+
+  RMUtilHistogram_Add(&s->hist, elapsed);
+  if (latencyThresholdNs && elapsed >= latencyThresholdNs && RedisModule_LatencyAddSample) {
+    // the monitor takes whole milliseconds, round up so that sub-millisecond calls still count
+    RedisModule_LatencyAddSample(s->name, (elapsed + 999999) / 1000000);
+  }
+  return rc;
+}
+
+/* There are no closures in C, so each timed command gets one of a fixed set of trampolines, which
+ * knows the index of the command's stats */
+#define CMDSTATS_TRAMPOLINE(a, b)                                                                 \
+  static int cmdstats_trampoline_##a##b(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) { \
+    return cmdstats_run(a * 8 + b, ctx, argv, argc);                                              \
+  }
+#define CMDSTATS_TRAMPOLINE_NAME(a, b) cmdstats_trampoline_##a##b,
+#define CMDSTATS_ROW(X, a) X(a, 0) X(a, 1) X(a, 2) X(a, 3) X(a, 4) X(a, 5) X(a, 6) X(a, 7)
+#define CMDSTATS_ALL(X)                                                                    \
+  CMDSTATS_ROW(X, 0) CMDSTATS_ROW(X, 1) CMDSTATS_ROW(X, 2) CMDSTATS_ROW(X, 3) CMDSTATS_ROW(X, 4) \
+  CMDSTATS_ROW(X, 5) CMDSTATS_ROW(X, 6) CMDSTATS_ROW(X, 7)
+
+CMDSTATS_ALL(CMDSTATS_TRAMPOLINE)
+
+static RedisModuleCmdFunc trampolines[RMUTIL_CMDSTATS_MAX_COMMANDS] = {
+    CMDSTATS_ALL(CMDSTATS_TRAMPOLINE_NAME)};
+
+void RMUtilCmdStats_SetLatencyThreshold(long long thresholdUs) {
+  latencyThresholdNs = thresholdUs > 0 ? (uint64_t)thresholdUs * 1000 : 0;
+}
+
+int RMUtil_CreateTimedCommand(RedisModuleCtx *ctx, const char *name, RedisModuleCmdFunc cmdfunc,
+                              const char *strflags, int firstkey, int lastkey, int keystep) {
+  if (numCmdStats == RMUTIL_CMDSTATS_MAX_COMMANDS) {
+    return REDISMODULE_ERR;
+  }
+
+  int idx = numCmdStats;
+  if (RedisModule_CreateCommand(ctx, name, trampolines[idx], strflags, firstkey, lastkey,
+                                keystep) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+
+  cmdStats *s = calloc(1, sizeof(*s));
+  s->name = strdup(name);
+  s->func = cmdfunc;
+  cmdstats[idx] = s;
+  numCmdStats++;
+  return REDISMODULE_OK;
+}
+
+const RMUtilHistogram *RMUtilCmdStats_Get(const char *name) {
+  for (int i = 0; i < numCmdStats; i++) {
+    if (!strcasecmp(cmdstats[i]->name, name)) {
+      return &cmdstats[i]->hist;
+    }
+  }
+  return NULL;
+}
+
+void RMUtilCmdStats_Reset() {
+  for (int i = 0; i < numCmdStats; i++) {
+    RMUtilHistogram_Reset(&cmdstats[i]->hist);
+  }
+}
+
+void RMUtilCmdStats_AddInfo(RedisModuleInfoCtx *ctx, int for_crash_report) {
+  RedisModule_InfoAddSection(ctx, "cmdstats");
+  for (int i = 0; i < numCmdStats; i++) {
+    const RMUtilHistogram *h = &cmdstats[i]->hist;
+    RedisModule_InfoBeginDictField(ctx, cmdstats[i]->name);
+    RedisModule_InfoAddFieldULongLong(ctx, "calls", h->count);
+    RedisModule_InfoAddFieldDouble(ctx, "mean_usec", RMUtilHistogram_Mean(h) / 1000);
+    RedisModule_InfoAddFieldDouble(ctx, "p50_usec", RMUtilHistogram_Percentile(h, 50) / 1000.0);
+    RedisModule_InfoAddFieldDouble(ctx, "p99_usec", RMUtilHistogram_Percentile(h, 99) / 1000.0);
+    RedisModule_InfoAddFieldDouble(ctx, "p999_usec", RMUtilHistogram_Percentile(h, 99.9) / 1000.0);
+    RedisModule_InfoAddFieldDouble(ctx, "max_usec", h->max / 1000.0);
+    RedisModule_InfoEndDictField(ctx);
+  }
+}
+
+int RMUtilCmdStats_RegisterInfoFunc(RedisModuleCtx *ctx) {
+  return RedisModule_RegisterInfoFunc(ctx, RMUtilCmdStats_AddInfo);
+}
@@ -0,0 +1,58 @@
+#ifndef __RMUTIL_CMDSTATS_H__
+#define __RMUTIL_CMDSTATS_H__
+
+#include <redismodule.h>
+#include "histogram.h"
+
+/** cmdstats.h - opt-in per-command latency histograms.
+ *
+ * Commands registered through RMUtil_CreateTimedCommand (or the RMUtil_RegisterTimed*Cmd macros,
+ * the timed counterparts of the macros in util.h) have their handler wrapped so that every call
+ * is timed with the monotonic clock and recorded in a per-command log-bucketed histogram. Calls
+ * slower than the configured threshold are also reported to the redis latency monitor with
+ * RedisModule_LatencyAddSample, using the command name as the event name.
+ *
+ * The histograms are exported to INFO as calls/mean/p50/p99/p999/max (in microseconds) per
+ * command, either by RMUtilCmdStats_RegisterInfoFunc, or - for modules that already have their own
+ * info callback - by calling RMUtilCmdStats_AddInfo from it.
+ *
+ * Note that only the synchronous part of a command is measured: the time a blocked client waits
+ * for its reply is not included.
+ */
+
+/* Maximal number of timed commands per module */
+#define RMUTIL_CMDSTATS_MAX_COMMANDS 64
+
+/* Set the latency (in microseconds) above which calls are reported to the latency monitor. 0 (the
+ * default) disables reporting */
+void RMUtilCmdStats_SetLatencyThreshold(long long thresholdUs);
+
+/* Same as RedisModule_CreateCommand, but wraps the handler with latency recording */
+int RMUtil_CreateTimedCommand(RedisModuleCtx *ctx, const char *name, RedisModuleCmdFunc cmdfunc,
+                              const char *strflags, int firstkey, int lastkey, int keystep);
+
+/* Return the latency histogram (in nanoseconds) of a timed command, or NULL if it's not one */
+const RMUtilHistogram *RMUtilCmdStats_Get(const char *name);
+
+/* Clear the recorded latencies of all timed commands */
+void RMUtilCmdStats_Reset();
+
+/* Add a "cmdstats" INFO section with the latency percentiles of all timed commands. Call this from
+ * the module's info callback */
+void RMUtilCmdStats_AddInfo(RedisModuleInfoCtx *ctx, int for_crash_report);
+
+/* Register RMUtilCmdStats_AddInfo as the module's info callback */
+int RMUtilCmdStats_RegisterInfoFunc(RedisModuleCtx *ctx);
+
+#define __rmutil_register_timed_cmd(ctx, cmd, f, mode)                        \
+  if (RMUtil_CreateTimedCommand(ctx, cmd, f, mode, 1, 1, 1) == REDISMODULE_ERR) \
+    return REDISMODULE_ERR;
+
+#define RMUtil_RegisterTimedReadCmd(ctx, cmd, f) __rmutil_register_timed_cmd(ctx, cmd, f, "readonly")
+
+#define RMUtil_RegisterTimedWriteCmd(ctx, cmd, f) __rmutil_register_timed_cmd(ctx, cmd, f, "write")
+
+#define RMUtil_RegisterTimedWriteDenyOOMCmd(ctx, cmd, f) \
+  __rmutil_register_timed_cmd(ctx, cmd, f, "write deny-oom")
+
+#endif
@@ -0,0 +1,243 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include "epoch.h"
+#include "alloc.h"
+
+/* Per thread record. Padded to a cache line, so entering and leaving critical sections never
+ * bounces lines between readers */
+typedef struct epochRecord {
+  /* the epoch observed when entering the outermost critical section, 0 outside of one */
+  uint64_t epoch;
+  /* only touched by the owning thread */
+  int nesting;
+  int inUse;
+  pthread_t owner;
+  struct epochRecord *next;
+  char pad[64 - 2 * sizeof(uint64_t) - 2 * sizeof(int) - sizeof(pthread_t)];
+} epochRecord;
+
+typedef struct epochRetired {
+  void *ptr;
+  void (*freeFunc)(void *);
+  uint64_t epoch;
+  struct epochRetired *next;
+} epochRetired;
+
+struct RMUtilEpochDomain {
+  /* the global epoch, starting at 1 so 0 can mean "not in a critical section" */
+  uint64_t epoch;
+  uint64_t id;
+  pthread_mutex_t lock;
+  epochRecord *records;
+  epochRetired *retired;
+  size_t numRetired;
+};
+
+/* Domain ids tell a thread's cached record apart from one of a freed domain at the same address */
+static uint64_t nextDomainId = 1;
+static __thread uint64_t cachedDomainId = 0;
+static __thread epochRecord *cachedRecord = NULL;
+
+RMUtilEpochDomain *RMUtilEpoch_NewDomain(void) {
+  RMUtilEpochDomain *d = calloc(1, sizeof(*d));
+  d->epoch = 1;
+  d->id = __atomic_fetch_add(&nextDomainId, 1, __ATOMIC_RELAXED);
+  pthread_mutex_init(&d->lock, NULL);
+  return d;
+}
+
+static epochRecord *epoch_lookupRecord(RMUtilEpochDomain *d) {
+  pthread_t self = pthread_self();
+  epochRecord *r, *unused = NULL;
+
+  pthread_mutex_lock(&d->lock);
+  for (r = d->records; r; r = r->next) {
+    if (r->inUse && pthread_equal(r->owner, self)) break;
+    if (!r->inUse && !unused) unused = r;
+  }
+  if (!r) {
+    if (unused) {
+      r = unused;
+    } else {
+      r = calloc(1, sizeof(*r));
+      r->next = d->records;
+      d->records = r;
+    }
+    r->inUse = 1;
+    r->owner = self;
+    r->nesting = 0;
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  cachedDomainId = d->id;
+  cachedRecord = r;
+  return r;
+}
+
+static inline epochRecord *epoch_record(RMUtilEpochDomain *d) {
+  if (cachedDomainId == d->id) return cachedRecord;
+  return epoch_lookupRecord(d);
+}
+
+void RMUtilEpoch_Enter(RMUtilEpochDomain *d) {
+  epochRecord *r = epoch_record(d);
+  if (r->nesting++ == 0) {
+    __atomic_store_n(&r->epoch, __atomic_load_n(&d->epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    // publish the epoch before loading any shared pointer. Pairs with the fence in reclaim
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  }
+}
+
+void RMUtilEpoch_Exit(RMUtilEpochDomain *d) {
+  epochRecord *r = epoch_record(d);
+  if (--r->nesting == 0) __atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Advance the epoch and detach the retired objects older than any active reader. Must be called
+ * with the lock held. Returns the detached list, and the oldest epoch still referenced in *oldest */
+static epochRetired *epoch_collect(RMUtilEpochDomain *d, uint64_t *oldest) {
+  uint64_t min = __atomic_add_fetch(&d->epoch, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (epochRecord *r = d->records; r; r = r->next) {
+    uint64_t e = __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE);
+    if (e && e < min) min = e;
+  }
+
+  // objects retired in epoch e may be referenced by readers that entered in e or before
+  epochRetired *freeList = NULL, **pp = &d->retired;
+  while (*pp) {
+    epochRetired *it = *pp;
+    if (it->epoch < min) {
+      *pp = it->next;
+      it->next = freeList;
+      freeList = it;
+      d->numRetired--;
+    } else {
+      pp = &it->next;
+    }
+  }
+  if (oldest) *oldest = min;
+  return freeList;
+}
+
+/* Free a detached list, outside of the lock as free functions may retire more objects */
+static size_t epoch_freeList(epochRetired *list) {
+  size_t n = 0;
+  while (list) {
+    epochRetired *next = list->next;
+    list->freeFunc(list->ptr);
+    free(list);
+    list = next;
+    n++;
+  }
+  return n;
+}
+
+size_t RMUtilEpoch_Reclaim(RMUtilEpochDomain *d) {
+  pthread_mutex_lock(&d->lock);
+  epochRetired *list = epoch_collect(d, NULL);
+  pthread_mutex_unlock(&d->lock);
+  return epoch_freeList(list);
+}
+
+void RMUtilEpoch_Retire(RMUtilEpochDomain *d, void *ptr, void (*freeFunc)(void *)) {
+  epochRetired *it = malloc(sizeof(*it));
+  it->ptr = ptr;
+  it->freeFunc = freeFunc;
+
+  pthread_mutex_lock(&d->lock);
+  it->epoch = __atomic_load_n(&d->epoch, __ATOMIC_RELAXED);
+  it->next = d->retired;
+  d->retired = it;
+  int reclaim = ++d->numRetired >= RMUTIL_EPOCH_RECLAIM_THRESHOLD;
+  pthread_mutex_unlock(&d->lock);
+
+  if (reclaim) RMUtilEpoch_Reclaim(d);
+}
+
+void RMUtilEpoch_Synchronize(RMUtilEpochDomain *d) {
+  pthread_mutex_lock(&d->lock);
+  uint64_t target = __atomic_load_n(&d->epoch, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&d->lock);
+
+  // everything retired up to now is tagged with target or before
+  for (;;) {
+    uint64_t oldest;
+    pthread_mutex_lock(&d->lock);
+    epochRetired *list = epoch_collect(d, &oldest);
+    pthread_mutex_unlock(&d->lock);
+    epoch_freeList(list);
+    if (oldest > target) break;
+    sched_yield();
+  }
+}
+
+void RMUtilEpoch_ThreadExit(RMUtilEpochDomain *d) {
+  // the cache only holds the last domain entered, the record may be in any of them
+  pthread_t self = pthread_self();
+  pthread_mutex_lock(&d->lock);
+  for (epochRecord *r = d->records; r; r = r->next) {
+    if (r->inUse && pthread_equal(r->owner, self)) {
+      r->inUse = 0;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&d->lock);
+  if (cachedDomainId == d->id) {
+    cachedDomainId = 0;
+    cachedRecord = NULL;
+  }
+}
+
+size_t RMUtilEpoch_NumThreads(RMUtilEpochDomain *d) {
+  size_t n = 0;
+  pthread_mutex_lock(&d->lock);
+  for (epochRecord *r = d->records; r; r = r->next) n += r->inUse;
+  pthread_mutex_unlock(&d->lock);
+  return n;
+}
+
+void RMUtilEpoch_FreeDomain(RMUtilEpochDomain *d) {
+  epochRetired *list = d->retired;
+  d->retired = NULL;
+  epoch_freeList(list);
+  for (epochRecord *r = d->records; r;) {
+    epochRecord *next = r->next;
+    free(r);
+    r = next;
+  }
+  if (cachedDomainId == d->id) cachedDomainId = 0;
+  pthread_mutex_destroy(&d->lock);
+  free(d);
+}
+
+struct RMUtilSnapshot {
+  RMUtilEpochDomain *domain;
+  void *current;
+  void (*freeFunc)(void *);
+};
+
+RMUtilSnapshot *RMUtilSnapshot_New(RMUtilEpochDomain *d, void *initial, void (*freeFunc)(void *)) {
+  RMUtilSnapshot *s = malloc(sizeof(*s));
+  *s = (RMUtilSnapshot){.domain = d, .current = initial, .freeFunc = freeFunc};
+  return s;
+}
+
+const void *RMUtilSnapshot_Acquire(RMUtilSnapshot *s) {
+  return __atomic_load_n(&s->current, __ATOMIC_ACQUIRE);
+}
+
+void *RMUtilSnapshot_Get(RMUtilSnapshot *s) {
+  return s->current;
+}
+
+void RMUtilSnapshot_Publish(RMUtilSnapshot *s, void *next) {
+  void *prev = __atomic_exchange_n(&s->current, next, __ATOMIC_SEQ_CST);
+  if (prev) RMUtilEpoch_Retire(s->domain, prev, s->freeFunc);
+}
+
+void RMUtilSnapshot_Free(RMUtilSnapshot *s) {
+  if (s->current) RMUtilEpoch_Retire(s->domain, s->current, s->freeFunc);
+  free(s);
+}
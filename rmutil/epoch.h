@@ -0,0 +1,95 @@
+#ifndef __RMUTIL_EPOCH_H__
+#define __RMUTIL_EPOCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** epoch.h - epoch based reclamation, and RCU style snapshots built on it.
+ *
+ * Lets worker threads read data owned by the main thread without taking any lock, while the main
+ * thread keeps modifying it by publishing new versions:
+ *
+ *  - Readers bracket their accesses with RMUtilEpoch_Enter / RMUtilEpoch_Exit. Entering only
+ *    stores the current epoch in the thread's own record, so readers never contend.
+ *  - Writers unlink an object so no new reader can reach it, and retire it with
+ *    RMUtilEpoch_Retire. It is freed once every reader that was inside a critical section when it
+ *    was retired has left it.
+ *
+ * RMUtilSnapshot wraps a single pointer to an immutable version of some data structure: readers
+ * load the current version inside a critical section, and the writer replaces it with a modified
+ * copy, retiring the old one.
+ *
+ *    // worker thread
+ *    RMUtilEpoch_Enter(domain);
+ *    const myIndex *idx = RMUtilSnapshot_Acquire(snap);
+ *    ... read idx ...
+ *    RMUtilEpoch_Exit(domain);
+ *
+ *    // main thread
+ *    myIndex *next = myIndex_Copy(RMUtilSnapshot_Get(snap));
+ *    myIndex_Add(next, ...);
+ *    RMUtilSnapshot_Publish(snap, next);
+ *
+ * Each thread that enters a domain gets a record in it, found through a thread local cache. A
+ * thread that is going away should call RMUtilEpoch_ThreadExit, so its record can be reused.
+ */
+
+/* RMUtilEpochDomain - a set of readers and the objects retired while they may be reading them */
+typedef struct RMUtilEpochDomain RMUtilEpochDomain;
+
+/* Create a new domain */
+RMUtilEpochDomain *RMUtilEpoch_NewDomain(void);
+
+/* Enter a read side critical section. Pointers loaded from shared data inside it stay valid until
+ * the matching RMUtilEpoch_Exit. Sections may be nested */
+void RMUtilEpoch_Enter(RMUtilEpochDomain *d);
+
+/* Leave a read side critical section */
+void RMUtilEpoch_Exit(RMUtilEpochDomain *d);
+
+/* Free ptr with freeFunc once no reader can still be using it. ptr must already be unreachable for
+ * new readers. Can be called from any thread, including from within a critical section */
+void RMUtilEpoch_Retire(RMUtilEpochDomain *d, void *ptr, void (*freeFunc)(void *));
+
+/* Advance the epoch and free the retired objects no reader can reference anymore. Retire does this
+ * every RMUTIL_EPOCH_RECLAIM_THRESHOLD objects, call it to reclaim sooner. Returns the number of
+ * objects freed */
+size_t RMUtilEpoch_Reclaim(RMUtilEpochDomain *d);
+
+/* Wait until all the readers currently in a critical section have left it, and free all the
+ * retired objects. Must not be called from within a critical section */
+void RMUtilEpoch_Synchronize(RMUtilEpochDomain *d);
+
+/* Release the calling thread's record in the domain. Must be called outside a critical section */
+void RMUtilEpoch_ThreadExit(RMUtilEpochDomain *d);
+
+/* Number of threads holding a record in the domain: those that entered it and have not called
+ * RMUtilEpoch_ThreadExit since */
+size_t RMUtilEpoch_NumThreads(RMUtilEpochDomain *d);
+
+/* Free all retired objects and the domain itself. No thread may be using it anymore */
+void RMUtilEpoch_FreeDomain(RMUtilEpochDomain *d);
+
+#define RMUTIL_EPOCH_RECLAIM_THRESHOLD 64
+
+/* RMUtilSnapshot - a pointer to the current version of some data, replaced copy-on-write */
+typedef struct RMUtilSnapshot RMUtilSnapshot;
+
+/* Create a snapshot holding initial as its first version. Versions are freed with freeFunc */
+RMUtilSnapshot *RMUtilSnapshot_New(RMUtilEpochDomain *d, void *initial, void (*freeFunc)(void *));
+
+/* Return the current version, for reading. Must be called within a critical section of the
+ * snapshot's domain, and the version must not be modified nor used after leaving it */
+const void *RMUtilSnapshot_Acquire(RMUtilSnapshot *s);
+
+/* Return the current version from the writer's side, where it can't change underneath. Writers
+ * must be serialized, e.g. by only writing from the main thread */
+void *RMUtilSnapshot_Get(RMUtilSnapshot *s);
+
+/* Make next the current version and retire the previous one */
+void RMUtilSnapshot_Publish(RMUtilSnapshot *s, void *next);
+
+/* Retire the current version and free the snapshot. No reader may be using it anymore */
+void RMUtilSnapshot_Free(RMUtilSnapshot *s);
+
+#endif
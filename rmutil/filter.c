@@ -0,0 +1,395 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "filter.h"
+#include "alloc.h"
+
+/* Bloom blocks are 8 32 bit words, the key setting one bit in each */
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BLOCK_BYTES (BLOOM_BLOCK_WORDS * sizeof(uint32_t))
+/* Block indexes come from 32 bits of the hash */
+#define BLOOM_MAX_BLOCKS (1ULL << 32)
+
+struct RMUtilBloom {
+  /* the blocks, aligned to BLOOM_BLOCK_BYTES within alloc */
+  uint32_t *words;
+  void *alloc;
+  uint64_t numBlocks;
+  uint64_t count;
+};
+
+/* Multipliers picking the bit of each word, odd and well spread */
+static const uint32_t bloom_salt[BLOOM_BLOCK_WORDS] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU,
+                                                       0xa2b7289dU, 0x705495c7U, 0x2df1424bU,
+                                                       0x9efc4947U, 0x5c6bfb31U};
+
+static inline uint32_t *bloom_block(const RMUtilBloom *b, uint64_t hash) {
+  return b->words + ((hash >> 32) * b->numBlocks >> 32) * BLOOM_BLOCK_WORDS;
+}
+
+/* Probability that a block holding n keys has the 8 bits of another key set */
+static double bloom_blockFpr(double n) {
+  return pow(1 - pow(1 - 1.0 / 32, n), BLOOM_BLOCK_WORDS);
+}
+
+/* Terms of the sum over the block loads, past which the range is sampled */
+#define BLOOM_FPR_TERMS 256
+
+double RMUtilBloom_FalsePositiveRate(size_t bytes, uint64_t n) {
+  uint64_t blocks = bytes / BLOOM_BLOCK_BYTES;
+  if (!blocks) return 1;
+  if (!n) return 0;
+  // keys are spread over the blocks following a Poisson distribution, sum over its likely range.
+  // Loads are doubles, as they can be anything up to 2^64. Over large ranges the terms vary
+  // slowly, so every step-th one stands for its neighbours
+  double load = (double)n / blocks, fpr = 0;
+  double from = fmax(0, floor(load - 10 * sqrt(load) - 10)), to = ceil(load + 10 * sqrt(load) + 10);
+  double step = fmax(1, floor((to - from) / BLOOM_FPR_TERMS));
+  for (double i = from; i <= to; i += step) {
+    fpr += step * exp(i * log(load) - load - lgamma(i + 1)) * bloom_blockFpr(i);
+  }
+  return fmin(fpr, 1);
+}
+
+size_t RMUtilBloom_BytesFor(uint64_t capacity, double fpr) {
+  // the false positive rate only goes down with more blocks: double then bisect
+  uint64_t lo = 1, hi = 1;
+  while (hi < BLOOM_MAX_BLOCKS &&
+         RMUtilBloom_FalsePositiveRate(hi * BLOOM_BLOCK_BYTES, capacity) > fpr) {
+    lo = hi + 1;
+    hi *= 2;
+  }
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (RMUtilBloom_FalsePositiveRate(mid * BLOOM_BLOCK_BYTES, capacity) > fpr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo * BLOOM_BLOCK_BYTES;
+}
+
+static RMUtilBloom *bloom_new(uint64_t numBlocks) {
+  RMUtilBloom *b = malloc(sizeof(*b));
+  b->numBlocks = numBlocks;
+  b->count = 0;
+  b->alloc = calloc(1, numBlocks * BLOOM_BLOCK_BYTES + BLOOM_BLOCK_BYTES);
+  uintptr_t p = (uintptr_t)b->alloc + BLOOM_BLOCK_BYTES - 1;
+  b->words = (uint32_t *)(p - p % BLOOM_BLOCK_BYTES);
+  return b;
+}
+
+RMUtilBloom *RMUtilBloom_New(uint64_t capacity, double fpr) {
+  return bloom_new(RMUtilBloom_BytesFor(capacity, fpr) / BLOOM_BLOCK_BYTES);
+}
+
+void RMUtilBloom_Free(RMUtilBloom *b) {
+  free(b->alloc);
+  free(b);
+}
+
+#ifdef __AVX2__
+static inline __m256i bloom_mask(uint32_t key) {
+  __m256i salt = _mm256_loadu_si256((const __m256i *)bloom_salt);
+  __m256i bits = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(key), salt), 27);
+  return _mm256_sllv_epi32(_mm256_set1_epi32(1), bits);
+}
+
+int RMUtilBloom_AddHash(RMUtilBloom *b, uint64_t hash) {
+  __m256i *block = (__m256i *)bloom_block(b, hash);
+  __m256i mask = bloom_mask(hash), words = _mm256_load_si256(block);
+  int added = !_mm256_testc_si256(words, mask);
+  _mm256_store_si256(block, _mm256_or_si256(words, mask));
+  b->count += added;
+  return added;
+}
+
+int RMUtilBloom_ContainsHash(const RMUtilBloom *b, uint64_t hash) {
+  const __m256i *block = (const __m256i *)bloom_block(b, hash);
+  return _mm256_testc_si256(_mm256_load_si256(block), bloom_mask(hash));
+}
+#else
+int RMUtilBloom_AddHash(RMUtilBloom *b, uint64_t hash) {
+  uint32_t *block = bloom_block(b, hash), key = hash, missing = 0;
+  for (int i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+    uint32_t bit = 1U << ((key * bloom_salt[i]) >> 27);
+    missing |= ~block[i] & bit;
+    block[i] |= bit;
+  }
+  b->count += missing != 0;
+  return missing != 0;
+}
+
+int RMUtilBloom_ContainsHash(const RMUtilBloom *b, uint64_t hash) {
+  const uint32_t *block = bloom_block(b, hash);
+  uint32_t key = hash, missing = 0;
+  for (int i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+    missing |= ~block[i] & 1U << ((key * bloom_salt[i]) >> 27);
+  }
+  return !missing;
+}
+#endif
+
+uint64_t RMUtilBloom_Count(const RMUtilBloom *b) {
+  return b->count;
+}
+
+size_t RMUtilBloom_MemUsage(const RMUtilBloom *b) {
+  return sizeof(*b) + (b->numBlocks + 1) * BLOOM_BLOCK_BYTES;
+}
+
+static inline void filter_put(unsigned char **p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) *(*p)++ = v >> (8 * i);
+}
+
+static inline uint64_t filter_get(const unsigned char **p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) v |= (uint64_t) * (*p)++ << (8 * i);
+  return v;
+}
+
+/* Serialized Bloom filter, all little endian: the number of blocks and the count (64 bits each),
+ * then the blocks' words (32 bits each) */
+#define BLOOM_HEADER_SIZE 16
+
+size_t RMUtilBloom_SerializedSize(const RMUtilBloom *b) {
+  return BLOOM_HEADER_SIZE + b->numBlocks * BLOOM_BLOCK_BYTES;
+}
+
+void RMUtilBloom_Serialize(const RMUtilBloom *b, char *buf) {
+  unsigned char *p = (unsigned char *)buf;
+  filter_put(&p, b->numBlocks, 8);
+  filter_put(&p, b->count, 8);
+  for (uint64_t i = 0; i < b->numBlocks * BLOOM_BLOCK_WORDS; i++) filter_put(&p, b->words[i], 4);
+}
+
+RMUtilBloom *RMUtilBloom_Deserialize(const char *buf, size_t len) {
+  const unsigned char *p = (const unsigned char *)buf;
+  if (len < BLOOM_HEADER_SIZE) return NULL;
+  uint64_t numBlocks = filter_get(&p, 8), count = filter_get(&p, 8);
+  if (!numBlocks || numBlocks > BLOOM_MAX_BLOCKS ||
+      numBlocks != (len - BLOOM_HEADER_SIZE) / BLOOM_BLOCK_BYTES ||
+      (len - BLOOM_HEADER_SIZE) % BLOOM_BLOCK_BYTES) {
+    return NULL;
+  }
+  RMUtilBloom *b = bloom_new(numBlocks);
+  b->count = count;
+  for (uint64_t i = 0; i < numBlocks * BLOOM_BLOCK_WORDS; i++) b->words[i] = filter_get(&p, 4);
+  return b;
+}
+
+void RMUtilBloom_RdbSave(RedisModuleIO *io, const RMUtilBloom *b) {
+  size_t len = RMUtilBloom_SerializedSize(b);
+  char *buf = malloc(len);
+  RMUtilBloom_Serialize(b, buf);
+  RedisModule_SaveStringBuffer(io, buf, len);
+  free(buf);
+}
+
+RMUtilBloom *RMUtilBloom_RdbLoad(RedisModuleIO *io) {
+  size_t len;
+  char *buf = RedisModule_LoadStringBuffer(io, &len);
+  if (!buf) return NULL;
+  RMUtilBloom *b = RMUtilBloom_Deserialize(buf, len);
+  RedisModule_Free(buf);
+  return b;
+}
+
+/* Cuckoo buckets are 64 bit words of 4 16 bit fingerprints, 0 marking an empty slot */
+#define CUCKOO_SLOTS 4
+#define CUCKOO_LOAD 0.95
+#define CUCKOO_MAX_KICKS 500
+#define CUCKOO_LANES 0x0001000100010001ULL
+
+struct RMUtilCuckoo {
+  uint64_t *buckets;
+  /* number of buckets - 1, a power of 2 */
+  uint64_t mask;
+  uint64_t count;
+  /* a fingerprint left out by a failed insert, which fills the filter */
+  uint64_t victimIndex;
+  uint16_t victimFp;
+  uint32_t rand;
+};
+
+/* Non zero if one of the 4 fingerprints of v is zero, its lowest set bit being in the lowest
+ * such fingerprint */
+static inline uint64_t cuckoo_hasZero(uint64_t v) {
+  return (v - CUCKOO_LANES) & ~v & (CUCKOO_LANES << 15);
+}
+
+static inline uint16_t cuckoo_fp(uint64_t hash) {
+  return (hash & 0xffff) ? (hash & 0xffff) : 1;
+}
+
+static inline uint64_t cuckoo_alt(const RMUtilCuckoo *c, uint64_t i, uint16_t fp) {
+  return (i ^ (fp * 0x5bd1e995ULL)) & c->mask;
+}
+
+/* Put fp in a free slot of bucket i. Returns 0 if it's full */
+static inline int cuckoo_insertAt(RMUtilCuckoo *c, uint64_t i, uint16_t fp) {
+  uint64_t empty = cuckoo_hasZero(c->buckets[i]);
+  if (!empty) return 0;
+  c->buckets[i] |= (uint64_t)fp << (__builtin_ctzll(empty) - 15);
+  return 1;
+}
+
+/* Clear one slot of bucket i holding fp. Returns 0 if there is none */
+static inline int cuckoo_deleteAt(RMUtilCuckoo *c, uint64_t i, uint16_t fp) {
+  uint64_t found = cuckoo_hasZero(c->buckets[i] ^ (fp * CUCKOO_LANES));
+  if (!found) return 0;
+  c->buckets[i] &= ~(0xffffULL << (__builtin_ctzll(found) - 15));
+  return 1;
+}
+
+size_t RMUtilCuckoo_BytesFor(uint64_t capacity) {
+  uint64_t n = 1;
+  while (n * CUCKOO_SLOTS * CUCKOO_LOAD < capacity) n *= 2;
+  return n * sizeof(uint64_t);
+}
+
+static RMUtilCuckoo *cuckoo_new(uint64_t numBuckets) {
+  RMUtilCuckoo *c = calloc(1, sizeof(*c));
+  c->buckets = calloc(numBuckets, sizeof(uint64_t));
+  c->mask = numBuckets - 1;
+  c->rand = 2463534242U;
+  return c;
+}
+
+RMUtilCuckoo *RMUtilCuckoo_New(uint64_t capacity) {
+  return cuckoo_new(RMUtilCuckoo_BytesFor(capacity) / sizeof(uint64_t));
+}
+
+void RMUtilCuckoo_Free(RMUtilCuckoo *c) {
+  free(c->buckets);
+  free(c);
+}
+
+static inline uint32_t cuckoo_rand(RMUtilCuckoo *c) {
+  c->rand ^= c->rand << 13;
+  c->rand ^= c->rand >> 17;
+  c->rand ^= c->rand << 5;
+  return c->rand;
+}
+
+/* Insert fp in bucket i or its other bucket, moving other fingerprints around as needed. If it
+ * fails the last fingerprint moved out is kept as the victim */
+static void cuckoo_insert(RMUtilCuckoo *c, uint64_t i, uint16_t fp) {
+  if (cuckoo_insertAt(c, i, fp)) return;
+  i = cuckoo_alt(c, i, fp);
+  if (cuckoo_insertAt(c, i, fp)) return;
+
+  // both buckets are full: evict a random fingerprint to its other bucket, and so on
+  for (int n = 0; n < CUCKOO_MAX_KICKS; n++) {
+    int shift = (cuckoo_rand(c) % CUCKOO_SLOTS) * 16;
+    uint16_t evicted = c->buckets[i] >> shift;
+    c->buckets[i] ^= (uint64_t)(evicted ^ fp) << shift;
+    fp = evicted;
+    i = cuckoo_alt(c, i, fp);
+    if (cuckoo_insertAt(c, i, fp)) return;
+  }
+  c->victimIndex = i;
+  c->victimFp = fp;
+}
+
+int RMUtilCuckoo_AddHash(RMUtilCuckoo *c, uint64_t hash) {
+  // the victim is in the way, until a delete makes room for it
+  if (c->victimFp) return 0;
+  c->count++;
+  cuckoo_insert(c, (hash >> 32) & c->mask, cuckoo_fp(hash));
+  return 1;
+}
+
+int RMUtilCuckoo_ContainsHash(const RMUtilCuckoo *c, uint64_t hash) {
+  uint16_t fp = cuckoo_fp(hash);
+  uint64_t i1 = (hash >> 32) & c->mask, i2 = cuckoo_alt(c, i1, fp), lanes = fp * CUCKOO_LANES;
+  if (cuckoo_hasZero(c->buckets[i1] ^ lanes) | cuckoo_hasZero(c->buckets[i2] ^ lanes)) return 1;
+  return c->victimFp == fp && (c->victimIndex == i1 || c->victimIndex == i2);
+}
+
+int RMUtilCuckoo_DeleteHash(RMUtilCuckoo *c, uint64_t hash) {
+  uint16_t fp = cuckoo_fp(hash);
+  uint64_t i1 = (hash >> 32) & c->mask, i2 = cuckoo_alt(c, i1, fp);
+  if (c->victimFp == fp && (c->victimIndex == i1 || c->victimIndex == i2)) {
+    c->victimFp = 0;
+  } else if (!cuckoo_deleteAt(c, i1, fp) && !cuckoo_deleteAt(c, i2, fp)) {
+    return 0;
+  }
+  c->count--;
+
+  // there may be room for the victim now
+  if (c->victimFp) {
+    fp = c->victimFp;
+    c->victimFp = 0;
+    cuckoo_insert(c, c->victimIndex, fp);
+  }
+  return 1;
+}
+
+uint64_t RMUtilCuckoo_Count(const RMUtilCuckoo *c) {
+  return c->count;
+}
+
+size_t RMUtilCuckoo_MemUsage(const RMUtilCuckoo *c) {
+  return sizeof(*c) + (c->mask + 1) * sizeof(uint64_t);
+}
+
+/* Serialized cuckoo filter, all little endian: the number of buckets and the victim's bucket (64
+ * bits each) and fingerprint (16 bits, 0 if there is none), then the buckets (64 bits each) */
+#define CUCKOO_HEADER_SIZE 18
+
+size_t RMUtilCuckoo_SerializedSize(const RMUtilCuckoo *c) {
+  return CUCKOO_HEADER_SIZE + (c->mask + 1) * sizeof(uint64_t);
+}
+
+void RMUtilCuckoo_Serialize(const RMUtilCuckoo *c, char *buf) {
+  unsigned char *p = (unsigned char *)buf;
+  filter_put(&p, c->mask + 1, 8);
+  filter_put(&p, c->victimIndex, 8);
+  filter_put(&p, c->victimFp, 2);
+  for (uint64_t i = 0; i <= c->mask; i++) filter_put(&p, c->buckets[i], 8);
+}
+
+RMUtilCuckoo *RMUtilCuckoo_Deserialize(const char *buf, size_t len) {
+  const unsigned char *p = (const unsigned char *)buf;
+  if (len < CUCKOO_HEADER_SIZE) return NULL;
+  uint64_t numBuckets = filter_get(&p, 8), victimIndex = filter_get(&p, 8);
+  uint16_t victimFp = filter_get(&p, 2);
+  if (!numBuckets || (numBuckets & (numBuckets - 1)) || victimIndex >= numBuckets ||
+      numBuckets != (len - CUCKOO_HEADER_SIZE) / sizeof(uint64_t) ||
+      (len - CUCKOO_HEADER_SIZE) % sizeof(uint64_t)) {
+    return NULL;
+  }
+  RMUtilCuckoo *c = cuckoo_new(numBuckets);
+  c->victimIndex = victimIndex;
+  c->victimFp = victimFp;
+  c->count = victimFp != 0;
+  for (uint64_t i = 0; i < numBuckets; i++) {
+    uint64_t b = c->buckets[i] = filter_get(&p, 8);
+    // the count is the number of used slots
+    for (int j = 0; j < CUCKOO_SLOTS; j++) c->count += (b >> (16 * j) & 0xffff) != 0;
+  }
+  return c;
+}
+
+void RMUtilCuckoo_RdbSave(RedisModuleIO *io, const RMUtilCuckoo *c) {
+  size_t len = RMUtilCuckoo_SerializedSize(c);
+  char *buf = malloc(len);
+  RMUtilCuckoo_Serialize(c, buf);
+  RedisModule_SaveStringBuffer(io, buf, len);
+  free(buf);
+}
+
+RMUtilCuckoo *RMUtilCuckoo_RdbLoad(RedisModuleIO *io) {
+  size_t len;
+  char *buf = RedisModule_LoadStringBuffer(io, &len);
+  if (!buf) return NULL;
+  RMUtilCuckoo *c = RMUtilCuckoo_Deserialize(buf, len);
+  RedisModule_Free(buf);
+  return c;
+}
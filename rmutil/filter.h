@@ -0,0 +1,122 @@
+#ifndef __RMUTIL_FILTER_H__
+#define __RMUTIL_FILTER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <redismodule.h>
+#include "hashmap.h"
+
+/** filter.h - probabilistic membership filters, to put in front of expensive lookups.
+ *
+ * Both filters may answer "maybe" for keys that were never added (false positives), but never
+ * answer "no" for keys that were. Keys are given either as bytes, hashed with RMUtilHash_Bytes, or
+ * as a 64 bit hash the caller already has, which must be well mixed (e.g. from hashmap.h).
+ *
+ * RMUtilBloom is a split block Bloom filter: each key maps to a single 32 byte block, aligned so
+ * it never straddles a cache line, and sets one bit in each of the block's eight 32 bit words. A
+ * query costs one cache miss, and the eight bit positions are computed with independent multiplies,
+ * in a single AVX2 instruction when compiled with -mavx2. It needs about 30% more bits than a
+ * classic Bloom filter for the same false positive rate.
+ *
+ * RMUtilCuckoo is a cuckoo filter with 16 bit fingerprints in buckets of four, each key having two
+ * candidate buckets. A query reads two 8 byte buckets and checks all their fingerprints at once,
+ * and unlike a Bloom filter it supports deletion. Its false positive rate is fixed at about 0.012%
+ * (RMUTIL_CUCKOO_FPR), and it holds up to about 95% of its slots before inserts fail.
+ *
+ * Both serialize to a portable (little endian) form, validated when loaded, and can be saved in
+ * RDB files with their RdbSave and RdbLoad functions.
+ */
+
+/* RMUtilBloom - opaque blocked Bloom filter */
+typedef struct RMUtilBloom RMUtilBloom;
+
+/* Return the size in bytes of a filter for capacity keys with a false positive rate of fpr */
+size_t RMUtilBloom_BytesFor(uint64_t capacity, double fpr);
+
+/* Return the false positive rate of a filter of the given size holding n keys */
+double RMUtilBloom_FalsePositiveRate(size_t bytes, uint64_t n);
+
+/* Create a filter sized with RMUtilBloom_BytesFor */
+RMUtilBloom *RMUtilBloom_New(uint64_t capacity, double fpr);
+void RMUtilBloom_Free(RMUtilBloom *b);
+
+/* Add a key. Returns 1 if it was not in the filter, 0 if it may have been */
+int RMUtilBloom_AddHash(RMUtilBloom *b, uint64_t hash);
+int RMUtilBloom_ContainsHash(const RMUtilBloom *b, uint64_t hash);
+
+static inline int RMUtilBloom_Add(RMUtilBloom *b, const void *key, size_t len) {
+  return RMUtilBloom_AddHash(b, RMUtilHash_Bytes(key, len, 0));
+}
+
+static inline int RMUtilBloom_Contains(const RMUtilBloom *b, const void *key, size_t len) {
+  return RMUtilBloom_ContainsHash(b, RMUtilHash_Bytes(key, len, 0));
+}
+
+/* Return the number of keys added, not counting the ones that may have been in already */
+uint64_t RMUtilBloom_Count(const RMUtilBloom *b);
+
+/* Return the number of bytes allocated by the filter */
+size_t RMUtilBloom_MemUsage(const RMUtilBloom *b);
+
+size_t RMUtilBloom_SerializedSize(const RMUtilBloom *b);
+
+/* Serialize the filter into buf, which must be RMUtilBloom_SerializedSize bytes long */
+void RMUtilBloom_Serialize(const RMUtilBloom *b, char *buf);
+
+/* Load a serialized filter. Returns NULL if buf does not hold a valid one */
+RMUtilBloom *RMUtilBloom_Deserialize(const char *buf, size_t len);
+
+void RMUtilBloom_RdbSave(RedisModuleIO *io, const RMUtilBloom *b);
+RMUtilBloom *RMUtilBloom_RdbLoad(RedisModuleIO *io);
+
+/* RMUtilCuckoo - opaque cuckoo filter */
+typedef struct RMUtilCuckoo RMUtilCuckoo;
+
+/* The false positive rate of a cuckoo filter: 2 buckets of 4 slots, 16 bit fingerprints */
+#define RMUTIL_CUCKOO_FPR (8.0 / 65535)
+
+/* Return the size in bytes of a filter for capacity keys */
+size_t RMUtilCuckoo_BytesFor(uint64_t capacity);
+
+RMUtilCuckoo *RMUtilCuckoo_New(uint64_t capacity);
+void RMUtilCuckoo_Free(RMUtilCuckoo *c);
+
+/* Add a key. Adding a key twice stores it twice, so it must then be deleted twice. Returns 0 if
+ * the filter is full, in which case the key was not added */
+int RMUtilCuckoo_AddHash(RMUtilCuckoo *c, uint64_t hash);
+int RMUtilCuckoo_ContainsHash(const RMUtilCuckoo *c, uint64_t hash);
+
+/* Delete a key that was added. Returns 1 if it was found. Deleting keys that were never added may
+ * delete other keys with the same fingerprint */
+int RMUtilCuckoo_DeleteHash(RMUtilCuckoo *c, uint64_t hash);
+
+static inline int RMUtilCuckoo_Add(RMUtilCuckoo *c, const void *key, size_t len) {
+  return RMUtilCuckoo_AddHash(c, RMUtilHash_Bytes(key, len, 0));
+}
+
+static inline int RMUtilCuckoo_Contains(const RMUtilCuckoo *c, const void *key, size_t len) {
+  return RMUtilCuckoo_ContainsHash(c, RMUtilHash_Bytes(key, len, 0));
+}
+
+static inline int RMUtilCuckoo_Delete(RMUtilCuckoo *c, const void *key, size_t len) {
+  return RMUtilCuckoo_DeleteHash(c, RMUtilHash_Bytes(key, len, 0));
+}
+
+/* Return the number of keys in the filter */
+uint64_t RMUtilCuckoo_Count(const RMUtilCuckoo *c);
+
+/* Return the number of bytes allocated by the filter */
+size_t RMUtilCuckoo_MemUsage(const RMUtilCuckoo *c);
+
+size_t RMUtilCuckoo_SerializedSize(const RMUtilCuckoo *c);
+
+/* Serialize the filter into buf, which must be RMUtilCuckoo_SerializedSize bytes long */
+void RMUtilCuckoo_Serialize(const RMUtilCuckoo *c, char *buf);
+
+/* Load a serialized filter. Returns NULL if buf does not hold a valid one */
+RMUtilCuckoo *RMUtilCuckoo_Deserialize(const char *buf, size_t len);
+
+void RMUtilCuckoo_RdbSave(RedisModuleIO *io, const RMUtilCuckoo *c);
+RMUtilCuckoo *RMUtilCuckoo_RdbLoad(RedisModuleIO *io);
+
+#endif
@@ -0,0 +1,209 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fork.h"
+#include "alloc.h"
+
+/* Upper bound on chunks delivered per event loop wakeup, so a fast child can't starve clients */
+#define FORK_MAX_CHUNKS_PER_EVENT 16
+
+struct RMUtilForkJob {
+  RMUtilForkDataFunc onData;
+  RMUtilForkDoneFunc onDone;
+  void *privdata;
+  RMUtilForkJobOptions opts;
+
+  int pid;
+  int fd;
+  char *buf;
+  size_t buflen;
+
+  /* timeout timer, stopped through a detached context of the calling module */
+  RedisModuleCtx *timerCtx;
+  RedisModuleTimerID timer;
+  int timerPending;
+  int timedOut;
+  int finished;
+};
+
+static void forkJob_free(RMUtilForkJob *job) {
+  if (job->timerCtx) RedisModule_FreeThreadSafeContext(job->timerCtx);
+  free(job->buf);
+  free(job);
+}
+
+/* Deliver up to maxChunks chunks of output. Returns 1 once the pipe is drained and closed by the
+ * child */
+static int forkJob_read(RMUtilForkJob *job, int maxChunks) {
+  for (int i = 0; !maxChunks || i < maxChunks; i++) {
+    ssize_t n = read(job->fd, job->buf, job->opts.chunkSize);
+    if (n > 0) {
+      if (job->onData) job->onData(job->buf, n, job->privdata);
+    } else if (n == 0) {
+      return 1;
+    } else if (errno == EINTR) {
+      continue;
+    } else {
+      // EAGAIN: more to come. Anything else: we won't get more
+      return errno != EAGAIN;
+    }
+  }
+  return 0;
+}
+
+static void forkJob_closePipe(RMUtilForkJob *job) {
+  if (job->fd < 0) return;
+  RedisModule_EventLoopDel(job->fd, REDISMODULE_EVENTLOOP_READABLE);
+  close(job->fd);
+  job->fd = -1;
+}
+
+static void forkJob_onReadable(int fd, void *user_data, int mask) {
+  RMUtilForkJob *job = user_data;
+  if (forkJob_read(job, FORK_MAX_CHUNKS_PER_EVENT)) forkJob_closePipe(job);
+}
+
+/* The child is gone: deliver the rest of its output, call the done callback and free the job,
+ * unless the timeout timer still holds it */
+static void forkJob_finish(RMUtilForkJob *job, int exitcode, int bysignal) {
+  // whatever is left in the pipe can now be read without blocking
+  if (job->fd >= 0) {
+    fcntl(job->fd, F_SETFL, fcntl(job->fd, F_GETFL) & ~O_NONBLOCK);
+    forkJob_read(job, 0);
+    forkJob_closePipe(job);
+  }
+  job->finished = 1;
+  if (job->onDone) job->onDone(exitcode, bysignal, job->timedOut, job->privdata);
+
+  if (job->timerPending && job->timerCtx &&
+      RedisModule_StopTimer(job->timerCtx, job->timer, NULL) == REDISMODULE_OK) {
+    job->timerPending = 0;
+  }
+  // otherwise the timer frees the job when it fires
+  if (!job->timerPending) forkJob_free(job);
+}
+
+/* Called from the main thread once the child exited */
+static void forkJob_onExit(int exitcode, int bysignal, void *user_data) {
+  forkJob_finish(user_data, exitcode, bysignal);
+}
+
+/* Killing the child waits for it, and redis doesn't call the done handler then */
+static void forkJob_kill(RMUtilForkJob *job) {
+  RedisModule_KillForkChild(job->pid);
+  forkJob_finish(job, -1, SIGUSR1);
+}
+
+static void forkJob_onTimeout(RedisModuleCtx *ctx, void *data) {
+  RMUtilForkJob *job = data;
+  job->timerPending = 0;
+  if (job->finished) {
+    forkJob_free(job);
+    return;
+  }
+  job->timedOut = 1;
+  forkJob_kill(job);
+}
+
+static int forkJob_flush(RMUtilForkJob *job) {
+  size_t off = 0;
+  while (off < job->buflen) {
+    ssize_t n = write(job->fd, job->buf + off, job->buflen - off);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return REDISMODULE_ERR;
+    }
+    off += n;
+  }
+  job->buflen = 0;
+  return REDISMODULE_OK;
+}
+
+RMUtilForkJob *RMUtil_ForkJob(RedisModuleCtx *ctx, RMUtilForkChildFunc child,
+                              RMUtilForkDataFunc onData, RMUtilForkDoneFunc onDone, void *privdata,
+                              const RMUtilForkJobOptions *opts) {
+  // everything the parent needs once the child runs, so it's never left without a way to reap it
+  if (!RedisModule_Fork || !RedisModule_ExitFromChild || !RedisModule_KillForkChild ||
+      !RedisModule_EventLoopAdd || !RedisModule_EventLoopDel) {
+    return NULL;
+  }
+  if (opts && opts->timeout_ms > 0 && !RedisModule_CreateTimer) return NULL;
+  int fds[2];
+  if (pipe(fds) != 0) return NULL;
+
+  RMUtilForkJob *job = calloc(1, sizeof(*job));
+  job->onData = onData;
+  job->onDone = onDone;
+  job->privdata = privdata;
+  if (opts) job->opts = *opts;
+  if (!job->opts.chunkSize) job->opts.chunkSize = RMUTIL_FORK_DEFAULT_CHUNK;
+  job->buf = malloc(job->opts.chunkSize);
+
+  int pid = RedisModule_Fork(forkJob_onExit, job);
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    forkJob_free(job);
+    return NULL;
+  }
+
+  if (pid == 0) {
+    // child: run, flush what's left and exit without returning to the command
+    close(fds[0]);
+    job->fd = fds[1];
+    int rc = child(ctx, job, privdata);
+    if (forkJob_flush(job) != REDISMODULE_OK && rc == 0) rc = 1;
+    close(job->fd);
+    RedisModule_ExitFromChild(rc);
+    _exit(rc);
+  }
+
+  close(fds[1]);
+  job->pid = pid;
+  job->fd = fds[0];
+  fcntl(job->fd, F_SETFL, fcntl(job->fd, F_GETFL) | O_NONBLOCK);
+  if (RedisModule_EventLoopAdd(job->fd, REDISMODULE_EVENTLOOP_READABLE, forkJob_onReadable, job) !=
+      REDISMODULE_OK) {
+    // the output could not be delivered: kill the child, which also reaps it without a done call
+    RedisModule_KillForkChild(pid);
+    close(job->fd);
+    forkJob_free(job);
+    return NULL;
+  }
+
+  if (job->opts.timeout_ms > 0) {
+    if (RedisModule_GetDetachedThreadSafeContext) {
+      job->timerCtx = RedisModule_GetDetachedThreadSafeContext(ctx);
+    }
+    job->timer = RedisModule_CreateTimer(ctx, job->opts.timeout_ms, forkJob_onTimeout, job);
+    job->timerPending = 1;
+  }
+  return job;
+}
+
+int RMUtilForkJob_Write(RMUtilForkJob *job, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len) {
+    size_t n = job->opts.chunkSize - job->buflen;
+    if (n > len) n = len;
+    memcpy(job->buf + job->buflen, p, n);
+    job->buflen += n;
+    p += n;
+    len -= n;
+    if (job->buflen == job->opts.chunkSize && forkJob_flush(job) != REDISMODULE_OK) {
+      return REDISMODULE_ERR;
+    }
+  }
+  return REDISMODULE_OK;
+}
+
+void RMUtilForkJob_Progress(RMUtilForkJob *job, double progress) {
+  if (RedisModule_SendChildHeartbeat) RedisModule_SendChildHeartbeat(progress);
+}
+
+void RMUtilForkJob_Kill(RMUtilForkJob *job) {
+  forkJob_kill(job);
+}
@@ -0,0 +1,64 @@
+#ifndef __RMUTIL_FORK_H__
+#define __RMUTIL_FORK_H__
+
+#include <stddef.h>
+#include <redismodule.h>
+
+/** fork.h - run work in a forked child over a copy-on-write snapshot of the dataset.
+ *
+ * RMUtil_ForkJob forks with RedisModule_Fork and runs the child function right away, in the child,
+ * with the calling command's context - so it can open and scan keys as of the moment of the fork,
+ * while the parent goes on serving clients. The child streams its results back through a pipe with
+ * RMUtilForkJob_Write, and reports progress with RMUtilForkJob_Progress (shown in INFO as the
+ * module fork progress). In the parent, the results are delivered in chunks from the event loop,
+ * and the done callback is called once the child exited and all its output was delivered.
+ *
+ * Redis only runs one child process at a time, so forking fails while an RDB or AOF rewrite, or
+ * another module's fork, is running.
+ */
+
+/* RMUtilForkJob - opaque handle of a fork job */
+typedef struct RMUtilForkJob RMUtilForkJob;
+
+/* Runs in the child. Returns the child's exit code */
+typedef int (*RMUtilForkChildFunc)(RedisModuleCtx *ctx, RMUtilForkJob *job, void *privdata);
+
+/* Runs in the parent, on the event loop, for every chunk of output written by the child */
+typedef void (*RMUtilForkDataFunc)(const char *buf, size_t len, void *privdata);
+
+/* Runs in the parent once the child is gone and all its output was delivered. timedOut is set if
+ * the child was killed because it ran past its timeout */
+typedef void (*RMUtilForkDoneFunc)(int exitcode, int bysignal, int timedOut, void *privdata);
+
+typedef struct {
+  /* Kill the child if it runs longer than this, 0 for no timeout */
+  long long timeout_ms;
+  /* Size of the chunks the output is written and delivered in. Default 64KB */
+  size_t chunkSize;
+} RMUtilForkJobOptions;
+
+#define RMUTIL_FORK_DEFAULT_CHUNK (64 * 1024)
+
+/**
+ * Fork and run child(ctx, job, privdata) in the child. Must be called from the main thread.
+ * opts may be NULL for the defaults. onData may be NULL to discard the child's output, and onDone
+ * if there is nothing to do once it exits.
+ * @return the job, or NULL if the child could not be forked (e.g. another child is running, or the
+ * server lacks the fork or event loop API), in which case none of the callbacks are called
+ */
+RMUtilForkJob *RMUtil_ForkJob(RedisModuleCtx *ctx, RMUtilForkChildFunc child,
+                              RMUtilForkDataFunc onData, RMUtilForkDoneFunc onDone, void *privdata,
+                              const RMUtilForkJobOptions *opts);
+
+/* Child side: send len bytes of output to the parent. Output is buffered and sent in chunks, and
+ * blocks if the parent falls behind. Returns REDISMODULE_ERR if the parent went away */
+int RMUtilForkJob_Write(RMUtilForkJob *job, const void *buf, size_t len);
+
+/* Child side: report progress, between 0 and 1 */
+void RMUtilForkJob_Progress(RMUtilForkJob *job, double progress);
+
+/* Parent side: kill the child, deliver what it already wrote and call the done callback with the
+ * signal. Must not be called once the done callback ran, as the job is freed after it */
+void RMUtilForkJob_Kill(RMUtilForkJob *job);
+
+#endif
@@ -0,0 +1,213 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "gil.h"
+#include "alloc.h"
+
+typedef struct gilTask {
+  RMUtilGILFunc func;
+  void *arg;
+  struct gilTask *next;
+} gilTask;
+
+struct RMUtilGILExecutor {
+  RMUtilGILExecutorOptions opts;
+  RedisModuleCtx *ctx;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  /* signaled when tasks are queued, or on shutdown */
+  pthread_cond_t cond;
+  /* signaled after every batch, for flushers */
+  pthread_cond_t doneCond;
+
+  gilTask *head, *tail;
+  /* sequence numbers of the last submitted and last completed task */
+  uint64_t submitted, completed;
+  int stopping;
+
+  RMUtilGILExecutorStats stats;
+};
+
+static long long gil_nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void gil_sleepUs(long long us) {
+  struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+  nanosleep(&ts, NULL);
+}
+
+/* Acquire the GIL, politely: try first, and back off while the main thread holds it. Returns the
+ * number of failed attempts */
+static int gil_acquire(RMUtilGILExecutor *e) {
+  int failures = 0;
+  if (RedisModule_ThreadSafeContextTryLock) {
+    long long backoff = e->opts.minBackoffUs;
+    for (; failures < e->opts.maxTryLockAttempts; failures++) {
+      if (RedisModule_ThreadSafeContextTryLock(e->ctx) == REDISMODULE_OK) return failures;
+      gil_sleepUs(backoff);
+      backoff *= 2;
+      if (backoff > e->opts.maxBackoffUs) backoff = e->opts.maxBackoffUs;
+    }
+  }
+  RedisModule_ThreadSafeContextLock(e->ctx);
+  return failures;
+}
+
+/* Run a single batch under the GIL. Called with e->lock held and tasks pending, and returns with
+ * it held */
+static void gil_runBatch(RMUtilGILExecutor *e) {
+  pthread_mutex_unlock(&e->lock);
+  int failures = gil_acquire(e);
+
+  long long deadline = gil_nowUs() + e->opts.batchBudgetUs;
+  size_t n = 0;
+  int full = 0, overBudget = 0;
+
+  pthread_mutex_lock(&e->lock);
+  while (e->head && !full && !overBudget) {
+    // take whatever is queued now, and run it without holding the queue lock
+    gilTask *t = e->head;
+    e->head = e->tail = NULL;
+    pthread_mutex_unlock(&e->lock);
+
+    size_t ran = 0;
+    while (t) {
+      // always make some progress, then stop at the batch size or the deadline
+      if (n + ran > 0) {
+        if (e->opts.maxBatch && n + ran >= e->opts.maxBatch) {
+          full = 1;
+          break;
+        }
+        if (gil_nowUs() >= deadline) {
+          overBudget = 1;
+          break;
+        }
+      }
+      gilTask *next = t->next;
+      t->func(e->ctx, t->arg);
+      free(t);
+      t = next;
+      ran++;
+    }
+    n += ran;
+
+    pthread_mutex_lock(&e->lock);
+    e->completed += ran;
+    if (t) {
+      // put back what we didn't get to, ahead of anything submitted meanwhile
+      gilTask *last = t;
+      while (last->next) last = last->next;
+      last->next = e->head;
+      if (!e->head) e->tail = last;
+      e->head = t;
+    }
+  }
+  e->stats.executed += n;
+  e->stats.batches++;
+  e->stats.tryLockFailures += failures;
+  if (overBudget) e->stats.budgetExceeded++;
+  pthread_mutex_unlock(&e->lock);
+
+  RedisModule_ThreadSafeContextUnlock(e->ctx);
+  // with more to run, the next batch would take the lock right back before a waiting main thread
+  // gets to run, as the lock is not fair
+  if (full || overBudget) gil_sleepUs(e->opts.minBackoffUs);
+
+  pthread_mutex_lock(&e->lock);
+  pthread_cond_broadcast(&e->doneCond);
+}
+
+static void *gil_loop(void *arg) {
+  RMUtilGILExecutor *e = arg;
+  pthread_mutex_lock(&e->lock);
+  for (;;) {
+    while (!e->head && !e->stopping) pthread_cond_wait(&e->cond, &e->lock);
+    if (!e->head) break;
+    gil_runBatch(e);
+  }
+  pthread_mutex_unlock(&e->lock);
+  return NULL;
+}
+
+RMUtilGILExecutor *RMUtilGILExecutor_New(RedisModuleCtx *ctx, const RMUtilGILExecutorOptions *opts) {
+  RMUtilGILExecutor *e = calloc(1, sizeof(*e));
+  if (opts) e->opts = *opts;
+  if (e->opts.batchBudgetUs <= 0) e->opts.batchBudgetUs = 1000;
+  if (e->opts.minBackoffUs <= 0) e->opts.minBackoffUs = 20;
+  if (e->opts.maxBackoffUs <= 0) e->opts.maxBackoffUs = 1000;
+  if (e->opts.maxBackoffUs < e->opts.minBackoffUs) e->opts.maxBackoffUs = e->opts.minBackoffUs;
+  if (e->opts.maxTryLockAttempts <= 0) e->opts.maxTryLockAttempts = 16;
+
+  if (ctx && RedisModule_GetDetachedThreadSafeContext) {
+    e->ctx = RedisModule_GetDetachedThreadSafeContext(ctx);
+  } else {
+    e->ctx = RedisModule_GetThreadSafeContext(NULL);
+  }
+
+  pthread_mutex_init(&e->lock, NULL);
+  pthread_cond_init(&e->cond, NULL);
+  pthread_cond_init(&e->doneCond, NULL);
+  if (pthread_create(&e->thread, NULL, gil_loop, e) != 0) {
+    RedisModule_FreeThreadSafeContext(e->ctx);
+    pthread_cond_destroy(&e->doneCond);
+    pthread_cond_destroy(&e->cond);
+    pthread_mutex_destroy(&e->lock);
+    free(e);
+    return NULL;
+  }
+  return e;
+}
+
+int RMUtilGILExecutor_Submit(RMUtilGILExecutor *e, RMUtilGILFunc func, void *arg) {
+  gilTask *t = malloc(sizeof(*t));
+  *t = (gilTask){.func = func, .arg = arg, .next = NULL};
+
+  pthread_mutex_lock(&e->lock);
+  if (e->stopping) {
+    pthread_mutex_unlock(&e->lock);
+    free(t);
+    return REDISMODULE_ERR;
+  }
+  if (e->tail) {
+    e->tail->next = t;
+  } else {
+    e->head = t;
+  }
+  e->tail = t;
+  e->submitted++;
+  // the executor only waits when the queue is empty, so only the first task needs to wake it
+  if (e->head == t) pthread_cond_signal(&e->cond);
+  pthread_mutex_unlock(&e->lock);
+  return REDISMODULE_OK;
+}
+
+void RMUtilGILExecutor_Flush(RMUtilGILExecutor *e) {
+  pthread_mutex_lock(&e->lock);
+  uint64_t target = e->submitted;
+  while (e->completed < target) pthread_cond_wait(&e->doneCond, &e->lock);
+  pthread_mutex_unlock(&e->lock);
+}
+
+void RMUtilGILExecutor_GetStats(RMUtilGILExecutor *e, RMUtilGILExecutorStats *stats) {
+  pthread_mutex_lock(&e->lock);
+  *stats = e->stats;
+  pthread_mutex_unlock(&e->lock);
+}
+
+void RMUtilGILExecutor_Free(RMUtilGILExecutor *e) {
+  pthread_mutex_lock(&e->lock);
+  e->stopping = 1;
+  pthread_cond_signal(&e->cond);
+  pthread_mutex_unlock(&e->lock);
+  pthread_join(e->thread, NULL);
+
+  RedisModule_FreeThreadSafeContext(e->ctx);
+  pthread_cond_destroy(&e->doneCond);
+  pthread_cond_destroy(&e->cond);
+  pthread_mutex_destroy(&e->lock);
+  free(e);
+}
@@ -0,0 +1,73 @@
+#ifndef __RMUTIL_GIL_H__
+#define __RMUTIL_GIL_H__
+
+#include <stdint.h>
+#include <redismodule.h>
+
+/** gil.h - batch keyspace access from background threads under a single GIL acquisition.
+ *
+ * Background threads that lock a thread safe context for every small piece of work fight the main
+ * thread, and each other, for the redis global lock. An RMUtilGILExecutor queues closures from any
+ * thread and runs them on its own thread in batches, taking the GIL once per batch:
+ *
+ *  - A batch runs until the queue is empty, maxBatch closures ran, or the batch's time budget is
+ *    spent, and then the GIL is released so the main thread can serve clients. A batch cut short
+ *    is followed by a pause of minBackoffUs, so that the main thread gets the GIL in between.
+ *  - The GIL is acquired with RedisModule_ThreadSafeContextTryLock, backing off exponentially
+ *    while the main thread holds it, and only falling back to a blocking lock after
+ *    maxTryLockAttempts failures, so the executor never queues up behind a busy event loop.
+ *
+ * Closures get a thread safe context that is already locked, and must not lock or unlock it.
+ */
+
+/* RMUtilGILFunc - a closure to run under the GIL */
+typedef void (*RMUtilGILFunc)(RedisModuleCtx *ctx, void *arg);
+
+/* RMUtilGILExecutor - opaque GIL executor */
+typedef struct RMUtilGILExecutor RMUtilGILExecutor;
+
+typedef struct {
+  /* Maximum time to hold the GIL per batch, in microseconds. Default 1000 */
+  long long batchBudgetUs;
+  /* Maximum number of closures per batch, 0 for no limit */
+  size_t maxBatch;
+  /* Initial and maximum back off between failed TryLock attempts, in microseconds. Defaults 20
+   * and 1000. The initial one is also the pause after a batch cut short */
+  long long minBackoffUs;
+  long long maxBackoffUs;
+  /* Number of failed TryLock attempts before blocking on the lock. Default 16 */
+  int maxTryLockAttempts;
+} RMUtilGILExecutorOptions;
+
+typedef struct {
+  /* Closures run so far */
+  uint64_t executed;
+  /* Batches run, i.e. GIL acquisitions */
+  uint64_t batches;
+  /* Failed TryLock attempts */
+  uint64_t tryLockFailures;
+  /* Batches cut short by the time budget */
+  uint64_t budgetExceeded;
+} RMUtilGILExecutorStats;
+
+/* Create and start a new executor. If ctx is given and the server supports it, the executor uses
+ * a detached thread safe context of it, otherwise one not bound to any client. opts may be NULL for
+ * the defaults */
+RMUtilGILExecutor *RMUtilGILExecutor_New(RedisModuleCtx *ctx, const RMUtilGILExecutorOptions *opts);
+
+/* Queue func(ctx, arg) to run under the GIL. Can be called from any thread. Returns
+ * REDISMODULE_ERR if the executor is shutting down */
+int RMUtilGILExecutor_Submit(RMUtilGILExecutor *e, RMUtilGILFunc func, void *arg);
+
+/* Wait until all the closures submitted so far have run. Must not be called while holding the GIL,
+ * e.g. from the main thread or from a closure, as that would deadlock */
+void RMUtilGILExecutor_Flush(RMUtilGILExecutor *e);
+
+/* Copy the executor's counters into stats */
+void RMUtilGILExecutor_GetStats(RMUtilGILExecutor *e, RMUtilGILExecutorStats *stats);
+
+/* Run all the pending closures, stop the executor thread and free the executor. The same locking
+ * rules as RMUtilGILExecutor_Flush apply */
+void RMUtilGILExecutor_Free(RMUtilGILExecutor *e);
+
+#endif
@@ -0,0 +1,480 @@
+#ifndef __RMUTIL_HASHMAP_H__
+#define __RMUTIL_HASHMAP_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/** hashmap.h - an open addressing hash map in the style of SwissTable, instantiated per type.
+ *
+ * Slots are split into groups of 16, with one control byte per slot: EMPTY, DELETED, or the low 7
+ * bits of the hash of the key stored in it. A lookup hashes the key once, and checks a whole group
+ * of control bytes at a time against those 7 bits with SSE2 (or a portable loop without it), so it
+ * only compares keys that almost certainly match, and usually touches a single group. The map
+ * grows at 7/8 full.
+ *
+ * RMUTIL_HASHMAP_DEFINE(name, key_t, val_t, hash, eq) defines the type `name` and its functions,
+ * all prefixed with `name_`. hash(key) returns a uint64_t and eq(a, b) returns non zero if the
+ * keys are equal; both are usually macros or static inline functions, so they get inlined.
+ *
+ *    #define intHash(k) RMUtilHash_U64(k)
+ *    #define intEq(a, b) ((a) == (b))
+ *    RMUTIL_HASHMAP_DEFINE(IntMap, uint64_t, double, intHash, intEq)
+ *
+ *    IntMap *m = IntMap_New(0);
+ *    IntMap_Put(m, 42, 3.14);
+ *    double *d = IntMap_Get(m, 42);
+ *    IntMap_Free(m);
+ *
+ * The map does not own keys or values; free them before removing them or freeing the map (e.g.
+ * by iterating over it with name_Next). Pointers returned by Get, Put and Insert are valid until
+ * the next insertion. name_MemUsage reports the map's own allocation, for mem_usage callbacks.
+ */
+
+#define RMUTIL_HM_GROUP 16
+#define RMUTIL_HM_EMPTY ((int8_t)-128)
+#define RMUTIL_HM_DELETED ((int8_t)-2)
+
+/* Bit i of the returned masks is set if slot i of the group matches */
+#ifdef __SSE2__
+static inline uint32_t __rmutil_hm_match(const int8_t *g, int8_t h2) {
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)g);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+}
+
+/* EMPTY and DELETED are the only negative control bytes */
+static inline uint32_t __rmutil_hm_matchFree(const int8_t *g) {
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+}
+#else
+static inline uint32_t __rmutil_hm_match(const int8_t *g, int8_t h2) {
+  uint32_t mask = 0;
+  for (int i = 0; i < RMUTIL_HM_GROUP; i++) mask |= (uint32_t)(g[i] == h2) << i;
+  return mask;
+}
+
+static inline uint32_t __rmutil_hm_matchFree(const int8_t *g) {
+  uint32_t mask = 0;
+  for (int i = 0; i < RMUTIL_HM_GROUP; i++) mask |= (uint32_t)(g[i] < 0) << i;
+  return mask;
+}
+#endif
+
+static inline uint32_t __rmutil_hm_matchEmpty(const int8_t *g) {
+  return __rmutil_hm_match(g, RMUTIL_HM_EMPTY);
+}
+
+/* Capacity holding n elements below the maximal load factor: a power of two, at least a group */
+static inline size_t __rmutil_hm_capacityFor(size_t n) {
+  size_t cap = RMUTIL_HM_GROUP;
+  while (cap - cap / 8 < n) cap *= 2;
+  return cap;
+}
+
+/* Hash functions for common key types */
+
+static inline uint64_t RMUtilHash_U64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+static inline uint64_t __rmutil_hash_mix(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+  return RMUtilHash_U64(a ^ RMUtilHash_U64(b));
+#endif
+}
+
+static inline uint64_t __rmutil_hash_read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t __rmutil_hash_read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/* Hash len bytes, 16 at a time with a 64x64->128 bit multiply per round */
+static inline uint64_t RMUtilHash_Bytes(const void *key, size_t len, uint64_t seed) {
+  const uint8_t *p = key;
+  const uint64_t k0 = 0xa0761d6478bd642fULL, k1 = 0xe7037ed1a0b428dbULL;
+  uint64_t h = seed ^ k0 ^ len, a = 0, b = 0;
+  size_t n = len;
+  while (n > 16) {
+    h = __rmutil_hash_mix(__rmutil_hash_read64(p) ^ k1, __rmutil_hash_read64(p + 8) ^ h);
+    p += 16;
+    n -= 16;
+  }
+  // the last 1..16 bytes, with overlapping reads
+  if (n >= 8) {
+    a = __rmutil_hash_read64(p);
+    b = __rmutil_hash_read64(p + n - 8);
+  } else if (n >= 4) {
+    a = __rmutil_hash_read32(p);
+    b = __rmutil_hash_read32(p + n - 4);
+  } else if (n > 0) {
+    a = ((uint64_t)p[0] << 16) | ((uint64_t)p[n >> 1] << 8) | p[n - 1];
+  }
+  return __rmutil_hash_mix(__rmutil_hash_mix(a ^ k1, b ^ h), len ^ k0);
+}
+
+static inline uint64_t RMUtilHash_Str(const char *s) {
+  return RMUtilHash_Bytes(s, strlen(s), 0);
+}
+
+#define RMUTIL_HASHMAP_DEFINE(name, key_t, val_t, hashfn, eqfn)                                  \
+  typedef struct {                                                                               \
+    key_t key;                                                                                   \
+    val_t val;                                                                                   \
+  } name##_Entry;                                                                                \
+                                                                                                 \
+  typedef struct {                                                                               \
+    int8_t *ctrl;                                                                                \
+    name##_Entry *slots;                                                                         \
+    size_t cap;                                                                                  \
+    size_t size;                                                                                 \
+    /* insertions into EMPTY slots left before the map must grow or be cleaned up */             \
+    size_t growthLeft;                                                                           \
+  } name;                                                                                        \
+                                                                                                 \
+  static inline void name##__alloc(name *m, size_t cap) {                                        \
+    m->cap = cap;                                                                                \
+    m->slots = malloc(cap * (sizeof(name##_Entry) + 1));                                         \
+    m->ctrl = (int8_t *)(m->slots + cap);                                                        \
+    memset(m->ctrl, RMUTIL_HM_EMPTY, cap);                                                       \
+    m->growthLeft = cap - cap / 8;                                                               \
+  }                                                                                              \
+                                                                                                 \
+  /* Create a new map with room for at least cap elements */                                     \
+  static inline name *name##_New(size_t cap) {                                                   \
+    name *m = calloc(1, sizeof(*m));                                                             \
+    if (cap) name##__alloc(m, __rmutil_hm_capacityFor(cap));                                     \
+    return m;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  static inline void name##_Free(name *m) {                                                      \
+    free(m->slots);                                                                              \
+    free(m);                                                                                     \
+  }                                                                                              \
+                                                                                                 \
+  static inline size_t name##_Size(name *m) {                                                    \
+    return m->size;                                                                              \
+  }                                                                                              \
+                                                                                                 \
+  /* Bytes allocated by the map itself, excluding whatever keys and values point to */          \
+  static inline size_t name##_MemUsage(name *m) {                                                \
+    return sizeof(*m) + m->cap * (sizeof(name##_Entry) + 1);                                     \
+  }                                                                                              \
+                                                                                                 \
+  /* Return the index of key's slot, or -1 */                                                    \
+  static inline ssize_t name##__find(name *m, key_t key, uint64_t h) {                           \
+    if (!m->cap) return -1;                                                                      \
+    size_t mask = m->cap / RMUTIL_HM_GROUP - 1, g = (h >> 7) & mask;                             \
+    int8_t h2 = h & 0x7f;                                                                        \
+    for (size_t i = 1;; i++) {                                                                   \
+      const int8_t *ctrl = m->ctrl + g * RMUTIL_HM_GROUP;                                        \
+      for (uint32_t bits = __rmutil_hm_match(ctrl, h2); bits; bits &= bits - 1) {                \
+        size_t idx = g * RMUTIL_HM_GROUP + __builtin_ctz(bits);                                  \
+        if (eqfn(m->slots[idx].key, key)) return idx;                                            \
+      }                                                                                          \
+      if (__rmutil_hm_matchEmpty(ctrl)) return -1;                                               \
+      g = (g + i) & mask;                                                                        \
+    }                                                                                            \
+  }                                                                                              \
+                                                                                                 \
+  /* Return the index of the first free slot on h's probe sequence */                            \
+  static inline size_t name##__findFree(name *m, uint64_t h) {                                   \
+    size_t mask = m->cap / RMUTIL_HM_GROUP - 1, g = (h >> 7) & mask;                             \
+    for (size_t i = 1;; i++) {                                                                   \
+      uint32_t bits = __rmutil_hm_matchFree(m->ctrl + g * RMUTIL_HM_GROUP);                      \
+      if (bits) return g * RMUTIL_HM_GROUP + __builtin_ctz(bits);                                \
+      g = (g + i) & mask;                                                                        \
+    }                                                                                            \
+  }                                                                                              \
+                                                                                                 \
+  /* Move all the elements to a new table of cap slots, dropping DELETED markers */              \
+  static inline void name##__rehash(name *m, size_t cap) {                                       \
+    name old = *m;                                                                               \
+    name##__alloc(m, cap);                                                                       \
+    for (size_t i = 0; i < old.cap; i++) {                                                       \
+      if (old.ctrl[i] < 0) continue;                                                             \
+      uint64_t h = hashfn(old.slots[i].key);                                                     \
+      size_t idx = name##__findFree(m, h);                                                       \
+      m->ctrl[idx] = h & 0x7f;                                                                   \
+      m->slots[idx] = old.slots[i];                                                              \
+    }                                                                                            \
+    m->growthLeft -= m->size;                                                                    \
+    free(old.slots);                                                                             \
+  }                                                                                              \
+                                                                                                 \
+  /* Make room for at least n elements */                                                        \
+  static inline void name##_Reserve(name *m, size_t n) {                                         \
+    size_t cap = __rmutil_hm_capacityFor(n);                                                     \
+    if (cap > m->cap) name##__rehash(m, cap);                                                    \
+  }                                                                                              \
+                                                                                                 \
+  /* Return a pointer to key's value, or NULL if it's not in the map */                          \
+  static inline val_t *name##_Get(name *m, key_t key) {                                          \
+    ssize_t idx = name##__find(m, key, hashfn(key));                                             \
+    return idx < 0 ? NULL : &m->slots[idx].val;                                                  \
+  }                                                                                              \
+                                                                                                 \
+  /* Return a pointer to key's value, adding key if it's not in the map. *inserted tells which  \
+   * happened; a new value is left uninitialized for the caller to set */                        \
+  static inline val_t *name##_Insert(name *m, key_t key, int *inserted) {                        \
+    uint64_t h = hashfn(key);                                                                    \
+    ssize_t found = name##__find(m, key, h);                                                     \
+    if (found >= 0) {                                                                            \
+      if (inserted) *inserted = 0;                                                               \
+      return &m->slots[found].val;                                                               \
+    }                                                                                            \
+    size_t idx = m->cap ? name##__findFree(m, h) : 0;                                            \
+    if (!m->cap || (m->ctrl[idx] == RMUTIL_HM_EMPTY && m->growthLeft == 0)) {                    \
+      /* mostly DELETED markers: clean up in place, otherwise grow */                            \
+      size_t cap = !m->cap ? RMUTIL_HM_GROUP                                                     \
+                           : m->size < (m->cap - m->cap / 8) / 2 ? m->cap : m->cap * 2;          \
+      name##__rehash(m, cap);                                                                    \
+      idx = name##__findFree(m, h);                                                              \
+    }                                                                                            \
+    if (m->ctrl[idx] == RMUTIL_HM_EMPTY) m->growthLeft--;                                        \
+    m->ctrl[idx] = h & 0x7f;                                                                     \
+    m->slots[idx].key = key;                                                                     \
+    m->size++;                                                                                   \
+    if (inserted) *inserted = 1;                                                                 \
+    return &m->slots[idx].val;                                                                   \
+  }                                                                                              \
+                                                                                                 \
+  /* Set key to val, adding it if needed. Returns a pointer to the stored value */               \
+  static inline val_t *name##_Put(name *m, key_t key, val_t val) {                               \
+    val_t *v = name##_Insert(m, key, NULL);                                                      \
+    *v = val;                                                                                    \
+    return v;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  /* Remove key, storing the removed key and value if oldkey / oldval are not NULL. Returns 1 if \
+   * the key was found */                                                                        \
+  static inline int name##_Del(name *m, key_t key, key_t *oldkey, val_t *oldval) {               \
+    ssize_t idx = name##__find(m, key, hashfn(key));                                             \
+    if (idx < 0) return 0;                                                                       \
+    if (oldkey) *oldkey = m->slots[idx].key;                                                     \
+    if (oldval) *oldval = m->slots[idx].val;                                                     \
+    /* probes stop at a group with an EMPTY slot, so if this group has one, no probe sequence   \
+     * goes through it and the slot can be EMPTY again */                                        \
+    if (__rmutil_hm_matchEmpty(m->ctrl + idx / RMUTIL_HM_GROUP * RMUTIL_HM_GROUP)) {             \
+      m->ctrl[idx] = RMUTIL_HM_EMPTY;                                                            \
+      m->growthLeft++;                                                                           \
+    } else {                                                                                     \
+      m->ctrl[idx] = RMUTIL_HM_DELETED;                                                          \
+    }                                                                                            \
+    m->size--;                                                                                   \
+    return 1;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  /* Remove all elements, keeping the capacity */                                                \
+  static inline void name##_Clear(name *m) {                                                     \
+    if (!m->cap) return;                                                                         \
+    memset(m->ctrl, RMUTIL_HM_EMPTY, m->cap);                                                    \
+    m->size = 0;                                                                                 \
+    m->growthLeft = m->cap - m->cap / 8;                                                         \
+  }                                                                                              \
+                                                                                                 \
+  /* Iterate over the map: start with *iter = 0, and call until it returns 0. key and val may be \
+   * NULL. The map must not be modified while iterating, except for deleting the current key */ \
+  static inline int name##_Next(name *m, size_t *iter, key_t *key, val_t **val) {                \
+    for (; *iter < m->cap; (*iter)++) {                                                          \
+      if (m->ctrl[*iter] < 0) continue;                                                          \
+      if (key) *key = m->slots[*iter].key;                                                       \
+      if (val) *val = &m->slots[*iter].val;                                                      \
+      (*iter)++;                                                                                 \
+      return 1;                                                                                  \
+    }                                                                                            \
+    return 0;                                                                                    \
+  }
+
+/** RMUTIL_INCHASHMAP_DEFINE(name, key_t, val_t, hash, eq) defines an incrementally rehashing
+ * variant of the same map, for tables too big to rehash in one go without stalling the server.
+ *
+ * When the table needs to grow, a new one of twice the size is allocated, and the elements are
+ * migrated to it a few groups at a time: RMUTIL_INCHASHMAP_STEP_GROUPS groups on every insertion
+ * and deletion, and as much as the caller wants from name_RehashStep / name_RehashFor, e.g. from an
+ * idle timer. Meanwhile lookups check both tables. Lookups never migrate, so iterating while
+ * looking up is fine, but the map must not be modified during an iteration.
+ *
+ * A periodic timer (periodic.h) can move migration forward in the background:
+ *
+ *    void rehashTick(RedisModuleCtx *ctx, void *p) {
+ *      RedisModule_ThreadSafeContextLock(ctx);
+ *      if (BigMap_IsRehashing(p)) BigMap_RehashFor(p, 1000);
+ *      RedisModule_ThreadSafeContextUnlock(ctx);
+ *    }
+ */
+
+#define RMUTIL_INCHASHMAP_STEP_GROUPS 4
+
+#define RMUTIL_INCHASHMAP_DEFINE(name, key_t, val_t, hashfn, eqfn)                               \
+  RMUTIL_HASHMAP_DEFINE(name##_Table, key_t, val_t, hashfn, eqfn)                                \
+                                                                                                 \
+  typedef struct {                                                                               \
+    name##_Table cur;                                                                            \
+    /* the table being migrated from, with cap 0 when not rehashing */                           \
+    name##_Table old;                                                                            \
+    /* index of the next slot of old to migrate */                                               \
+    size_t cursor;                                                                               \
+  } name;                                                                                        \
+                                                                                                 \
+  static inline name *name##_New(size_t cap) {                                                   \
+    name *m = calloc(1, sizeof(*m));                                                             \
+    if (cap) name##_Table__alloc(&m->cur, __rmutil_hm_capacityFor(cap));                         \
+    return m;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  static inline void name##_Free(name *m) {                                                      \
+    free(m->cur.slots);                                                                          \
+    free(m->old.slots);                                                                          \
+    free(m);                                                                                     \
+  }                                                                                              \
+                                                                                                 \
+  static inline size_t name##_Size(name *m) {                                                    \
+    return m->cur.size + m->old.size;                                                            \
+  }                                                                                              \
+                                                                                                 \
+  static inline size_t name##_MemUsage(name *m) {                                                \
+    return sizeof(*m) + (m->cur.cap + m->old.cap) * (sizeof(name##_Table_Entry) + 1);            \
+  }                                                                                              \
+                                                                                                 \
+  static inline int name##_IsRehashing(name *m) {                                                \
+    return m->old.cap != 0;                                                                      \
+  }                                                                                              \
+                                                                                                 \
+  /* Fraction of the old table migrated so far, 1 when not rehashing */                          \
+  static inline double name##_RehashProgress(name *m) {                                          \
+    return m->old.cap ? (double)m->cursor / m->old.cap : 1;                                      \
+  }                                                                                              \
+                                                                                                 \
+  /* Migrate up to groups groups of the old table. Returns 1 if there is more to migrate */      \
+  static inline int name##_RehashStep(name *m, size_t groups) {                                  \
+    if (!m->old.cap) return 0;                                                                   \
+    size_t end = m->cursor + groups * RMUTIL_HM_GROUP;                                           \
+    if (end > m->old.cap) end = m->old.cap;                                                      \
+    for (; m->cursor < end; m->cursor++) {                                                       \
+      if (m->old.ctrl[m->cursor] < 0) continue;                                                  \
+      uint64_t h = hashfn(m->old.slots[m->cursor].key);                                          \
+      size_t idx = name##_Table__findFree(&m->cur, h);                                           \
+      if (m->cur.ctrl[idx] == RMUTIL_HM_EMPTY) m->cur.growthLeft--;                              \
+      m->cur.ctrl[idx] = h & 0x7f;                                                               \
+      m->cur.slots[idx] = m->old.slots[m->cursor];                                               \
+      m->cur.size++;                                                                             \
+      /* keep the probe sequences of the keys still in old intact */                            \
+      m->old.ctrl[m->cursor] = RMUTIL_HM_DELETED;                                                \
+      m->old.size--;                                                                             \
+    }                                                                                            \
+    if (m->cursor < m->old.cap) return 1;                                                        \
+    free(m->old.slots);                                                                          \
+    memset(&m->old, 0, sizeof(m->old));                                                         \
+    m->cursor = 0;                                                                               \
+    return 0;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  /* Migrate for about us microseconds. Returns 1 if there is more to migrate */                 \
+  static inline int name##_RehashFor(name *m, long long us) {                                    \
+    struct timespec ts;                                                                          \
+    clock_gettime(CLOCK_MONOTONIC, &ts);                                                         \
+    long long deadline = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000 + us;                         \
+    while (name##_RehashStep(m, 64)) {                                                           \
+      clock_gettime(CLOCK_MONOTONIC, &ts);                                                       \
+      if (ts.tv_sec * 1000000LL + ts.tv_nsec / 1000 >= deadline) return 1;                       \
+    }                                                                                            \
+    return 0;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  /* Move cur aside and start migrating it to a new table: twice as big, or as big if it's       \
+   * mostly DELETED markers */                                                                   \
+  static inline void name##__startRehash(name *m) {                                              \
+    /* a migration still running when cur fills up is finished first. It can't happen with the  \
+     * default step, which migrates all of old well before cur, twice as big, fills up */       \
+    while (name##_RehashStep(m, m->old.cap / RMUTIL_HM_GROUP))                                   \
+      ;                                                                                          \
+    size_t cap = m->cur.cap * 2;                                                                 \
+    if (!cap) {                                                                                  \
+      cap = RMUTIL_HM_GROUP;                                                                     \
+    } else if (m->cur.size < (m->cur.cap - m->cur.cap / 8) / 2) {                                \
+      cap = m->cur.cap;                                                                          \
+    }                                                                                            \
+    m->old = m->cur;                                                                             \
+    m->cursor = 0;                                                                               \
+    name##_Table__alloc(&m->cur, cap);                                                           \
+    m->cur.size = 0;                                                                             \
+    if (!m->old.cap) memset(&m->old, 0, sizeof(m->old));                                         \
+  }                                                                                              \
+                                                                                                 \
+  static inline val_t *name##_Get(name *m, key_t key) {                                          \
+    uint64_t h = hashfn(key);                                                                    \
+    ssize_t idx = name##_Table__find(&m->cur, key, h);                                           \
+    if (idx >= 0) return &m->cur.slots[idx].val;                                                 \
+    idx = name##_Table__find(&m->old, key, h);                                                   \
+    return idx < 0 ? NULL : &m->old.slots[idx].val;                                              \
+  }                                                                                              \
+                                                                                                 \
+  static inline val_t *name##_Insert(name *m, key_t key, int *inserted) {                        \
+    name##_RehashStep(m, RMUTIL_INCHASHMAP_STEP_GROUPS);                                         \
+    uint64_t h = hashfn(key);                                                                    \
+    ssize_t found = name##_Table__find(&m->cur, key, h);                                         \
+    name##_Table *t = &m->cur;                                                                   \
+    if (found < 0 && m->old.cap) {                                                               \
+      found = name##_Table__find(&m->old, key, h);                                               \
+      t = &m->old;                                                                               \
+    }                                                                                            \
+    if (found >= 0) {                                                                            \
+      if (inserted) *inserted = 0;                                                               \
+      return &t->slots[found].val;                                                               \
+    }                                                                                            \
+    size_t idx = m->cur.cap ? name##_Table__findFree(&m->cur, h) : 0;                            \
+    if (!m->cur.cap || (m->cur.ctrl[idx] == RMUTIL_HM_EMPTY && m->cur.growthLeft == 0)) {        \
+      name##__startRehash(m);                                                                    \
+      idx = name##_Table__findFree(&m->cur, h);                                                  \
+    }                                                                                            \
+    if (m->cur.ctrl[idx] == RMUTIL_HM_EMPTY) m->cur.growthLeft--;                                \
+    m->cur.ctrl[idx] = h & 0x7f;                                                                 \
+    m->cur.slots[idx].key = key;                                                                 \
+    m->cur.size++;                                                                               \
+    if (inserted) *inserted = 1;                                                                 \
+    return &m->cur.slots[idx].val;                                                               \
+  }                                                                                              \
+                                                                                                 \
+  static inline val_t *name##_Put(name *m, key_t key, val_t val) {                               \
+    val_t *v = name##_Insert(m, key, NULL);                                                      \
+    *v = val;                                                                                    \
+    return v;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  static inline int name##_Del(name *m, key_t key, key_t *oldkey, val_t *oldval) {               \
+    name##_RehashStep(m, RMUTIL_INCHASHMAP_STEP_GROUPS);                                         \
+    return name##_Table_Del(&m->cur, key, oldkey, oldval) ||                                     \
+           (m->old.cap && name##_Table_Del(&m->old, key, oldkey, oldval));                       \
+  }                                                                                              \
+                                                                                                 \
+  static inline int name##_Next(name *m, size_t *iter, key_t *key, val_t **val) {                \
+    if (*iter < m->cur.cap) {                                                                    \
+      if (name##_Table_Next(&m->cur, iter, key, val)) return 1;                                  \
+    }                                                                                            \
+    size_t oldIter = *iter - m->cur.cap;                                                         \
+    int rc = m->old.cap && name##_Table_Next(&m->old, &oldIter, key, val);                       \
+    *iter = m->cur.cap + oldIter;                                                                \
+    return rc;                                                                                   \
+  }
+
+#endif
@@ -105,3 +105,10 @@ inline void Heap_Pop(Vector *v, size_t first, size_t last, int (*cmp)(void *, vo
         __sift_down(v, first, last, cmp, first);
     }
 }
+
+
+void Heap_Update(Vector *v, size_t first, size_t last, size_t pos, int (*cmp)(void *, void *)) {
+    // at most one of these moves it: if it goes up, pos gets its former parent which is in heap-order
+    __sift_up(v, first, pos + 1, cmp);
+    __sift_down(v, first, last, cmp, pos);
+}
@@ -35,4 +35,11 @@ void Heap_Push(Vector *v, size_t first, size_t last, int (*cmp)(void *, void *))
  */
 void Heap_Pop(Vector *v, size_t first, size_t last, int (*cmp)(void *, void *));
 
+
+/* Update element in heap range
+ * Given a heap in the range [first,last) whose element at pos was modified in place, restores the properties of the
+ * heap by moving that element up or down to its new location.
+ */
+void Heap_Update(Vector *v, size_t first, size_t last, size_t pos, int (*cmp)(void *, void *));
+
 #endif //__HEAP_H__
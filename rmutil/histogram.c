@@ -0,0 +1,60 @@
+#include <string.h>
+#include <math.h>
+#include "histogram.h"
+#include "alloc.h"
+
+RMUtilHistogram *RMUtilHistogram_New() {
+  return calloc(1, sizeof(RMUtilHistogram));
+}
+
+void RMUtilHistogram_Reset(RMUtilHistogram *h) {
+  memset(h, 0, sizeof(*h));
+}
+
+/* The middle of the value range a bucket covers */
+static uint64_t histogram_bucketValue(int idx) {
+  if (idx < RMUTIL_HISTOGRAM_SUB_BUCKETS) return idx;
+  int shift = idx / RMUTIL_HISTOGRAM_SUB_BUCKETS - 1;
+  uint64_t low = (uint64_t)(idx % RMUTIL_HISTOGRAM_SUB_BUCKETS + RMUTIL_HISTOGRAM_SUB_BUCKETS)
+                 << shift;
+  return low + ((1ULL << shift) >> 1);
+}
+
+uint64_t RMUtilHistogram_Percentile(const RMUtilHistogram *h, double p) {
+  if (h->count == 0) return 0;
+  if (p <= 0) return h->min;
+  if (p >= 100) return h->max;
+
+  uint64_t rank = (uint64_t)ceil(p / 100.0 * h->count);
+  uint64_t seen = 0;
+  for (int i = 0; i < RMUTIL_HISTOGRAM_NUM_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= rank) {
+      uint64_t v = histogram_bucketValue(i);
+      // the extremes are known exactly, never report past them
+      if (v < h->min) return h->min;
+      if (v > h->max) return h->max;
+      return v;
+    }
+  }
+  return h->max;
+}
+
+double RMUtilHistogram_Mean(const RMUtilHistogram *h) {
+  return h->count ? (double)h->sum / h->count : 0;
+}
+
+void RMUtilHistogram_Merge(RMUtilHistogram *dst, const RMUtilHistogram *src) {
+  if (src->count == 0) return;
+  for (int i = 0; i < RMUTIL_HISTOGRAM_NUM_BUCKETS; i++) {
+    dst->buckets[i] += src->buckets[i];
+  }
+  if (dst->count == 0 || src->min < dst->min) dst->min = src->min;
+  if (src->max > dst->max) dst->max = src->max;
+  dst->count += src->count;
+  dst->sum += src->sum;
+}
+
+void RMUtilHistogram_Free(RMUtilHistogram *h) {
+  free(h);
+}
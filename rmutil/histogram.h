@@ -0,0 +1,64 @@
+#ifndef __RMUTIL_HISTOGRAM_H__
+#define __RMUTIL_HISTOGRAM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** histogram.h - HDR-style log-bucketed histogram of unsigned 64 bit values.
+ *
+ * Every power of two range is split into RMUTIL_HISTOGRAM_SUB_BUCKETS linear sub-buckets, so any
+ * recorded value is reported back with a relative error below 1/RMUTIL_HISTOGRAM_SUB_BUCKETS
+ * (about 6%). Values below RMUTIL_HISTOGRAM_SUB_BUCKETS are recorded exactly. Recording a value is
+ * a couple of shifts and an increment, making it cheap enough to sit on every command call.
+ * A histogram is not thread safe, each thread should record into its own and merge them.
+ */
+
+#define RMUTIL_HISTOGRAM_SUB_BITS 4
+#define RMUTIL_HISTOGRAM_SUB_BUCKETS (1 << RMUTIL_HISTOGRAM_SUB_BITS)
+#define RMUTIL_HISTOGRAM_NUM_BUCKETS \
+  ((64 - RMUTIL_HISTOGRAM_SUB_BITS + 1) * RMUTIL_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t sum;
+  uint64_t buckets[RMUTIL_HISTOGRAM_NUM_BUCKETS];
+} RMUtilHistogram;
+
+/* Allocate a new, empty histogram */
+RMUtilHistogram *RMUtilHistogram_New();
+
+/* Clear all the recorded values */
+void RMUtilHistogram_Reset(RMUtilHistogram *h);
+
+static inline int __rmutil_histogram_Bucket(uint64_t v) {
+  if (v < RMUTIL_HISTOGRAM_SUB_BUCKETS) return (int)v;
+  int msb = 63 - __builtin_clzll(v);
+  int shift = msb - RMUTIL_HISTOGRAM_SUB_BITS;
+  return (shift + 1) * RMUTIL_HISTOGRAM_SUB_BUCKETS +
+         (int)((v >> shift) - RMUTIL_HISTOGRAM_SUB_BUCKETS);
+}
+
+/* Record a single value */
+static inline void RMUtilHistogram_Add(RMUtilHistogram *h, uint64_t v) {
+  h->buckets[__rmutil_histogram_Bucket(v)]++;
+  if (h->count == 0 || v < h->min) h->min = v;
+  if (v > h->max) h->max = v;
+  h->count++;
+  h->sum += v;
+}
+
+/* Return the value at percentile p (0-100), or 0 if the histogram is empty */
+uint64_t RMUtilHistogram_Percentile(const RMUtilHistogram *h, double p);
+
+/* Return the mean of the recorded values */
+double RMUtilHistogram_Mean(const RMUtilHistogram *h);
+
+/* Add all the values recorded in src to dst */
+void RMUtilHistogram_Merge(RMUtilHistogram *dst, const RMUtilHistogram *src);
+
+/* Free a histogram */
+void RMUtilHistogram_Free(RMUtilHistogram *h);
+
+#endif
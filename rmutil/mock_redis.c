@@ -0,0 +1,1947 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#define REDISMODULE_SDK_RLEC
+#include "mock_redis.h"
+
+/* The mock host implements the API functions below as mock_<Name>, and hands them to modules
+ * through mock_GetApi. Nothing here uses the RedisModule_* function pointers themselves, so the
+ * host works no matter which translation unit defines them. */
+
+struct RedisModuleString {
+  int refcount;
+  size_t len;
+  char buf[];  // always NULL terminated
+};
+
+/***************************************************************************************************
+ * A minimal chained hash table, used for the keyspace, hash values and the command table
+ **************************************************************************************************/
+
+typedef struct mockDictEntry {
+  struct mockDictEntry *next;
+  uint64_t hash;
+  void *val;
+  size_t len;
+  char key[];
+} mockDictEntry;
+
+typedef struct {
+  mockDictEntry **buckets;
+  size_t size;  // always a power of two
+  size_t count;
+} mockDict;
+
+typedef void (*mockDictFreeFunc)(void *val);
+
+static uint64_t mockHash(const char *s, size_t len) {
+  // FNV-1a
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static mockDict *mockDict_New() {
+  mockDict *d = malloc(sizeof(*d));
+  d->size = 16;
+  d->count = 0;
+  d->buckets = calloc(d->size, sizeof(mockDictEntry *));
+  return d;
+}
+
+static mockDictEntry *mockDict_Find(mockDict *d, const char *key, size_t len) {
+  uint64_t h = mockHash(key, len);
+  for (mockDictEntry *e = d->buckets[h & (d->size - 1)]; e; e = e->next) {
+    if (e->hash == h && e->len == len && !memcmp(e->key, key, len)) return e;
+  }
+  return NULL;
+}
+
+static void mockDict_Grow(mockDict *d) {
+  size_t newsize = d->size * 2;
+  mockDictEntry **buckets = calloc(newsize, sizeof(mockDictEntry *));
+  for (size_t i = 0; i < d->size; i++) {
+    mockDictEntry *e = d->buckets[i];
+    while (e) {
+      mockDictEntry *next = e->next;
+      e->next = buckets[e->hash & (newsize - 1)];
+      buckets[e->hash & (newsize - 1)] = e;
+      e = next;
+    }
+  }
+  free(d->buckets);
+  d->buckets = buckets;
+  d->size = newsize;
+}
+
+/* Return the entry for key, creating it with a NULL value if it does not exist */
+static mockDictEntry *mockDict_FindOrAdd(mockDict *d, const char *key, size_t len, int *created) {
+  mockDictEntry *e = mockDict_Find(d, key, len);
+  if (created) *created = e == NULL;
+  if (e) return e;
+
+  if (d->count >= d->size) mockDict_Grow(d);
+  e = malloc(sizeof(*e) + len);
+  e->hash = mockHash(key, len);
+  e->len = len;
+  e->val = NULL;
+  memcpy(e->key, key, len);
+  e->next = d->buckets[e->hash & (d->size - 1)];
+  d->buckets[e->hash & (d->size - 1)] = e;
+  d->count++;
+  return e;
+}
+
+static int mockDict_Delete(mockDict *d, const char *key, size_t len, mockDictFreeFunc freeval) {
+  uint64_t h = mockHash(key, len);
+  mockDictEntry **pe = &d->buckets[h & (d->size - 1)];
+  for (; *pe; pe = &(*pe)->next) {
+    mockDictEntry *e = *pe;
+    if (e->hash == h && e->len == len && !memcmp(e->key, key, len)) {
+      *pe = e->next;
+      if (freeval) freeval(e->val);
+      free(e);
+      d->count--;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void mockDict_Clear(mockDict *d, mockDictFreeFunc freeval) {
+  for (size_t i = 0; i < d->size; i++) {
+    mockDictEntry *e = d->buckets[i];
+    while (e) {
+      mockDictEntry *next = e->next;
+      if (freeval) freeval(e->val);
+      free(e);
+      e = next;
+    }
+    d->buckets[i] = NULL;
+  }
+  d->count = 0;
+}
+
+static void mockDict_Free(mockDict *d, mockDictFreeFunc freeval) {
+  mockDict_Clear(d, freeval);
+  free(d->buckets);
+  free(d);
+}
+
+/***************************************************************************************************
+ * Host state
+ **************************************************************************************************/
+
+struct RedisModuleType {
+  char name[10];
+  int encver;
+  RedisModuleTypeMethods methods;
+};
+
+/* A value in the keyspace */
+typedef struct {
+  int type;
+  int swapped;  // on swap rather than in RAM
+  union {
+    RedisModuleString *str;
+    mockDict *hash;
+    struct {
+      RedisModuleType *mt;
+      void *value;
+    } module;
+  };
+} mockValue;
+
+typedef struct {
+  RedisModuleCmdFunc func;
+  char *name;
+} mockCommand;
+
+struct RedisModuleKey {
+  RedisModuleCtx *ctx;
+  RedisModuleString *name;
+  int mode;
+};
+
+struct RedisModuleCallReply {
+  int type;
+  int nested;           // owned by its parent array, FreeCallReply is a no-op
+  RedisModuleCtx *ctx;  // set if tracked by the auto memory of a context
+  long long integer;
+  double d;
+  char *str;
+  size_t len;     // string length, or number of array elements
+  long expected;  // declared array length, REDISMODULE_POSTPONED_LEN until set
+  struct RedisModuleCallReply **elements;
+  size_t cap;
+};
+
+#define MOCK_AM_STRING 1
+#define MOCK_AM_KEY 2
+#define MOCK_AM_REPLY 3
+
+#define MOCK_CTX_AUTO_MEMORY 0x01
+
+struct RedisModuleCtx {
+  void *getapifuncptr;  // must be first, RedisModule_Init reads it
+  int flags;
+  mockCommand *cmd;
+
+  // auto memory pool
+  struct {
+    int type;
+    void *ptr;
+  } * am;
+  size_t amlen, amcap;
+
+  // the reply being built: top level replies are appended to root, nested ones to the innermost
+  // array that is still open
+  RedisModuleCallReply root;
+  RedisModuleCallReply **open;
+  size_t depth, opencap;
+
+  void *blockedPrivdata;  // in the callbacks of a blocked client
+};
+
+struct RedisModuleBlockedClient {
+  RedisModuleCmdFunc reply;
+  RedisModuleCmdFunc timeout;
+  long long timeoutMs;
+  void (*freePrivdata)(RedisModuleCtx *, void *);
+  RedisModuleDisconnectFunc disconnected;
+  void *privdata;
+  int gone;       // disconnected or timed out, nothing is replied once it's unblocked
+  int unblocked;  // set by RedisModule_UnblockClient, from any thread
+};
+
+/* A timer, fired by the first iteration of the event loop once it's due */
+typedef struct {
+  RedisModuleTimerID id;
+  uint64_t when;  // monotonic microseconds
+  RedisModuleTimerProc cb;
+  void *data;
+} mockTimer;
+
+/* A file descriptor watched by the event loop */
+typedef struct {
+  int fd;
+  int mask;
+  RedisModuleEventLoopFunc func;
+  void *data;
+} mockFileEvent;
+
+/* A key prefetch waiting for the next iteration of the event loop */
+typedef struct {
+  RedisModuleString *key;
+  RedisModuleSwapPrefetchCB fn;
+  void *data;
+} mockPrefetch;
+
+static struct {
+  int initialized;
+  mockDict *keyspace;
+  mockDict *commands;
+
+  // the clients still blocked, unblocked ones are handled by the event loop. lock guards the
+  // unblocked flag and private data of all of them
+  RedisModuleBlockedClient **blocked;
+  size_t numBlocked, blockedCap;
+  pthread_mutex_t lock;
+  pthread_mutex_t gil;  // locked by thread safe contexts
+  // replies sent to clients once unblocked, not yet popped
+  RedisModuleCallReply **replies;
+  size_t numReplies, repliesCap;
+
+  mockPrefetch *prefetches;
+  size_t numPrefetches, prefetchesCap;
+
+  char *moduleName;  // of the module being loaded
+  struct {
+    char *module;
+    RedisModuleInfoFunc cb;
+  } * infoFuncs;
+  size_t numInfoFuncs;
+  mockDict *latency;  // event name -> number of samples
+
+  mockTimer *timers;
+  size_t numTimers, timersCap;
+  RedisModuleTimerID nextTimerId;
+  size_t yields;
+  int contextFlags;
+
+  mockFileEvent *fileEvents;
+  size_t numFileEvents, fileEventsCap;
+  // the forked child, only one at a time like redis
+  pid_t childPid;
+  RedisModuleForkDoneHandler childDone;
+  void *childData;
+} mockHost = {.lock = PTHREAD_MUTEX_INITIALIZER, .gil = PTHREAD_MUTEX_INITIALIZER};
+
+static int mock_GetApi(const char *name, void *pp);
+static void mock_FreeCallReply(RedisModuleCallReply *r);
+static void mock_CloseKey(RedisModuleKey *key);
+static uint64_t mock_MonotonicMicroseconds(void);
+
+static void mock_ctxInit(RedisModuleCtx *ctx, mockCommand *cmd) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->getapifuncptr = (void *)(unsigned long)mock_GetApi;
+  ctx->cmd = cmd;
+  ctx->root.type = REDISMODULE_REPLY_ARRAY;
+  ctx->root.expected = REDISMODULE_POSTPONED_LEN;
+}
+
+/***************************************************************************************************
+ * Memory and auto memory
+ **************************************************************************************************/
+
+static void *mock_Alloc(size_t bytes) {
+  return malloc(bytes);
+}
+
+static void *mock_Calloc(size_t nmemb, size_t size) {
+  return calloc(nmemb, size);
+}
+
+static void *mock_Realloc(void *ptr, size_t bytes) {
+  return realloc(ptr, bytes);
+}
+
+static void mock_Free(void *ptr) {
+  free(ptr);
+}
+
+static char *mock_Strdup(const char *str) {
+  return strdup(str);
+}
+
+static void mock_AutoMemory(RedisModuleCtx *ctx) {
+  ctx->flags |= MOCK_CTX_AUTO_MEMORY;
+}
+
+static void mock_amAdd(RedisModuleCtx *ctx, int type, void *ptr) {
+  if (ctx == NULL || !(ctx->flags & MOCK_CTX_AUTO_MEMORY)) return;
+  if (ctx->amlen == ctx->amcap) {
+    ctx->amcap = ctx->amcap ? ctx->amcap * 2 : 16;
+    ctx->am = realloc(ctx->am, ctx->amcap * sizeof(*ctx->am));
+  }
+  ctx->am[ctx->amlen].type = type;
+  ctx->am[ctx->amlen].ptr = ptr;
+  ctx->amlen++;
+}
+
+/* Stop tracking ptr, most recently created objects are the most likely to be released */
+static void mock_amRemove(RedisModuleCtx *ctx, void *ptr) {
+  if (ctx == NULL || !(ctx->flags & MOCK_CTX_AUTO_MEMORY)) return;
+  for (size_t i = ctx->amlen; i > 0; i--) {
+    if (ctx->am[i - 1].ptr == ptr) {
+      ctx->am[i - 1].ptr = NULL;
+      return;
+    }
+  }
+}
+
+static void mock_decrRefCount(RedisModuleString *s) {
+  if (s && --s->refcount == 0) free(s);
+}
+
+static void mock_amRelease(RedisModuleCtx *ctx) {
+  // clear the flag first so releasing objects does not touch the pool
+  ctx->flags &= ~MOCK_CTX_AUTO_MEMORY;
+  for (size_t i = 0; i < ctx->amlen; i++) {
+    void *ptr = ctx->am[i].ptr;
+    if (ptr == NULL) continue;
+    switch (ctx->am[i].type) {
+      case MOCK_AM_STRING:
+        mock_decrRefCount(ptr);
+        break;
+      case MOCK_AM_KEY:
+        mock_CloseKey(ptr);
+        break;
+      case MOCK_AM_REPLY:
+        ((RedisModuleCallReply *)ptr)->ctx = NULL;
+        mock_FreeCallReply(ptr);
+        break;
+    }
+  }
+  free(ctx->am);
+  ctx->am = NULL;
+  ctx->amlen = ctx->amcap = 0;
+}
+
+/***************************************************************************************************
+ * Strings
+ **************************************************************************************************/
+
+static RedisModuleString *mock_newString(const char *ptr, size_t len) {
+  RedisModuleString *s = malloc(sizeof(*s) + len + 1);
+  s->refcount = 1;
+  s->len = len;
+  if (ptr) memcpy(s->buf, ptr, len);
+  s->buf[len] = '\0';
+  return s;
+}
+
+static RedisModuleString *mock_CreateString(RedisModuleCtx *ctx, const char *ptr, size_t len) {
+  RedisModuleString *s = mock_newString(ptr, len);
+  mock_amAdd(ctx, MOCK_AM_STRING, s);
+  return s;
+}
+
+static RedisModuleString *mock_CreateStringFromLongLong(RedisModuleCtx *ctx, long long ll) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%lld", ll);
+  return mock_CreateString(ctx, buf, len);
+}
+
+static RedisModuleString *mock_CreateStringFromDouble(RedisModuleCtx *ctx, double d) {
+  char buf[64];
+  int len = snprintf(buf, sizeof(buf), "%.17g", d);
+  return mock_CreateString(ctx, buf, len);
+}
+
+static RedisModuleString *mock_CreateStringPrintf(RedisModuleCtx *ctx, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+
+  RedisModuleString *s = mock_CreateString(ctx, NULL, len);
+  va_start(ap, fmt);
+  vsnprintf(s->buf, len + 1, fmt, ap);
+  va_end(ap);
+  return s;
+}
+
+static RedisModuleString *mock_CreateStringFromString(RedisModuleCtx *ctx,
+                                                      const RedisModuleString *str) {
+  return mock_CreateString(ctx, str->buf, str->len);
+}
+
+static void mock_FreeString(RedisModuleCtx *ctx, RedisModuleString *str) {
+  mock_amRemove(ctx, str);
+  mock_decrRefCount(str);
+}
+
+static void mock_RetainString(RedisModuleCtx *ctx, RedisModuleString *str) {
+  str->refcount++;
+}
+
+static const char *mock_StringPtrLen(const RedisModuleString *str, size_t *len) {
+  if (str == NULL) {
+    if (len) *len = 0;
+    return NULL;
+  }
+  if (len) *len = str->len;
+  return str->buf;
+}
+
+static int mock_StringToLongLong(const RedisModuleString *str, long long *ll) {
+  if (str->len == 0 || isspace((unsigned char)str->buf[0])) return REDISMODULE_ERR;
+  char *end;
+  errno = 0;
+  long long v = strtoll(str->buf, &end, 10);
+  if (errno || end != str->buf + str->len) return REDISMODULE_ERR;
+  *ll = v;
+  return REDISMODULE_OK;
+}
+
+static int mock_StringToDouble(const RedisModuleString *str, double *d) {
+  if (str->len == 0 || isspace((unsigned char)str->buf[0])) return REDISMODULE_ERR;
+  char *end;
+  errno = 0;
+  double v = strtod(str->buf, &end);
+  if (errno == ERANGE || isnan(v) || end != str->buf + str->len) return REDISMODULE_ERR;
+  *d = v;
+  return REDISMODULE_OK;
+}
+
+static int mock_StringCompare(const RedisModuleString *a, const RedisModuleString *b) {
+  size_t minlen = a->len < b->len ? a->len : b->len;
+  int cmp = memcmp(a->buf, b->buf, minlen);
+  if (cmp) return cmp;
+  return a->len < b->len ? -1 : a->len > b->len;
+}
+
+/***************************************************************************************************
+ * Keys
+ **************************************************************************************************/
+
+static void mock_freeValue(void *p) {
+  mockValue *v = p;
+  switch (v->type) {
+    case REDISMODULE_KEYTYPE_STRING:
+      mock_decrRefCount(v->str);
+      break;
+    case REDISMODULE_KEYTYPE_HASH:
+      mockDict_Free(v->hash, (mockDictFreeFunc)mock_decrRefCount);
+      break;
+    case REDISMODULE_KEYTYPE_MODULE:
+      if (v->module.mt->methods.free) v->module.mt->methods.free(v->module.value);
+      break;
+  }
+  free(v);
+}
+
+static mockValue *mock_lookup(RedisModuleString *name) {
+  mockDictEntry *e = mockDict_Find(mockHost.keyspace, name->buf, name->len);
+  return e ? e->val : NULL;
+}
+
+/* Replace the value of a key with a new, empty value of the given type */
+static mockValue *mock_setValue(RedisModuleString *name, int type) {
+  mockDictEntry *e = mockDict_FindOrAdd(mockHost.keyspace, name->buf, name->len, NULL);
+  if (e->val) mock_freeValue(e->val);
+  mockValue *v = calloc(1, sizeof(*v));
+  v->type = type;
+  e->val = v;
+  return v;
+}
+
+static RedisModuleKey *mock_OpenKey(RedisModuleCtx *ctx, RedisModuleString *keyname, int mode) {
+  // like redis, opening a missing key for reading only returns NULL
+  if (!(mode & REDISMODULE_WRITE) && mock_lookup(keyname) == NULL) return NULL;
+
+  RedisModuleKey *key = malloc(sizeof(*key));
+  key->ctx = ctx;
+  key->mode = mode;
+  key->name = keyname;
+  keyname->refcount++;
+  mock_amAdd(ctx, MOCK_AM_KEY, key);
+  return key;
+}
+
+static void mock_CloseKey(RedisModuleKey *key) {
+  if (key == NULL) return;
+  mock_amRemove(key->ctx, key);
+  mock_decrRefCount(key->name);
+  free(key);
+}
+
+static int mock_KeyType(RedisModuleKey *key) {
+  if (key == NULL) return REDISMODULE_KEYTYPE_EMPTY;
+  mockValue *v = mock_lookup(key->name);
+  return v ? v->type : REDISMODULE_KEYTYPE_EMPTY;
+}
+
+static int mock_DeleteKey(RedisModuleKey *key) {
+  if (!(key->mode & REDISMODULE_WRITE)) return REDISMODULE_ERR;
+  mockDict_Delete(mockHost.keyspace, key->name->buf, key->name->len, mock_freeValue);
+  return REDISMODULE_OK;
+}
+
+static size_t mock_ValueLength(RedisModuleKey *key) {
+  mockValue *v = key ? mock_lookup(key->name) : NULL;
+  if (v == NULL) return 0;
+  switch (v->type) {
+    case REDISMODULE_KEYTYPE_STRING:
+      return v->str->len;
+    case REDISMODULE_KEYTYPE_HASH:
+      return v->hash->count;
+  }
+  return 0;
+}
+
+static int mock_StringSet(RedisModuleKey *key, RedisModuleString *str) {
+  if (!(key->mode & REDISMODULE_WRITE)) return REDISMODULE_ERR;
+  mockValue *v = mock_setValue(key->name, REDISMODULE_KEYTYPE_STRING);
+  v->str = mock_newString(str->buf, str->len);
+  return REDISMODULE_OK;
+}
+
+/* Set (or delete, if value is NULL) a single hash field. Returns 1 if the hash was modified */
+static int mock_hashSetField(mockValue *v, const char *field, size_t flen,
+                             RedisModuleString *value, int flags) {
+  if (value == NULL) {
+    return mockDict_Delete(v->hash, field, flen, (mockDictFreeFunc)mock_decrRefCount);
+  }
+  mockDictEntry *e = mockDict_Find(v->hash, field, flen);
+  if ((e && (flags & REDISMODULE_HASH_NX)) || (!e && (flags & REDISMODULE_HASH_XX))) return 0;
+  if (e == NULL) e = mockDict_FindOrAdd(v->hash, field, flen, NULL);
+  mock_decrRefCount(e->val);
+  e->val = mock_newString(value->buf, value->len);
+  return 1;
+}
+
+static int mock_HashSet(RedisModuleKey *key, int flags, ...) {
+  if (!(key->mode & REDISMODULE_WRITE)) return 0;
+  mockValue *v = mock_lookup(key->name);
+  if (v && v->type != REDISMODULE_KEYTYPE_HASH) return 0;
+
+  int updated = 0;
+  va_list ap;
+  va_start(ap, flags);
+  for (;;) {
+    const char *field;
+    size_t flen;
+    if (flags & REDISMODULE_HASH_CFIELDS) {
+      field = va_arg(ap, const char *);
+      if (field == NULL) break;
+      flen = strlen(field);
+    } else {
+      RedisModuleString *f = va_arg(ap, RedisModuleString *);
+      if (f == NULL) break;
+      field = f->buf;
+      flen = f->len;
+    }
+    RedisModuleString *value = va_arg(ap, RedisModuleString *);
+    if (value == REDISMODULE_HASH_DELETE) value = NULL;
+
+    if (v == NULL) {
+      if (value == NULL) continue;
+      v = mock_setValue(key->name, REDISMODULE_KEYTYPE_HASH);
+      v->hash = mockDict_New();
+    }
+    updated += mock_hashSetField(v, field, flen, value, flags);
+  }
+  va_end(ap);
+
+  // like redis, a hash left with no fields is deleted
+  if (v && v->hash->count == 0) {
+    mockDict_Delete(mockHost.keyspace, key->name->buf, key->name->len, mock_freeValue);
+  }
+  return updated;
+}
+
+static int mock_HashGet(RedisModuleKey *key, int flags, ...) {
+  mockValue *v = key ? mock_lookup(key->name) : NULL;
+  if (v && v->type != REDISMODULE_KEYTYPE_HASH) return REDISMODULE_ERR;
+
+  va_list ap;
+  va_start(ap, flags);
+  for (;;) {
+    const char *field;
+    size_t flen;
+    if (flags & REDISMODULE_HASH_CFIELDS) {
+      field = va_arg(ap, const char *);
+      if (field == NULL) break;
+      flen = strlen(field);
+    } else {
+      RedisModuleString *f = va_arg(ap, RedisModuleString *);
+      if (f == NULL) break;
+      field = f->buf;
+      flen = f->len;
+    }
+
+    mockDictEntry *e = v ? mockDict_Find(v->hash, field, flen) : NULL;
+    if (flags & REDISMODULE_HASH_EXISTS) {
+      int *exists = va_arg(ap, int *);
+      *exists = e != NULL;
+    } else {
+      RedisModuleString **out = va_arg(ap, RedisModuleString **);
+      *out = e ? mock_CreateStringFromString(key->ctx, e->val) : NULL;
+    }
+  }
+  va_end(ap);
+  return REDISMODULE_OK;
+}
+
+static RedisModuleType *mock_CreateDataType(RedisModuleCtx *ctx, const char *name, int encver,
+                                            RedisModuleTypeMethods *typemethods) {
+  if (strlen(name) != 9) return NULL;
+  RedisModuleType *mt = calloc(1, sizeof(*mt));
+  memcpy(mt->name, name, 9);
+  mt->encver = encver;
+  mt->methods = *typemethods;
+  return mt;
+}
+
+static int mock_ModuleTypeSetValue(RedisModuleKey *key, RedisModuleType *mt, void *value) {
+  if (!(key->mode & REDISMODULE_WRITE)) return REDISMODULE_ERR;
+  mockValue *v = mock_setValue(key->name, REDISMODULE_KEYTYPE_MODULE);
+  v->module.mt = mt;
+  v->module.value = value;
+  return REDISMODULE_OK;
+}
+
+static RedisModuleType *mock_ModuleTypeGetType(RedisModuleKey *key) {
+  mockValue *v = key ? mock_lookup(key->name) : NULL;
+  return v && v->type == REDISMODULE_KEYTYPE_MODULE ? v->module.mt : NULL;
+}
+
+static void *mock_ModuleTypeGetValue(RedisModuleKey *key) {
+  mockValue *v = key ? mock_lookup(key->name) : NULL;
+  return v && v->type == REDISMODULE_KEYTYPE_MODULE ? v->module.value : NULL;
+}
+
+/***************************************************************************************************
+ * Replies
+ **************************************************************************************************/
+
+static RedisModuleCallReply *mock_newReply(int type) {
+  RedisModuleCallReply *r = calloc(1, sizeof(*r));
+  r->type = type;
+  return r;
+}
+
+static void mock_arrayAppend(RedisModuleCallReply *arr, RedisModuleCallReply *r) {
+  if (arr->len == arr->cap) {
+    arr->cap = arr->cap ? arr->cap * 2 : 4;
+    arr->elements = realloc(arr->elements, arr->cap * sizeof(*arr->elements));
+  }
+  arr->elements[arr->len++] = r;
+}
+
+/* Pop all the innermost arrays that got all of their elements */
+static void mock_closeArrays(RedisModuleCtx *ctx) {
+  while (ctx->depth) {
+    RedisModuleCallReply *top = ctx->open[ctx->depth - 1];
+    if (top->expected < 0 || top->len < (size_t)top->expected) break;
+    ctx->depth--;
+  }
+}
+
+static int mock_addReply(RedisModuleCtx *ctx, RedisModuleCallReply *r) {
+  RedisModuleCallReply *parent = ctx->depth ? ctx->open[ctx->depth - 1] : &ctx->root;
+  r->nested = parent != &ctx->root;
+  mock_arrayAppend(parent, r);
+
+  if (r->type == REDISMODULE_REPLY_ARRAY && r->expected != 0) {
+    if (ctx->depth == ctx->opencap) {
+      ctx->opencap = ctx->opencap ? ctx->opencap * 2 : 4;
+      ctx->open = realloc(ctx->open, ctx->opencap * sizeof(*ctx->open));
+    }
+    ctx->open[ctx->depth++] = r;
+  }
+  mock_closeArrays(ctx);
+  return REDISMODULE_OK;
+}
+
+static int mock_replyString(RedisModuleCtx *ctx, int type, const char *buf, size_t len) {
+  RedisModuleCallReply *r = mock_newReply(type);
+  r->str = malloc(len + 1);
+  memcpy(r->str, buf, len);
+  r->str[len] = '\0';
+  r->len = len;
+  return mock_addReply(ctx, r);
+}
+
+static int mock_ReplyWithLongLong(RedisModuleCtx *ctx, long long ll) {
+  RedisModuleCallReply *r = mock_newReply(REDISMODULE_REPLY_INTEGER);
+  r->integer = ll;
+  return mock_addReply(ctx, r);
+}
+
+static int mock_ReplyWithDouble(RedisModuleCtx *ctx, double d) {
+  RedisModuleCallReply *r = mock_newReply(REDISMODULE_REPLY_DOUBLE);
+  r->d = d;
+  return mock_addReply(ctx, r);
+}
+
+static int mock_ReplyWithError(RedisModuleCtx *ctx, const char *err) {
+  mock_replyString(ctx, REDISMODULE_REPLY_ERROR, err, strlen(err));
+  return REDISMODULE_OK;
+}
+
+static int mock_ReplyWithSimpleString(RedisModuleCtx *ctx, const char *msg) {
+  return mock_replyString(ctx, REDISMODULE_REPLY_STRING, msg, strlen(msg));
+}
+
+static int mock_ReplyWithStringBuffer(RedisModuleCtx *ctx, const char *buf, size_t len) {
+  return mock_replyString(ctx, REDISMODULE_REPLY_STRING, buf, len);
+}
+
+static int mock_ReplyWithCString(RedisModuleCtx *ctx, const char *buf) {
+  return mock_replyString(ctx, REDISMODULE_REPLY_STRING, buf, strlen(buf));
+}
+
+static int mock_ReplyWithString(RedisModuleCtx *ctx, RedisModuleString *str) {
+  return mock_replyString(ctx, REDISMODULE_REPLY_STRING, str->buf, str->len);
+}
+
+static int mock_ReplyWithNull(RedisModuleCtx *ctx) {
+  return mock_addReply(ctx, mock_newReply(REDISMODULE_REPLY_NULL));
+}
+
+static int mock_ReplyWithArray(RedisModuleCtx *ctx, long len) {
+  RedisModuleCallReply *r = mock_newReply(REDISMODULE_REPLY_ARRAY);
+  r->expected = len;
+  return mock_addReply(ctx, r);
+}
+
+static void mock_ReplySetArrayLength(RedisModuleCtx *ctx, long len) {
+  // set the length of the most recently postponed array
+  for (size_t i = ctx->depth; i > 0; i--) {
+    if (ctx->open[i - 1]->expected == REDISMODULE_POSTPONED_LEN) {
+      ctx->open[i - 1]->expected = len;
+      break;
+    }
+  }
+  mock_closeArrays(ctx);
+}
+
+static RedisModuleCallReply *mock_copyReply(RedisModuleCallReply *src) {
+  RedisModuleCallReply *r = mock_newReply(src->type);
+  r->integer = src->integer;
+  r->d = src->d;
+  r->expected = src->len;
+  if (src->str) {
+    r->str = malloc(src->len + 1);
+    memcpy(r->str, src->str, src->len + 1);
+    r->len = src->len;
+  }
+  for (size_t i = 0; i < src->len && src->elements; i++) {
+    RedisModuleCallReply *e = mock_copyReply(src->elements[i]);
+    e->nested = 1;
+    mock_arrayAppend(r, e);
+  }
+  return r;
+}
+
+static int mock_ReplyWithCallReply(RedisModuleCtx *ctx, RedisModuleCallReply *reply) {
+  return mock_addReply(ctx, mock_copyReply(reply));
+}
+
+static int mock_WrongArity(RedisModuleCtx *ctx) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "ERR wrong number of arguments for '%s' command",
+           ctx->cmd ? ctx->cmd->name : "");
+  return mock_ReplyWithError(ctx, buf);
+}
+
+static void mock_freeReplyTree(RedisModuleCallReply *r) {
+  for (size_t i = 0; r->elements && i < r->len; i++) {
+    mock_freeReplyTree(r->elements[i]);
+  }
+  free(r->elements);
+  free(r->str);
+  free(r);
+}
+
+static void mock_FreeCallReply(RedisModuleCallReply *r) {
+  if (r == NULL || r->nested) return;
+  mock_amRemove(r->ctx, r);
+  mock_freeReplyTree(r);
+}
+
+static int mock_CallReplyType(RedisModuleCallReply *r) {
+  return r ? r->type : REDISMODULE_REPLY_UNKNOWN;
+}
+
+static size_t mock_CallReplyLength(RedisModuleCallReply *r) {
+  return r ? r->len : 0;
+}
+
+static long long mock_CallReplyInteger(RedisModuleCallReply *r) {
+  return r && r->type == REDISMODULE_REPLY_INTEGER ? r->integer : LLONG_MIN;
+}
+
+static const char *mock_CallReplyStringPtr(RedisModuleCallReply *r, size_t *len) {
+  if (r == NULL || (r->type != REDISMODULE_REPLY_STRING && r->type != REDISMODULE_REPLY_ERROR)) {
+    return NULL;
+  }
+  if (len) *len = r->len;
+  return r->str;
+}
+
+static RedisModuleCallReply *mock_CallReplyArrayElement(RedisModuleCallReply *r, size_t idx) {
+  if (r == NULL || r->type != REDISMODULE_REPLY_ARRAY || idx >= r->len) return NULL;
+  return r->elements[idx];
+}
+
+static RedisModuleString *mock_CreateStringFromCallReply(RedisModuleCallReply *r) {
+  if (r == NULL) return NULL;
+  switch (r->type) {
+    case REDISMODULE_REPLY_STRING:
+    case REDISMODULE_REPLY_ERROR:
+      return mock_CreateString(r->ctx, r->str, r->len);
+    case REDISMODULE_REPLY_INTEGER:
+      return mock_CreateStringFromLongLong(r->ctx, r->integer);
+  }
+  return NULL;
+}
+
+/***************************************************************************************************
+ * Commands
+ **************************************************************************************************/
+
+static mockCommand *mock_lookupCommand(const char *name, size_t len) {
+  char lower[128];
+  if (len >= sizeof(lower)) return NULL;
+  for (size_t i = 0; i < len; i++) lower[i] = tolower((unsigned char)name[i]);
+  mockDictEntry *e = mockDict_Find(mockHost.commands, lower, len);
+  return e ? e->val : NULL;
+}
+
+static int mock_registerCommand(const char *name, RedisModuleCmdFunc func) {
+  size_t len = strlen(name);
+  char lower[128];
+  if (len >= sizeof(lower)) return REDISMODULE_ERR;
+  for (size_t i = 0; i < len; i++) lower[i] = tolower((unsigned char)name[i]);
+
+  int created;
+  mockDictEntry *e = mockDict_FindOrAdd(mockHost.commands, lower, len, &created);
+  if (!created) return REDISMODULE_ERR;
+  mockCommand *cmd = malloc(sizeof(*cmd));
+  cmd->func = func;
+  cmd->name = strndup(lower, len);
+  e->val = cmd;
+  return REDISMODULE_OK;
+}
+
+static int mock_CreateCommand(RedisModuleCtx *ctx, const char *name, RedisModuleCmdFunc cmdfunc,
+                              const char *strflags, int firstkey, int lastkey, int keystep) {
+  return mock_registerCommand(name, cmdfunc);
+}
+
+static void mock_SetModuleAttribs(RedisModuleCtx *ctx, const char *name, int ver, int apiver) {
+  free(mockHost.moduleName);
+  mockHost.moduleName = strdup(name);
+}
+
+/* Release a context once its handler returned, and return the first reply it sent, or NULL if it
+ * replied nothing */
+static RedisModuleCallReply *mock_ctxDone(RedisModuleCtx *ctx) {
+  mock_amRelease(ctx);
+  RedisModuleCallReply *r = NULL;
+  for (size_t i = 0; i < ctx->root.len; i++) {
+    if (i == 0) {
+      r = ctx->root.elements[0];
+    } else {
+      mock_freeReplyTree(ctx->root.elements[i]);
+    }
+  }
+  free(ctx->root.elements);
+  free(ctx->open);
+  return r;
+}
+
+/* Run a command and return its reply, or NULL if it replied nothing */
+static RedisModuleCallReply *mock_execute(RedisModuleString **argv, int argc, int *rc) {
+  mockCommand *cmd = argc ? mock_lookupCommand(argv[0]->buf, argv[0]->len) : NULL;
+  if (cmd == NULL) {
+    if (rc) *rc = REDISMODULE_ERR;
+    RedisModuleCallReply *r = mock_newReply(REDISMODULE_REPLY_ERROR);
+    r->str = strdup("ERR unknown command");
+    r->len = strlen(r->str);
+    return r;
+  }
+
+  RedisModuleCtx ctx;
+  mock_ctxInit(&ctx, cmd);
+  int ret = cmd->func(&ctx, argv, argc);
+  if (rc) *rc = ret;
+  return mock_ctxDone(&ctx);
+}
+
+/* Build an argument vector from a RedisModule_Call style format. Returns the number of arguments,
+ * and sets *owned to a bitmap-like array marking the arguments we created */
+static int mock_buildArgv(const char *cmdname, const char *fmt, va_list ap,
+                          RedisModuleString ***argvp, char **ownedp) {
+  size_t cap = strlen(fmt) + 1, argc = 0;
+  RedisModuleString **argv = malloc(cap * sizeof(*argv));
+  char *owned = malloc(cap);
+
+#define MOCK_PUSH_ARG(s, own)                              \
+  do {                                                     \
+    if (argc == cap) {                                     \
+      cap *= 2;                                            \
+      argv = realloc(argv, cap * sizeof(*argv));           \
+      owned = realloc(owned, cap);                         \
+    }                                                      \
+    argv[argc] = (s);                                      \
+    owned[argc++] = (own);                                 \
+  } while (0)
+
+  MOCK_PUSH_ARG(mock_newString(cmdname, strlen(cmdname)), 1);
+  for (const char *p = fmt; *p; p++) {
+    switch (*p) {
+      case 'c': {
+        const char *c = va_arg(ap, const char *);
+        MOCK_PUSH_ARG(mock_newString(c, strlen(c)), 1);
+        break;
+      }
+      case 'b': {
+        const char *buf = va_arg(ap, const char *);
+        size_t len = va_arg(ap, size_t);
+        MOCK_PUSH_ARG(mock_newString(buf, len), 1);
+        break;
+      }
+      case 'l': {
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%lld", va_arg(ap, long long));
+        MOCK_PUSH_ARG(mock_newString(buf, len), 1);
+        break;
+      }
+      case 's':
+        MOCK_PUSH_ARG(va_arg(ap, RedisModuleString *), 0);
+        break;
+      case 'v': {
+        RedisModuleString **v = va_arg(ap, RedisModuleString **);
+        size_t n = va_arg(ap, size_t);
+        for (size_t i = 0; i < n; i++) MOCK_PUSH_ARG(v[i], 0);
+        break;
+      }
+      default:
+        // call flags ('!', 'A', 'R', '3', etc.) have no meaning here
+        break;
+    }
+  }
+#undef MOCK_PUSH_ARG
+
+  *argvp = argv;
+  *ownedp = owned;
+  return argc;
+}
+
+static RedisModuleCallReply *mock_vcall(RedisModuleCtx *ctx, const char *cmdname, const char *fmt,
+                                        va_list ap) {
+  RedisModuleString **argv;
+  char *owned;
+  int argc = mock_buildArgv(cmdname, fmt, ap, &argv, &owned);
+
+  RedisModuleCallReply *r = mock_execute(argv, argc, NULL);
+  if (r == NULL) r = mock_newReply(REDISMODULE_REPLY_NULL);
+
+  for (int i = 0; i < argc; i++) {
+    if (owned[i]) mock_decrRefCount(argv[i]);
+  }
+  free(argv);
+  free(owned);
+
+  if (ctx && (ctx->flags & MOCK_CTX_AUTO_MEMORY)) {
+    r->ctx = ctx;
+    mock_amAdd(ctx, MOCK_AM_REPLY, r);
+  }
+  return r;
+}
+
+static RedisModuleCallReply *mock_Call(RedisModuleCtx *ctx, const char *cmdname, const char *fmt,
+                                       ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  RedisModuleCallReply *r = mock_vcall(ctx, cmdname, fmt, ap);
+  va_end(ap);
+  return r;
+}
+
+/***************************************************************************************************
+ * AOF rewrite
+ **************************************************************************************************/
+
+struct RedisModuleIO {
+  RedisModuleCallReply *cmds;  // the commands emitted so far
+};
+
+static void mock_EmitAOF(RedisModuleIO *io, const char *cmdname, const char *fmt, ...) {
+  RedisModuleString **argv;
+  char *owned;
+  va_list ap;
+  va_start(ap, fmt);
+  int argc = mock_buildArgv(cmdname, fmt, ap, &argv, &owned);
+  va_end(ap);
+
+  // each command is recorded as an array of its arguments, the command name first
+  RedisModuleCallReply *cmd = mock_newReply(REDISMODULE_REPLY_ARRAY);
+  cmd->nested = 1;
+  cmd->expected = argc;
+  for (int i = 0; i < argc; i++) {
+    RedisModuleCallReply *arg = mock_newReply(REDISMODULE_REPLY_STRING);
+    arg->nested = 1;
+    arg->str = strndup(argv[i]->buf, argv[i]->len);
+    arg->len = argv[i]->len;
+    mock_arrayAppend(cmd, arg);
+    if (owned[i]) mock_decrRefCount(argv[i]);
+  }
+  mock_arrayAppend(io->cmds, cmd);
+  free(argv);
+  free(owned);
+}
+
+/***************************************************************************************************
+ * Blocked clients
+ **************************************************************************************************/
+
+static RedisModuleBlockedClient *mock_BlockClient(RedisModuleCtx *ctx,
+                                                  RedisModuleCmdFunc reply_callback,
+                                                  RedisModuleCmdFunc timeout_callback,
+                                                  void (*free_privdata)(RedisModuleCtx *, void *),
+                                                  long long timeout_ms) {
+  RedisModuleBlockedClient *bc = calloc(1, sizeof(*bc));
+  bc->reply = reply_callback;
+  bc->timeout = timeout_callback;
+  bc->timeoutMs = timeout_ms;
+  bc->freePrivdata = free_privdata;
+  if (mockHost.numBlocked == mockHost.blockedCap) {
+    mockHost.blockedCap = mockHost.blockedCap ? mockHost.blockedCap * 2 : 8;
+    mockHost.blocked = realloc(mockHost.blocked, mockHost.blockedCap * sizeof(bc));
+  }
+  mockHost.blocked[mockHost.numBlocked++] = bc;
+  return bc;
+}
+
+static int mock_UnblockClient(RedisModuleBlockedClient *bc, void *privdata) {
+  pthread_mutex_lock(&mockHost.lock);
+  bc->privdata = privdata;
+  bc->unblocked = 1;
+  pthread_mutex_unlock(&mockHost.lock);
+  return REDISMODULE_OK;
+}
+
+/* Like redis, aborting unblocks the client with no reply and no private data to free */
+static int mock_AbortBlock(RedisModuleBlockedClient *bc) {
+  pthread_mutex_lock(&mockHost.lock);
+  bc->reply = NULL;
+  bc->timeout = NULL;
+  bc->disconnected = NULL;
+  bc->privdata = NULL;
+  bc->unblocked = 1;
+  pthread_mutex_unlock(&mockHost.lock);
+  return REDISMODULE_OK;
+}
+
+static void mock_BlockClientSetPrivateData(RedisModuleBlockedClient *bc, void *private_data) {
+  pthread_mutex_lock(&mockHost.lock);
+  bc->privdata = private_data;
+  pthread_mutex_unlock(&mockHost.lock);
+}
+
+static void *mock_BlockClientGetPrivateData(RedisModuleBlockedClient *bc) {
+  pthread_mutex_lock(&mockHost.lock);
+  void *privdata = bc->privdata;
+  pthread_mutex_unlock(&mockHost.lock);
+  return privdata;
+}
+
+static void *mock_GetBlockedClientPrivateData(RedisModuleCtx *ctx) {
+  return ctx->blockedPrivdata;
+}
+
+static void mock_SetDisconnectCallback(RedisModuleBlockedClient *bc,
+                                       RedisModuleDisconnectFunc callback) {
+  bc->disconnected = callback;
+}
+
+/* Queue the reply a blocked client got, if any, for RMUtilMock_PopReply */
+static void mock_pushReply(RedisModuleCallReply *r) {
+  if (r == NULL) return;
+  if (mockHost.numReplies == mockHost.repliesCap) {
+    mockHost.repliesCap = mockHost.repliesCap ? mockHost.repliesCap * 2 : 8;
+    mockHost.replies = realloc(mockHost.replies, mockHost.repliesCap * sizeof(r));
+  }
+  mockHost.replies[mockHost.numReplies++] = r;
+}
+
+/* Reply to an unblocked client if it's still there, then free its private data */
+static void mock_handleUnblocked(RedisModuleBlockedClient *bc) {
+  RedisModuleCtx ctx;
+  mock_ctxInit(&ctx, NULL);
+  ctx.blockedPrivdata = bc->privdata;
+  if (!bc->gone && bc->reply) bc->reply(&ctx, NULL, 0);
+  if (bc->privdata && bc->freePrivdata) bc->freePrivdata(&ctx, bc->privdata);
+  mock_pushReply(mock_ctxDone(&ctx));
+  free(bc);
+}
+
+/* Handle the clients unblocked since the last call, in the order they were blocked */
+static int mock_processUnblocked() {
+  RedisModuleBlockedClient **done = malloc((mockHost.numBlocked + 1) * sizeof(*done));
+  size_t n = 0, kept = 0;
+  pthread_mutex_lock(&mockHost.lock);
+  for (size_t i = 0; i < mockHost.numBlocked; i++) {
+    RedisModuleBlockedClient *bc = mockHost.blocked[i];
+    if (bc->unblocked) {
+      done[n++] = bc;
+    } else {
+      mockHost.blocked[kept++] = bc;
+    }
+  }
+  mockHost.numBlocked = kept;
+  pthread_mutex_unlock(&mockHost.lock);
+
+  for (size_t i = 0; i < n; i++) mock_handleUnblocked(done[i]);
+  free(done);
+  return n;
+}
+
+/***************************************************************************************************
+ * Thread safe contexts
+ **************************************************************************************************/
+
+/* The mock has no server thread to exclude, the lock only serializes thread safe contexts */
+static RedisModuleCtx *mock_GetThreadSafeContext(RedisModuleBlockedClient *bc) {
+  RedisModuleCtx *ctx = malloc(sizeof(*ctx));
+  mock_ctxInit(ctx, NULL);
+  return ctx;
+}
+
+static RedisModuleCtx *mock_GetDetachedThreadSafeContext(RedisModuleCtx *ctx) {
+  return mock_GetThreadSafeContext(NULL);
+}
+
+static void mock_FreeThreadSafeContext(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r = mock_ctxDone(ctx);
+  if (r) mock_freeReplyTree(r);
+  free(ctx);
+}
+
+static void mock_ThreadSafeContextLock(RedisModuleCtx *ctx) {
+  pthread_mutex_lock(&mockHost.gil);
+}
+
+static void mock_ThreadSafeContextUnlock(RedisModuleCtx *ctx) {
+  pthread_mutex_unlock(&mockHost.gil);
+}
+
+/***************************************************************************************************
+ * Swap
+ **************************************************************************************************/
+
+static int mock_IsKeyInRam(RedisModuleCtx *ctx, RedisModuleString *key) {
+  mockValue *v = mock_lookup(key);
+  return v == NULL || !v->swapped;
+}
+
+static int mock_SwapPrefetchKey(RedisModuleCtx *ctx, RedisModuleString *keyname,
+                                RedisModuleSwapPrefetchCB fn, void *user_data, int flags) {
+  if (mockHost.numPrefetches == mockHost.prefetchesCap) {
+    mockHost.prefetchesCap = mockHost.prefetchesCap ? mockHost.prefetchesCap * 2 : 8;
+    mockHost.prefetches =
+        realloc(mockHost.prefetches, mockHost.prefetchesCap * sizeof(mockPrefetch));
+  }
+  keyname->refcount++;
+  mockHost.prefetches[mockHost.numPrefetches++] = (mockPrefetch){keyname, fn, user_data};
+  return REDISMODULE_OK;
+}
+
+/* Load the keys prefetched so far into RAM, and call their callbacks */
+static int mock_processPrefetches() {
+  size_t n = mockHost.numPrefetches;
+  if (n == 0) return 0;
+  mockPrefetch *todo = malloc((n + 1) * sizeof(*todo));
+  memcpy(todo, mockHost.prefetches, n * sizeof(*todo));
+  mockHost.numPrefetches = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    mockValue *v = mock_lookup(todo[i].key);
+    if (v) v->swapped = 0;
+    RedisModuleCtx ctx;
+    mock_ctxInit(&ctx, NULL);
+    if (todo[i].fn) todo[i].fn(&ctx, todo[i].key, todo[i].data);
+    RedisModuleCallReply *r = mock_ctxDone(&ctx);
+    if (r) mock_freeReplyTree(r);
+    mock_decrRefCount(todo[i].key);
+  }
+  free(todo);
+  return n;
+}
+
+/***************************************************************************************************
+ * Timers, yield and context flags
+ **************************************************************************************************/
+
+static RedisModuleTimerID mock_CreateTimer(RedisModuleCtx *ctx, mstime_t period,
+                                           RedisModuleTimerProc callback, void *data) {
+  if (mockHost.numTimers == mockHost.timersCap) {
+    mockHost.timersCap = mockHost.timersCap ? mockHost.timersCap * 2 : 8;
+    mockHost.timers = realloc(mockHost.timers, mockHost.timersCap * sizeof(mockTimer));
+  }
+  RedisModuleTimerID id = ++mockHost.nextTimerId;
+  uint64_t when = mock_MonotonicMicroseconds() + (period > 0 ? period * 1000 : 0);
+  mockHost.timers[mockHost.numTimers++] = (mockTimer){id, when, callback, data};
+  return id;
+}
+
+/* Remove the timer at index i */
+static mockTimer mock_removeTimer(size_t i) {
+  mockTimer t = mockHost.timers[i];
+  mockHost.numTimers--;
+  memmove(mockHost.timers + i, mockHost.timers + i + 1, (mockHost.numTimers - i) * sizeof(t));
+  return t;
+}
+
+static int mock_StopTimer(RedisModuleCtx *ctx, RedisModuleTimerID id, void **data) {
+  for (size_t i = 0; i < mockHost.numTimers; i++) {
+    if (mockHost.timers[i].id != id) continue;
+    mockTimer t = mock_removeTimer(i);
+    if (data) *data = t.data;
+    return REDISMODULE_OK;
+  }
+  return REDISMODULE_ERR;
+}
+
+/* Fire the due timers created before this call, in order. Timers they create wait for the next
+ * one */
+static int mock_processTimers() {
+  RedisModuleTimerID last = mockHost.nextTimerId;
+  uint64_t now = mock_MonotonicMicroseconds();
+  int n = 0;
+  for (size_t i = 0; i < mockHost.numTimers;) {
+    if (mockHost.timers[i].id > last || mockHost.timers[i].when > now) {
+      i++;
+      continue;
+    }
+    mockTimer t = mock_removeTimer(i);
+    RedisModuleCtx ctx;
+    mock_ctxInit(&ctx, NULL);
+    t.cb(&ctx, t.data);
+    RedisModuleCallReply *r = mock_ctxDone(&ctx);
+    if (r) mock_freeReplyTree(r);
+    n++;
+  }
+  return n;
+}
+
+static void mock_Yield(RedisModuleCtx *ctx, int flags, const char *busy_reply) {
+  mockHost.yields++;
+}
+
+static int mock_GetContextFlags(RedisModuleCtx *ctx) {
+  return mockHost.contextFlags;
+}
+
+/***************************************************************************************************
+ * Fork and file events
+ **************************************************************************************************/
+
+static int mock_Fork(RedisModuleForkDoneHandler cb, void *user_data) {
+  if (mockHost.childPid > 0) {
+    errno = EEXIST;
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid > 0) {
+    mockHost.childPid = pid;
+    mockHost.childDone = cb;
+    mockHost.childData = user_data;
+  }
+  return pid;
+}
+
+static int mock_ExitFromChild(int retcode) {
+  _exit(retcode);
+}
+
+/* Like redis, the child is reaped here and the done handler is not called */
+static int mock_KillForkChild(int child_pid) {
+  if (mockHost.childPid <= 0 || child_pid != mockHost.childPid) return REDISMODULE_ERR;
+  kill(child_pid, SIGUSR1);
+  while (waitpid(child_pid, NULL, 0) < 0 && errno == EINTR) {
+  }
+  mockHost.childPid = 0;
+  return REDISMODULE_OK;
+}
+
+/* Call the done handler if the child exited */
+static int mock_processChild() {
+  int status;
+  if (mockHost.childPid <= 0 || waitpid(mockHost.childPid, &status, WNOHANG) <= 0) return 0;
+  mockHost.childPid = 0;
+  int exitcode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+  int bysignal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+  mockHost.childDone(exitcode, bysignal, mockHost.childData);
+  return 1;
+}
+
+static int mock_EventLoopAdd(int fd, int mask, RedisModuleEventLoopFunc func, void *user_data) {
+  mask &= REDISMODULE_EVENTLOOP_READABLE | REDISMODULE_EVENTLOOP_WRITABLE;
+  if (fd < 0 || !func || !mask) {
+    errno = EINVAL;
+    return REDISMODULE_ERR;
+  }
+  for (size_t i = 0; i < mockHost.numFileEvents; i++) {
+    mockFileEvent *fe = &mockHost.fileEvents[i];
+    if (fe->fd != fd) continue;
+    fe->mask |= mask;
+    fe->func = func;
+    fe->data = user_data;
+    return REDISMODULE_OK;
+  }
+  if (mockHost.numFileEvents == mockHost.fileEventsCap) {
+    mockHost.fileEventsCap = mockHost.fileEventsCap ? mockHost.fileEventsCap * 2 : 8;
+    mockHost.fileEvents =
+        realloc(mockHost.fileEvents, mockHost.fileEventsCap * sizeof(mockFileEvent));
+  }
+  mockHost.fileEvents[mockHost.numFileEvents++] = (mockFileEvent){fd, mask, func, user_data};
+  return REDISMODULE_OK;
+}
+
+static int mock_EventLoopDel(int fd, int mask) {
+  for (size_t i = 0; i < mockHost.numFileEvents; i++) {
+    mockFileEvent *fe = &mockHost.fileEvents[i];
+    if (fe->fd != fd) continue;
+    fe->mask &= ~mask;
+    if (!fe->mask) {
+      mockHost.numFileEvents--;
+      memmove(fe, fe + 1, (mockHost.numFileEvents - i) * sizeof(*fe));
+    }
+    return REDISMODULE_OK;
+  }
+  errno = EINVAL;
+  return REDISMODULE_ERR;
+}
+
+/* Call the handlers of the file descriptors ready so far, without waiting */
+static int mock_processFileEvents() {
+  size_t n = mockHost.numFileEvents;
+  if (n == 0) return 0;
+  struct pollfd *pfds = malloc(n * sizeof(*pfds));
+  for (size_t i = 0; i < n; i++) {
+    int mask = mockHost.fileEvents[i].mask;
+    pfds[i] = (struct pollfd){.fd = mockHost.fileEvents[i].fd};
+    if (mask & REDISMODULE_EVENTLOOP_READABLE) pfds[i].events |= POLLIN;
+    if (mask & REDISMODULE_EVENTLOOP_WRITABLE) pfds[i].events |= POLLOUT;
+  }
+  int handled = 0;
+  if (poll(pfds, n, 0) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      int mask = 0;
+      if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) mask |= REDISMODULE_EVENTLOOP_READABLE;
+      if (pfds[i].revents & (POLLOUT | POLLERR)) mask |= REDISMODULE_EVENTLOOP_WRITABLE;
+      if (!mask) continue;
+      // a handler may have removed this or other descriptors, look it up again
+      for (size_t j = 0; j < mockHost.numFileEvents; j++) {
+        mockFileEvent fe = mockHost.fileEvents[j];
+        if (fe.fd != pfds[i].fd || !(fe.mask & mask)) continue;
+        fe.func(fe.fd, fe.data, fe.mask & mask);
+        handled++;
+        break;
+      }
+    }
+  }
+  free(pfds);
+  return handled;
+}
+
+/***************************************************************************************************
+ * INFO and the latency monitor
+ **************************************************************************************************/
+
+/* Module info is rendered like redis does: sections and fields are prefixed with the module name,
+ * and dict fields are a single line of comma separated field=value pairs */
+struct RedisModuleInfoCtx {
+  const char *module;
+  char *buf;
+  size_t len, cap;
+  int inDict;  // fields written to the current dict field so far, -1 outside of one
+};
+
+static void mock_infoAppend(RedisModuleInfoCtx *ctx, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+  if (ctx->len + n + 1 > ctx->cap) {
+    ctx->cap = (ctx->len + n + 1) * 2;
+    ctx->buf = realloc(ctx->buf, ctx->cap);
+  }
+  va_start(ap, fmt);
+  vsnprintf(ctx->buf + ctx->len, n + 1, fmt, ap);
+  va_end(ap);
+  ctx->len += n;
+}
+
+static int mock_RegisterInfoFunc(RedisModuleCtx *ctx, RedisModuleInfoFunc cb) {
+  size_t n = mockHost.numInfoFuncs++;
+  mockHost.infoFuncs =
+      realloc(mockHost.infoFuncs, mockHost.numInfoFuncs * sizeof(*mockHost.infoFuncs));
+  mockHost.infoFuncs[n].module = strdup(mockHost.moduleName ? mockHost.moduleName : "");
+  mockHost.infoFuncs[n].cb = cb;
+  return REDISMODULE_OK;
+}
+
+static void mock_infoEndDict(RedisModuleInfoCtx *ctx) {
+  if (ctx->inDict >= 0) mock_infoAppend(ctx, "\r\n");
+  ctx->inDict = -1;
+}
+
+static int mock_InfoEndDictField(RedisModuleInfoCtx *ctx) {
+  mock_infoEndDict(ctx);
+  return REDISMODULE_OK;
+}
+
+static int mock_InfoAddSection(RedisModuleInfoCtx *ctx, const char *name) {
+  mock_infoEndDict(ctx);
+  if (name && *name) {
+    mock_infoAppend(ctx, "# %s_%s\r\n", ctx->module, name);
+  } else {
+    mock_infoAppend(ctx, "# %s\r\n", ctx->module);
+  }
+  return REDISMODULE_OK;
+}
+
+static int mock_InfoBeginDictField(RedisModuleInfoCtx *ctx, const char *name) {
+  mock_infoEndDict(ctx);
+  mock_infoAppend(ctx, "%s_%s:", ctx->module, name);
+  ctx->inDict = 0;
+  return REDISMODULE_OK;
+}
+
+/* Add a field with an already formatted value */
+static int mock_infoAddField(RedisModuleInfoCtx *ctx, const char *field, const char *value) {
+  if (ctx->inDict >= 0) {
+    mock_infoAppend(ctx, "%s%s=%s", ctx->inDict++ ? "," : "", field, value);
+  } else {
+    mock_infoAppend(ctx, "%s_%s:%s\r\n", ctx->module, field, value);
+  }
+  return REDISMODULE_OK;
+}
+
+static int mock_InfoAddFieldCString(RedisModuleInfoCtx *ctx, const char *field, const char *value) {
+  return mock_infoAddField(ctx, field, value);
+}
+
+static int mock_InfoAddFieldString(RedisModuleInfoCtx *ctx, const char *field,
+                                   RedisModuleString *value) {
+  return mock_infoAddField(ctx, field, value->buf);
+}
+
+static int mock_InfoAddFieldLongLong(RedisModuleInfoCtx *ctx, const char *field, long long value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%lld", value);
+  return mock_infoAddField(ctx, field, buf);
+}
+
+static int mock_InfoAddFieldULongLong(RedisModuleInfoCtx *ctx, const char *field,
+                                      unsigned long long value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%llu", value);
+  return mock_infoAddField(ctx, field, buf);
+}
+
+static int mock_InfoAddFieldDouble(RedisModuleInfoCtx *ctx, const char *field, double value) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.17g", value);
+  return mock_infoAddField(ctx, field, buf);
+}
+
+/* Append the info of all the modules to buf */
+static void mock_modulesInfo(RedisModuleInfoCtx *ctx) {
+  for (size_t i = 0; i < mockHost.numInfoFuncs; i++) {
+    ctx->module = mockHost.infoFuncs[i].module;
+    ctx->inDict = -1;
+    mockHost.infoFuncs[i].cb(ctx, 0);
+    mock_infoEndDict(ctx);
+  }
+}
+
+static void mock_LatencyAddSample(const char *event, mstime_t latency) {
+  // redis drops samples below its own threshold, which is at least 1ms when the monitor is on
+  if (latency <= 0) return;
+  mockDictEntry *e = mockDict_FindOrAdd(mockHost.latency, event, strlen(event), NULL);
+  e->val = (void *)((uintptr_t)e->val + 1);
+}
+
+/***************************************************************************************************
+ * Built-in commands
+ **************************************************************************************************/
+
+static int mockCmd_Ping(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc > 1) return mock_ReplyWithString(ctx, argv[1]);
+  return mock_ReplyWithSimpleString(ctx, "PONG");
+}
+
+static int mockCmd_Get(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 2) return mock_WrongArity(ctx);
+  mockValue *v = mock_lookup(argv[1]);
+  if (v == NULL) return mock_ReplyWithNull(ctx);
+  if (v->type != REDISMODULE_KEYTYPE_STRING) {
+    return mock_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+  }
+  return mock_ReplyWithString(ctx, v->str);
+}
+
+static int mockCmd_Set(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 3) return mock_WrongArity(ctx);
+  mockValue *v = mock_setValue(argv[1], REDISMODULE_KEYTYPE_STRING);
+  v->str = mock_newString(argv[2]->buf, argv[2]->len);
+  return mock_ReplyWithSimpleString(ctx, "OK");
+}
+
+static int mockCmd_Del(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 2) return mock_WrongArity(ctx);
+  long long n = 0;
+  for (int i = 1; i < argc; i++) {
+    n += mockDict_Delete(mockHost.keyspace, argv[i]->buf, argv[i]->len, mock_freeValue);
+  }
+  return mock_ReplyWithLongLong(ctx, n);
+}
+
+static int mockCmd_Exists(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 2) return mock_WrongArity(ctx);
+  long long n = 0;
+  for (int i = 1; i < argc; i++) n += mock_lookup(argv[i]) != NULL;
+  return mock_ReplyWithLongLong(ctx, n);
+}
+
+static mockValue *mock_lookupHash(RedisModuleCtx *ctx, RedisModuleString *key, int *wrongtype) {
+  mockValue *v = mock_lookup(key);
+  *wrongtype = v && v->type != REDISMODULE_KEYTYPE_HASH;
+  if (*wrongtype) mock_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+  return *wrongtype ? NULL : v;
+}
+
+static int mockCmd_HGet(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 3) return mock_WrongArity(ctx);
+  int wrongtype;
+  mockValue *v = mock_lookupHash(ctx, argv[1], &wrongtype);
+  if (wrongtype) return REDISMODULE_OK;
+  mockDictEntry *e = v ? mockDict_Find(v->hash, argv[2]->buf, argv[2]->len) : NULL;
+  return e ? mock_ReplyWithString(ctx, e->val) : mock_ReplyWithNull(ctx);
+}
+
+static int mockCmd_HSet(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 4 || argc % 2) return mock_WrongArity(ctx);
+  int wrongtype;
+  mockValue *v = mock_lookupHash(ctx, argv[1], &wrongtype);
+  if (wrongtype) return REDISMODULE_OK;
+  if (v == NULL) {
+    v = mock_setValue(argv[1], REDISMODULE_KEYTYPE_HASH);
+    v->hash = mockDict_New();
+  }
+
+  long long added = 0;
+  for (int i = 2; i < argc; i += 2) {
+    int created;
+    mockDictEntry *e = mockDict_FindOrAdd(v->hash, argv[i]->buf, argv[i]->len, &created);
+    mock_decrRefCount(e->val);
+    e->val = mock_newString(argv[i + 1]->buf, argv[i + 1]->len);
+    added += created;
+  }
+  return mock_ReplyWithLongLong(ctx, added);
+}
+
+static int mockCmd_HDel(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 3) return mock_WrongArity(ctx);
+  int wrongtype;
+  mockValue *v = mock_lookupHash(ctx, argv[1], &wrongtype);
+  if (wrongtype) return REDISMODULE_OK;
+
+  long long n = 0;
+  for (int i = 2; v && i < argc; i++) {
+    n += mockDict_Delete(v->hash, argv[i]->buf, argv[i]->len, (mockDictFreeFunc)mock_decrRefCount);
+  }
+  if (v && v->hash->count == 0) {
+    mockDict_Delete(mockHost.keyspace, argv[1]->buf, argv[1]->len, mock_freeValue);
+  }
+  return mock_ReplyWithLongLong(ctx, n);
+}
+
+static int mockCmd_HLen(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 2) return mock_WrongArity(ctx);
+  int wrongtype;
+  mockValue *v = mock_lookupHash(ctx, argv[1], &wrongtype);
+  if (wrongtype) return REDISMODULE_OK;
+  return mock_ReplyWithLongLong(ctx, v ? v->hash->count : 0);
+}
+
+static int mockCmd_DbSize(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  return mock_ReplyWithLongLong(ctx, mockHost.keyspace->count);
+}
+
+static int mockCmd_FlushAll(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  RMUtilMock_FlushAll();
+  return mock_ReplyWithSimpleString(ctx, "OK");
+}
+
+static int mockCmd_Info(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  RedisModuleInfoCtx info = {0};
+  mock_infoAppend(&info,
+                  "# Server\r\nredis_version:255.255.255\r\nredis_mode:mock\r\n"
+                  "# Keyspace\r\ndb0:keys=%zu,expires=0,avg_ttl=0\r\n",
+                  mockHost.keyspace->count);
+  mock_modulesInfo(&info);
+  int rc = mock_ReplyWithStringBuffer(ctx, info.buf, info.len);
+  free(info.buf);
+  return rc;
+}
+
+/***************************************************************************************************
+ * Misc
+ **************************************************************************************************/
+
+static void mock_Log(RedisModuleCtx *ctx, const char *level, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "<mock:%s> ", level);
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+}
+
+static long long mock_Milliseconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t mock_MonotonicMicroseconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#define MOCK_API(name) {"RedisModule_" #name, (void *)(unsigned long)mock_##name}
+
+static const struct {
+  const char *name;
+  void *func;
+} mockApi[] = {
+    MOCK_API(GetApi),
+    MOCK_API(Alloc),
+    MOCK_API(Calloc),
+    MOCK_API(Realloc),
+    MOCK_API(Free),
+    MOCK_API(Strdup),
+    MOCK_API(SetModuleAttribs),
+    MOCK_API(CreateCommand),
+    MOCK_API(AutoMemory),
+    MOCK_API(CreateString),
+    MOCK_API(CreateStringFromLongLong),
+    MOCK_API(CreateStringFromDouble),
+    MOCK_API(CreateStringPrintf),
+    MOCK_API(CreateStringFromString),
+    MOCK_API(CreateStringFromCallReply),
+    MOCK_API(FreeString),
+    MOCK_API(RetainString),
+    MOCK_API(StringPtrLen),
+    MOCK_API(StringToLongLong),
+    MOCK_API(StringToDouble),
+    MOCK_API(StringCompare),
+    MOCK_API(OpenKey),
+    MOCK_API(CloseKey),
+    MOCK_API(KeyType),
+    MOCK_API(DeleteKey),
+    MOCK_API(ValueLength),
+    MOCK_API(StringSet),
+    MOCK_API(HashSet),
+    MOCK_API(HashGet),
+    MOCK_API(CreateDataType),
+    MOCK_API(ModuleTypeSetValue),
+    MOCK_API(ModuleTypeGetType),
+    MOCK_API(ModuleTypeGetValue),
+    MOCK_API(EmitAOF),
+    MOCK_API(ReplyWithLongLong),
+    MOCK_API(ReplyWithDouble),
+    MOCK_API(ReplyWithError),
+    MOCK_API(ReplyWithSimpleString),
+    MOCK_API(ReplyWithStringBuffer),
+    MOCK_API(ReplyWithCString),
+    MOCK_API(ReplyWithString),
+    MOCK_API(ReplyWithNull),
+    MOCK_API(ReplyWithArray),
+    MOCK_API(ReplySetArrayLength),
+    MOCK_API(ReplyWithCallReply),
+    MOCK_API(WrongArity),
+    MOCK_API(Call),
+    MOCK_API(CallReplyType),
+    MOCK_API(CallReplyLength),
+    MOCK_API(CallReplyInteger),
+    MOCK_API(CallReplyStringPtr),
+    MOCK_API(CallReplyArrayElement),
+    MOCK_API(FreeCallReply),
+    MOCK_API(BlockClient),
+    MOCK_API(UnblockClient),
+    MOCK_API(AbortBlock),
+    MOCK_API(BlockClientSetPrivateData),
+    MOCK_API(BlockClientGetPrivateData),
+    MOCK_API(GetBlockedClientPrivateData),
+    MOCK_API(SetDisconnectCallback),
+    MOCK_API(GetThreadSafeContext),
+    MOCK_API(GetDetachedThreadSafeContext),
+    MOCK_API(FreeThreadSafeContext),
+    MOCK_API(ThreadSafeContextLock),
+    MOCK_API(ThreadSafeContextUnlock),
+    MOCK_API(IsKeyInRam),
+    MOCK_API(RegisterInfoFunc),
+    MOCK_API(InfoAddSection),
+    MOCK_API(InfoBeginDictField),
+    MOCK_API(InfoEndDictField),
+    MOCK_API(InfoAddFieldString),
+    MOCK_API(InfoAddFieldCString),
+    MOCK_API(InfoAddFieldDouble),
+    MOCK_API(InfoAddFieldLongLong),
+    MOCK_API(InfoAddFieldULongLong),
+    MOCK_API(LatencyAddSample),
+    MOCK_API(SwapPrefetchKey),
+    MOCK_API(CreateTimer),
+    MOCK_API(StopTimer),
+    MOCK_API(Yield),
+    MOCK_API(GetContextFlags),
+    MOCK_API(Fork),
+    MOCK_API(ExitFromChild),
+    MOCK_API(KillForkChild),
+    MOCK_API(EventLoopAdd),
+    MOCK_API(EventLoopDel),
+    MOCK_API(Log),
+    MOCK_API(Milliseconds),
+    MOCK_API(MonotonicMicroseconds),
+};
+
+static int mock_GetApi(const char *name, void *pp) {
+  for (size_t i = 0; i < sizeof(mockApi) / sizeof(*mockApi); i++) {
+    if (!strcmp(name, mockApi[i].name)) {
+      *(void **)pp = mockApi[i].func;
+      return REDISMODULE_OK;
+    }
+  }
+  return REDISMODULE_ERR;
+}
+
+static void mock_init() {
+  if (mockHost.initialized) return;
+  mockHost.initialized = 1;
+  mockHost.keyspace = mockDict_New();
+  mockHost.commands = mockDict_New();
+  mockHost.latency = mockDict_New();
+
+  mock_registerCommand("ping", mockCmd_Ping);
+  mock_registerCommand("get", mockCmd_Get);
+  mock_registerCommand("set", mockCmd_Set);
+  mock_registerCommand("del", mockCmd_Del);
+  mock_registerCommand("exists", mockCmd_Exists);
+  mock_registerCommand("hget", mockCmd_HGet);
+  mock_registerCommand("hset", mockCmd_HSet);
+  mock_registerCommand("hdel", mockCmd_HDel);
+  mock_registerCommand("hlen", mockCmd_HLen);
+  mock_registerCommand("dbsize", mockCmd_DbSize);
+  mock_registerCommand("flushall", mockCmd_FlushAll);
+  mock_registerCommand("info", mockCmd_Info);
+}
+
+int RMUtilMock_LoadModule(RMUtilMockOnLoadFunc onload, RedisModuleString **argv, int argc) {
+  mock_init();
+  RedisModuleCtx ctx;
+  mock_ctxInit(&ctx, NULL);
+  int rc = onload(&ctx, argv, argc);
+  RedisModuleCallReply *r = mock_ctxDone(&ctx);
+  if (r) mock_freeReplyTree(r);
+  return rc;
+}
+
+RedisModuleCallReply *RMUtilMock_Call(const char *cmdname, const char *fmt, ...) {
+  mock_init();
+  va_list ap;
+  va_start(ap, fmt);
+  RedisModuleCallReply *r = mock_vcall(NULL, cmdname, fmt, ap);
+  va_end(ap);
+  return r;
+}
+
+int RMUtilMock_Execute(RedisModuleString **argv, int argc) {
+  mock_init();
+  int rc;
+  RedisModuleCallReply *r = mock_execute(argv, argc, &rc);
+  if (r) mock_freeReplyTree(r);
+  return rc;
+}
+
+void RMUtilMock_FlushAll(void) {
+  mock_init();
+  mockDict_Clear(mockHost.keyspace, mock_freeValue);
+}
+
+size_t RMUtilMock_DbSize(void) {
+  mock_init();
+  return mockHost.keyspace->count;
+}
+
+RedisModuleCallReply *RMUtilMock_RewriteAof(const char *keyname) {
+  mock_init();
+  RedisModuleString *name = mock_newString(keyname, strlen(keyname));
+  mockValue *v = mock_lookup(name);
+  RedisModuleCallReply *r = NULL;
+  if (v && v->type == REDISMODULE_KEYTYPE_MODULE && v->module.mt->methods.aof_rewrite) {
+    RedisModuleIO io = {.cmds = mock_newReply(REDISMODULE_REPLY_ARRAY)};
+    v->module.mt->methods.aof_rewrite(&io, name, v->module.value);
+    r = io.cmds;
+    r->expected = r->len;
+  }
+  mock_decrRefCount(name);
+  return r;
+}
+
+int RMUtilMock_ProcessEvents(void) {
+  mock_init();
+  int n = mock_processFileEvents();
+  n += mock_processPrefetches();
+  n += mock_processTimers();
+  n += mock_processChild();
+  return n + mock_processUnblocked();
+}
+
+size_t RMUtilMock_BlockedClients(void) {
+  return mockHost.numBlocked;
+}
+
+RedisModuleCallReply *RMUtilMock_PopReply(void) {
+  if (mockHost.numReplies == 0) return NULL;
+  RedisModuleCallReply *r = mockHost.replies[0];
+  mockHost.numReplies--;
+  memmove(mockHost.replies, mockHost.replies + 1, mockHost.numReplies * sizeof(r));
+  return r;
+}
+
+int RMUtilMock_DisconnectClients(void) {
+  int n = 0;
+  for (size_t i = 0; i < mockHost.numBlocked; i++) {
+    RedisModuleBlockedClient *bc = mockHost.blocked[i];
+    if (bc->gone) continue;
+    bc->gone = 1;
+    n++;
+    if (bc->disconnected) {
+      RedisModuleCtx ctx;
+      mock_ctxInit(&ctx, NULL);
+      bc->disconnected(&ctx, bc);
+      RedisModuleCallReply *r = mock_ctxDone(&ctx);
+      if (r) mock_freeReplyTree(r);
+    }
+  }
+  return n;
+}
+
+int RMUtilMock_TimeoutClients(void) {
+  int n = 0;
+  for (size_t i = 0; i < mockHost.numBlocked; i++) {
+    RedisModuleBlockedClient *bc = mockHost.blocked[i];
+    pthread_mutex_lock(&mockHost.lock);
+    int expired = !bc->gone && !bc->unblocked && bc->timeoutMs > 0;
+    void *privdata = bc->privdata;
+    pthread_mutex_unlock(&mockHost.lock);
+    if (!expired) continue;
+
+    bc->gone = 1;
+    n++;
+    RedisModuleCtx ctx;
+    mock_ctxInit(&ctx, NULL);
+    ctx.blockedPrivdata = privdata;
+    if (bc->timeout) bc->timeout(&ctx, NULL, 0);
+    mock_pushReply(mock_ctxDone(&ctx));
+  }
+  return n;
+}
+
+int RMUtilMock_SwapOut(const char *keyname) {
+  mock_init();
+  mockDictEntry *e = mockDict_Find(mockHost.keyspace, keyname, strlen(keyname));
+  if (e == NULL) return 0;
+  ((mockValue *)e->val)->swapped = 1;
+  return 1;
+}
+
+size_t RMUtilMock_Yields(void) {
+  return mockHost.yields;
+}
+
+void RMUtilMock_SetContextFlags(int flags) {
+  mockHost.contextFlags = flags;
+}
+
+size_t RMUtilMock_LatencySamples(const char *event) {
+  mock_init();
+  mockDictEntry *e = mockDict_Find(mockHost.latency, event, strlen(event));
+  return e ? (uintptr_t)e->val : 0;
+}
@@ -0,0 +1,103 @@
+#ifndef __RMUTIL_MOCK_REDIS_H__
+#define __RMUTIL_MOCK_REDIS_H__
+
+#include <redismodule.h>
+
+/** mock_redis.h - an in-process stand-in for the redis module host.
+ *
+ * It implements RedisModule_GetApi and the core of the module API - strings, keys (strings, hashes
+ * and module types), replies and RedisModule_Call - over in-memory stores, so a driver program can
+ * load a module through its RedisModule_OnLoad and invoke its command handlers directly, without
+ * the network and protocol overhead of a real redis-server. This is meant for profiling handler
+ * CPU cost (perf, flamegraphs) and for microbenchmarks, not as a redis replacement: only a handful
+ * of built-in commands (PING, GET, SET, DEL, EXISTS, HGET, HSET, HDEL, HLEN, DBSIZE, FLUSHALL,
+ * INFO) are available to RedisModule_Call, and API functions not implemented here are left NULL.
+ *
+ * Tests can also use it to drive the server side of the API: RMUtilMock_RewriteAof runs the
+ * aof_rewrite callback of a module type and returns the commands it emitted, and there is a
+ * single-threaded event loop (RMUtilMock_ProcessEvents) for blocked clients, timers, file events,
+ * forked children and prefetches of keys that were put on swap with RMUtilMock_SwapOut. A command
+ * that blocks the client replies nothing when called; the reply is sent once the client is
+ * unblocked and the event loop handles it, and can then be popped with RMUtilMock_PopReply.
+ * Clients can be disconnected or timed out on demand, and thread safe contexts are available to
+ * the threads doing their work. INFO includes the sections of the modules' info callbacks, and
+ * samples added to the latency monitor and calls to RedisModule_Yield are counted.
+ *
+ * Usage:
+ *
+ *    #define REDISMODULE_MAIN
+ *    #include "mock_redis.h"
+ *
+ *    int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
+ *
+ *    RMUtilMock_LoadModule(RedisModule_OnLoad, NULL, 0);
+ *    RedisModuleCallReply *r = RMUtilMock_Call("example.parse", "ccc", "SUM", "5", "2");
+ *    ...
+ *    RedisModule_FreeCallReply(r);
+ */
+
+typedef int (*RMUtilMockOnLoadFunc)(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
+
+/* Load a module into the mock host by calling its OnLoad function. Can be called more than once
+ * to load several modules. Returns REDISMODULE_OK or REDISMODULE_ERR as returned by OnLoad */
+int RMUtilMock_LoadModule(RMUtilMockOnLoadFunc onload, RedisModuleString **argv, int argc);
+
+/* Run a command given in RedisModule_Call format as if a client sent it, and return its reply.
+ * The reply should be freed with RedisModule_FreeCallReply */
+RedisModuleCallReply *RMUtilMock_Call(const char *cmdname, const char *fmt, ...);
+
+/* Run a command from an argument vector, discarding the reply. This is the cheapest way to invoke
+ * a handler in a benchmark loop. Returns the handler's return value, or REDISMODULE_ERR if the
+ * command does not exist */
+int RMUtilMock_Execute(RedisModuleString **argv, int argc);
+
+/* Remove all keys from the mock keyspace */
+void RMUtilMock_FlushAll(void);
+
+/* Return the number of keys in the mock keyspace */
+size_t RMUtilMock_DbSize(void);
+
+/* Run the aof_rewrite callback of the module type value of a key, and return the commands it
+ * emitted with RedisModule_EmitAOF as an array reply, each command an array of strings starting
+ * with the command name. Returns NULL if the key holds no module value, or its type has no
+ * aof_rewrite callback. The reply should be freed with RedisModule_FreeCallReply */
+RedisModuleCallReply *RMUtilMock_RewriteAof(const char *keyname);
+
+/* Run one iteration of the event loop, without waiting: call the handlers of the ready file
+ * descriptors, load the prefetched keys and call their callbacks, fire the timers that are due,
+ * call the done handler of the forked child if it exited, then handle the clients unblocked so far
+ * - reply to them, and free their private data. Returns the number of events handled */
+int RMUtilMock_ProcessEvents(void);
+
+/* Return the number of blocked clients that the event loop did not handle yet */
+size_t RMUtilMock_BlockedClients(void);
+
+/* Pop the oldest reply sent to a client once it was unblocked, or NULL if there is none. The reply
+ * should be freed with RedisModule_FreeCallReply */
+RedisModuleCallReply *RMUtilMock_PopReply(void);
+
+/* Disconnect all the blocked clients, calling their disconnect callbacks. They get no reply once
+ * unblocked. Returns the number of clients disconnected */
+int RMUtilMock_DisconnectClients(void);
+
+/* Time out all the blocked clients that have a timeout and were not unblocked yet, as if it
+ * expired: their timeout callbacks reply, and they get no other reply once unblocked. Their private
+ * data is still freed by the event loop once they are unblocked. Returns the number of clients
+ * timed out */
+int RMUtilMock_TimeoutClients(void);
+
+/* Put a key on swap: RedisModule_IsKeyInRam returns 0 for it until it is prefetched. Returns 0 if
+ * the key does not exist */
+int RMUtilMock_SwapOut(const char *keyname);
+
+/* Return the number of calls to RedisModule_Yield so far */
+size_t RMUtilMock_Yields(void);
+
+/* Set the flags returned by RedisModule_GetContextFlags, e.g. REDISMODULE_CTX_FLAGS_MULTI to run
+ * the following commands as if in a transaction. 0 by default */
+void RMUtilMock_SetContextFlags(int flags);
+
+/* Return the number of samples of 1ms or more reported to the latency monitor for an event */
+size_t RMUtilMock_LatencySamples(const char *event);
+
+#endif
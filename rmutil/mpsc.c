@@ -0,0 +1,166 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "mpsc.h"
+#include "alloc.h"
+
+typedef struct mpscNode {
+  struct mpscNode *next;
+  void *item;
+} mpscNode;
+
+struct RMUtilMPSCQueue {
+  /* producers swap themselves in at the head, the consumer pops from the tail. The tail is always a
+   * stub node whose item was already consumed */
+  mpscNode *head;
+  char pad[64 - sizeof(mpscNode *)];
+  mpscNode *tail;
+
+  /* set by the producer that finds the queue idle, cleared by the consumer before draining */
+  int pending;
+  int closing;
+  int pipefd[2];
+
+  RMUtilMPSCConsumeFunc consume;
+  void *privdata;
+  size_t maxBatch;
+  void **batch;
+};
+
+static void mpsc_free(RMUtilMPSCQueue *q) {
+  if (q->pipefd[0] >= 0) {
+    RedisModule_EventLoopDel(q->pipefd[0], REDISMODULE_EVENTLOOP_READABLE);
+    close(q->pipefd[0]);
+    close(q->pipefd[1]);
+  }
+  free(q->tail);
+  free(q->batch);
+  free(q);
+}
+
+/* Drain at most one batch. Returns the number of items consumed */
+static size_t mpsc_drainBatch(RMUtilMPSCQueue *q) {
+  size_t n = 0;
+  void *item;
+  while (n < q->maxBatch && (item = RMUtilMPSCQueue_Pop(q)) != NULL) q->batch[n++] = item;
+  if (n) q->consume(q->batch, n, q->privdata);
+  return n;
+}
+
+static void mpsc_schedule(RMUtilMPSCQueue *q);
+
+/* Runs on the main thread on wakeup */
+static void mpsc_onWakeup(RMUtilMPSCQueue *q) {
+  if (q->closing) {
+    mpsc_free(q);
+    return;
+  }
+  // clear the flag first, so a push racing with the drain schedules another wakeup
+  __atomic_store_n(&q->pending, 0, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  size_t n = mpsc_drainBatch(q);
+
+  // leave the rest for another iteration of the event loop
+  if (n == q->maxBatch && !__atomic_exchange_n(&q->pending, 1, __ATOMIC_SEQ_CST)) {
+    mpsc_schedule(q);
+  }
+}
+
+static void mpsc_oneShot(void *user_data) {
+  mpsc_onWakeup(user_data);
+}
+
+static void mpsc_pipeReadable(int fd, void *user_data, int mask) {
+  char buf[64];
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+  mpsc_onWakeup(user_data);
+}
+
+static void mpsc_schedule(RMUtilMPSCQueue *q) {
+  if (RedisModule_EventLoopAddOneShot) {
+    RedisModule_EventLoopAddOneShot(mpsc_oneShot, q);
+  } else if (q->pipefd[1] >= 0) {
+    // a full pipe already has a wakeup in it, so EAGAIN is fine
+    ssize_t rc;
+    do {
+      rc = write(q->pipefd[1], "x", 1);
+    } while (rc < 0 && errno == EINTR);
+  }
+}
+
+RMUtilMPSCQueue *RMUtilMPSCQueue_New(RMUtilMPSCConsumeFunc consume, void *privdata,
+                                     size_t maxBatch) {
+  RMUtilMPSCQueue *q = calloc(1, sizeof(*q));
+  q->consume = consume;
+  q->privdata = privdata;
+  q->maxBatch = maxBatch ? maxBatch : RMUTIL_MPSC_DEFAULT_BATCH;
+  q->batch = malloc(q->maxBatch * sizeof(void *));
+  q->head = q->tail = calloc(1, sizeof(mpscNode));
+  q->pipefd[0] = q->pipefd[1] = -1;
+
+  if (!RedisModule_EventLoopAddOneShot && RedisModule_EventLoopAdd) {
+    if (pipe(q->pipefd) != 0) {
+      q->pipefd[0] = q->pipefd[1] = -1;
+      mpsc_free(q);
+      return NULL;
+    }
+    fcntl(q->pipefd[0], F_SETFL, fcntl(q->pipefd[0], F_GETFL) | O_NONBLOCK);
+    fcntl(q->pipefd[1], F_SETFL, fcntl(q->pipefd[1], F_GETFL) | O_NONBLOCK);
+    if (RedisModule_EventLoopAdd(q->pipefd[0], REDISMODULE_EVENTLOOP_READABLE, mpsc_pipeReadable,
+                                 q) != REDISMODULE_OK) {
+      close(q->pipefd[0]);
+      close(q->pipefd[1]);
+      q->pipefd[0] = q->pipefd[1] = -1;
+      mpsc_free(q);
+      return NULL;
+    }
+  }
+  return q;
+}
+
+void RMUtilMPSCQueue_Push(RMUtilMPSCQueue *q, void *item) {
+  mpscNode *n = malloc(sizeof(*n));
+  n->item = item;
+  n->next = NULL;
+  mpscNode *prev = __atomic_exchange_n(&q->head, n, __ATOMIC_ACQ_REL);
+  // until this store the consumer can't see n, nor anything pushed after it
+  __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+  // the store above must not pass the load of pending below, or the consumer could clear pending,
+  // miss n and go idle while we see pending still set. Pairs with the fence in mpsc_onWakeup
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  if (!__atomic_load_n(&q->pending, __ATOMIC_SEQ_CST) &&
+      !__atomic_exchange_n(&q->pending, 1, __ATOMIC_SEQ_CST)) {
+    mpsc_schedule(q);
+  }
+}
+
+void *RMUtilMPSCQueue_Pop(RMUtilMPSCQueue *q) {
+  mpscNode *tail = q->tail;
+  mpscNode *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if (!next) return NULL;
+  // next becomes the new stub
+  void *item = next->item;
+  q->tail = next;
+  free(tail);
+  return item;
+}
+
+size_t RMUtilMPSCQueue_Drain(RMUtilMPSCQueue *q) {
+  size_t total = 0, n;
+  while ((n = mpsc_drainBatch(q)) > 0) total += n;
+  return total;
+}
+
+void RMUtilMPSCQueue_Free(RMUtilMPSCQueue *q) {
+  RMUtilMPSCQueue_Drain(q);
+  // with the pipe, the handler is removed along with it. A one shot can't be cancelled, so let it
+  // free the queue when it fires
+  if (RedisModule_EventLoopAddOneShot && __atomic_load_n(&q->pending, __ATOMIC_SEQ_CST)) {
+    q->closing = 1;
+    return;
+  }
+  mpsc_free(q);
+}
@@ -0,0 +1,52 @@
+#ifndef __RMUTIL_MPSC_H__
+#define __RMUTIL_MPSC_H__
+
+#include <stddef.h>
+#include <redismodule.h>
+
+/** mpsc.h - a lock-free multi-producer single-consumer queue for handing results from worker
+ * threads to the redis main thread without taking the GIL.
+ *
+ * Any thread may push items. The first push into an idle queue wakes the main thread, with
+ * RedisModule_EventLoopAddOneShot if the server has it, or otherwise by writing to a pipe whose
+ * read end is registered with RedisModule_EventLoopAdd. On the main thread, the queue is drained
+ * in batches of up to maxBatch items, each passed to the consume callback. If more items remain
+ * after a batch, another wakeup is scheduled instead of looping, so a flood of items can't starve
+ * the clients.
+ *
+ * Pushing is wait-free: a single atomic exchange plus a store, and a wakeup only when the queue
+ * goes from idle to pending.
+ *
+ * When running outside of redis (neither event loop API is available), no wakeups are scheduled
+ * and the consumer thread calls RMUtilMPSCQueue_Drain or RMUtilMPSCQueue_Pop itself.
+ */
+
+/* Called on the consumer thread with a batch of up to maxBatch items, in push order per producer */
+typedef void (*RMUtilMPSCConsumeFunc)(void **items, size_t n, void *privdata);
+
+/* RMUtilMPSCQueue - opaque queue */
+typedef struct RMUtilMPSCQueue RMUtilMPSCQueue;
+
+#define RMUTIL_MPSC_DEFAULT_BATCH 1024
+
+/* Create a new queue. Must be called from the main thread when running in redis. maxBatch of 0
+ * means RMUTIL_MPSC_DEFAULT_BATCH. Returns NULL if the wakeup pipe could not be set up */
+RMUtilMPSCQueue *RMUtilMPSCQueue_New(RMUtilMPSCConsumeFunc consume, void *privdata,
+                                     size_t maxBatch);
+
+/* Push an item from any thread */
+void RMUtilMPSCQueue_Push(RMUtilMPSCQueue *q, void *item);
+
+/* Pop a single item, or return NULL if there is none. Consumer thread only */
+void *RMUtilMPSCQueue_Pop(RMUtilMPSCQueue *q);
+
+/* Consume all the items currently in the queue in batches. Consumer thread only. Returns the
+ * number of items consumed */
+size_t RMUtilMPSCQueue_Drain(RMUtilMPSCQueue *q);
+
+/* Consume the remaining items and free the queue. Must be called from the consumer thread after
+ * all the producers have stopped pushing. If a wakeup is still scheduled, the queue is freed
+ * when it fires */
+void RMUtilMPSCQueue_Free(RMUtilMPSCQueue *q);
+
+#endif
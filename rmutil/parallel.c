@@ -0,0 +1,186 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parallel.h"
+#include "alloc.h"
+
+/* Shared by the caller and the helper jobs of a single RMUtil_ParallelFor. Freed by whoever drops
+ * the last reference, as helpers may only get to run after all the chunks are done */
+typedef struct {
+  size_t begin, end, grain, numChunks;
+  size_t next, done;
+  int refs;
+  RMUtilParallelForFunc body;
+  void *arg;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} pforState;
+
+static void pfor_release(pforState *st) {
+  if (__atomic_sub_fetch(&st->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    pthread_cond_destroy(&st->cond);
+    pthread_mutex_destroy(&st->lock);
+    free(st);
+  }
+}
+
+/* Claim and run chunks until there are none left */
+static void pfor_work(pforState *st) {
+  size_t c;
+  while ((c = __atomic_fetch_add(&st->next, 1, __ATOMIC_RELAXED)) < st->numChunks) {
+    size_t from = st->begin + c * st->grain;
+    size_t to = from + st->grain < st->end ? from + st->grain : st->end;
+    st->body(from, to, st->arg);
+    if (__atomic_add_fetch(&st->done, 1, __ATOMIC_ACQ_REL) == st->numChunks) {
+      pthread_mutex_lock(&st->lock);
+      pthread_cond_broadcast(&st->cond);
+      pthread_mutex_unlock(&st->lock);
+    }
+  }
+}
+
+static void pfor_helper(void *arg) {
+  pfor_work(arg);
+  pfor_release(arg);
+}
+
+void RMUtil_ParallelFor(RMUtilThreadPool *pool, size_t begin, size_t end, size_t grain,
+                        RMUtilParallelForFunc body, void *arg) {
+  if (end <= begin) return;
+  size_t n = end - begin;
+  int threads = pool ? RMUtilThreadPool_NumThreads(pool) : 0;
+  if (grain == 0) {
+    grain = n / ((threads + 1) * 4);
+    if (grain == 0) grain = 1;
+  }
+  if (!pool || n <= grain) {
+    body(begin, end, arg);
+    return;
+  }
+
+  pforState *st = malloc(sizeof(*st));
+  *st = (pforState){
+      .begin = begin, .end = end, .grain = grain, .numChunks = (n + grain - 1) / grain,
+      .body = body, .arg = arg, .refs = 1,
+  };
+  pthread_mutex_init(&st->lock, NULL);
+  pthread_cond_init(&st->cond, NULL);
+
+  size_t helpers = st->numChunks - 1 < (size_t)threads ? st->numChunks - 1 : (size_t)threads;
+  for (size_t i = 0; i < helpers; i++) {
+    __atomic_add_fetch(&st->refs, 1, __ATOMIC_RELAXED);
+    if (RMUtilThreadPool_Submit(pool, pfor_helper, st) != REDISMODULE_OK) {
+      __atomic_sub_fetch(&st->refs, 1, __ATOMIC_RELAXED);
+      break;
+    }
+  }
+
+  // do our share, then wait for the chunks other threads are still running
+  pfor_work(st);
+  if (__atomic_load_n(&st->done, __ATOMIC_ACQUIRE) < st->numChunks) {
+    pthread_mutex_lock(&st->lock);
+    while (__atomic_load_n(&st->done, __ATOMIC_ACQUIRE) < st->numChunks) {
+      pthread_cond_wait(&st->cond, &st->lock);
+    }
+    pthread_mutex_unlock(&st->lock);
+  }
+  pfor_release(st);
+}
+
+typedef int (*sortCmp)(const void *, const void *);
+
+typedef struct {
+  size_t elemSize;
+  sortCmp cmp;
+  char *src, *dst;
+  size_t n;
+  /* length of the sorted runs being merged in this pass, and of the output pieces */
+  size_t width, piece;
+} sortState;
+
+#define ELEM(base, i) ((base) + (i) * st->elemSize)
+
+static void sort_chunks(size_t from, size_t to, void *arg) {
+  sortState *st = arg;
+  qsort(ELEM(st->src, from), to - from, st->elemSize, st->cmp);
+}
+
+/* Return how many of the first k merged elements of a[0..m) and b[0..n) come from a. Ties are
+ * taken from a first */
+static size_t sort_coRank(sortState *st, size_t k, const char *a, size_t m, const char *b,
+                          size_t n) {
+  size_t lo = k > n ? k - n : 0, hi = k < m ? k : m;
+  while (lo < hi) {
+    size_t i = lo + (hi - lo) / 2, j = k - i;
+    // too few from a: a[i] must precede b[j-1]
+    if (j > 0 && st->cmp(ELEM(a, i), ELEM(b, j - 1)) <= 0) {
+      lo = i + 1;
+    } else {
+      hi = i;
+    }
+  }
+  return lo;
+}
+
+/* Merge output positions [from, to) of the pass, in pieces that don't cross pairs of runs */
+static void sort_mergePieces(size_t from, size_t to, void *arg) {
+  sortState *st = arg;
+  for (size_t p = from; p < to; p++) {
+    size_t out = p * st->piece;
+    size_t pair = out / (2 * st->width) * (2 * st->width);
+    size_t pairEnd = pair + 2 * st->width < st->n ? pair + 2 * st->width : st->n;
+    size_t outEnd = out + st->piece < pairEnd ? out + st->piece : pairEnd;
+
+    const char *a = ELEM(st->src, pair);
+    size_t m = pair + st->width < st->n ? st->width : st->n - pair;
+    const char *b = ELEM(st->src, pair + m);
+    size_t bn = pairEnd - pair - m;
+
+    size_t i = sort_coRank(st, out - pair, a, m, b, bn), j = out - pair - i;
+    size_t iEnd = sort_coRank(st, outEnd - pair, a, m, b, bn), jEnd = outEnd - pair - iEnd;
+    char *d = ELEM(st->dst, out);
+    while (i < iEnd && j < jEnd) {
+      if (st->cmp(ELEM(b, j), ELEM(a, i)) < 0) {
+        memcpy(d, ELEM(b, j++), st->elemSize);
+      } else {
+        memcpy(d, ELEM(a, i++), st->elemSize);
+      }
+      d += st->elemSize;
+    }
+    if (i < iEnd) memcpy(d, ELEM(a, i), (iEnd - i) * st->elemSize);
+    if (j < jEnd) memcpy(d, ELEM(b, j), (jEnd - j) * st->elemSize);
+  }
+}
+
+int Vector_ParallelSort(Vector *v, int (*cmp)(const void *, const void *), RMUtilThreadPool *pool) {
+  size_t n = v->top;
+  if (!pool || n < RMUTIL_PARALLEL_SORT_THRESHOLD) {
+    qsort(v->data, n, v->elemSize, cmp);
+    return 0;
+  }
+  char *tmp = malloc(n * v->elemSize);
+  if (!tmp) {
+    qsort(v->data, n, v->elemSize, cmp);
+    return -1;
+  }
+
+  // a couple of chunks per thread, merged pairwise in log2(chunks) passes
+  size_t chunks = __rmutil_psort_chunks(pool, n);
+  sortState s = {.elemSize = v->elemSize, .cmp = cmp, .src = v->data, .dst = tmp, .n = n};
+  s.width = (n + chunks - 1) / chunks;
+  RMUtil_ParallelFor(pool, 0, n, s.width, sort_chunks, &s);
+
+  // every pass splits the output into the same number of pieces, so even the last merge of two
+  // halves keeps all the threads busy
+  s.piece = (n + chunks - 1) / chunks;
+  while (s.width < n) {
+    RMUtil_ParallelFor(pool, 0, (n + s.piece - 1) / s.piece, 1, sort_mergePieces, &s);
+    char *t = s.src;
+    s.src = s.dst;
+    s.dst = t;
+    s.width *= 2;
+  }
+  if (s.src != v->data) memcpy(v->data, s.src, n * v->elemSize);
+  free(tmp);
+  return 0;
+}
@@ -0,0 +1,172 @@
+#ifndef __RMUTIL_PARALLEL_H__
+#define __RMUTIL_PARALLEL_H__
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "threadpool.h"
+#include "vector.h"
+
+/** parallel.h - data parallel loops and sorting on top of RMUtilThreadPool.
+ *
+ * Both functions run on the calling thread as well as the pool, and return when all the work is
+ * done. They can be called from any thread, including from a job running on the same pool. With a
+ * NULL pool, or a range too small to be worth splitting, they simply run sequentially.
+ */
+
+/* Process the range [from, to) */
+typedef void (*RMUtilParallelForFunc)(size_t from, size_t to, void *arg);
+
+/* Call body on sub-ranges of [begin, end) in parallel. Each sub-range is at least grain long
+ * (except maybe the last). A grain of 0 picks one giving a few sub-ranges per thread */
+void RMUtil_ParallelFor(RMUtilThreadPool *pool, size_t begin, size_t end, size_t grain,
+                        RMUtilParallelForFunc body, void *arg);
+
+/* Vectors shorter than this are sorted with a plain qsort */
+#define RMUTIL_PARALLEL_SORT_THRESHOLD 16384
+
+/* Sort the elements of v with cmp (as for qsort) using the pool. The sort is a parallel merge sort:
+ * chunks are sorted concurrently, then merged pairwise, with each merge split between the threads.
+ * Like qsort, it is not stable. Needs a temporary buffer the size of the vector. Returns 0 on
+ * success, or -1 if the buffer could not be allocated, in which case v is sorted sequentially */
+int Vector_ParallelSort(Vector *v, int (*cmp)(const void *, const void *), RMUtilThreadPool *pool);
+
+/* The number of chunks a parallel sort of n elements is split into: a couple per thread, as long
+ * as they stay big enough to be worth it. Always a power of 2 */
+static inline size_t __rmutil_psort_chunks(RMUtilThreadPool *pool, size_t n) {
+  size_t threads = RMUtilThreadPool_NumThreads(pool) + 1;
+  size_t chunks = 1;
+  while (chunks < threads * 2 && n / (chunks * 2) >= RMUTIL_PARALLEL_SORT_THRESHOLD / 4) {
+    chunks *= 2;
+  }
+  return chunks;
+}
+
+/** RMUTIL_PARALLELSORT_DEFINE(name, T, cmp) defines name_ParallelSort(T *a, size_t n, pool) and
+ * name_ParallelSortVector(Vector *v, pool), the same parallel merge sort specialized for elements
+ * of type T. cmp(a, b) takes two T values and returns <0, 0 or >0 like a qsort comparator; it is
+ * usually a macro or a static inline function, so it gets inlined along with the element moves,
+ * instead of an indirect call and a memcpy per comparison. Chunks are merge sorted too, so unlike
+ * Vector_ParallelSort this sort is stable. It needs a temporary buffer the size of the array even
+ * when it runs sequentially.
+ *
+ *    #define cmpScore(a, b) (((a).score > (b).score) - ((a).score < (b).score))
+ *    RMUTIL_PARALLELSORT_DEFINE(Hits, hit, cmpScore)
+ *
+ *    Hits_ParallelSort(hits, n, pool);
+ */
+
+/* Length of the runs sorted by insertion before merging */
+#define RMUTIL_PARALLEL_SORT_RUN 16
+
+#define RMUTIL_PARALLELSORT_DEFINE(name, T, cmpfn)                                               \
+  typedef struct {                                                                               \
+    T *src, *dst;                                                                                \
+    size_t n, width, piece;                                                                      \
+  } name##__State;                                                                               \
+                                                                                                 \
+  static inline void name##__insertion(T *a, size_t n) {                                         \
+    for (size_t i = 1; i < n; i++) {                                                             \
+      T x = a[i];                                                                                \
+      size_t j = i;                                                                              \
+      for (; j > 0 && cmpfn(x, a[j - 1]) < 0; j--) a[j] = a[j - 1];                              \
+      a[j] = x;                                                                                  \
+    }                                                                                            \
+  }                                                                                              \
+                                                                                                 \
+  /* Merge a[0..m) and b[0..n) into d, taking ties from a first */                               \
+  static inline void name##__merge(const T *a, size_t m, const T *b, size_t n, T *d) {           \
+    size_t i = 0, j = 0;                                                                         \
+    while (i < m && j < n) *d++ = cmpfn(b[j], a[i]) < 0 ? b[j++] : a[i++];                       \
+    while (i < m) *d++ = a[i++];                                                                 \
+    while (j < n) *d++ = b[j++];                                                                 \
+  }                                                                                              \
+                                                                                                 \
+  /* Stable merge sort of a[0..n), using tmp[0..n) as scratch space */                           \
+  static inline void name##__sortRange(T *a, T *tmp, size_t n) {                                 \
+    for (size_t i = 0; i < n; i += RMUTIL_PARALLEL_SORT_RUN) {                                   \
+      size_t len = n - i < RMUTIL_PARALLEL_SORT_RUN ? n - i : RMUTIL_PARALLEL_SORT_RUN;          \
+      name##__insertion(a + i, len);                                                             \
+    }                                                                                            \
+    T *src = a, *dst = tmp;                                                                      \
+    for (size_t w = RMUTIL_PARALLEL_SORT_RUN; w < n; w *= 2) {                                   \
+      for (size_t i = 0; i < n; i += 2 * w) {                                                    \
+        size_t m = n - i < w ? n - i : w;                                                        \
+        size_t bn = n - i - m < w ? n - i - m : w;                                               \
+        name##__merge(src + i, m, src + i + m, bn, dst + i);                                     \
+      }                                                                                          \
+      T *t = src;                                                                                \
+      src = dst;                                                                                 \
+      dst = t;                                                                                   \
+    }                                                                                            \
+    if (src != a) memcpy(a, src, n * sizeof(T));                                                 \
+  }                                                                                              \
+                                                                                                 \
+  /* How many of the first k merged elements of a[0..m) and b[0..n) come from a */               \
+  static inline size_t name##__coRank(size_t k, const T *a, size_t m, const T *b, size_t n) {    \
+    size_t lo = k > n ? k - n : 0, hi = k < m ? k : m;                                           \
+    while (lo < hi) {                                                                            \
+      size_t i = lo + (hi - lo) / 2, j = k - i;                                                  \
+      if (j > 0 && cmpfn(a[i], b[j - 1]) <= 0) {                                                 \
+        lo = i + 1;                                                                              \
+      } else {                                                                                   \
+        hi = i;                                                                                  \
+      }                                                                                          \
+    }                                                                                            \
+    return lo;                                                                                   \
+  }                                                                                              \
+                                                                                                 \
+  static inline void name##__sortChunks(size_t from, size_t to, void *arg) {                     \
+    name##__State *st = arg;                                                                     \
+    name##__sortRange(st->src + from, st->dst + from, to - from);                                \
+  }                                                                                              \
+                                                                                                 \
+  static inline void name##__mergePieces(size_t from, size_t to, void *arg) {                    \
+    name##__State *st = arg;                                                                     \
+    for (size_t p = from; p < to; p++) {                                                         \
+      size_t out = p * st->piece;                                                                \
+      size_t pair = out / (2 * st->width) * (2 * st->width);                                     \
+      size_t pairEnd = pair + 2 * st->width < st->n ? pair + 2 * st->width : st->n;              \
+      size_t outEnd = out + st->piece < pairEnd ? out + st->piece : pairEnd;                     \
+      const T *a = st->src + pair;                                                               \
+      size_t m = pair + st->width < st->n ? st->width : st->n - pair;                            \
+      const T *b = a + m;                                                                        \
+      size_t bn = pairEnd - pair - m;                                                            \
+      size_t i = name##__coRank(out - pair, a, m, b, bn), j = out - pair - i;                    \
+      size_t iEnd = name##__coRank(outEnd - pair, a, m, b, bn), jEnd = outEnd - pair - iEnd;     \
+      name##__merge(a + i, iEnd - i, b + j, jEnd - j, st->dst + out);                            \
+    }                                                                                            \
+  }                                                                                              \
+                                                                                                 \
+  /* Sort a[0..n) with the pool. Returns 0, or -1 if the temporary buffer could not be           \
+   * allocated, in which case a is left unsorted */                                              \
+  static inline int name##_ParallelSort(T *a, size_t n, RMUtilThreadPool *pool) {                \
+    T *tmp = malloc((n ? n : 1) * sizeof(T));                                                    \
+    if (!tmp) return -1;                                                                         \
+    if (!pool || n < RMUTIL_PARALLEL_SORT_THRESHOLD) {                                           \
+      name##__sortRange(a, tmp, n);                                                              \
+      free(tmp);                                                                                 \
+      return 0;                                                                                  \
+    }                                                                                            \
+    size_t chunks = __rmutil_psort_chunks(pool, n);                                              \
+    name##__State s = {.src = a, .dst = tmp, .n = n};                                            \
+    s.width = s.piece = (n + chunks - 1) / chunks;                                               \
+    RMUtil_ParallelFor(pool, 0, n, s.width, name##__sortChunks, &s);                             \
+    while (s.width < n) {                                                                        \
+      RMUtil_ParallelFor(pool, 0, (n + s.piece - 1) / s.piece, 1, name##__mergePieces, &s);      \
+      T *t = s.src;                                                                              \
+      s.src = s.dst;                                                                             \
+      s.dst = t;                                                                                 \
+      s.width *= 2;                                                                              \
+    }                                                                                            \
+    if (s.src != a) memcpy(a, s.src, n * sizeof(T));                                             \
+    free(tmp);                                                                                   \
+    return 0;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  /* Sort a vector of T, see name_ParallelSort */                                                \
+  static inline int name##_ParallelSortVector(Vector *v, RMUtilThreadPool *pool) {               \
+    return name##_ParallelSort((T *)v->data, v->top, pool);                                      \
+  }
+
+#endif
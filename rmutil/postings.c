@@ -0,0 +1,535 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSSE3__
+#include <pthread.h>
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "postings.h"
+#include "alloc.h"
+
+/* Block header bytes, after the bit widths 0 to 32 of bit-packed blocks */
+#define POSTINGS_STREAMVBYTE 0xfe
+#define POSTINGS_VARINT 0xff
+
+/* Room past the blocks, for 16 byte loads near the end of the last one */
+#define POSTINGS_PADDING 16
+
+/* The largest encoded block: a header byte and 127 10 byte varints */
+#define POSTINGS_MAX_BLOCK_SIZE (1 + 10 * (RMUTIL_POSTINGS_BLOCK - 1))
+
+struct RMUtilPostings {
+  size_t count;
+  size_t numBlocks;
+  /* the skip table: the first value of each block, and the offset of each block in data, with
+   * the end of the last one */
+  uint64_t *first;
+  uint32_t *offsets;
+  unsigned char *data;
+};
+
+struct RMUtilPostingsIterator {
+  const RMUtilPostings *p;
+  /* the next block to decode */
+  size_t block;
+  /* the position in the decoded block, and its size */
+  uint32_t pos, n;
+  uint64_t buf[RMUTIL_POSTINGS_BLOCK];
+};
+
+static inline void postings_put(unsigned char **p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) *(*p)++ = v >> (8 * i);
+}
+
+static inline uint64_t postings_get(const unsigned char **p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) v |= (uint64_t) * (*p)++ << (8 * i);
+  return v;
+}
+
+static inline size_t postings_blockCount(const RMUtilPostings *p, size_t i) {
+  size_t left = p->count - i * RMUTIL_POSTINGS_BLOCK;
+  return left < RMUTIL_POSTINGS_BLOCK ? left : RMUTIL_POSTINGS_BLOCK;
+}
+
+/*********************************** Bit-packing ***********************************/
+
+/* A block of 128 values is packed in 4 lanes of 32, value i going to lane i % 4. Each lane is a
+ * stream of w bit values in 32 bit words, and word j of lane l is stored at word 4 * j + l. So
+ * packing and unpacking 4 values at once is a shift of 4 words, and values 4k to 4k+3 come out
+ * together in order. */
+
+#ifdef __SSE2__
+
+static void postings_pack(const uint32_t *in, unsigned char *out, int w) {
+  if (!w) return;
+  __m128i acc = _mm_setzero_si128();
+  int off = 0;
+  for (int k = 0; k < RMUTIL_POSTINGS_BLOCK / 4; k++) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(in + 4 * k));
+    acc = _mm_or_si128(acc, _mm_sll_epi32(v, _mm_cvtsi32_si128(off)));
+    off += w;
+    if (off >= 32) {
+      _mm_storeu_si128((__m128i *)out, acc);
+      out += 16;
+      off -= 32;
+      // the bits that did not fit
+      acc = off ? _mm_srl_epi32(v, _mm_cvtsi32_si128(w - off)) : _mm_setzero_si128();
+    }
+  }
+}
+
+/* Add 4 deltas to run, the previous sum in all lanes, and store them as 64 bit values from base.
+ * Returns the last sum in all lanes */
+static inline __m128i postings_store4(uint64_t *out, __m128i v, __m128i run, __m128i base) {
+  __m128i zero = _mm_setzero_si128();
+  v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+  v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+  v = _mm_add_epi32(v, run);
+  _mm_storeu_si128((__m128i *)out, _mm_add_epi64(_mm_unpacklo_epi32(v, zero), base));
+  _mm_storeu_si128((__m128i *)(out + 2), _mm_add_epi64(_mm_unpackhi_epi32(v, zero), base));
+  return _mm_shuffle_epi32(v, 0xff);
+}
+
+/* Unpack the deltas of a block and store their sums from first. w > 0 */
+static void postings_unpack(const unsigned char *in, int w, uint64_t first, uint64_t *out) {
+  __m128i mask = _mm_set1_epi32(w == 32 ? UINT32_MAX : (1U << w) - 1);
+  __m128i base = _mm_set1_epi64x(first), run = _mm_setzero_si128();
+  __m128i cur = _mm_loadu_si128((const __m128i *)in);
+  int off = 0, word = 1;
+  for (int k = 0; k < RMUTIL_POSTINGS_BLOCK / 4; k++) {
+    __m128i v = _mm_srl_epi32(cur, _mm_cvtsi32_si128(off));
+    off += w;
+    if (off >= 32) {
+      off -= 32;
+      if (word < w) {
+        cur = _mm_loadu_si128((const __m128i *)(in + 16 * word++));
+        if (off) v = _mm_or_si128(v, _mm_sll_epi32(cur, _mm_cvtsi32_si128(w - off)));
+      }
+    }
+    run = postings_store4(out + 4 * k, _mm_and_si128(v, mask), run, base);
+  }
+}
+
+#else
+
+static void postings_pack(const uint32_t *in, unsigned char *out, int w) {
+  uint32_t words[RMUTIL_POSTINGS_BLOCK] = {0};
+  for (int k = 0; k < RMUTIL_POSTINGS_BLOCK / 4; k++) {
+    int bit = k * w, j = bit / 32, off = bit % 32;
+    for (int l = 0; l < 4; l++) {
+      uint32_t v = in[4 * k + l];
+      words[4 * j + l] |= v << off;
+      if (off + w > 32) words[4 * (j + 1) + l] |= v >> (32 - off);
+    }
+  }
+  for (int j = 0; j < 4 * w; j++) postings_put(&out, words[j], 4);
+}
+
+static void postings_unpack(const unsigned char *in, int w, uint64_t first, uint64_t *out) {
+  uint32_t words[RMUTIL_POSTINGS_BLOCK], mask = w == 32 ? UINT32_MAX : (1U << w) - 1;
+  for (int j = 0; j < 4 * w; j++) words[j] = postings_get(&in, 4);
+  uint64_t x = first;
+  for (int k = 0; k < RMUTIL_POSTINGS_BLOCK / 4; k++) {
+    int bit = k * w, j = bit / 32, off = bit % 32;
+    for (int l = 0; l < 4; l++) {
+      uint32_t v = words[4 * j + l] >> off;
+      if (off + w > 32) v |= words[4 * (j + 1) + l] << (32 - off);
+      x += v & mask;
+      out[4 * k + l] = x;
+    }
+  }
+}
+
+#endif
+
+/*********************************** Stream-vbyte ***********************************/
+
+/* Deltas take 1 to 4 bytes, and the lengths of 4 of them are stored in a control byte, 2 bits
+ * each from the low ones. All the control bytes come first, then the data */
+
+#ifdef __SSSE3__
+
+/* The shuffle moving the data of 4 deltas into 4 words for each control byte, and their length */
+static unsigned char svbShuffle[256][16];
+static unsigned char svbLength[256];
+static pthread_once_t svbOnce = PTHREAD_ONCE_INIT;
+
+static void postings_initTables(void) {
+  for (int c = 0; c < 256; c++) {
+    int pos = 0;
+    for (int j = 0; j < 4; j++) {
+      int len = ((c >> (2 * j)) & 3) + 1;
+      for (int b = 0; b < 4; b++) svbShuffle[c][4 * j + b] = b < len ? pos + b : 0x80;
+      pos += len;
+    }
+    svbLength[c] = pos;
+  }
+}
+
+#endif
+
+static unsigned char *postings_putStreamVByte(unsigned char *p, const uint32_t *d, size_t m) {
+  unsigned char *ctrl = p, *data = p + (m + 3) / 4;
+  memset(ctrl, 0, (m + 3) / 4);
+  for (size_t i = 0; i < m; i++) {
+    uint32_t v = d[i];
+    int len = v < 1U << 8 ? 1 : v < 1U << 16 ? 2 : v < 1U << 24 ? 3 : 4;
+    ctrl[i / 4] |= (len - 1) << (2 * (i % 4));
+    postings_put(&data, v, len);
+  }
+  return data;
+}
+
+/* Decode m deltas and store their sums from first */
+static void postings_decodeStreamVByte(const unsigned char *p, size_t m, uint64_t first,
+                                       uint64_t *out) {
+  const unsigned char *ctrl = p, *data = p + (m + 3) / 4;
+  uint64_t x = first;
+  size_t i = 0;
+#ifdef __SSSE3__
+  pthread_once(&svbOnce, postings_initTables);
+  __m128i base = _mm_set1_epi64x(first), run = _mm_setzero_si128();
+  for (; i + 4 <= m; i += 4) {
+    unsigned char c = ctrl[i / 4];
+    __m128i shuf = _mm_loadu_si128((const __m128i *)svbShuffle[c]);
+    __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), shuf);
+    data += svbLength[c];
+    run = postings_store4(out + i, v, run, base);
+  }
+  x += (uint32_t)_mm_cvtsi128_si32(run);
+#endif
+  for (; i < m; i++) {
+    int len = ((ctrl[i / 4] >> (2 * (i % 4))) & 3) + 1;
+    x += postings_get(&data, len);
+    out[i] = x;
+  }
+}
+
+/* Return the size of m stream-vbyte deltas at p, or SIZE_MAX if they don't end by end */
+static size_t postings_streamVByteSize(const unsigned char *p, const unsigned char *end, size_t m) {
+  size_t size = (m + 3) / 4;
+  if (size > (size_t)(end - p)) return SIZE_MAX;
+  for (size_t i = 0; i < m; i++) size += ((p[i / 4] >> (2 * (i % 4))) & 3) + 1;
+  return size;
+}
+
+/*********************************** Varint ***********************************/
+
+static inline unsigned char *postings_putVarint(unsigned char *p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = v | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+static void postings_decodeVarints(const unsigned char *p, size_t m, uint64_t first,
+                                   uint64_t *out) {
+  uint64_t x = first;
+  for (size_t i = 0; i < m; i++) {
+    uint64_t v = 0;
+    for (int shift = 0;; shift += 7) {
+      v |= (uint64_t)(*p & 0x7f) << shift;
+      if (!(*p++ & 0x80)) break;
+    }
+    x += v;
+    out[i] = x;
+  }
+}
+
+/* Return the size of m varints at p, or SIZE_MAX if they don't end by end or overflow 64 bits */
+static size_t postings_varintsSize(const unsigned char *p, const unsigned char *end, size_t m) {
+  const unsigned char *start = p;
+  for (size_t i = 0; i < m; i++) {
+    for (int shift = 0;; shift += 7) {
+      if (p == end || (shift == 63 && *p > 1)) return SIZE_MAX;
+      if (!(*p++ & 0x80)) break;
+    }
+  }
+  return p - start;
+}
+
+/*********************************** Encoding ***********************************/
+
+/* Encode a block of n values at p, returning its end */
+static unsigned char *postings_encodeBlock(unsigned char *p, const uint64_t *values, size_t n,
+                                           RMUtilPostingsCodec codec) {
+  uint32_t d[RMUTIL_POSTINGS_BLOCK];
+  int narrow = values[n - 1] - values[0] <= UINT32_MAX;
+  if (codec == RMUTIL_POSTINGS_VARINT || !narrow ||
+      (codec == RMUTIL_POSTINGS_BITPACK && n < RMUTIL_POSTINGS_BLOCK)) {
+    *p++ = POSTINGS_VARINT;
+    for (size_t i = 1; i < n; i++) p = postings_putVarint(p, values[i] - values[i - 1]);
+    return p;
+  }
+
+  uint32_t bits = d[0] = 0;
+  for (size_t i = 1; i < n; i++) bits |= d[i] = values[i] - values[i - 1];
+  if (codec == RMUTIL_POSTINGS_STREAMVBYTE) {
+    *p++ = POSTINGS_STREAMVBYTE;
+    return postings_putStreamVByte(p, d + 1, n - 1);
+  }
+  int w = bits ? 32 - __builtin_clz(bits) : 0;
+  *p++ = w;
+  postings_pack(d, p, w);
+  return p + 16 * w;
+}
+
+RMUtilPostings *RMUtilPostings_Encode(const uint64_t *values, size_t n, RMUtilPostingsCodec codec) {
+  for (size_t i = 1; i < n; i++) {
+    if (values[i] < values[i - 1]) return NULL;
+  }
+  RMUtilPostings *p = calloc(1, sizeof(*p));
+  p->count = n;
+  p->numBlocks = (n + RMUTIL_POSTINGS_BLOCK - 1) / RMUTIL_POSTINGS_BLOCK;
+  p->first = malloc(p->numBlocks * sizeof(uint64_t));
+  p->offsets = malloc((p->numBlocks + 1) * sizeof(uint32_t));
+  // room for the largest blocks, given back once the size is known
+  p->data = malloc(p->numBlocks * POSTINGS_MAX_BLOCK_SIZE + POSTINGS_PADDING);
+
+  unsigned char *end = p->data;
+  for (size_t i = 0; i < p->numBlocks; i++) {
+    size_t off = end - p->data;
+    if (off > UINT32_MAX) {
+      RMUtilPostings_Free(p);
+      return NULL;
+    }
+    p->offsets[i] = off;
+    p->first[i] = values[i * RMUTIL_POSTINGS_BLOCK];
+    end = postings_encodeBlock(end, values + i * RMUTIL_POSTINGS_BLOCK, postings_blockCount(p, i),
+                               codec);
+  }
+  size_t size = end - p->data;
+  if (size > UINT32_MAX) {
+    RMUtilPostings_Free(p);
+    return NULL;
+  }
+  p->offsets[p->numBlocks] = size;
+  p->data = realloc(p->data, size + POSTINGS_PADDING);
+  return p;
+}
+
+RMUtilPostings *RMUtilPostings_EncodeVector(const Vector *v, RMUtilPostingsCodec codec) {
+  if (v->elemSize != sizeof(uint64_t)) return NULL;
+  return RMUtilPostings_Encode((const uint64_t *)v->data, v->top, codec);
+}
+
+void RMUtilPostings_Free(RMUtilPostings *p) {
+  free(p->first);
+  free(p->offsets);
+  free(p->data);
+  free(p);
+}
+
+size_t RMUtilPostings_Count(const RMUtilPostings *p) {
+  return p->count;
+}
+
+size_t RMUtilPostings_NumBlocks(const RMUtilPostings *p) {
+  return p->numBlocks;
+}
+
+size_t RMUtilPostings_MemUsage(const RMUtilPostings *p) {
+  return sizeof(*p) + p->numBlocks * (sizeof(uint64_t) + sizeof(uint32_t)) + sizeof(uint32_t) +
+         p->offsets[p->numBlocks] + POSTINGS_PADDING;
+}
+
+/*********************************** Decoding ***********************************/
+
+size_t RMUtilPostings_DecodeBlock(const RMUtilPostings *p, size_t i, uint64_t *out) {
+  if (i >= p->numBlocks) return 0;
+  size_t n = postings_blockCount(p, i);
+  const unsigned char *data = p->data + p->offsets[i];
+  int hdr = *data++;
+  out[0] = p->first[i];
+  switch (hdr) {
+    case POSTINGS_VARINT:
+      postings_decodeVarints(data, n - 1, out[0], out + 1);
+      break;
+    case POSTINGS_STREAMVBYTE:
+      postings_decodeStreamVByte(data, n - 1, out[0], out + 1);
+      break;
+    case 0:
+      for (size_t j = 1; j < n; j++) out[j] = out[0];
+      break;
+    default:
+      postings_unpack(data, hdr, out[0], out);
+      break;
+  }
+  return n;
+}
+
+void RMUtilPostings_Decode(const RMUtilPostings *p, uint64_t *out) {
+  for (size_t i = 0; i < p->numBlocks; i++) {
+    RMUtilPostings_DecodeBlock(p, i, out + i * RMUTIL_POSTINGS_BLOCK);
+  }
+}
+
+RMUtilPostingsIterator *RMUtilPostings_Iterate(const RMUtilPostings *p) {
+  RMUtilPostingsIterator *it = malloc(sizeof(*it));
+  it->p = p;
+  it->block = 0;
+  it->pos = it->n = 0;
+  return it;
+}
+
+int RMUtilPostingsIterator_Next(RMUtilPostingsIterator *it, uint64_t *x) {
+  if (it->pos == it->n) {
+    if (it->block == it->p->numBlocks) return 0;
+    it->n = RMUtilPostings_DecodeBlock(it->p, it->block++, it->buf);
+    it->pos = 0;
+  }
+  *x = it->buf[it->pos++];
+  return 1;
+}
+
+int RMUtilPostingsIterator_SkipTo(RMUtilPostingsIterator *it, uint64_t target, uint64_t *x) {
+  const RMUtilPostings *p = it->p;
+  if (it->pos == it->n || it->buf[it->n - 1] < target) {
+    // find the first block starting at target or later: the value is in the one before, or is
+    // its first
+    size_t lo = it->block, hi = p->numBlocks;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (p->first[mid] < target) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo > it->block) it->block = lo - 1;
+    it->pos = it->n;
+  }
+
+  for (;;) {
+    if (it->pos == it->n) {
+      if (it->block == p->numBlocks) return 0;
+      it->n = RMUtilPostings_DecodeBlock(p, it->block++, it->buf);
+      it->pos = 0;
+    }
+    uint32_t lo = it->pos, hi = it->n;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (it->buf[mid] < target) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    it->pos = lo;
+    if (lo < it->n) {
+      *x = it->buf[it->pos++];
+      return 1;
+    }
+  }
+}
+
+void RMUtilPostingsIterator_Free(RMUtilPostingsIterator *it) {
+  free(it);
+}
+
+/*********************************** Serialization ***********************************/
+
+/* The count (8), then the first value (8) and size (4) of each block, then the blocks */
+#define POSTINGS_HEADER_SIZE 8
+#define POSTINGS_SKIP_ENTRY_SIZE 12
+
+size_t RMUtilPostings_SerializedSize(const RMUtilPostings *p) {
+  return POSTINGS_HEADER_SIZE + p->numBlocks * POSTINGS_SKIP_ENTRY_SIZE + p->offsets[p->numBlocks];
+}
+
+void RMUtilPostings_Serialize(const RMUtilPostings *p, char *buf) {
+  unsigned char *b = (unsigned char *)buf;
+  postings_put(&b, p->count, 8);
+  for (size_t i = 0; i < p->numBlocks; i++) {
+    postings_put(&b, p->first[i], 8);
+    postings_put(&b, p->offsets[i + 1] - p->offsets[i], 4);
+  }
+  memcpy(b, p->data, p->offsets[p->numBlocks]);
+}
+
+/* Check that block i is well formed and decodes to sorted values, up to the next block, within a
+ * 32 bit span unless it's varints */
+static int postings_validBlock(const RMUtilPostings *p, size_t i, uint64_t *buf) {
+  size_t n = postings_blockCount(p, i);
+  const unsigned char *data = p->data + p->offsets[i], *end = p->data + p->offsets[i + 1];
+  int hdr = *data++;
+  size_t size;
+  if (hdr == POSTINGS_VARINT) {
+    size = postings_varintsSize(data, end, n - 1);
+  } else if (hdr == POSTINGS_STREAMVBYTE) {
+    size = postings_streamVByteSize(data, end, n - 1);
+  } else {
+    if (hdr > 32 || n != RMUTIL_POSTINGS_BLOCK) return 0;
+    size = 16 * hdr;
+  }
+  if (size != (size_t)(end - data)) return 0;
+
+  RMUtilPostings_DecodeBlock(p, i, buf);
+  for (size_t j = 1; j < n; j++) {
+    if (buf[j] < buf[j - 1]) return 0;
+  }
+  if (hdr != POSTINGS_VARINT && buf[n - 1] - buf[0] > UINT32_MAX) return 0;
+  return i + 1 == p->numBlocks || buf[n - 1] <= p->first[i + 1];
+}
+
+RMUtilPostings *RMUtilPostings_Deserialize(const char *buf, size_t len) {
+  const unsigned char *b = (const unsigned char *)buf;
+  if (len < POSTINGS_HEADER_SIZE) return NULL;
+  uint64_t count = postings_get(&b, 8);
+  uint64_t numBlocks = count / RMUTIL_POSTINGS_BLOCK + (count % RMUTIL_POSTINGS_BLOCK != 0);
+  len -= POSTINGS_HEADER_SIZE;
+  if (numBlocks > len / POSTINGS_SKIP_ENTRY_SIZE) return NULL;
+  size_t size = len - numBlocks * POSTINGS_SKIP_ENTRY_SIZE;
+  if (size > UINT32_MAX) return NULL;
+
+  RMUtilPostings *p = calloc(1, sizeof(*p));
+  p->count = count;
+  p->numBlocks = numBlocks;
+  p->first = malloc(numBlocks * sizeof(uint64_t));
+  p->offsets = malloc((numBlocks + 1) * sizeof(uint32_t));
+  p->data = malloc(size + POSTINGS_PADDING);
+  // blocks can't be empty, as they start with a header byte
+  uint64_t off = 0;
+  for (size_t i = 0; i < numBlocks; i++) {
+    p->first[i] = postings_get(&b, 8);
+    p->offsets[i] = off;
+    uint32_t blockSize = postings_get(&b, 4);
+    off += blockSize;
+    if (!blockSize || off > size) goto err;
+  }
+  if (off != size) goto err;
+  p->offsets[numBlocks] = size;
+  memcpy(p->data, b, size);
+
+  uint64_t tmp[RMUTIL_POSTINGS_BLOCK];
+  for (size_t i = 0; i < numBlocks; i++) {
+    if (!postings_validBlock(p, i, tmp)) goto err;
+  }
+  return p;
+
+err:
+  RMUtilPostings_Free(p);
+  return NULL;
+}
+
+void RMUtilPostings_RdbSave(RedisModuleIO *io, const RMUtilPostings *p) {
+  size_t len = RMUtilPostings_SerializedSize(p);
+  char *buf = malloc(len);
+  RMUtilPostings_Serialize(p, buf);
+  RedisModule_SaveStringBuffer(io, buf, len);
+  free(buf);
+}
+
+RMUtilPostings *RMUtilPostings_RdbLoad(RedisModuleIO *io) {
+  size_t len;
+  char *buf = RedisModule_LoadStringBuffer(io, &len);
+  if (!buf) return NULL;
+  RMUtilPostings *p = RMUtilPostings_Deserialize(buf, len);
+  RedisModule_Free(buf);
+  return p;
+}
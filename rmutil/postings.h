@@ -0,0 +1,96 @@
+#ifndef __RMUTIL_POSTINGS_H__
+#define __RMUTIL_POSTINGS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <redismodule.h>
+#include "vector.h"
+
+/** postings.h - compressed sorted lists of 64 bit integers, e.g. the document ids of an inverted
+ * index term.
+ *
+ * Values are delta encoded in blocks of RMUTIL_POSTINGS_BLOCK. A skip table holds the first value
+ * and the offset of every block, so a block can be decoded on its own, and seeking to a value
+ * only decodes the block holding it. Each block is encoded in one of three formats:
+ *
+ *  - bit-packed: the 128 deltas of a full block, at the bit width of the largest one, in 4
+ *    interleaved lanes (value i in lane i % 4), so SSE2 packs, unpacks and prefix sums 4 values at
+ *    a time. The layout is the same without SSE2, which uses a portable loop.
+ *  - stream-vbyte: 1 to 4 bytes per delta, with the lengths of 4 deltas in a control byte, which
+ *    SSSE3 (-mssse3) turns into a shuffle decoding 4 deltas at once.
+ *  - varint: LEB128 deltas, for partial blocks and blocks spanning more than 2^32.
+ *
+ * RMUTIL_POSTINGS_BITPACK bit-packs the full blocks and uses varints for the last one, the
+ * smallest and fastest choice for dense lists. RMUTIL_POSTINGS_STREAMVBYTE suits lists with
+ * irregular gaps, where a few large deltas would widen a whole bit-packed block. The skip table
+ * adds 12 bytes per block, under a bit per value.
+ *
+ * Lists are immutable: build a new one to add values. The serialized form is portable (little
+ * endian) and validated when loaded.
+ */
+
+#define RMUTIL_POSTINGS_BLOCK 128
+
+typedef enum {
+  RMUTIL_POSTINGS_BITPACK,
+  RMUTIL_POSTINGS_STREAMVBYTE,
+  RMUTIL_POSTINGS_VARINT,
+} RMUtilPostingsCodec;
+
+/* RMUtilPostings - opaque encoded list */
+typedef struct RMUtilPostings RMUtilPostings;
+
+/* RMUtilPostingsIterator - opaque iterator */
+typedef struct RMUtilPostingsIterator RMUtilPostingsIterator;
+
+/* Encode n sorted values (duplicates allowed). Returns NULL if they are not sorted */
+RMUtilPostings *RMUtilPostings_Encode(const uint64_t *values, size_t n, RMUtilPostingsCodec codec);
+
+/* Encode a sorted vector of uint64_t. Returns NULL if it is not sorted or has another type */
+RMUtilPostings *RMUtilPostings_EncodeVector(const Vector *v, RMUtilPostingsCodec codec);
+
+void RMUtilPostings_Free(RMUtilPostings *p);
+
+/* Return the number of values */
+size_t RMUtilPostings_Count(const RMUtilPostings *p);
+
+size_t RMUtilPostings_NumBlocks(const RMUtilPostings *p);
+
+/* Return the number of bytes allocated by the list */
+size_t RMUtilPostings_MemUsage(const RMUtilPostings *p);
+
+/* Decode all the values into out, which needs room for RMUtilPostings_Count values */
+void RMUtilPostings_Decode(const RMUtilPostings *p, uint64_t *out);
+
+/* Decode block i into out, which needs room for RMUTIL_POSTINGS_BLOCK values. Returns the number
+ * of values in the block, 0 if there is no such block */
+size_t RMUtilPostings_DecodeBlock(const RMUtilPostings *p, size_t i, uint64_t *out);
+
+/* Iterate over the values in order */
+RMUtilPostingsIterator *RMUtilPostings_Iterate(const RMUtilPostings *p);
+
+/* Get the next value. Returns 0 when done */
+int RMUtilPostingsIterator_Next(RMUtilPostingsIterator *it, uint64_t *x);
+
+/* Skip to the first value at least target, from the current position on, and get it like Next.
+ * Blocks entirely below target are skipped without being decoded. Returns 0 if there is none */
+int RMUtilPostingsIterator_SkipTo(RMUtilPostingsIterator *it, uint64_t target, uint64_t *x);
+
+void RMUtilPostingsIterator_Free(RMUtilPostingsIterator *it);
+
+/* Return the size of the serialized list */
+size_t RMUtilPostings_SerializedSize(const RMUtilPostings *p);
+
+/* Serialize the list into buf, which must be RMUtilPostings_SerializedSize bytes long */
+void RMUtilPostings_Serialize(const RMUtilPostings *p, char *buf);
+
+/* Load a serialized list. Returns NULL if buf does not hold a valid one */
+RMUtilPostings *RMUtilPostings_Deserialize(const char *buf, size_t len);
+
+/* Save the list as a single string buffer in an RDB file */
+void RMUtilPostings_RdbSave(RedisModuleIO *io, const RMUtilPostings *p);
+
+/* Load a list saved with RMUtilPostings_RdbSave. Returns NULL on error */
+RMUtilPostings *RMUtilPostings_RdbLoad(RedisModuleIO *io);
+
+#endif
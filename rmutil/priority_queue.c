@@ -30,6 +30,10 @@ inline void Priority_Queue_Pop(PriorityQueue *pq) {
     pq->v->top--;
 }
 
+void Priority_Queue_Update(PriorityQueue *pq, size_t pos) {
+    Heap_Update(pq->v, 0, pq->v->top, pos, pq->cmp);
+}
+
 void Priority_Queue_Free(PriorityQueue *pq) {
     Vector_Free(pq->v);
     free(pq);
@@ -39,7 +39,7 @@ int Priority_Queue_Top(PriorityQueue *pq, void *ptr);
  */
 size_t __priority_Queue_PushPtr(PriorityQueue *pq, void *elem);
 
-#define Priority_Queue_Push(pq, elem) __priority_Queue_PushPtr(pq, &(typeof(elem)){elem})
+#define Priority_Queue_Push(pq, elem) __priority_Queue_PushPtr(pq, (typeof(elem)[1]){elem})
 
 /* Remove top element
  * Removes the element on top of the priority_queue, effectively reducing its size by one. The element removed is the
@@ -48,6 +48,12 @@ size_t __priority_Queue_PushPtr(PriorityQueue *pq, void *elem);
  */
 void Priority_Queue_Pop(PriorityQueue *pq);
 
+/* Update element
+ * Restores the order of the priority_queue after the element at pos in pq->v was modified in place, e.g. to change
+ * the priority of an element found by scanning pq->v.
+ */
+void Priority_Queue_Update(PriorityQueue *pq, size_t pos);
+
 /* free the priority queue and the underlying data. Does not release its elements if
  * they are pointers */
 void Priority_Queue_Free(PriorityQueue *pq);
@@ -0,0 +1,383 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "quantile.h"
+#include "alloc.h"
+
+/*********************************** t-digest ***********************************/
+
+typedef struct {
+  double mean, weight;
+} tdCentroid;
+
+struct RMUtilTDigest {
+  double compression;
+  /* n merged centroids sorted by mean, followed by the unmerged values */
+  tdCentroid *c;
+  int n, unmerged, cap;
+  /* the total weight, merged or not */
+  double weight;
+  double min, max;
+};
+
+/* The k1 scale function and its inverse: a centroid may only grow while it spans at most one unit
+ * of k, which is steepest near q = 0 and q = 1 */
+static inline double td_k(const RMUtilTDigest *td, double q) {
+  return td->compression / (2 * M_PI) * asin(2 * q - 1);
+}
+
+static inline double td_kinv(const RMUtilTDigest *td, double k) {
+  return (sin(k * 2 * M_PI / td->compression) + 1) / 2;
+}
+
+RMUtilTDigest *RMUtilTDigest_New(double compression) {
+  RMUtilTDigest *td = malloc(sizeof(*td));
+  td->compression = compression < 10 ? 10 : compression;
+  // merges leave at most compression + 2 centroids, and the buffer takes the rest
+  td->cap = (int)ceil(td->compression) * 6 + 10;
+  td->c = malloc(td->cap * sizeof(tdCentroid));
+  td->n = td->unmerged = 0;
+  td->weight = 0;
+  td->min = INFINITY;
+  td->max = -INFINITY;
+  return td;
+}
+
+void RMUtilTDigest_Free(RMUtilTDigest *td) {
+  free(td->c);
+  free(td);
+}
+
+/* Sort centroids by mean, quicksort down to small ranges which are insertion sorted */
+static void td_sort(tdCentroid *c, int n) {
+  while (n > 16) {
+    // median of three pivot
+    double a = c[0].mean, b = c[n / 2].mean, d = c[n - 1].mean;
+    double pivot = a < b ? (b < d ? b : (a < d ? d : a)) : (a < d ? a : (b < d ? d : b));
+    int i = 0, j = n - 1;
+    while (i <= j) {
+      while (c[i].mean < pivot) i++;
+      while (c[j].mean > pivot) j--;
+      if (i <= j) {
+        tdCentroid t = c[i];
+        c[i++] = c[j];
+        c[j--] = t;
+      }
+    }
+    // recurse into the smaller side, loop on the larger one
+    if (j + 1 < n - i) {
+      td_sort(c, j + 1);
+      c += i;
+      n -= i;
+    } else {
+      td_sort(c + i, n - i);
+      n = j + 1;
+    }
+  }
+  for (int i = 1; i < n; i++) {
+    tdCentroid t = c[i];
+    int j = i;
+    for (; j > 0 && c[j - 1].mean > t.mean; j--) c[j] = c[j - 1];
+    c[j] = t;
+  }
+}
+
+/* Merge the buffered values into the centroids */
+static void td_compress(RMUtilTDigest *td) {
+  if (!td->unmerged) return;
+  int m = td->n + td->unmerged, out = 0;
+  tdCentroid *c = td->c;
+  td_sort(c, m);
+
+  double total = td->weight, wSoFar = 0;
+  double wLimit = total * td_kinv(td, td_k(td, 0) + 1);
+  tdCentroid cur = c[0];
+  for (int i = 1; i < m; i++) {
+    if (wSoFar + cur.weight + c[i].weight <= wLimit) {
+      cur.weight += c[i].weight;
+      cur.mean += (c[i].mean - cur.mean) * c[i].weight / cur.weight;
+    } else {
+      wSoFar += cur.weight;
+      c[out++] = cur;
+      wLimit = total * td_kinv(td, td_k(td, wSoFar / total) + 1);
+      cur = c[i];
+    }
+  }
+  c[out++] = cur;
+  td->n = out;
+  td->unmerged = 0;
+}
+
+void RMUtilTDigest_AddWeighted(RMUtilTDigest *td, double x, double w) {
+  if (isnan(x) || !(w > 0)) return;
+  if (td->n + td->unmerged == td->cap) td_compress(td);
+  td->c[td->n + td->unmerged++] = (tdCentroid){x, w};
+  td->weight += w;
+  if (x < td->min) td->min = x;
+  if (x > td->max) td->max = x;
+}
+
+void RMUtilTDigest_Add(RMUtilTDigest *td, double x) {
+  RMUtilTDigest_AddWeighted(td, x, 1);
+}
+
+void RMUtilTDigest_AddBatch(RMUtilTDigest *td, const double *xs, size_t n) {
+  for (size_t i = 0; i < n; i++) RMUtilTDigest_AddWeighted(td, xs[i], 1);
+}
+
+void RMUtilTDigest_Merge(RMUtilTDigest *dst, const RMUtilTDigest *src) {
+  for (int i = 0; i < src->n + src->unmerged; i++) {
+    RMUtilTDigest_AddWeighted(dst, src->c[i].mean, src->c[i].weight);
+  }
+  // centroid means are within the range, the exact bounds are kept
+  if (src->min < dst->min) dst->min = src->min;
+  if (src->max > dst->max) dst->max = src->max;
+}
+
+double RMUtilTDigest_Quantile(RMUtilTDigest *td, double q) {
+  td_compress(td);
+  if (!td->n) return NAN;
+  if (q <= 0) return td->min;
+  if (q >= 1) return td->max;
+
+  // each centroid's weight is centered on its mean: interpolate between neighbouring means, and
+  // between the extreme means and the min or max
+  const tdCentroid *c = td->c;
+  double index = q * td->weight, wSoFar = c[0].weight / 2;
+  if (index < wSoFar) {
+    return td->min + (c[0].mean - td->min) * index / wSoFar;
+  }
+  for (int i = 0; i < td->n - 1; i++) {
+    double dw = (c[i].weight + c[i + 1].weight) / 2;
+    if (wSoFar + dw > index) {
+      return c[i].mean + (c[i + 1].mean - c[i].mean) * (index - wSoFar) / dw;
+    }
+    wSoFar += dw;
+  }
+  double last = c[td->n - 1].weight / 2;
+  return c[td->n - 1].mean + (td->max - c[td->n - 1].mean) * (index - wSoFar) / last;
+}
+
+double RMUtilTDigest_CDF(RMUtilTDigest *td, double x) {
+  td_compress(td);
+  if (!td->n) return NAN;
+  if (x < td->min) return 0;
+  if (x >= td->max) return 1;
+
+  const tdCentroid *c = td->c;
+  double wSoFar = c[0].weight / 2;
+  if (x < c[0].mean) {
+    return wSoFar * (x - td->min) / (c[0].mean - td->min) / td->weight;
+  }
+  for (int i = 0; i < td->n - 1; i++) {
+    double dw = (c[i].weight + c[i + 1].weight) / 2;
+    if (x < c[i + 1].mean) {
+      return (wSoFar + dw * (x - c[i].mean) / (c[i + 1].mean - c[i].mean)) / td->weight;
+    }
+    wSoFar += dw;
+  }
+  double last = c[td->n - 1].weight / 2;
+  return (wSoFar + last * (x - c[td->n - 1].mean) / (td->max - c[td->n - 1].mean)) / td->weight;
+}
+
+double RMUtilTDigest_Count(const RMUtilTDigest *td) {
+  return td->weight;
+}
+
+double RMUtilTDigest_Min(const RMUtilTDigest *td) {
+  return td->weight ? td->min : NAN;
+}
+
+double RMUtilTDigest_Max(const RMUtilTDigest *td) {
+  return td->weight ? td->max : NAN;
+}
+
+size_t RMUtilTDigest_MemUsage(const RMUtilTDigest *td) {
+  return sizeof(*td) + td->cap * sizeof(tdCentroid);
+}
+
+/*********************************** DDSketch ***********************************/
+
+/* Counts of the bucket indexes offset..offset + len, non zero between lo and hi */
+typedef struct {
+  uint64_t *counts;
+  int32_t offset, len;
+  int32_t lo, hi;
+} ddStore;
+
+struct RMUtilDDSketch {
+  double alpha, gamma, invLogGamma;
+  uint32_t maxBuckets;
+  /* positive values, and negative ones by their absolute value */
+  ddStore pos, neg;
+  uint64_t zeros, count;
+  double min, max;
+};
+
+RMUtilDDSketch *RMUtilDDSketch_New(double alpha, int maxBuckets) {
+  if (!(alpha > 0 && alpha < 1)) return NULL;
+  RMUtilDDSketch *dd = calloc(1, sizeof(*dd));
+  dd->alpha = alpha;
+  dd->gamma = (1 + alpha) / (1 - alpha);
+  dd->invLogGamma = 1 / log(dd->gamma);
+  dd->maxBuckets = maxBuckets < 16 ? 16 : maxBuckets;
+  dd->min = INFINITY;
+  dd->max = -INFINITY;
+  return dd;
+}
+
+void RMUtilDDSketch_Free(RMUtilDDSketch *dd) {
+  free(dd->pos.counts);
+  free(dd->neg.counts);
+  free(dd);
+}
+
+/* Bucket i holds the values in (gamma^(i-1), gamma^i] */
+static inline int32_t dd_index(const RMUtilDDSketch *dd, double x) {
+  return (int32_t)ceil(log(x) * dd->invLogGamma);
+}
+
+/* The value reported for bucket i, within alpha of all the values in it */
+static inline double dd_value(const RMUtilDDSketch *dd, int32_t i) {
+  return 2 * pow(dd->gamma, i) / (dd->gamma + 1);
+}
+
+/* Make room for bucket i, merging the lowest buckets if there would be too many */
+static int32_t dd_reserve(const RMUtilDDSketch *dd, ddStore *s, int32_t i) {
+  if (s->counts && i >= s->offset && i < s->offset + s->len) return i;
+
+  int32_t lo = s->counts ? (i < s->lo ? i : s->lo) : i;
+  int32_t hi = s->counts ? (i > s->hi ? i : s->hi) : i;
+  int64_t want = (int64_t)hi - lo + 1, len = want * 2 < 32 ? 32 : want * 2;
+  if (len > dd->maxBuckets) len = dd->maxBuckets;
+  // leave the slack on the side the store grows to, or around the first bucket
+  int32_t offset = !s->counts ? i - len / 2 : i < s->lo ? hi - len + 1 : lo;
+  if (want > dd->maxBuckets) offset = hi - len + 1;
+
+  uint64_t *counts = calloc(len, sizeof(uint64_t));
+  if (s->counts) {
+    for (int32_t j = s->lo; j <= s->hi; j++) {
+      counts[(j < offset ? offset : j) - offset] += s->counts[j - s->offset];
+    }
+    free(s->counts);
+  }
+  s->counts = counts;
+  s->offset = offset;
+  s->len = len;
+  if (s->lo < offset) s->lo = offset;
+  return i < offset ? offset : i;
+}
+
+static void dd_add(const RMUtilDDSketch *dd, ddStore *s, int32_t i, uint64_t n) {
+  int empty = !s->counts;
+  i = dd_reserve(dd, s, i);
+  s->counts[i - s->offset] += n;
+  if (empty) {
+    s->lo = s->hi = i;
+  } else {
+    if (i < s->lo) s->lo = i;
+    if (i > s->hi) s->hi = i;
+  }
+}
+
+void RMUtilDDSketch_AddN(RMUtilDDSketch *dd, double x, uint64_t n) {
+  if (!isfinite(x) || !n) return;
+  if (x > 0) {
+    dd_add(dd, &dd->pos, dd_index(dd, x), n);
+  } else if (x < 0) {
+    dd_add(dd, &dd->neg, dd_index(dd, -x), n);
+  } else {
+    dd->zeros += n;
+  }
+  dd->count += n;
+  if (x < dd->min) dd->min = x;
+  if (x > dd->max) dd->max = x;
+}
+
+static void dd_mergeStore(const RMUtilDDSketch *dd, ddStore *dst, const ddStore *src) {
+  if (!src->counts) return;
+  for (int32_t i = src->lo; i <= src->hi; i++) {
+    uint64_t n = src->counts[i - src->offset];
+    if (n) dd_add(dd, dst, i, n);
+  }
+}
+
+int RMUtilDDSketch_Merge(RMUtilDDSketch *dst, const RMUtilDDSketch *src) {
+  if (dst->alpha != src->alpha) return 0;
+  dd_mergeStore(dst, &dst->pos, &src->pos);
+  dd_mergeStore(dst, &dst->neg, &src->neg);
+  dst->zeros += src->zeros;
+  dst->count += src->count;
+  if (src->min < dst->min) dst->min = src->min;
+  if (src->max > dst->max) dst->max = src->max;
+  return 1;
+}
+
+static inline double dd_clamp(const RMUtilDDSketch *dd, double x) {
+  return x < dd->min ? dd->min : x > dd->max ? dd->max : x;
+}
+
+double RMUtilDDSketch_Quantile(const RMUtilDDSketch *dd, double q) {
+  if (!dd->count) return NAN;
+  if (q <= 0) return dd->min;
+  if (q >= 1) return dd->max;
+
+  // negative values from the largest absolute value, then zeros, then positive values
+  double rank = q * (dd->count - 1);
+  uint64_t seen = 0;
+  const ddStore *s = &dd->neg;
+  if (s->counts) {
+    for (int32_t i = s->hi; i >= s->lo; i--) {
+      seen += s->counts[i - s->offset];
+      if (seen > rank) return dd_clamp(dd, -dd_value(dd, i));
+    }
+  }
+  seen += dd->zeros;
+  if (seen > rank) return 0;
+  s = &dd->pos;
+  for (int32_t i = s->lo; i <= s->hi; i++) {
+    seen += s->counts[i - s->offset];
+    if (seen > rank) return dd_clamp(dd, dd_value(dd, i));
+  }
+  return dd->max;
+}
+
+double RMUtilDDSketch_CDF(const RMUtilDDSketch *dd, double x) {
+  if (!dd->count) return NAN;
+  if (x < dd->min) return 0;
+  if (x >= dd->max) return 1;
+
+  // count whole buckets, up to the one of x
+  uint64_t below = 0;
+  const ddStore *s = &dd->neg;
+  if (s->counts) {
+    int32_t limit = x < 0 ? dd_index(dd, -x) : INT32_MIN;
+    for (int32_t i = s->lo; i <= s->hi; i++) {
+      if (i >= limit) below += s->counts[i - s->offset];
+    }
+  }
+  if (x >= 0) below += dd->zeros;
+  s = &dd->pos;
+  if (x > 0 && s->counts) {
+    int32_t limit = dd_index(dd, x);
+    for (int32_t i = s->lo; i <= s->hi && i <= limit; i++) below += s->counts[i - s->offset];
+  }
+  return (double)below / dd->count;
+}
+
+uint64_t RMUtilDDSketch_Count(const RMUtilDDSketch *dd) {
+  return dd->count;
+}
+
+double RMUtilDDSketch_Min(const RMUtilDDSketch *dd) {
+  return dd->count ? dd->min : NAN;
+}
+
+double RMUtilDDSketch_Max(const RMUtilDDSketch *dd) {
+  return dd->count ? dd->max : NAN;
+}
+
+size_t RMUtilDDSketch_MemUsage(const RMUtilDDSketch *dd) {
+  return sizeof(*dd) + ((size_t)dd->pos.len + dd->neg.len) * sizeof(uint64_t);
+}
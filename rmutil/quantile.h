@@ -0,0 +1,88 @@
+#ifndef __RMUTIL_QUANTILE_H__
+#define __RMUTIL_QUANTILE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** quantile.h - bounded memory quantile estimators for streams of doubles.
+ *
+ * Unlike histogram.h, which has a fixed set of buckets over unsigned integers, these adapt to any
+ * range of values, negative ones included.
+ *
+ *  - RMUtilTDigest is a merging t-digest. Values are appended to a buffer, which is sorted and
+ *    merged into a list of centroids when it fills up. The k1 scale function keeps centroids small
+ *    near the ends, so that extreme quantiles (p99, p999) are the most accurate. It holds about
+ *    compression / 2 centroids: 100 gives about 1% error at the median, much less at the tails,
+ *    in about 10KB.
+ *  - RMUtilDDSketch guarantees a relative error: a quantile is reported within alpha times its
+ *    true value. Values are counted in logarithmic buckets, which makes inserts cheap and merges
+ *    exact. The number of buckets is capped, the lowest ones being merged past it, so memory stays
+ *    bounded even for values spanning many orders of magnitude.
+ *
+ * Both can be merged, e.g. the per-thread sketches of a workload. They are not thread safe.
+ */
+
+/* RMUtilTDigest - opaque t-digest */
+typedef struct RMUtilTDigest RMUtilTDigest;
+
+/* A t-digest with the given compression, e.g. 100. Higher is more accurate and takes more room */
+RMUtilTDigest *RMUtilTDigest_New(double compression);
+void RMUtilTDigest_Free(RMUtilTDigest *td);
+
+/* Add a value, or a value with a weight. NaNs are ignored */
+void RMUtilTDigest_Add(RMUtilTDigest *td, double x);
+void RMUtilTDigest_AddWeighted(RMUtilTDigest *td, double x, double w);
+
+/* Add n values */
+void RMUtilTDigest_AddBatch(RMUtilTDigest *td, const double *xs, size_t n);
+
+/* Add the values of src to dst */
+void RMUtilTDigest_Merge(RMUtilTDigest *dst, const RMUtilTDigest *src);
+
+/* Return the estimated value at quantile q (0-1), or NaN if the digest is empty. This merges the
+ * buffered values first */
+double RMUtilTDigest_Quantile(RMUtilTDigest *td, double q);
+
+/* Return the estimated fraction of the values smaller than or equal to x, or NaN if empty */
+double RMUtilTDigest_CDF(RMUtilTDigest *td, double x);
+
+/* Return the total weight of the values added */
+double RMUtilTDigest_Count(const RMUtilTDigest *td);
+double RMUtilTDigest_Min(const RMUtilTDigest *td);
+double RMUtilTDigest_Max(const RMUtilTDigest *td);
+
+/* Return the number of bytes allocated by the digest */
+size_t RMUtilTDigest_MemUsage(const RMUtilTDigest *td);
+
+/* RMUtilDDSketch - opaque DDSketch */
+typedef struct RMUtilDDSketch RMUtilDDSketch;
+
+/* A sketch reporting quantiles within a relative error of alpha (e.g. 0.01), with at most
+ * maxBuckets buckets for each sign (e.g. 2048). Returns NULL if alpha is not in (0, 1) */
+RMUtilDDSketch *RMUtilDDSketch_New(double alpha, int maxBuckets);
+void RMUtilDDSketch_Free(RMUtilDDSketch *dd);
+
+/* Add a value n times. NaNs and infinities are ignored */
+void RMUtilDDSketch_AddN(RMUtilDDSketch *dd, double x, uint64_t n);
+
+static inline void RMUtilDDSketch_Add(RMUtilDDSketch *dd, double x) {
+  RMUtilDDSketch_AddN(dd, x, 1);
+}
+
+/* Add the values of src to dst. Returns 0 if their relative errors differ */
+int RMUtilDDSketch_Merge(RMUtilDDSketch *dst, const RMUtilDDSketch *src);
+
+/* Return the estimated value at quantile q (0-1), or NaN if the sketch is empty */
+double RMUtilDDSketch_Quantile(const RMUtilDDSketch *dd, double q);
+
+/* Return the estimated fraction of the values smaller than or equal to x, or NaN if empty */
+double RMUtilDDSketch_CDF(const RMUtilDDSketch *dd, double x);
+
+uint64_t RMUtilDDSketch_Count(const RMUtilDDSketch *dd);
+double RMUtilDDSketch_Min(const RMUtilDDSketch *dd);
+double RMUtilDDSketch_Max(const RMUtilDDSketch *dd);
+
+/* Return the number of bytes allocated by the sketch */
+size_t RMUtilDDSketch_MemUsage(const RMUtilDDSketch *dd);
+
+#endif
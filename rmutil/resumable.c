@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <time.h>
+#include "resumable.h"
+#include "alloc.h"
+
+typedef struct {
+  RMUtilResumableStepFunc step;
+  RMUtilResumableReplyFunc reply;
+  RMUtilResumableFreeFunc freeState;
+  void *state;
+  RMUtilResumableOptions opts;
+  RedisModuleBlockedClient *bc;
+  int disconnected;
+} resumableJob;
+
+static long long resumable_nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Run steps for a single time slice. Returns RMUTIL_RESUMABLE_DONE or _CONTINUE */
+static int resumable_runSlice(RedisModuleCtx *ctx, resumableJob *job) {
+  long long deadline = resumable_nowUs() + job->opts.budgetUs;
+  int rc;
+  while ((rc = job->step(ctx, job->state)) == RMUTIL_RESUMABLE_CONTINUE) {
+    if (resumable_nowUs() >= deadline) break;
+  }
+  return rc;
+}
+
+static void resumable_freeJob(resumableJob *job) {
+  if (job->freeState) job->freeState(job->state);
+  free(job);
+}
+
+static int resumable_finish(RedisModuleCtx *ctx, resumableJob *job) {
+  int rc = job->reply(ctx, job->state);
+  resumable_freeJob(job);
+  return rc;
+}
+
+static int resumable_reply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  resumableJob *job = RedisModule_GetBlockedClientPrivateData(ctx);
+  return job->reply(ctx, job->state);
+}
+
+static void resumable_freePrivdata(RedisModuleCtx *ctx, void *pd) {
+  if (pd) resumable_freeJob(pd);
+}
+
+static void resumable_disconnected(RedisModuleCtx *ctx, RedisModuleBlockedClient *bc) {
+  resumableJob *job = RedisModule_BlockClientGetPrivateData(bc);
+  if (job) job->disconnected = 1;
+}
+
+/* Timer callback, runs one slice per iteration of the event loop */
+static void resumable_continue(RedisModuleCtx *ctx, void *data) {
+  resumableJob *job = data;
+  if (!job->disconnected && resumable_runSlice(ctx, job) == RMUTIL_RESUMABLE_CONTINUE) {
+    RedisModule_CreateTimer(ctx, 0, resumable_continue, job);
+    return;
+  }
+  RedisModule_UnblockClient(job->bc, job);
+}
+
+/* Run to the end within the command, yielding between slices if we can. Called once a slice has
+ * run out of budget, so it yields before running the next one */
+static int resumable_runYielding(RedisModuleCtx *ctx, resumableJob *job) {
+  do {
+    if (RedisModule_Yield) RedisModule_Yield(ctx, job->opts.yieldFlags, job->opts.busyReply);
+  } while (resumable_runSlice(ctx, job) == RMUTIL_RESUMABLE_CONTINUE);
+  return resumable_finish(ctx, job);
+}
+
+int RMUtil_RunResumable(RedisModuleCtx *ctx, RMUtilResumableStepFunc step,
+                        RMUtilResumableReplyFunc reply, RMUtilResumableFreeFunc freeState,
+                        void *state, const RMUtilResumableOptions *opts) {
+  resumableJob *job = calloc(1, sizeof(*job));
+  *job = (resumableJob){.step = step, .reply = reply, .freeState = freeState, .state = state};
+  if (opts) job->opts = *opts;
+  if (job->opts.budgetUs <= 0) job->opts.budgetUs = 1000;
+  if (!job->opts.yieldFlags) job->opts.yieldFlags = REDISMODULE_YIELD_FLAG_CLIENTS;
+
+  // the first slice runs right away, and short commands never get past it
+  if (resumable_runSlice(ctx, job) == RMUTIL_RESUMABLE_DONE) return resumable_finish(ctx, job);
+
+  int canBlock = RedisModule_BlockClient && RedisModule_CreateTimer;
+  if (canBlock && RedisModule_GetContextFlags) {
+    int flags = RedisModule_GetContextFlags(ctx);
+    if (flags & (REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA |
+                 REDISMODULE_CTX_FLAGS_DENY_BLOCKING)) {
+      canBlock = 0;
+    }
+  }
+  RMUtilResumableMode mode = job->opts.mode;
+  if (mode == RMUTIL_RESUMABLE_AUTO) {
+    mode = RedisModule_Yield ? RMUTIL_RESUMABLE_YIELD : RMUTIL_RESUMABLE_BLOCK;
+  }
+  if (mode == RMUTIL_RESUMABLE_YIELD || !canBlock) return resumable_runYielding(ctx, job);
+
+  job->bc = RedisModule_BlockClient(ctx, resumable_reply, NULL, resumable_freePrivdata, 0);
+  if (!job->bc) return resumable_runYielding(ctx, job);
+  if (RedisModule_BlockClientSetPrivateData) RedisModule_BlockClientSetPrivateData(job->bc, job);
+  if (RedisModule_SetDisconnectCallback) {
+    RedisModule_SetDisconnectCallback(job->bc, resumable_disconnected);
+  }
+  RedisModule_CreateTimer(ctx, 0, resumable_continue, job);
+  return REDISMODULE_OK;
+}
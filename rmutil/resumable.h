@@ -0,0 +1,64 @@
+#ifndef __RMUTIL_RESUMABLE_H__
+#define __RMUTIL_RESUMABLE_H__
+
+#include <redismodule.h>
+
+/** resumable.h - run long commands cooperatively, a time slice at a time.
+ *
+ * A long scan or range delete is written as a resumable step function: each call does a small,
+ * bounded chunk of work (say a hundred elements), keeps its cursor in the state, and says whether
+ * there is more to do. RMUtil_RunResumable calls it over and over, and every time the time budget
+ * is spent it lets the server breathe, in one of two ways:
+ *
+ *  - RMUTIL_RESUMABLE_YIELD: keep running inside the command, calling RedisModule_Yield between
+ *    slices so the server processes events (and, past busy-reply-threshold, answers clients with
+ *    the busy reply). The command is still atomic.
+ *  - RMUTIL_RESUMABLE_BLOCK: block the client and continue on a timer in the next iterations of
+ *    the event loop, with the state kept as the blocked client's private data. Other clients are
+ *    served between slices, so the keyspace may change under the cursor - the step function must
+ *    cope with that, like SCAN does.
+ *
+ * RMUTIL_RESUMABLE_AUTO uses Yield if the server has it, and blocking otherwise. Where blocking is
+ * not allowed (MULTI, scripts) the command falls back to Yield, or to just running to the end.
+ * If the work finishes within the first slice, the command replies right away either way.
+ */
+
+#define RMUTIL_RESUMABLE_DONE 0
+#define RMUTIL_RESUMABLE_CONTINUE 1
+
+/* Do a bounded chunk of work on state, and return RMUTIL_RESUMABLE_DONE when there is nothing
+ * left to do or RMUTIL_RESUMABLE_CONTINUE otherwise */
+typedef int (*RMUtilResumableStepFunc)(RedisModuleCtx *ctx, void *state);
+
+/* Reply to the client once the work is done */
+typedef int (*RMUtilResumableReplyFunc)(RedisModuleCtx *ctx, void *state);
+
+/* Free the state */
+typedef void (*RMUtilResumableFreeFunc)(void *state);
+
+typedef enum {
+  RMUTIL_RESUMABLE_AUTO = 0,
+  RMUTIL_RESUMABLE_YIELD,
+  RMUTIL_RESUMABLE_BLOCK,
+} RMUtilResumableMode;
+
+typedef struct {
+  RMUtilResumableMode mode;
+  /* Time slice in microseconds. Default 1000 */
+  long long budgetUs;
+  /* Flags and busy reply passed to RedisModule_Yield. Default REDISMODULE_YIELD_FLAG_CLIENTS */
+  int yieldFlags;
+  const char *busyReply;
+} RMUtilResumableOptions;
+
+/**
+ * Run step(ctx, state) until it's done, then reply(ctx, state) and freeState(state). Call it from
+ * a command handler and return its return value. opts may be NULL for the defaults.
+ *
+ * If the client disconnects while blocked, the remaining steps are skipped and the state freed.
+ */
+int RMUtil_RunResumable(RedisModuleCtx *ctx, RMUtilResumableStepFunc step,
+                        RMUtilResumableReplyFunc reply, RMUtilResumableFreeFunc freeState,
+                        void *state, const RMUtilResumableOptions *opts);
+
+#endif
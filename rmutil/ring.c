@@ -0,0 +1,356 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+#include "alloc.h"
+
+#define RING_CACHE_LINE 64
+/* how many times a waiter polls the ring before yielding or sleeping */
+#define RING_SPINS 256
+
+static inline void ring_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/* Sleepers of RMUTIL_RING_BLOCKING rings. Producers waiting for room and consumers waiting for
+ * items share it: a wakeup may be for the other side, and waiters just check again */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int waiters;
+  int closed;
+} ringWait;
+
+static void ring_initWait(ringWait *w) {
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->cond, NULL);
+  w->waiters = w->closed = 0;
+}
+
+static void ring_destroyWait(ringWait *w) {
+  pthread_cond_destroy(&w->cond);
+  pthread_mutex_destroy(&w->lock);
+}
+
+/* Wake up the sleepers after a push or pop. The fence pairs with the one in ring_wait: either the
+ * waiter sees the ring change, or we see the waiter */
+static inline void ring_notify(ringWait *w) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&w->waiters, __ATOMIC_RELAXED)) {
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+  }
+}
+
+static void ring_close(ringWait *w) {
+  __atomic_store_n(&w->closed, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock(&w->lock);
+  pthread_cond_broadcast(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+}
+
+static inline int ring_closed(ringWait *w) {
+  return __atomic_load_n(&w->closed, __ATOMIC_ACQUIRE);
+}
+
+/* Wait until ready(r) or the ring is closed. May return early, callers check again */
+static void ring_wait(ringWait *w, int flags, int (*ready)(void *), void *r) {
+  for (int i = 0; i < RING_SPINS; i++) {
+    if (ready(r) || ring_closed(w)) return;
+    ring_pause();
+  }
+  if (!(flags & RMUTIL_RING_BLOCKING)) {
+    sched_yield();
+    return;
+  }
+  pthread_mutex_lock(&w->lock);
+  __atomic_add_fetch(&w->waiters, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  while (!ready(r) && !ring_closed(w)) pthread_cond_wait(&w->cond, &w->lock);
+  __atomic_sub_fetch(&w->waiters, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&w->lock);
+}
+
+/* Round capacity up to a power of two, or return 0 if it is out of range */
+static uint64_t ring_capacity(size_t capacity) {
+  if (!capacity || capacity > (size_t)1 << 31) return 0;
+  uint64_t cap = 1;
+  while (cap < capacity) cap <<= 1;
+  return cap;
+}
+
+/* Copy n items to the slots from position pos on, wrapping around */
+static inline void ring_copyIn(void **slots, uint64_t mask, uint64_t pos, void *const *items,
+                               size_t n) {
+  size_t i = pos & mask, first = mask + 1 - i;
+  if (n == 1) {
+    slots[i] = items[0];
+    return;
+  }
+  if (first > n) first = n;
+  memcpy(slots + i, items, first * sizeof(void *));
+  memcpy(slots, items + first, (n - first) * sizeof(void *));
+}
+
+static inline void ring_copyOut(void *const *slots, uint64_t mask, uint64_t pos, void **items,
+                                size_t n) {
+  size_t i = pos & mask, first = mask + 1 - i;
+  if (n == 1) {
+    items[0] = slots[i];
+    return;
+  }
+  if (first > n) first = n;
+  memcpy(items, slots + i, first * sizeof(void *));
+  memcpy(items + first, slots, (n - first) * sizeof(void *));
+}
+
+/*********************************** SPSC ***********************************/
+
+struct RMUtilSPSCRing {
+  /* read only */
+  void **slots;
+  uint64_t mask;
+  int flags;
+  char pad0[RING_CACHE_LINE];
+  /* the producer's: the next slot to fill, and the consumer's tail as last seen */
+  uint64_t head, cachedTail;
+  char pad1[RING_CACHE_LINE];
+  /* the consumer's: the next slot to read, and the producer's head as last seen */
+  uint64_t tail, cachedHead;
+  char pad2[RING_CACHE_LINE];
+  ringWait wait;
+};
+
+RMUtilSPSCRing *RMUtilSPSCRing_New(size_t capacity, int flags) {
+  uint64_t cap = ring_capacity(capacity);
+  if (!cap) return NULL;
+  RMUtilSPSCRing *r = calloc(1, sizeof(*r));
+  r->slots = malloc(cap * sizeof(void *));
+  r->mask = cap - 1;
+  r->flags = flags;
+  ring_initWait(&r->wait);
+  return r;
+}
+
+void RMUtilSPSCRing_Free(RMUtilSPSCRing *r) {
+  ring_destroyWait(&r->wait);
+  free(r->slots);
+  free(r);
+}
+
+size_t RMUtilSPSCRing_Capacity(const RMUtilSPSCRing *r) {
+  return r->mask + 1;
+}
+
+size_t RMUtilSPSCRing_Size(const RMUtilSPSCRing *r) {
+  uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+}
+
+size_t RMUtilSPSCRing_PushBatch(RMUtilSPSCRing *r, void *const *items, size_t n) {
+  uint64_t head = r->head, cap = r->mask + 1;
+  // only look at the consumer's line when the cached tail says there's no room
+  if (cap - (head - r->cachedTail) < n) {
+    r->cachedTail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+  }
+  size_t room = cap - (head - r->cachedTail);
+  if (n > room) n = room;
+  if (!n) return 0;
+  ring_copyIn(r->slots, r->mask, head, items, n);
+  __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+  if (r->flags & RMUTIL_RING_BLOCKING) ring_notify(&r->wait);
+  return n;
+}
+
+int RMUtilSPSCRing_Push(RMUtilSPSCRing *r, void *item) {
+  return RMUtilSPSCRing_PushBatch(r, &item, 1);
+}
+
+size_t RMUtilSPSCRing_PopBatch(RMUtilSPSCRing *r, void **items, size_t max) {
+  uint64_t tail = r->tail;
+  if (r->cachedHead - tail < max) {
+    r->cachedHead = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  }
+  size_t avail = r->cachedHead - tail;
+  if (max > avail) max = avail;
+  if (!max) return 0;
+  ring_copyOut(r->slots, r->mask, tail, items, max);
+  __atomic_store_n(&r->tail, tail + max, __ATOMIC_RELEASE);
+  if (r->flags & RMUTIL_RING_BLOCKING) ring_notify(&r->wait);
+  return max;
+}
+
+int RMUtilSPSCRing_Pop(RMUtilSPSCRing *r, void **item) {
+  return RMUtilSPSCRing_PopBatch(r, item, 1);
+}
+
+static int spsc_canPush(void *p) {
+  RMUtilSPSCRing *r = p;
+  return r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) <= r->mask;
+}
+
+static int spsc_canPop(void *p) {
+  RMUtilSPSCRing *r = p;
+  return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != r->tail;
+}
+
+size_t RMUtilSPSCRing_PushWait(RMUtilSPSCRing *r, void *const *items, size_t n) {
+  size_t done = RMUtilSPSCRing_PushBatch(r, items, n);
+  while (done < n && !ring_closed(&r->wait)) {
+    ring_wait(&r->wait, r->flags, spsc_canPush, r);
+    done += RMUtilSPSCRing_PushBatch(r, items + done, n - done);
+  }
+  return done;
+}
+
+size_t RMUtilSPSCRing_PopWait(RMUtilSPSCRing *r, void **items, size_t max) {
+  for (;;) {
+    // check for closing first, so the items pushed before it are not missed
+    int closed = ring_closed(&r->wait);
+    size_t n = RMUtilSPSCRing_PopBatch(r, items, max);
+    if (n || closed || !max) return n;
+    ring_wait(&r->wait, r->flags, spsc_canPop, r);
+  }
+}
+
+void RMUtilSPSCRing_Close(RMUtilSPSCRing *r) {
+  ring_close(&r->wait);
+}
+
+/*********************************** MPMC ***********************************/
+
+struct RMUtilMPMCRing {
+  /* read only */
+  void **slots;
+  uint64_t mask;
+  int flags;
+  char pad0[RING_CACHE_LINE];
+  /* producers claim slots by moving prodHead, and publish them in claim order by moving prodTail */
+  uint64_t prodHead, prodTail;
+  char pad1[RING_CACHE_LINE];
+  /* same for the consumers, with the slots they are done reading */
+  uint64_t consHead, consTail;
+  char pad2[RING_CACHE_LINE];
+  ringWait wait;
+};
+
+RMUtilMPMCRing *RMUtilMPMCRing_New(size_t capacity, int flags) {
+  uint64_t cap = ring_capacity(capacity);
+  if (!cap) return NULL;
+  RMUtilMPMCRing *r = calloc(1, sizeof(*r));
+  r->slots = malloc(cap * sizeof(void *));
+  r->mask = cap - 1;
+  r->flags = flags;
+  ring_initWait(&r->wait);
+  return r;
+}
+
+void RMUtilMPMCRing_Free(RMUtilMPMCRing *r) {
+  ring_destroyWait(&r->wait);
+  free(r->slots);
+  free(r);
+}
+
+size_t RMUtilMPMCRing_Capacity(const RMUtilMPMCRing *r) {
+  return r->mask + 1;
+}
+
+size_t RMUtilMPMCRing_Size(const RMUtilMPMCRing *r) {
+  uint64_t tail = __atomic_load_n(&r->consTail, __ATOMIC_ACQUIRE);
+  uint64_t head = __atomic_load_n(&r->prodTail, __ATOMIC_ACQUIRE);
+  return head > tail ? head - tail : 0;
+}
+
+/* Wait for the threads that claimed the slots before ours to publish them, then publish ours. The
+ * acquire makes their slots part of what our release publishes */
+static inline void mpmc_publish(uint64_t *tail, uint64_t from, uint64_t to) {
+  for (int spins = 0; __atomic_load_n(tail, __ATOMIC_ACQUIRE) != from; spins++) {
+    // the thread we are waiting for may have been preempted
+    if (spins < RING_SPINS) {
+      ring_pause();
+    } else {
+      sched_yield();
+    }
+  }
+  __atomic_store_n(tail, to, __ATOMIC_RELEASE);
+}
+
+size_t RMUtilMPMCRing_PushBatch(RMUtilMPMCRing *r, void *const *items, size_t n) {
+  uint64_t head = __atomic_load_n(&r->prodHead, __ATOMIC_RELAXED), cap = r->mask + 1;
+  size_t m;
+  do {
+    // once the CAS succeeds head is current, and the consumers can't be past it
+    size_t room = cap - (head - __atomic_load_n(&r->consTail, __ATOMIC_ACQUIRE));
+    m = n < room ? n : room;
+    if (!m) return 0;
+  } while (!__atomic_compare_exchange_n(&r->prodHead, &head, head + m, 1, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED));
+  ring_copyIn(r->slots, r->mask, head, items, m);
+  mpmc_publish(&r->prodTail, head, head + m);
+  if (r->flags & RMUTIL_RING_BLOCKING) ring_notify(&r->wait);
+  return m;
+}
+
+int RMUtilMPMCRing_Push(RMUtilMPMCRing *r, void *item) {
+  return RMUtilMPMCRing_PushBatch(r, &item, 1);
+}
+
+size_t RMUtilMPMCRing_PopBatch(RMUtilMPMCRing *r, void **items, size_t max) {
+  uint64_t head = __atomic_load_n(&r->consHead, __ATOMIC_RELAXED);
+  size_t m;
+  do {
+    size_t avail = __atomic_load_n(&r->prodTail, __ATOMIC_ACQUIRE) - head;
+    m = max < avail ? max : avail;
+    if (!m) return 0;
+  } while (!__atomic_compare_exchange_n(&r->consHead, &head, head + m, 1, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED));
+  ring_copyOut(r->slots, r->mask, head, items, m);
+  mpmc_publish(&r->consTail, head, head + m);
+  if (r->flags & RMUTIL_RING_BLOCKING) ring_notify(&r->wait);
+  return m;
+}
+
+int RMUtilMPMCRing_Pop(RMUtilMPMCRing *r, void **item) {
+  return RMUtilMPMCRing_PopBatch(r, item, 1);
+}
+
+static int mpmc_canPush(void *p) {
+  RMUtilMPMCRing *r = p;
+  uint64_t tail = __atomic_load_n(&r->consTail, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&r->prodHead, __ATOMIC_RELAXED) - tail <= r->mask;
+}
+
+static int mpmc_canPop(void *p) {
+  RMUtilMPMCRing *r = p;
+  uint64_t head = __atomic_load_n(&r->consHead, __ATOMIC_RELAXED);
+  return __atomic_load_n(&r->prodTail, __ATOMIC_ACQUIRE) != head;
+}
+
+size_t RMUtilMPMCRing_PushWait(RMUtilMPMCRing *r, void *const *items, size_t n) {
+  size_t done = RMUtilMPMCRing_PushBatch(r, items, n);
+  while (done < n && !ring_closed(&r->wait)) {
+    ring_wait(&r->wait, r->flags, mpmc_canPush, r);
+    done += RMUtilMPMCRing_PushBatch(r, items + done, n - done);
+  }
+  return done;
+}
+
+size_t RMUtilMPMCRing_PopWait(RMUtilMPMCRing *r, void **items, size_t max) {
+  for (;;) {
+    int closed = ring_closed(&r->wait);
+    size_t n = RMUtilMPMCRing_PopBatch(r, items, max);
+    if (n || closed || !max) return n;
+    ring_wait(&r->wait, r->flags, mpmc_canPop, r);
+  }
+}
+
+void RMUtilMPMCRing_Close(RMUtilMPMCRing *r) {
+  ring_close(&r->wait);
+}
@@ -0,0 +1,79 @@
+#ifndef __RMUTIL_RING_H__
+#define __RMUTIL_RING_H__
+
+#include <stddef.h>
+
+/** ring.h - bounded lock-free ring buffers of pointers, for passing work between threads.
+ *
+ *  - RMUtilSPSCRing has a single producer thread and a single consumer thread. Each side owns its
+ *    index on a cache line of its own, and keeps a cached copy of the other side's index, so the
+ *    shared lines only move between cores when the ring looks full or empty.
+ *  - RMUtilMPMCRing takes any number of producers and consumers. Each side claims a range of slots
+ *    with a CAS on its head index, fills or reads it, and then publishes it by advancing its tail
+ *    index in claim order. A batch of n items costs the same two atomic operations as a single one.
+ *
+ * Capacities are rounded up to a power of two. Pushes and pops never block, and move as many items
+ * as there is room or items for. PushWait and PopWait wait for room or items: they spin a little,
+ * and then sleep if the ring was created with RMUTIL_RING_BLOCKING, or yield the CPU otherwise.
+ * The flag makes every push and pop check for sleepers after a memory fence, which is why it is
+ * not the default.
+ *
+ * Closing a ring wakes up all waiters: PushWait stops pushing, and PopWait returns 0 once the ring
+ * is empty. Non-blocking pushes and pops are not affected.
+ */
+
+/* Waiters sleep on a condition variable instead of yielding */
+#define RMUTIL_RING_BLOCKING 0x1
+
+/* RMUtilSPSCRing - opaque single-producer single-consumer ring */
+typedef struct RMUtilSPSCRing RMUtilSPSCRing;
+
+/* A ring of at least capacity slots, with RMUTIL_RING_* flags. Returns NULL if capacity is 0 or
+ * larger than 2^31 */
+RMUtilSPSCRing *RMUtilSPSCRing_New(size_t capacity, int flags);
+void RMUtilSPSCRing_Free(RMUtilSPSCRing *r);
+
+size_t RMUtilSPSCRing_Capacity(const RMUtilSPSCRing *r);
+
+/* Return the number of items in the ring. Only exact when neither side is running */
+size_t RMUtilSPSCRing_Size(const RMUtilSPSCRing *r);
+
+/* Push an item. Returns 0 if the ring is full. Producer thread only */
+int RMUtilSPSCRing_Push(RMUtilSPSCRing *r, void *item);
+
+/* Push the first n items, or as many of them as fit. Returns the number pushed. Producer only */
+size_t RMUtilSPSCRing_PushBatch(RMUtilSPSCRing *r, void *const *items, size_t n);
+
+/* Pop an item into *item. Returns 0 if the ring is empty. Consumer thread only */
+int RMUtilSPSCRing_Pop(RMUtilSPSCRing *r, void **item);
+
+/* Pop up to max items into items. Returns the number popped. Consumer only */
+size_t RMUtilSPSCRing_PopBatch(RMUtilSPSCRing *r, void **items, size_t max);
+
+/* Push all the n items, waiting for room as needed. Returns the number pushed, which is less than
+ * n only if the ring was closed */
+size_t RMUtilSPSCRing_PushWait(RMUtilSPSCRing *r, void *const *items, size_t n);
+
+/* Pop up to max items, waiting for at least one. Returns 0 if the ring is closed and empty */
+size_t RMUtilSPSCRing_PopWait(RMUtilSPSCRing *r, void **items, size_t max);
+
+/* Close the ring, waking up all the waiters. Can be called from any thread */
+void RMUtilSPSCRing_Close(RMUtilSPSCRing *r);
+
+/* RMUtilMPMCRing - opaque multi-producer multi-consumer ring. Same semantics as the SPSC ring,
+ * from any number of threads */
+typedef struct RMUtilMPMCRing RMUtilMPMCRing;
+
+RMUtilMPMCRing *RMUtilMPMCRing_New(size_t capacity, int flags);
+void RMUtilMPMCRing_Free(RMUtilMPMCRing *r);
+size_t RMUtilMPMCRing_Capacity(const RMUtilMPMCRing *r);
+size_t RMUtilMPMCRing_Size(const RMUtilMPMCRing *r);
+int RMUtilMPMCRing_Push(RMUtilMPMCRing *r, void *item);
+size_t RMUtilMPMCRing_PushBatch(RMUtilMPMCRing *r, void *const *items, size_t n);
+int RMUtilMPMCRing_Pop(RMUtilMPMCRing *r, void **item);
+size_t RMUtilMPMCRing_PopBatch(RMUtilMPMCRing *r, void **items, size_t max);
+size_t RMUtilMPMCRing_PushWait(RMUtilMPMCRing *r, void *const *items, size_t n);
+size_t RMUtilMPMCRing_PopWait(RMUtilMPMCRing *r, void **items, size_t max);
+void RMUtilMPMCRing_Close(RMUtilMPMCRing *r);
+
+#endif
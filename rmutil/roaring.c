@@ -0,0 +1,918 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "roaring.h"
+#include "alloc.h"
+
+/* Chunks with more values than this are stored as bitmaps */
+#define ROARING_ARRAY_MAX 4096
+#define ROARING_WORDS 1024
+#define ROARING_BITMAP_BYTES (ROARING_WORDS * sizeof(uint64_t))
+
+enum { ROARING_ARRAY = 1, ROARING_BITMAP, ROARING_RUN };
+enum { ROARING_AND, ROARING_OR, ROARING_ANDNOT };
+
+/* The values start..start + len */
+typedef struct {
+  uint16_t start, len;
+} roaringRun;
+
+typedef struct {
+  int type;
+  /* number of values */
+  int32_t card;
+  /* number of array values or runs, and the allocated number of them */
+  int32_t n, cap;
+  union {
+    uint16_t *array;
+    uint64_t *words;
+    roaringRun *runs;
+  };
+} roaringContainer;
+
+/* The containers, sorted by the high 16 bits of their values */
+struct RMUtilRoaring {
+  uint16_t *keys;
+  roaringContainer *cs;
+  int32_t n, cap;
+};
+
+struct RMUtilRoaringIterator {
+  const RMUtilRoaring *r;
+  int32_t ci;
+  /* array index, bitmap word index or run index in the current container */
+  int32_t pos;
+  /* offset in the current run */
+  uint32_t off;
+  /* bits of the current bitmap word not returned yet */
+  uint64_t word;
+};
+
+static inline int roaring_popcount(uint64_t x) {
+#ifdef __POPCNT__
+  return __builtin_popcountll(x);
+#else
+  // without -mpopcnt the builtin is a library call
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+#ifdef __AVX2__
+/* Per 64 bit lane bit counts, looking up the count of each nibble with a byte shuffle */
+static inline __m256i roaring_popcount256(__m256i v) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                                          2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, nibble));
+  __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+  return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+#endif
+
+/* Combine two bitmaps into out, which may be one of them, and return the result's bit count */
+static int roaring_bitmapOp(uint64_t *out, const uint64_t *a, const uint64_t *b, int op) {
+#if defined(__AVX2__)
+#define ROARING_OP_LOOP(expr)                                                                    \
+  do {                                                                                           \
+    __m256i acc = _mm256_setzero_si256();                                                        \
+    for (int i = 0; i < ROARING_WORDS; i += 4) {                                                 \
+      __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));                                 \
+      __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));                                 \
+      __m256i v = expr;                                                                          \
+      _mm256_storeu_si256((__m256i *)(out + i), v);                                              \
+      acc = _mm256_add_epi64(acc, roaring_popcount256(v));                                       \
+    }                                                                                            \
+    return _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +                         \
+           _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);                          \
+  } while (0)
+  switch (op) {
+    case ROARING_AND:
+      ROARING_OP_LOOP(_mm256_and_si256(va, vb));
+    case ROARING_OR:
+      ROARING_OP_LOOP(_mm256_or_si256(va, vb));
+    default:
+      ROARING_OP_LOOP(_mm256_andnot_si256(vb, va));
+  }
+#elif defined(__SSE2__)
+#define ROARING_OP_LOOP(expr)                                                                    \
+  do {                                                                                           \
+    int card = 0;                                                                                \
+    for (int i = 0; i < ROARING_WORDS; i += 2) {                                                 \
+      __m128i va = _mm_loadu_si128((const __m128i *)(a + i));                                    \
+      __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));                                    \
+      _mm_storeu_si128((__m128i *)(out + i), expr);                                              \
+      card += roaring_popcount(out[i]) + roaring_popcount(out[i + 1]);                           \
+    }                                                                                            \
+    return card;                                                                                 \
+  } while (0)
+  switch (op) {
+    case ROARING_AND:
+      ROARING_OP_LOOP(_mm_and_si128(va, vb));
+    case ROARING_OR:
+      ROARING_OP_LOOP(_mm_or_si128(va, vb));
+    default:
+      ROARING_OP_LOOP(_mm_andnot_si128(vb, va));
+  }
+#else
+#define ROARING_OP_LOOP(expr)                                                                    \
+  do {                                                                                           \
+    int card = 0;                                                                                \
+    for (int i = 0; i < ROARING_WORDS; i++) {                                                    \
+      uint64_t va = a[i], vb = b[i];                                                             \
+      out[i] = expr;                                                                             \
+      card += roaring_popcount(out[i]);                                                          \
+    }                                                                                            \
+    return card;                                                                                 \
+  } while (0)
+  switch (op) {
+    case ROARING_AND:
+      ROARING_OP_LOOP(va & vb);
+    case ROARING_OR:
+      ROARING_OP_LOOP(va | vb);
+    default:
+      ROARING_OP_LOOP(va & ~vb);
+  }
+#endif
+#undef ROARING_OP_LOOP
+}
+
+static int roaring_bitmapCard(const uint64_t *words) {
+  int card = 0;
+  for (int i = 0; i < ROARING_WORDS; i++) card += roaring_popcount(words[i]);
+  return card;
+}
+
+/* Set the bits from..to, inclusive */
+static void roaring_setRange(uint64_t *words, int from, int to) {
+  int first = from >> 6, last = to >> 6;
+  uint64_t firstMask = ~0ULL << (from & 63), lastMask = ~0ULL >> (63 - (to & 63));
+  if (first == last) {
+    words[first] |= firstMask & lastMask;
+    return;
+  }
+  words[first] |= firstMask;
+  for (int i = first + 1; i < last; i++) words[i] = ~0ULL;
+  words[last] |= lastMask;
+}
+
+/* The first bit at or after from that is set (or clear if !set), or 65536 if there is none */
+static int roaring_nextBit(const uint64_t *words, int from, int set) {
+  if (from >= 65536) return 65536;
+  int i = from >> 6;
+  uint64_t w = (set ? words[i] : ~words[i]) & (~0ULL << (from & 63));
+  while (!w) {
+    if (++i == ROARING_WORDS) return 65536;
+    w = set ? words[i] : ~words[i];
+  }
+  return i * 64 + __builtin_ctzll(w);
+}
+
+/* Fill words with the values of c */
+static void roaring_toBitmap(const roaringContainer *c, uint64_t *words) {
+  memset(words, 0, ROARING_BITMAP_BYTES);
+  if (c->type == ROARING_ARRAY) {
+    for (int i = 0; i < c->n; i++) words[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+  } else {
+    for (int i = 0; i < c->n; i++) {
+      roaring_setRange(words, c->runs[i].start, c->runs[i].start + c->runs[i].len);
+    }
+  }
+}
+
+/* Make c an array or bitmap container holding the card values of words, taking ownership of
+ * words */
+static void roaring_fromBitmap(roaringContainer *c, uint64_t *words, int card) {
+  c->card = card;
+  if (card > ROARING_ARRAY_MAX) {
+    c->type = ROARING_BITMAP;
+    c->words = words;
+    c->n = c->cap = 0;
+    return;
+  }
+  c->type = ROARING_ARRAY;
+  c->array = malloc((card ? card : 1) * sizeof(uint16_t));
+  c->n = c->cap = card;
+  int k = 0;
+  for (int i = 0; i < ROARING_WORDS; i++) {
+    uint64_t w = words[i];
+    while (w) {
+      c->array[k++] = i * 64 + __builtin_ctzll(w);
+      w &= w - 1;
+    }
+  }
+  free(words);
+}
+
+/* Turn a run container into an array or a bitmap, so it can be modified */
+static void roaring_unrun(roaringContainer *c) {
+  uint64_t *words = malloc(ROARING_BITMAP_BYTES);
+  roaring_toBitmap(c, words);
+  free(c->runs);
+  roaring_fromBitmap(c, words, c->card);
+}
+
+static int roaring_runContains(const roaringContainer *c, uint16_t lo) {
+  int l = 0, h = c->n - 1;
+  while (l <= h) {
+    int m = (l + h) / 2;
+    if (lo < c->runs[m].start) {
+      h = m - 1;
+    } else if (lo > c->runs[m].start + c->runs[m].len) {
+      l = m + 1;
+    } else {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Index of the first of the n sorted values that is >= v */
+static inline int roaring_lowerBound(const uint16_t *a, int n, uint16_t v) {
+  int l = 0, h = n;
+  while (l < h) {
+    int m = (l + h) / 2;
+    if (a[m] < v) {
+      l = m + 1;
+    } else {
+      h = m;
+    }
+  }
+  return l;
+}
+
+static int roaring_containerContains(const roaringContainer *c, uint16_t lo) {
+  switch (c->type) {
+    case ROARING_ARRAY: {
+      int pos = roaring_lowerBound(c->array, c->n, lo);
+      return pos < c->n && c->array[pos] == lo;
+    }
+    case ROARING_BITMAP:
+      return (c->words[lo >> 6] >> (lo & 63)) & 1;
+    default:
+      return roaring_runContains(c, lo);
+  }
+}
+
+static int roaring_containerAdd(roaringContainer *c, uint16_t lo) {
+  if (c->type == ROARING_RUN) {
+    if (roaring_runContains(c, lo)) return 0;
+    roaring_unrun(c);
+  }
+  if (c->type == ROARING_BITMAP) {
+    uint64_t bit = 1ULL << (lo & 63);
+    if (c->words[lo >> 6] & bit) return 0;
+    c->words[lo >> 6] |= bit;
+    c->card++;
+    return 1;
+  }
+
+  int pos = roaring_lowerBound(c->array, c->n, lo);
+  if (pos < c->n && c->array[pos] == lo) return 0;
+  if (c->n == ROARING_ARRAY_MAX) {
+    uint64_t *words = malloc(ROARING_BITMAP_BYTES);
+    roaring_toBitmap(c, words);
+    free(c->array);
+    c->type = ROARING_BITMAP;
+    c->words = words;
+    c->n = c->cap = 0;
+    return roaring_containerAdd(c, lo);
+  }
+  if (c->n == c->cap) {
+    c->cap = c->cap ? c->cap * 2 : 4;
+    if (c->cap > ROARING_ARRAY_MAX) c->cap = ROARING_ARRAY_MAX;
+    c->array = realloc(c->array, c->cap * sizeof(uint16_t));
+  }
+  memmove(c->array + pos + 1, c->array + pos, (c->n - pos) * sizeof(uint16_t));
+  c->array[pos] = lo;
+  c->n++;
+  c->card++;
+  return 1;
+}
+
+static int roaring_containerRemove(roaringContainer *c, uint16_t lo) {
+  if (c->type == ROARING_RUN) {
+    if (!roaring_runContains(c, lo)) return 0;
+    roaring_unrun(c);
+  }
+  if (c->type == ROARING_BITMAP) {
+    uint64_t bit = 1ULL << (lo & 63);
+    if (!(c->words[lo >> 6] & bit)) return 0;
+    c->words[lo >> 6] &= ~bit;
+    if (--c->card <= ROARING_ARRAY_MAX) roaring_fromBitmap(c, c->words, c->card);
+    return 1;
+  }
+
+  int pos = roaring_lowerBound(c->array, c->n, lo);
+  if (pos == c->n || c->array[pos] != lo) return 0;
+  memmove(c->array + pos, c->array + pos + 1, (c->n - pos - 1) * sizeof(uint16_t));
+  c->n--;
+  c->card--;
+  if (c->cap > 16 && c->n < c->cap / 4) {
+    c->cap /= 2;
+    c->array = realloc(c->array, c->cap * sizeof(uint16_t));
+  }
+  return 1;
+}
+
+static void roaring_containerCopy(roaringContainer *dst, const roaringContainer *src) {
+  *dst = *src;
+  size_t size;
+  switch (src->type) {
+    case ROARING_ARRAY:
+      size = src->n * sizeof(uint16_t);
+      dst->cap = src->n;
+      break;
+    case ROARING_BITMAP:
+      size = ROARING_BITMAP_BYTES;
+      break;
+    default:
+      size = src->n * sizeof(roaringRun);
+      dst->cap = src->n;
+      break;
+  }
+  dst->words = malloc(size ? size : 1);
+  memcpy(dst->words, src->words, size);
+}
+
+static size_t roaring_containerBytes(const roaringContainer *c) {
+  switch (c->type) {
+    case ROARING_ARRAY:
+      return c->cap * sizeof(uint16_t);
+    case ROARING_BITMAP:
+      return ROARING_BITMAP_BYTES;
+    default:
+      return c->cap * sizeof(roaringRun);
+  }
+}
+
+/* Index of the container for key, or -(insertion position) - 1 if there's none */
+static int roaring_findKey(const RMUtilRoaring *r, uint16_t key) {
+  int l = 0, h = r->n - 1;
+  while (l <= h) {
+    int m = (l + h) / 2;
+    if (r->keys[m] < key) {
+      l = m + 1;
+    } else if (r->keys[m] > key) {
+      h = m - 1;
+    } else {
+      return m;
+    }
+  }
+  return -l - 1;
+}
+
+/* Insert a container at pos, taking ownership of its data */
+static void roaring_insertAt(RMUtilRoaring *r, int pos, uint16_t key, roaringContainer *c) {
+  if (r->n == r->cap) {
+    r->cap = r->cap ? r->cap * 2 : 4;
+    r->keys = realloc(r->keys, r->cap * sizeof(uint16_t));
+    r->cs = realloc(r->cs, r->cap * sizeof(roaringContainer));
+  }
+  memmove(r->keys + pos + 1, r->keys + pos, (r->n - pos) * sizeof(uint16_t));
+  memmove(r->cs + pos + 1, r->cs + pos, (r->n - pos) * sizeof(roaringContainer));
+  r->keys[pos] = key;
+  r->cs[pos] = *c;
+  r->n++;
+}
+
+static void roaring_removeAt(RMUtilRoaring *r, int pos) {
+  free(r->cs[pos].words);
+  memmove(r->keys + pos, r->keys + pos + 1, (r->n - pos - 1) * sizeof(uint16_t));
+  memmove(r->cs + pos, r->cs + pos + 1, (r->n - pos - 1) * sizeof(roaringContainer));
+  r->n--;
+}
+
+RMUtilRoaring *RMUtilRoaring_New(void) {
+  return calloc(1, sizeof(RMUtilRoaring));
+}
+
+RMUtilRoaring *RMUtilRoaring_Copy(const RMUtilRoaring *r) {
+  RMUtilRoaring *ret = calloc(1, sizeof(*ret));
+  ret->n = ret->cap = r->n;
+  ret->keys = malloc((r->n ? r->n : 1) * sizeof(uint16_t));
+  ret->cs = malloc((r->n ? r->n : 1) * sizeof(roaringContainer));
+  memcpy(ret->keys, r->keys, r->n * sizeof(uint16_t));
+  for (int i = 0; i < r->n; i++) roaring_containerCopy(&ret->cs[i], &r->cs[i]);
+  return ret;
+}
+
+void RMUtilRoaring_Free(RMUtilRoaring *r) {
+  for (int i = 0; i < r->n; i++) free(r->cs[i].words);
+  free(r->keys);
+  free(r->cs);
+  free(r);
+}
+
+int RMUtilRoaring_Add(RMUtilRoaring *r, uint32_t x) {
+  int i = roaring_findKey(r, x >> 16);
+  if (i < 0) {
+    roaringContainer c = {.type = ROARING_ARRAY, .card = 1, .n = 1, .cap = 1};
+    c.array = malloc(sizeof(uint16_t));
+    c.array[0] = x & 0xffff;
+    roaring_insertAt(r, -i - 1, x >> 16, &c);
+    return 1;
+  }
+  return roaring_containerAdd(&r->cs[i], x & 0xffff);
+}
+
+int RMUtilRoaring_Remove(RMUtilRoaring *r, uint32_t x) {
+  int i = roaring_findKey(r, x >> 16);
+  if (i < 0 || !roaring_containerRemove(&r->cs[i], x & 0xffff)) return 0;
+  if (!r->cs[i].card) roaring_removeAt(r, i);
+  return 1;
+}
+
+int RMUtilRoaring_Contains(const RMUtilRoaring *r, uint32_t x) {
+  int i = roaring_findKey(r, x >> 16);
+  return i >= 0 && roaring_containerContains(&r->cs[i], x & 0xffff);
+}
+
+uint64_t RMUtilRoaring_Cardinality(const RMUtilRoaring *r) {
+  uint64_t card = 0;
+  for (int i = 0; i < r->n; i++) card += r->cs[i].card;
+  return card;
+}
+
+/* Number of values of c <= lo */
+static int roaring_containerRank(const roaringContainer *c, uint16_t lo) {
+  switch (c->type) {
+    case ROARING_ARRAY:
+      return lo == 0xffff ? c->n : roaring_lowerBound(c->array, c->n, lo + 1);
+    case ROARING_BITMAP: {
+      int rank = 0;
+      for (int i = 0; i < lo >> 6; i++) rank += roaring_popcount(c->words[i]);
+      // 2 << 63 is 0, which makes a full mask for the last bit
+      return rank + roaring_popcount(c->words[lo >> 6] & ((2ULL << (lo & 63)) - 1));
+    }
+    default: {
+      int rank = 0;
+      for (int i = 0; i < c->n && lo >= c->runs[i].start; i++) {
+        int end = c->runs[i].start + c->runs[i].len;
+        rank += (lo < end ? lo : end) - c->runs[i].start + 1;
+      }
+      return rank;
+    }
+  }
+}
+
+uint64_t RMUtilRoaring_Rank(const RMUtilRoaring *r, uint32_t x) {
+  uint64_t rank = 0;
+  for (int i = 0; i < r->n && r->keys[i] <= x >> 16; i++) {
+    rank += r->keys[i] < x >> 16 ? r->cs[i].card : roaring_containerRank(&r->cs[i], x & 0xffff);
+  }
+  return rank;
+}
+
+/* The value of rank in c, which must be smaller than its cardinality */
+static uint16_t roaring_containerSelect(const roaringContainer *c, int rank) {
+  switch (c->type) {
+    case ROARING_ARRAY:
+      return c->array[rank];
+    case ROARING_BITMAP:
+      for (int i = 0;; i++) {
+        int count = roaring_popcount(c->words[i]);
+        if (rank >= count) {
+          rank -= count;
+          continue;
+        }
+        uint64_t w = c->words[i];
+        while (rank--) w &= w - 1;
+        return i * 64 + __builtin_ctzll(w);
+      }
+    default:
+      for (int i = 0;; i++) {
+        if (rank <= c->runs[i].len) return c->runs[i].start + rank;
+        rank -= c->runs[i].len + 1;
+      }
+  }
+}
+
+int RMUtilRoaring_Select(const RMUtilRoaring *r, uint64_t rank, uint32_t *x) {
+  for (int i = 0; i < r->n; i++) {
+    if (rank < r->cs[i].card) {
+      if (x) *x = (uint32_t)r->keys[i] << 16 | roaring_containerSelect(&r->cs[i], rank);
+      return 1;
+    }
+    rank -= r->cs[i].card;
+  }
+  return 0;
+}
+
+/* Galloping search: index of the first value >= v in a[from, n), probing exponentially larger
+ * steps first, which is cheap when the target is close */
+static int roaring_gallop(const uint16_t *a, int from, int n, uint16_t v) {
+  int step = 1, hi = from;
+  while (hi < n && a[hi] < v) {
+    from = hi + 1;
+    hi += step;
+    step *= 2;
+  }
+  if (hi > n) hi = n;
+  return from + roaring_lowerBound(a + from, hi - from, v);
+}
+
+/* Give back the unused end of a result array of cap values, n of them used */
+static uint16_t *roaring_shrink(uint16_t *array, int cap, int n) {
+  return n < cap ? realloc(array, (n ? n : 1) * sizeof(uint16_t)) : array;
+}
+
+/* Op on two array containers */
+static void roaring_arrayOp(roaringContainer *out, const roaringContainer *a,
+                            const roaringContainer *b, int op) {
+  if (op == ROARING_OR && a->n + b->n > ROARING_ARRAY_MAX) {
+    uint64_t *words = malloc(ROARING_BITMAP_BYTES);
+    roaring_toBitmap(a, words);
+    for (int i = 0; i < b->n; i++) words[b->array[i] >> 6] |= 1ULL << (b->array[i] & 63);
+    roaring_fromBitmap(out, words, roaring_bitmapCard(words));
+    return;
+  }
+
+  int cap = op == ROARING_OR ? a->n + b->n : a->n;
+  uint16_t *res = malloc((cap ? cap : 1) * sizeof(uint16_t));
+  int n = 0, i = 0, j = 0;
+  if (op == ROARING_AND && (a->n > 64 * b->n || b->n > 64 * a->n)) {
+    // very different sizes: look the small side's values up in the large one
+    const roaringContainer *s = a->n < b->n ? a : b, *l = s == a ? b : a;
+    for (; i < s->n && j < l->n; i++) {
+      j = roaring_gallop(l->array, j, l->n, s->array[i]);
+      if (j < l->n && l->array[j] == s->array[i]) res[n++] = s->array[i];
+    }
+  } else {
+    while (i < a->n && j < b->n) {
+      uint16_t va = a->array[i], vb = b->array[j];
+      if (va == vb) {
+        if (op != ROARING_ANDNOT) res[n++] = va;
+        i++;
+        j++;
+      } else if (va < vb) {
+        if (op != ROARING_AND) res[n++] = va;
+        i++;
+      } else {
+        if (op == ROARING_OR) res[n++] = vb;
+        j++;
+      }
+    }
+    if (op != ROARING_AND) {
+      memcpy(res + n, a->array + i, (a->n - i) * sizeof(uint16_t));
+      n += a->n - i;
+    }
+    if (op == ROARING_OR) {
+      memcpy(res + n, b->array + j, (b->n - j) * sizeof(uint16_t));
+      n += b->n - j;
+    }
+  }
+  out->type = ROARING_ARRAY;
+  out->array = roaring_shrink(res, cap, n);
+  out->n = out->cap = out->card = n;
+}
+
+/* Keep the values of array container a that are (AND) or aren't (ANDNOT) in b */
+static void roaring_filterArray(roaringContainer *out, const roaringContainer *a,
+                                const roaringContainer *b, int op) {
+  uint16_t *res = malloc((a->n ? a->n : 1) * sizeof(uint16_t));
+  int n = 0, keep = op == ROARING_AND;
+  if (b->type == ROARING_BITMAP) {
+    // branchless: always store, and only advance when kept
+    for (int i = 0; i < a->n; i++) {
+      uint16_t v = a->array[i];
+      res[n] = v;
+      n += ((b->words[v >> 6] >> (v & 63)) & 1) == keep;
+    }
+  } else {
+    for (int i = 0; i < a->n; i++) {
+      if (roaring_runContains(b, a->array[i]) == keep) res[n++] = a->array[i];
+    }
+  }
+  out->type = ROARING_ARRAY;
+  out->array = roaring_shrink(res, a->n, n);
+  out->n = out->cap = out->card = n;
+}
+
+/* Op on two containers with the same key, into out */
+static void roaring_containerOp(roaringContainer *out, const roaringContainer *a,
+                                const roaringContainer *b, int op) {
+  if (a->type == ROARING_ARRAY && b->type == ROARING_ARRAY) {
+    roaring_arrayOp(out, a, b, op);
+  } else if (a->type == ROARING_ARRAY && op != ROARING_OR) {
+    roaring_filterArray(out, a, b, op);
+  } else if (b->type == ROARING_ARRAY && op == ROARING_AND) {
+    roaring_filterArray(out, b, a, op);
+  } else {
+    uint64_t tmpA[a->type == ROARING_BITMAP ? 1 : ROARING_WORDS];
+    uint64_t tmpB[b->type == ROARING_BITMAP ? 1 : ROARING_WORDS];
+    const uint64_t *wa = a->words, *wb = b->words;
+    if (a->type != ROARING_BITMAP) {
+      roaring_toBitmap(a, tmpA);
+      wa = tmpA;
+    }
+    if (b->type != ROARING_BITMAP) {
+      roaring_toBitmap(b, tmpB);
+      wb = tmpB;
+    }
+    uint64_t *words = malloc(ROARING_BITMAP_BYTES);
+    roaring_fromBitmap(out, words, roaring_bitmapOp(words, wa, wb, op));
+  }
+}
+
+static RMUtilRoaring *roaring_op(const RMUtilRoaring *a, const RMUtilRoaring *b, int op) {
+  RMUtilRoaring *r = RMUtilRoaring_New();
+  int i = 0, j = 0;
+  while (i < a->n || j < b->n) {
+    if (op == ROARING_AND && (i == a->n || j == b->n)) break;
+    roaringContainer c;
+    uint16_t key;
+    if (j == b->n || (i < a->n && a->keys[i] < b->keys[j])) {
+      // only in a
+      key = a->keys[i];
+      if (op == ROARING_AND) {
+        i++;
+        continue;
+      }
+      roaring_containerCopy(&c, &a->cs[i++]);
+    } else if (i == a->n || b->keys[j] < a->keys[i]) {
+      // only in b
+      key = b->keys[j];
+      if (op != ROARING_OR) {
+        j++;
+        continue;
+      }
+      roaring_containerCopy(&c, &b->cs[j++]);
+    } else {
+      key = a->keys[i];
+      roaring_containerOp(&c, &a->cs[i++], &b->cs[j++], op);
+      if (!c.card) {
+        free(c.words);
+        continue;
+      }
+    }
+    roaring_insertAt(r, r->n, key, &c);
+  }
+  return r;
+}
+
+RMUtilRoaring *RMUtilRoaring_And(const RMUtilRoaring *a, const RMUtilRoaring *b) {
+  return roaring_op(a, b, ROARING_AND);
+}
+
+RMUtilRoaring *RMUtilRoaring_Or(const RMUtilRoaring *a, const RMUtilRoaring *b) {
+  return roaring_op(a, b, ROARING_OR);
+}
+
+RMUtilRoaring *RMUtilRoaring_AndNot(const RMUtilRoaring *a, const RMUtilRoaring *b) {
+  return roaring_op(a, b, ROARING_ANDNOT);
+}
+
+/* Number of runs of consecutive values in c */
+static int roaring_countRuns(const roaringContainer *c) {
+  int runs = 0;
+  if (c->type == ROARING_ARRAY) {
+    for (int i = 0; i < c->n; i++) runs += !i || c->array[i] != c->array[i - 1] + 1;
+  } else {
+    // a run starts at every set bit whose previous bit is clear
+    for (int i = 0; i < ROARING_WORDS; i++) {
+      uint64_t prev = i ? c->words[i - 1] >> 63 : 0;
+      runs += roaring_popcount(c->words[i] & ~(c->words[i] << 1 | prev));
+    }
+  }
+  return runs;
+}
+
+void RMUtilRoaring_RunOptimize(RMUtilRoaring *r) {
+  for (int i = 0; i < r->n; i++) {
+    roaringContainer *c = &r->cs[i];
+    if (c->type == ROARING_RUN) continue;
+    int numRuns = roaring_countRuns(c);
+    if (numRuns * sizeof(roaringRun) >= roaring_containerBytes(c)) continue;
+
+    roaringRun *runs = malloc(numRuns * sizeof(roaringRun));
+    int n = 0;
+    if (c->type == ROARING_ARRAY) {
+      for (int j = 0; j < c->n; j++) {
+        if (n && c->array[j] == runs[n - 1].start + runs[n - 1].len + 1) {
+          runs[n - 1].len++;
+        } else {
+          runs[n++] = (roaringRun){c->array[j], 0};
+        }
+      }
+    } else {
+      int start = roaring_nextBit(c->words, 0, 1);
+      while (start < 65536) {
+        int end = roaring_nextBit(c->words, start, 0);
+        runs[n++] = (roaringRun){start, end - start - 1};
+        start = roaring_nextBit(c->words, end, 1);
+      }
+    }
+    free(c->words);
+    c->type = ROARING_RUN;
+    c->runs = runs;
+    c->n = c->cap = n;
+  }
+}
+
+size_t RMUtilRoaring_MemUsage(const RMUtilRoaring *r) {
+  size_t size = sizeof(*r) + r->cap * (sizeof(uint16_t) + sizeof(roaringContainer));
+  for (int i = 0; i < r->n; i++) size += roaring_containerBytes(&r->cs[i]);
+  return size;
+}
+
+RMUtilRoaringIterator *RMUtilRoaring_Iterate(const RMUtilRoaring *r) {
+  RMUtilRoaringIterator *it = calloc(1, sizeof(*it));
+  it->r = r;
+  return it;
+}
+
+int RMUtilRoaringIterator_Next(RMUtilRoaringIterator *it, uint32_t *x) {
+  const RMUtilRoaring *r = it->r;
+  while (it->ci < r->n) {
+    const roaringContainer *c = &r->cs[it->ci];
+    uint32_t base = (uint32_t)r->keys[it->ci] << 16;
+    switch (c->type) {
+      case ROARING_ARRAY:
+        if (it->pos < c->n) {
+          *x = base | c->array[it->pos++];
+          return 1;
+        }
+        break;
+      case ROARING_BITMAP:
+        while (!it->word && it->pos < ROARING_WORDS) it->word = c->words[it->pos++];
+        if (it->word) {
+          *x = base | ((it->pos - 1) * 64 + __builtin_ctzll(it->word));
+          it->word &= it->word - 1;
+          return 1;
+        }
+        break;
+      default:
+        if (it->pos < c->n) {
+          const roaringRun *run = &c->runs[it->pos];
+          *x = base | (run->start + it->off);
+          if (it->off++ == run->len) {
+            it->pos++;
+            it->off = 0;
+          }
+          return 1;
+        }
+        break;
+    }
+    it->ci++;
+    it->pos = it->off = 0;
+    it->word = 0;
+  }
+  return 0;
+}
+
+void RMUtilRoaringIterator_Free(RMUtilRoaringIterator *it) {
+  free(it);
+}
+
+/* Serialized form, all little endian: the number of containers (32 bits), then for each one its
+ * key (16 bits), type (8 bits) and number of array values or runs (32 bits), followed by the
+ * values (16 bits each), the bitmap (1024 64 bit words) or the runs (16 bit start and length) */
+#define ROARING_HEADER_SIZE 4
+#define ROARING_CONTAINER_HEADER_SIZE 7
+
+static inline void roaring_put(unsigned char **p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) *(*p)++ = v >> (8 * i);
+}
+
+static inline uint64_t roaring_get(const unsigned char **p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) v |= (uint64_t) * (*p)++ << (8 * i);
+  return v;
+}
+
+static size_t roaring_payloadSize(int type, uint32_t n) {
+  switch (type) {
+    case ROARING_ARRAY:
+      return n * 2;
+    case ROARING_BITMAP:
+      return ROARING_BITMAP_BYTES;
+    default:
+      return n * 4;
+  }
+}
+
+size_t RMUtilRoaring_SerializedSize(const RMUtilRoaring *r) {
+  size_t size = ROARING_HEADER_SIZE;
+  for (int i = 0; i < r->n; i++) {
+    size += ROARING_CONTAINER_HEADER_SIZE + roaring_payloadSize(r->cs[i].type, r->cs[i].n);
+  }
+  return size;
+}
+
+void RMUtilRoaring_Serialize(const RMUtilRoaring *r, char *buf) {
+  unsigned char *p = (unsigned char *)buf;
+  roaring_put(&p, r->n, 4);
+  for (int i = 0; i < r->n; i++) {
+    const roaringContainer *c = &r->cs[i];
+    roaring_put(&p, r->keys[i], 2);
+    roaring_put(&p, c->type, 1);
+    roaring_put(&p, c->n, 4);
+    switch (c->type) {
+      case ROARING_ARRAY:
+        for (int j = 0; j < c->n; j++) roaring_put(&p, c->array[j], 2);
+        break;
+      case ROARING_BITMAP:
+        for (int j = 0; j < ROARING_WORDS; j++) roaring_put(&p, c->words[j], 8);
+        break;
+      default:
+        for (int j = 0; j < c->n; j++) {
+          roaring_put(&p, c->runs[j].start, 2);
+          roaring_put(&p, c->runs[j].len, 2);
+        }
+        break;
+    }
+  }
+}
+
+/* Read a container's payload, checking that its values are sorted and its cardinality fits its
+ * type. Returns 0 if it's invalid */
+static int roaring_loadContainer(roaringContainer *c, const unsigned char *p) {
+  switch (c->type) {
+    case ROARING_ARRAY:
+      if (c->n < 1 || c->n > ROARING_ARRAY_MAX) return 0;
+      c->array = malloc(c->n * sizeof(uint16_t));
+      for (int j = 0; j < c->n; j++) {
+        c->array[j] = roaring_get(&p, 2);
+        if (j && c->array[j] <= c->array[j - 1]) return 0;
+      }
+      c->card = c->cap = c->n;
+      return 1;
+    case ROARING_BITMAP:
+      if (c->n) return 0;
+      c->words = malloc(ROARING_BITMAP_BYTES);
+      for (int j = 0; j < ROARING_WORDS; j++) c->words[j] = roaring_get(&p, 8);
+      c->card = roaring_bitmapCard(c->words);
+      return c->card > ROARING_ARRAY_MAX;
+    default:
+      if (c->n < 1 || c->n > 32768) return 0;
+      c->runs = malloc(c->n * sizeof(roaringRun));
+      c->card = 0;
+      for (int j = 0; j < c->n; j++) {
+        roaringRun *run = &c->runs[j];
+        run->start = roaring_get(&p, 2);
+        run->len = roaring_get(&p, 2);
+        if (run->start + run->len > 0xffff) return 0;
+        if (j && run->start <= c->runs[j - 1].start + c->runs[j - 1].len + 1) return 0;
+        c->card += run->len + 1;
+      }
+      c->cap = c->n;
+      return 1;
+  }
+}
+
+RMUtilRoaring *RMUtilRoaring_Deserialize(const char *buf, size_t len) {
+  const unsigned char *p = (const unsigned char *)buf, *end = p + len;
+  if (len < ROARING_HEADER_SIZE) return NULL;
+  uint32_t n = roaring_get(&p, 4);
+  if (n > 65536) return NULL;
+
+  RMUtilRoaring *r = RMUtilRoaring_New();
+  for (uint32_t i = 0; i < n; i++) {
+    if (end - p < ROARING_CONTAINER_HEADER_SIZE) goto err;
+    uint16_t key = roaring_get(&p, 2);
+    roaringContainer c = {0};
+    c.type = roaring_get(&p, 1);
+    c.n = roaring_get(&p, 4);
+    if (c.type < ROARING_ARRAY || c.type > ROARING_RUN || c.n < 0) goto err;
+    if (r->n && key <= r->keys[r->n - 1]) goto err;
+    size_t size = roaring_payloadSize(c.type, c.n);
+    if ((size_t)(end - p) < size) goto err;
+    if (!roaring_loadContainer(&c, p)) {
+      free(c.words);
+      goto err;
+    }
+    roaring_insertAt(r, r->n, key, &c);
+    p += size;
+  }
+  if (p != end) goto err;
+  return r;
+
+err:
+  RMUtilRoaring_Free(r);
+  return NULL;
+}
+
+void RMUtilRoaring_RdbSave(RedisModuleIO *io, const RMUtilRoaring *r) {
+  size_t len = RMUtilRoaring_SerializedSize(r);
+  char *buf = malloc(len);
+  RMUtilRoaring_Serialize(r, buf);
+  RedisModule_SaveStringBuffer(io, buf, len);
+  free(buf);
+}
+
+RMUtilRoaring *RMUtilRoaring_RdbLoad(RedisModuleIO *io) {
+  size_t len;
+  char *buf = RedisModule_LoadStringBuffer(io, &len);
+  if (!buf) return NULL;
+  RMUtilRoaring *r = RMUtilRoaring_Deserialize(buf, len);
+  RedisModule_Free(buf);
+  return r;
+}
@@ -0,0 +1,87 @@
+#ifndef __RMUTIL_ROARING_H__
+#define __RMUTIL_ROARING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <redismodule.h>
+
+/** roaring.h - a compressed bitmap of 32 bit integers, e.g. a set of document ids.
+ *
+ * Values are split by their high 16 bits into chunks, each stored in the smallest of three
+ * containers: a sorted array of the low 16 bits for sparse chunks (up to 4096 values), a 65536 bit
+ * bitmap for dense ones, or a list of runs for chunks made of long consecutive ranges (see
+ * RMUtilRoaring_RunOptimize). A set of n sparse ids takes about 2n bytes, against 4n for an
+ * integer array, and never more than 8KB per 65536 ids.
+ *
+ * Set operations work chunk by chunk. Bitmap chunks are combined a vector at a time, with AVX2
+ * when compiled with it (-mavx2) or SSE2 otherwise, counting the result's bits on the way; array
+ * chunks are merged, or filtered through the other side's bitmap.
+ *
+ * The serialized form is portable (little endian) and validated when loaded, so it can be saved in
+ * RDB files with RMUtilRoaring_RdbSave and loaded back with RMUtilRoaring_RdbLoad.
+ */
+
+/* RMUtilRoaring - opaque bitmap */
+typedef struct RMUtilRoaring RMUtilRoaring;
+
+/* RMUtilRoaringIterator - opaque iterator */
+typedef struct RMUtilRoaringIterator RMUtilRoaringIterator;
+
+RMUtilRoaring *RMUtilRoaring_New(void);
+RMUtilRoaring *RMUtilRoaring_Copy(const RMUtilRoaring *r);
+void RMUtilRoaring_Free(RMUtilRoaring *r);
+
+/* Add x. Returns 1 if it was added, 0 if it was already set */
+int RMUtilRoaring_Add(RMUtilRoaring *r, uint32_t x);
+
+/* Remove x. Returns 1 if it was removed, 0 if it was not set */
+int RMUtilRoaring_Remove(RMUtilRoaring *r, uint32_t x);
+
+int RMUtilRoaring_Contains(const RMUtilRoaring *r, uint32_t x);
+
+/* Return the number of values in the bitmap */
+uint64_t RMUtilRoaring_Cardinality(const RMUtilRoaring *r);
+
+/* Return the number of values smaller than or equal to x */
+uint64_t RMUtilRoaring_Rank(const RMUtilRoaring *r, uint32_t x);
+
+/* Get the value of 0 based rank into *x. Returns 0 if rank is not smaller than the cardinality */
+int RMUtilRoaring_Select(const RMUtilRoaring *r, uint64_t rank, uint32_t *x);
+
+/* Set operations, returning a new bitmap */
+RMUtilRoaring *RMUtilRoaring_And(const RMUtilRoaring *a, const RMUtilRoaring *b);
+RMUtilRoaring *RMUtilRoaring_Or(const RMUtilRoaring *a, const RMUtilRoaring *b);
+RMUtilRoaring *RMUtilRoaring_AndNot(const RMUtilRoaring *a, const RMUtilRoaring *b);
+
+/* Convert the chunks that are smaller as runs to run containers. Worth calling on bitmaps with
+ * long ranges of consecutive values once they are built. Modifying a run container turns it back
+ * into an array or bitmap */
+void RMUtilRoaring_RunOptimize(RMUtilRoaring *r);
+
+/* Return the number of bytes allocated by the bitmap */
+size_t RMUtilRoaring_MemUsage(const RMUtilRoaring *r);
+
+/* Iterate over the values in increasing order. The bitmap must not be modified while iterating */
+RMUtilRoaringIterator *RMUtilRoaring_Iterate(const RMUtilRoaring *r);
+
+/* Get the next value. Returns 0 when done */
+int RMUtilRoaringIterator_Next(RMUtilRoaringIterator *it, uint32_t *x);
+
+void RMUtilRoaringIterator_Free(RMUtilRoaringIterator *it);
+
+/* Return the size of the serialized bitmap */
+size_t RMUtilRoaring_SerializedSize(const RMUtilRoaring *r);
+
+/* Serialize the bitmap into buf, which must be RMUtilRoaring_SerializedSize bytes long */
+void RMUtilRoaring_Serialize(const RMUtilRoaring *r, char *buf);
+
+/* Load a serialized bitmap. Returns NULL if buf does not hold a valid one */
+RMUtilRoaring *RMUtilRoaring_Deserialize(const char *buf, size_t len);
+
+/* Save the bitmap as a single string buffer in an RDB file */
+void RMUtilRoaring_RdbSave(RedisModuleIO *io, const RMUtilRoaring *r);
+
+/* Load a bitmap saved with RMUtilRoaring_RdbSave. Returns NULL on error */
+RMUtilRoaring *RMUtilRoaring_RdbLoad(RedisModuleIO *io);
+
+#endif
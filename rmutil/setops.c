@@ -0,0 +1,293 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "setops.h"
+#include "priority_queue.h"
+#include "alloc.h"
+
+/* The scalar kernels, for both element types */
+#define SETOPS_DEFINE_SCALAR(T, S)                                                               \
+  size_t RMUtil_IntersectMerge##S(const T *a, size_t na, const T *b, size_t nb, T *out) {        \
+    size_t i = 0, j = 0, n = 0;                                                                  \
+    /* always store, and only keep the value by advancing n if it matched */                    \
+    while (i < na && j < nb) {                                                                   \
+      T x = a[i], y = b[j];                                                                      \
+      out[n] = x;                                                                                \
+      n += x == y;                                                                               \
+      i += x <= y;                                                                               \
+      j += y <= x;                                                                               \
+    }                                                                                            \
+    return n;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  /* Index of the first value >= v in b[j, nb) */                                                \
+  static inline size_t setops_gallop##S(const T *b, size_t j, size_t nb, T v) {                  \
+    size_t lo = j, hi = j, step = 1;                                                             \
+    while (hi < nb && b[hi] < v) {                                                               \
+      lo = hi + 1;                                                                               \
+      hi += step;                                                                                \
+      step *= 2;                                                                                 \
+    }                                                                                            \
+    if (hi > nb) hi = nb;                                                                        \
+    while (lo < hi) {                                                                            \
+      size_t mid = lo + (hi - lo) / 2;                                                           \
+      if (b[mid] < v) {                                                                          \
+        lo = mid + 1;                                                                            \
+      } else {                                                                                   \
+        hi = mid;                                                                                \
+      }                                                                                          \
+    }                                                                                            \
+    return lo;                                                                                   \
+  }                                                                                              \
+                                                                                                 \
+  size_t RMUtil_IntersectGallop##S(const T *a, size_t na, const T *b, size_t nb, T *out) {       \
+    if (na > nb) return RMUtil_IntersectGallop##S(b, nb, a, na, out);                            \
+    size_t j = 0, n = 0;                                                                         \
+    for (size_t i = 0; i < na; i++) {                                                            \
+      j = setops_gallop##S(b, j, nb, a[i]);                                                      \
+      if (j == nb) break;                                                                        \
+      if (b[j] == a[i]) {                                                                        \
+        out[n++] = a[i];                                                                         \
+        j++;                                                                                     \
+      }                                                                                          \
+    }                                                                                            \
+    return n;                                                                                    \
+  }                                                                                              \
+                                                                                                 \
+  size_t RMUtil_Intersect##S(const T *a, size_t na, const T *b, size_t nb, T *out) {             \
+    size_t small = na < nb ? na : nb, large = na + nb - small;                                   \
+    if (!small) return 0;                                                                        \
+    if (large / small >= RMUTIL_INTERSECT_GALLOP_RATIO) {                                        \
+      return RMUtil_IntersectGallop##S(a, na, b, nb, out);                                       \
+    }                                                                                            \
+    return RMUtil_IntersectSIMD##S(a, na, b, nb, out);                                           \
+  }                                                                                              \
+                                                                                                 \
+  size_t RMUtil_Union##S(const T *a, size_t na, const T *b, size_t nb, T *out) {                 \
+    size_t i = 0, j = 0, n = 0;                                                                  \
+    while (i < na && j < nb) {                                                                   \
+      T x = a[i], y = b[j];                                                                      \
+      out[n++] = x <= y ? x : y;                                                                 \
+      i += x <= y;                                                                               \
+      j += y <= x;                                                                               \
+    }                                                                                            \
+    memcpy(out + n, a + i, (na - i) * sizeof(T));                                               \
+    n += na - i;                                                                                 \
+    memcpy(out + n, b + j, (nb - j) * sizeof(T));                                               \
+    return n + nb - j;                                                                           \
+  }
+
+SETOPS_DEFINE_SCALAR(uint32_t, U32)
+SETOPS_DEFINE_SCALAR(uint64_t, U64)
+
+/* The SIMD kernels compare a block of a against all the rotations of a block of b, which finds all
+ * the matches between the blocks, and then move past the block with the smaller last value. The
+ * leftovers go through the merge.
+ *
+ * The matches of a block of a are only stored once it's done with, as it may be compared against
+ * several blocks of b, and storing earlier could overwrite it when out is a */
+#define SETOPS_STORE_MATCHES(a, i, matched, out, n) \
+  do {                                              \
+    while (matched) {                               \
+      out[n++] = a[i + __builtin_ctz(matched)];     \
+      matched &= matched - 1;                       \
+    }                                               \
+  } while (0)
+
+size_t RMUtil_IntersectSIMDU32(const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                               uint32_t *out) {
+  size_t i = 0, j = 0, n = 0;
+#ifdef __SSE2__
+  int matched = 0;
+  while (i + 4 <= na && j + 4 <= nb) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+    __m128i eq = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                     _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+        _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                     _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+    matched |= _mm_movemask_ps(_mm_castsi128_ps(eq));
+    // read the block ends before writing, out may be a
+    uint32_t amax = a[i + 3], bmax = b[j + 3];
+    j += bmax <= amax ? 4 : 0;
+    if (amax <= bmax) {
+      SETOPS_STORE_MATCHES(a, i, matched, out, n);
+      i += 4;
+    }
+  }
+  // matches found for a block that is not done are all before the first value the merge can match
+  if (matched) {
+    size_t end = i + 32 - __builtin_clz(matched);
+    SETOPS_STORE_MATCHES(a, i, matched, out, n);
+    i = end;
+  }
+#endif
+  return n + RMUtil_IntersectMergeU32(a + i, na - i, b + j, nb - j, out + n);
+}
+
+#ifdef __SSE2__
+/* SSE2 has no 64 bit compare: both 32 bit halves have to be equal */
+static inline __m128i setops_cmpeq64(__m128i x, __m128i y) {
+  __m128i eq = _mm_cmpeq_epi32(x, y);
+  return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+/* Lanes of x equal to either value of b0 or b1, in either position */
+static inline __m128i setops_match64(__m128i x, __m128i b0, __m128i b1) {
+  __m128i s0 = _mm_shuffle_epi32(b0, _MM_SHUFFLE(1, 0, 3, 2));
+  __m128i s1 = _mm_shuffle_epi32(b1, _MM_SHUFFLE(1, 0, 3, 2));
+  return _mm_or_si128(_mm_or_si128(setops_cmpeq64(x, b0), setops_cmpeq64(x, s0)),
+                      _mm_or_si128(setops_cmpeq64(x, b1), setops_cmpeq64(x, s1)));
+}
+#endif
+
+size_t RMUtil_IntersectSIMDU64(const uint64_t *a, size_t na, const uint64_t *b, size_t nb,
+                               uint64_t *out) {
+  size_t i = 0, j = 0, n = 0;
+#ifdef __SSE2__
+  int matched = 0;
+  while (i + 4 <= na && j + 4 <= nb) {
+    __m128i b0 = _mm_loadu_si128((const __m128i *)(b + j));
+    __m128i b1 = _mm_loadu_si128((const __m128i *)(b + j + 2));
+    __m128i m0 = setops_match64(_mm_loadu_si128((const __m128i *)(a + i)), b0, b1);
+    __m128i m1 = setops_match64(_mm_loadu_si128((const __m128i *)(a + i + 2)), b0, b1);
+    matched |= _mm_movemask_pd(_mm_castsi128_pd(m0)) | _mm_movemask_pd(_mm_castsi128_pd(m1)) << 2;
+    uint64_t amax = a[i + 3], bmax = b[j + 3];
+    j += bmax <= amax ? 4 : 0;
+    if (amax <= bmax) {
+      SETOPS_STORE_MATCHES(a, i, matched, out, n);
+      i += 4;
+    }
+  }
+  if (matched) {
+    size_t end = i + 32 - __builtin_clz(matched);
+    SETOPS_STORE_MATCHES(a, i, matched, out, n);
+    i = end;
+  }
+#endif
+  return n + RMUtil_IntersectMergeU64(a + i, na - i, b + j, nb - j, out + n);
+}
+
+/* Element size shared by out and all the vectors, or 0 if there's none */
+static size_t setops_elemSize(Vector *out, Vector **vs, int n) {
+  size_t size = out->elemSize;
+  if (size != sizeof(uint32_t) && size != sizeof(uint64_t)) return 0;
+  for (int i = 0; i < n; i++) {
+    if (vs[i]->elemSize != size) return 0;
+  }
+  return size;
+}
+
+static void setops_reserve(Vector *v, size_t cap) {
+  if (v->cap < cap) Vector_Resize(v, cap);
+}
+
+static int setops_cmpSize(const void *a, const void *b) {
+  int x = Vector_Size(*(Vector **)a), y = Vector_Size(*(Vector **)b);
+  return x - y;
+}
+
+int Vector_IntersectSorted(Vector *out, Vector **vs, int n) {
+  size_t elemSize = setops_elemSize(out, vs, n);
+  if (!elemSize) return -1;
+  out->top = 0;
+  if (n <= 0) return 0;
+
+  Vector **sorted = malloc(n * sizeof(Vector *));
+  memcpy(sorted, vs, n * sizeof(Vector *));
+  qsort(sorted, n, sizeof(Vector *), setops_cmpSize);
+  size_t size = Vector_Size(sorted[0]);
+  setops_reserve(out, size ? size : 1);
+  if (n == 1) memcpy(out->data, sorted[0]->data, size * elemSize);
+
+  // the running result stays in out, and only shrinks
+  for (int i = 1; i < n && size; i++) {
+    const void *a = i == 1 ? sorted[0]->data : out->data;
+    if (elemSize == sizeof(uint32_t)) {
+      size = RMUtil_IntersectU32(a, size, (uint32_t *)sorted[i]->data, Vector_Size(sorted[i]),
+                                 (uint32_t *)out->data);
+    } else {
+      size = RMUtil_IntersectU64(a, size, (uint64_t *)sorted[i]->data, Vector_Size(sorted[i]),
+                                 (uint64_t *)out->data);
+    }
+  }
+  free(sorted);
+  out->top = size;
+  return size;
+}
+
+/* The head of a vector being merged */
+typedef struct {
+  uint64_t val;
+  int vec;
+} setopsHead;
+
+/* Order heads so that the smallest value is at the top of the queue */
+static int setops_cmpHeads(void *a, void *b) {
+  uint64_t x = ((setopsHead *)a)->val, y = ((setopsHead *)b)->val;
+  return x > y ? -1 : x < y;
+}
+
+static inline uint64_t setops_get(Vector *v, size_t pos) {
+  return v->elemSize == sizeof(uint32_t) ? ((uint32_t *)v->data)[pos] : ((uint64_t *)v->data)[pos];
+}
+
+int Vector_UnionSorted(Vector *out, Vector **vs, int n) {
+  size_t elemSize = setops_elemSize(out, vs, n), total = 0;
+  if (!elemSize) return -1;
+  out->top = 0;
+  if (n <= 0) return 0;
+  for (int i = 0; i < n; i++) total += Vector_Size(vs[i]);
+  setops_reserve(out, total ? total : 1);
+  if (n == 1) {
+    memcpy(out->data, vs[0]->data, total * elemSize);
+    out->top = total;
+    return total;
+  }
+  if (n == 2) {
+    // no need for a queue
+    if (elemSize == sizeof(uint32_t)) {
+      out->top = RMUtil_UnionU32((uint32_t *)vs[0]->data, Vector_Size(vs[0]),
+                                 (uint32_t *)vs[1]->data, Vector_Size(vs[1]),
+                                 (uint32_t *)out->data);
+    } else {
+      out->top = RMUtil_UnionU64((uint64_t *)vs[0]->data, Vector_Size(vs[0]),
+                                 (uint64_t *)vs[1]->data, Vector_Size(vs[1]),
+                                 (uint64_t *)out->data);
+    }
+    return out->top;
+  }
+
+  PriorityQueue *pq = NewPriorityQueue(setopsHead, n, setops_cmpHeads);
+  size_t *pos = calloc(n, sizeof(size_t));
+  for (int i = 0; i < n; i++) {
+    if (!Vector_Size(vs[i])) continue;
+    setopsHead h = {setops_get(vs[i], 0), i};
+    Priority_Queue_Push(pq, h);
+    pos[i] = 1;
+  }
+  size_t size = 0;
+  while (Priority_Queue_Size(pq)) {
+    setopsHead h;
+    Priority_Queue_Top(pq, &h);
+    Priority_Queue_Pop(pq);
+    if (!size || h.val != setops_get(out, size - 1)) {
+      if (elemSize == sizeof(uint32_t)) {
+        ((uint32_t *)out->data)[size++] = h.val;
+      } else {
+        ((uint64_t *)out->data)[size++] = h.val;
+      }
+    }
+    if (pos[h.vec] < Vector_Size(vs[h.vec])) {
+      h.val = setops_get(vs[h.vec], pos[h.vec]++);
+      Priority_Queue_Push(pq, h);
+    }
+  }
+  Priority_Queue_Free(pq);
+  free(pos);
+  out->top = size;
+  return size;
+}
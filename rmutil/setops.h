@@ -0,0 +1,67 @@
+#ifndef __RMUTIL_SETOPS_H__
+#define __RMUTIL_SETOPS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vector.h"
+
+/** setops.h - intersection and union kernels for sorted integer arrays, e.g. posting lists.
+ *
+ * All the inputs must be strictly increasing (sorted, without duplicates), and so are the outputs.
+ * Intersections write at most min(na, nb) values to out, which may be the same array as a.
+ *
+ * There are three intersection kernels, and RMUtil_IntersectU32/U64 pick one by the ratio of the
+ * input sizes:
+ *  - merge: a branchless two pointer merge. It is never picked, as it is already slower than SIMD
+ *    with 4 values on each side, but SIMD finishes with it, so inputs of less than 4 values
+ *    are merged.
+ *  - SIMD: compares blocks of 4 values of each side against each other with SSE2,
+ *    advancing by whole blocks. Best for inputs of similar sizes.
+ *  - galloping: looks each value of the small side up in the large one, with an exponential then a
+ *    binary search from the last position. Best when one side is much smaller, as it only reads a
+ *    logarithmic part of the large one.
+ *
+ * `make bench` measures the kernels side by side for a range of size ratios, which is how the
+ * ratio threshold was picked.
+ */
+
+/* Gallop when the larger input is at least this many times larger than the smaller one */
+#define RMUTIL_INTERSECT_GALLOP_RATIO 32
+
+size_t RMUtil_IntersectMergeU32(const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                                uint32_t *out);
+size_t RMUtil_IntersectGallopU32(const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                                 uint32_t *out);
+size_t RMUtil_IntersectSIMDU32(const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                               uint32_t *out);
+
+/* Intersect a and b into out with the best kernel for their sizes, returning the output size */
+size_t RMUtil_IntersectU32(const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                           uint32_t *out);
+
+/* Union of a and b into out, which needs room for na + nb values. Returns the output size */
+size_t RMUtil_UnionU32(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *out);
+
+/* The same for uint64_t */
+size_t RMUtil_IntersectMergeU64(const uint64_t *a, size_t na, const uint64_t *b, size_t nb,
+                                uint64_t *out);
+size_t RMUtil_IntersectGallopU64(const uint64_t *a, size_t na, const uint64_t *b, size_t nb,
+                                 uint64_t *out);
+size_t RMUtil_IntersectSIMDU64(const uint64_t *a, size_t na, const uint64_t *b, size_t nb,
+                               uint64_t *out);
+size_t RMUtil_IntersectU64(const uint64_t *a, size_t na, const uint64_t *b, size_t nb,
+                           uint64_t *out);
+size_t RMUtil_UnionU64(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, uint64_t *out);
+
+/* Vector versions, for vectors of uint32_t or uint64_t (by their element size). out is resized
+ * as needed, and its previous contents replaced. They return the output size, or -1 if the
+ * vectors don't all have the same element size, of 4 or 8 bytes */
+
+/* Intersect n vectors, starting from the two shortest, so that each step works on the smallest
+ * possible intermediate result */
+int Vector_IntersectSorted(Vector *out, Vector **vs, int n);
+
+/* Union of n vectors, merged in a single pass driven by a PriorityQueue of the vectors' heads */
+int Vector_UnionSorted(Vector *out, Vector **vs, int n);
+
+#endif
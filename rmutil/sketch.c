@@ -0,0 +1,707 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sketch.h"
+#include "priority_queue.h"
+#include "alloc.h"
+
+static inline void sketch_put(unsigned char **p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) *(*p)++ = v >> (8 * i);
+}
+
+static inline uint64_t sketch_get(const unsigned char **p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) v |= (uint64_t) * (*p)++ << (8 * i);
+  return v;
+}
+
+/* Index of a key in row of a table of the given width, by double hashing. h2 must be odd */
+static inline uint32_t sketch_index(uint64_t hash, uint64_t h2, uint32_t row, uint32_t width) {
+  return (((hash + row * h2) >> 32) * width) >> 32;
+}
+
+static inline uint32_t sketch_satAdd(uint32_t a, uint32_t b) {
+  return a + b < a ? UINT32_MAX : a + b;
+}
+
+/*********************************** Count-Min ***********************************/
+
+struct RMUtilCountMin {
+  uint32_t width, depth;
+  uint64_t total;
+  /* depth rows of width counters */
+  uint32_t *counters;
+};
+
+RMUtilCountMin *RMUtilCountMin_New(uint32_t width, uint32_t depth) {
+  if (!width || !depth) return NULL;
+  RMUtilCountMin *cm = malloc(sizeof(*cm));
+  cm->width = width;
+  cm->depth = depth;
+  cm->total = 0;
+  cm->counters = calloc((size_t)width * depth, sizeof(uint32_t));
+  return cm;
+}
+
+RMUtilCountMin *RMUtilCountMin_NewForError(double eps, double delta) {
+  double width = ceil(M_E / eps), depth = ceil(log(1 / delta));
+  return RMUtilCountMin_New(width < 1 ? 1 : width, depth < 1 ? 1 : depth);
+}
+
+void RMUtilCountMin_Free(RMUtilCountMin *cm) {
+  free(cm->counters);
+  free(cm);
+}
+
+uint32_t RMUtilCountMin_AddHash(RMUtilCountMin *cm, uint64_t hash, uint32_t n) {
+  uint64_t h2 = RMUtilHash_U64(hash) | 1;
+  uint32_t *counters[cm->depth], est = UINT32_MAX;
+  for (uint32_t i = 0; i < cm->depth; i++) {
+    counters[i] = cm->counters + (size_t)i * cm->width + sketch_index(hash, h2, i, cm->width);
+    if (*counters[i] < est) est = *counters[i];
+  }
+  // conservative update: only raise the counters below the new estimate
+  est = sketch_satAdd(est, n);
+  for (uint32_t i = 0; i < cm->depth; i++) {
+    if (*counters[i] < est) *counters[i] = est;
+  }
+  cm->total += n;
+  return est;
+}
+
+uint32_t RMUtilCountMin_QueryHash(const RMUtilCountMin *cm, uint64_t hash) {
+  uint64_t h2 = RMUtilHash_U64(hash) | 1;
+  uint32_t est = UINT32_MAX;
+  for (uint32_t i = 0; i < cm->depth; i++) {
+    uint32_t c = cm->counters[(size_t)i * cm->width + sketch_index(hash, h2, i, cm->width)];
+    if (c < est) est = c;
+  }
+  return est;
+}
+
+uint64_t RMUtilCountMin_Total(const RMUtilCountMin *cm) {
+  return cm->total;
+}
+
+int RMUtilCountMin_Merge(RMUtilCountMin *dst, const RMUtilCountMin *src) {
+  if (dst->width != src->width || dst->depth != src->depth) return 0;
+  size_t n = (size_t)dst->width * dst->depth;
+  for (size_t i = 0; i < n; i++) dst->counters[i] = sketch_satAdd(dst->counters[i], src->counters[i]);
+  dst->total += src->total;
+  return 1;
+}
+
+size_t RMUtilCountMin_MemUsage(const RMUtilCountMin *cm) {
+  return sizeof(*cm) + (size_t)cm->width * cm->depth * sizeof(uint32_t);
+}
+
+/* Serialized Count-Min sketch, all little endian: the width and depth (32 bits each), the total
+ * (64 bits), then the counters (32 bits each) */
+#define CM_HEADER_SIZE 16
+
+size_t RMUtilCountMin_SerializedSize(const RMUtilCountMin *cm) {
+  return CM_HEADER_SIZE + (size_t)cm->width * cm->depth * sizeof(uint32_t);
+}
+
+void RMUtilCountMin_Serialize(const RMUtilCountMin *cm, char *buf) {
+  unsigned char *p = (unsigned char *)buf;
+  sketch_put(&p, cm->width, 4);
+  sketch_put(&p, cm->depth, 4);
+  sketch_put(&p, cm->total, 8);
+  size_t n = (size_t)cm->width * cm->depth;
+  for (size_t i = 0; i < n; i++) sketch_put(&p, cm->counters[i], 4);
+}
+
+RMUtilCountMin *RMUtilCountMin_Deserialize(const char *buf, size_t len) {
+  const unsigned char *p = (const unsigned char *)buf;
+  if (len < CM_HEADER_SIZE) return NULL;
+  uint32_t width = sketch_get(&p, 4), depth = sketch_get(&p, 4);
+  uint64_t total = sketch_get(&p, 8), n = (uint64_t)width * depth;
+  if (!n || n != (len - CM_HEADER_SIZE) / sizeof(uint32_t) ||
+      (len - CM_HEADER_SIZE) % sizeof(uint32_t)) {
+    return NULL;
+  }
+  RMUtilCountMin *cm = RMUtilCountMin_New(width, depth);
+  cm->total = total;
+  for (size_t i = 0; i < n; i++) cm->counters[i] = sketch_get(&p, 4);
+  return cm;
+}
+
+void RMUtilCountMin_RdbSave(RedisModuleIO *io, const RMUtilCountMin *cm) {
+  size_t len = RMUtilCountMin_SerializedSize(cm);
+  char *buf = malloc(len);
+  RMUtilCountMin_Serialize(cm, buf);
+  RedisModule_SaveStringBuffer(io, buf, len);
+  free(buf);
+}
+
+RMUtilCountMin *RMUtilCountMin_RdbLoad(RedisModuleIO *io) {
+  size_t len;
+  char *buf = RedisModule_LoadStringBuffer(io, &len);
+  if (!buf) return NULL;
+  RMUtilCountMin *cm = RMUtilCountMin_Deserialize(buf, len);
+  RedisModule_Free(buf);
+  return cm;
+}
+
+/*********************************** HyperLogLog ***********************************/
+
+struct RMUtilHLL {
+  int p;
+  int dense;
+  /* sparse form: the non zero registers as index << 8 | value, sorted */
+  uint32_t n, cap;
+  uint32_t *sparse;
+  /* dense form: one byte per register */
+  uint8_t *regs;
+};
+
+#define HLL_SPARSE(idx, rank) ((uint32_t)(idx) << 8 | (rank))
+
+/* The register of a hash, and the value to set it to: the position of the first 1 bit in the
+ * rest of the hash */
+static inline void hll_split(const RMUtilHLL *h, uint64_t hash, uint32_t *idx, int *rank) {
+  *idx = hash >> (64 - h->p);
+  *rank = __builtin_clzll(hash << h->p | 1ULL << (h->p - 1)) + 1;
+}
+
+/* The sparse form is used as long as it is smaller than the dense one */
+static inline int hll_sparseFull(const RMUtilHLL *h, uint32_t n) {
+  return (size_t)n * sizeof(uint32_t) > (1U << h->p);
+}
+
+RMUtilHLL *RMUtilHLL_New(int p) {
+  if (p < RMUTIL_HLL_MIN_PRECISION || p > RMUTIL_HLL_MAX_PRECISION) return NULL;
+  RMUtilHLL *h = calloc(1, sizeof(*h));
+  h->p = p;
+  return h;
+}
+
+void RMUtilHLL_Free(RMUtilHLL *h) {
+  free(h->sparse);
+  free(h->regs);
+  free(h);
+}
+
+static void hll_toDense(RMUtilHLL *h) {
+  h->regs = calloc(1U << h->p, 1);
+  for (uint32_t i = 0; i < h->n; i++) h->regs[h->sparse[i] >> 8] = h->sparse[i] & 0xff;
+  free(h->sparse);
+  h->sparse = NULL;
+  h->n = h->cap = 0;
+  h->dense = 1;
+}
+
+int RMUtilHLL_AddHash(RMUtilHLL *h, uint64_t hash) {
+  uint32_t idx;
+  int rank;
+  hll_split(h, hash, &idx, &rank);
+  if (h->dense) {
+    if (h->regs[idx] >= rank) return 0;
+    h->regs[idx] = rank;
+    return 1;
+  }
+
+  uint32_t lo = 0, hi = h->n;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (h->sparse[mid] >> 8 < idx) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < h->n && h->sparse[lo] >> 8 == idx) {
+    if ((h->sparse[lo] & 0xff) >= rank) return 0;
+    h->sparse[lo] = HLL_SPARSE(idx, rank);
+    return 1;
+  }
+  if (hll_sparseFull(h, h->n + 1)) {
+    hll_toDense(h);
+    h->regs[idx] = rank;
+    return 1;
+  }
+  if (h->n == h->cap) {
+    h->cap = h->cap ? h->cap * 2 : 8;
+    h->sparse = realloc(h->sparse, h->cap * sizeof(uint32_t));
+  }
+  memmove(h->sparse + lo + 1, h->sparse + lo, (h->n - lo) * sizeof(uint32_t));
+  h->sparse[lo] = HLL_SPARSE(idx, rank);
+  h->n++;
+  return 1;
+}
+
+static double hll_sigma(double x) {
+  if (x == 1) return INFINITY;
+  double y = 1, z = x, prev;
+  do {
+    x *= x;
+    prev = z;
+    z += x * y;
+    y += y;
+  } while (z != prev);
+  return z;
+}
+
+static double hll_tau(double x) {
+  if (x == 0 || x == 1) return 0;
+  double y = 1, z = 1 - x, prev;
+  do {
+    x = sqrt(x);
+    prev = z;
+    y *= 0.5;
+    z -= (1 - x) * (1 - x) * y;
+  } while (z != prev);
+  return z / 3;
+}
+
+uint64_t RMUtilHLL_Count(const RMUtilHLL *h) {
+  // Ertl's estimator works on the histogram of the register values
+  int q = 64 - h->p;
+  uint32_t m = 1U << h->p, hist[64 + 2] = {0};
+  if (h->dense) {
+    for (uint32_t i = 0; i < m; i++) hist[h->regs[i]]++;
+  } else {
+    hist[0] = m - h->n;
+    for (uint32_t i = 0; i < h->n; i++) hist[h->sparse[i] & 0xff]++;
+  }
+  double z = m * hll_tau(1 - (double)hist[q + 1] / m);
+  for (int k = q; k >= 1; k--) z = 0.5 * (z + hist[k]);
+  z += m * hll_sigma((double)hist[0] / m);
+  return (uint64_t)((double)m * m / (2 * M_LN2 * z) + 0.5);
+}
+
+int RMUtilHLL_Merge(RMUtilHLL *dst, const RMUtilHLL *src) {
+  if (dst->p != src->p) return 0;
+  if (!dst->dense && !src->dense) {
+    // merge the sorted lists, unless the result may be too large for the sparse form
+    if (!hll_sparseFull(dst, dst->n + src->n)) {
+      uint32_t cap = dst->n + src->n;
+      uint32_t *merged = malloc(cap * sizeof(uint32_t) + 1);
+      uint32_t i = 0, j = 0, n = 0;
+      while (i < dst->n || j < src->n) {
+        uint32_t a = i < dst->n ? dst->sparse[i] : UINT32_MAX;
+        uint32_t b = j < src->n ? src->sparse[j] : UINT32_MAX;
+        if (a >> 8 == b >> 8) {
+          merged[n++] = a > b ? a : b;
+          i++;
+          j++;
+        } else if (a < b) {
+          merged[n++] = a;
+          i++;
+        } else {
+          merged[n++] = b;
+          j++;
+        }
+      }
+      free(dst->sparse);
+      dst->sparse = merged;
+      dst->n = n;
+      dst->cap = cap;
+      return 1;
+    }
+  }
+  if (!dst->dense) hll_toDense(dst);
+  if (src->dense) {
+    for (uint32_t i = 0; i < 1U << src->p; i++) {
+      if (src->regs[i] > dst->regs[i]) dst->regs[i] = src->regs[i];
+    }
+  } else {
+    for (uint32_t i = 0; i < src->n; i++) {
+      uint32_t idx = src->sparse[i] >> 8, rank = src->sparse[i] & 0xff;
+      if (rank > dst->regs[idx]) dst->regs[idx] = rank;
+    }
+  }
+  return 1;
+}
+
+size_t RMUtilHLL_MemUsage(const RMUtilHLL *h) {
+  return sizeof(*h) + (h->dense ? 1U << h->p : h->cap * sizeof(uint32_t));
+}
+
+/* Serialized HyperLogLog, all little endian: the precision and whether it is dense (8 bits each),
+ * then either the registers (8 bits each), or the number of sparse entries (32 bits) and the
+ * entries (32 bits each) */
+#define HLL_HEADER_SIZE 2
+
+size_t RMUtilHLL_SerializedSize(const RMUtilHLL *h) {
+  return HLL_HEADER_SIZE + (h->dense ? 1U << h->p : 4 + h->n * sizeof(uint32_t));
+}
+
+void RMUtilHLL_Serialize(const RMUtilHLL *h, char *buf) {
+  unsigned char *p = (unsigned char *)buf;
+  sketch_put(&p, h->p, 1);
+  sketch_put(&p, h->dense, 1);
+  if (h->dense) {
+    memcpy(p, h->regs, 1U << h->p);
+  } else {
+    sketch_put(&p, h->n, 4);
+    for (uint32_t i = 0; i < h->n; i++) sketch_put(&p, h->sparse[i], 4);
+  }
+}
+
+RMUtilHLL *RMUtilHLL_Deserialize(const char *buf, size_t len) {
+  const unsigned char *p = (const unsigned char *)buf;
+  if (len < HLL_HEADER_SIZE) return NULL;
+  RMUtilHLL *h = RMUtilHLL_New(sketch_get(&p, 1));
+  if (!h) return NULL;
+  int dense = sketch_get(&p, 1), maxRank = 64 - h->p + 1;
+  uint32_t m = 1U << h->p;
+  len -= HLL_HEADER_SIZE;
+
+  if (dense == 1) {
+    if (len != m) goto err;
+    hll_toDense(h);
+    memcpy(h->regs, p, m);
+    for (uint32_t i = 0; i < m; i++) {
+      if (h->regs[i] > maxRank) goto err;
+    }
+    return h;
+  }
+  if (dense != 0 || len < 4) goto err;
+  uint32_t n = sketch_get(&p, 4);
+  if (hll_sparseFull(h, n) || len != 4 + (size_t)n * sizeof(uint32_t)) goto err;
+  h->sparse = malloc(n * sizeof(uint32_t) + 1);
+  h->cap = n;
+  for (h->n = 0; h->n < n; h->n++) {
+    uint32_t e = h->sparse[h->n] = sketch_get(&p, 4), rank = e & 0xff;
+    if (e >> 8 >= m || rank < 1 || rank > maxRank) goto err;
+    if (h->n && e >> 8 <= h->sparse[h->n - 1] >> 8) goto err;
+  }
+  return h;
+
+err:
+  RMUtilHLL_Free(h);
+  return NULL;
+}
+
+void RMUtilHLL_RdbSave(RedisModuleIO *io, const RMUtilHLL *h) {
+  size_t len = RMUtilHLL_SerializedSize(h);
+  char *buf = malloc(len);
+  RMUtilHLL_Serialize(h, buf);
+  RedisModule_SaveStringBuffer(io, buf, len);
+  free(buf);
+}
+
+RMUtilHLL *RMUtilHLL_RdbLoad(RedisModuleIO *io) {
+  size_t len;
+  char *buf = RedisModule_LoadStringBuffer(io, &len);
+  if (!buf) return NULL;
+  RMUtilHLL *h = RMUtilHLL_Deserialize(buf, len);
+  RedisModule_Free(buf);
+  return h;
+}
+
+/*********************************** Top-K ***********************************/
+
+/* Decay probabilities are kept for counts below this, and are 0 above it */
+#define TOPK_DECAY_TABLE 256
+
+/* A HeavyKeeper bucket: the fingerprint of the key owning it and its count */
+typedef struct {
+  uint32_t fp, count;
+} topkBucket;
+
+/* A key in the top k */
+typedef struct {
+  char *key;
+  size_t len;
+  uint64_t hash;
+  uint64_t count;
+} topkEntry;
+
+struct RMUtilTopK {
+  uint32_t k, width, depth;
+  double decay;
+  /* decay^count as a fraction of 2^32 */
+  uint32_t decayThreshold[TOPK_DECAY_TABLE];
+  topkBucket *buckets;
+  /* the top k entries, the smallest count on top */
+  PriorityQueue *heap;
+  uint32_t rand;
+};
+
+static int topk_cmp(void *a, void *b) {
+  uint64_t x = ((topkEntry *)a)->count, y = ((topkEntry *)b)->count;
+  return x > y ? -1 : x < y;
+}
+
+static inline uint32_t topk_fp(uint64_t hash) {
+  return (uint32_t)hash ? (uint32_t)hash : 1;
+}
+
+static inline topkEntry *topk_entries(const RMUtilTopK *tk) {
+  return (topkEntry *)tk->heap->v->data;
+}
+
+RMUtilTopK *RMUtilTopK_New(uint32_t k, uint32_t width, uint32_t depth, double decay) {
+  if (!k || !width || !depth || !(decay > 0 && decay <= 1)) return NULL;
+  if (k > (uint64_t)width * depth) return NULL;
+  RMUtilTopK *tk = malloc(sizeof(*tk));
+  tk->k = k;
+  tk->width = width;
+  tk->depth = depth;
+  tk->decay = decay;
+  for (int i = 0; i < TOPK_DECAY_TABLE; i++) {
+    double t = pow(decay, i) * 4294967296.0;
+    tk->decayThreshold[i] = t >= UINT32_MAX ? UINT32_MAX : t;
+  }
+  tk->buckets = calloc((size_t)width * depth, sizeof(topkBucket));
+  tk->heap = NewPriorityQueue(topkEntry, k, topk_cmp);
+  tk->rand = 2463534242U;
+  if (!tk->buckets || !tk->heap->v->data) {
+    RMUtilTopK_Free(tk);
+    return NULL;
+  }
+  return tk;
+}
+
+void RMUtilTopK_Free(RMUtilTopK *tk) {
+  topkEntry *entries = topk_entries(tk);
+  for (size_t i = 0; i < Priority_Queue_Size(tk->heap); i++) free(entries[i].key);
+  Priority_Queue_Free(tk->heap);
+  free(tk->buckets);
+  free(tk);
+}
+
+static inline uint32_t topk_rand(RMUtilTopK *tk) {
+  tk->rand ^= tk->rand << 13;
+  tk->rand ^= tk->rand >> 17;
+  tk->rand ^= tk->rand << 5;
+  return tk->rand;
+}
+
+/* Count a key in the buckets, and return its estimated count */
+static uint32_t topk_update(RMUtilTopK *tk, uint64_t hash) {
+  uint64_t h2 = RMUtilHash_U64(hash) | 1;
+  uint32_t fp = topk_fp(hash), est = 0;
+  for (uint32_t i = 0; i < tk->depth; i++) {
+    topkBucket *b = &tk->buckets[(size_t)i * tk->width + sketch_index(hash, h2, i, tk->width)];
+    if (b->fp == fp) {
+      b->count = sketch_satAdd(b->count, 1);
+    } else if (!b->count) {
+      b->fp = fp;
+      b->count = 1;
+    } else if (b->count < TOPK_DECAY_TABLE && topk_rand(tk) < tk->decayThreshold[b->count]) {
+      // another key owns the bucket: decay it, and take it over once it's down to 0
+      if (!--b->count) {
+        b->fp = fp;
+        b->count = 1;
+      }
+    }
+    if (b->fp == fp && b->count > est) est = b->count;
+  }
+  return est;
+}
+
+static uint32_t topk_estimate(const RMUtilTopK *tk, uint64_t hash) {
+  uint64_t h2 = RMUtilHash_U64(hash) | 1;
+  uint32_t fp = topk_fp(hash), est = 0;
+  for (uint32_t i = 0; i < tk->depth; i++) {
+    const topkBucket *b =
+        &tk->buckets[(size_t)i * tk->width + sketch_index(hash, h2, i, tk->width)];
+    if (b->fp == fp && b->count > est) est = b->count;
+  }
+  return est;
+}
+
+/* Position of a key in the heap, or -1 */
+static ssize_t topk_find(const RMUtilTopK *tk, uint64_t hash, const char *key, size_t len) {
+  topkEntry *entries = topk_entries(tk);
+  for (size_t i = 0; i < Priority_Queue_Size(tk->heap); i++) {
+    if (entries[i].hash == hash && entries[i].len == len && !memcmp(entries[i].key, key, len)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* Put a key with the given count in the top k if it belongs there. Returns 1 if it is in */
+static int topk_offer(RMUtilTopK *tk, const char *key, size_t len, uint64_t hash, uint64_t count) {
+  topkEntry *entries = topk_entries(tk);
+  size_t size = Priority_Queue_Size(tk->heap);
+  // keys in the top k stay there with their count, even when their buckets decayed
+  ssize_t pos = topk_find(tk, hash, key, len);
+  if (pos >= 0) {
+    if (count > entries[pos].count) {
+      entries[pos].count = count;
+      Priority_Queue_Update(tk->heap, pos);
+    }
+    return 1;
+  }
+  if (size == tk->k) {
+    // ties keep the current key
+    if (count <= entries[0].count) return 0;
+    free(entries[0].key);
+    Priority_Queue_Pop(tk->heap);
+  }
+  topkEntry e = {malloc(len + 1), len, hash, count};
+  memcpy(e.key, key, len);
+  e.key[len] = '\0';
+  Priority_Queue_Push(tk->heap, e);
+  return 1;
+}
+
+int RMUtilTopK_Add(RMUtilTopK *tk, const char *key, size_t len) {
+  uint64_t hash = RMUtilHash_Bytes(key, len, 0);
+  return topk_offer(tk, key, len, hash, topk_update(tk, hash));
+}
+
+int RMUtilTopK_Query(const RMUtilTopK *tk, const char *key, size_t len) {
+  return topk_find(tk, RMUtilHash_Bytes(key, len, 0), key, len) >= 0;
+}
+
+uint32_t RMUtilTopK_Count(const RMUtilTopK *tk, const char *key, size_t len) {
+  return topk_estimate(tk, RMUtilHash_Bytes(key, len, 0));
+}
+
+static int topk_cmpItems(const void *a, const void *b) {
+  uint64_t x = ((RMUtilTopKItem *)a)->count, y = ((RMUtilTopKItem *)b)->count;
+  return x > y ? -1 : x < y;
+}
+
+size_t RMUtilTopK_List(const RMUtilTopK *tk, RMUtilTopKItem *items) {
+  topkEntry *entries = topk_entries(tk);
+  size_t n = Priority_Queue_Size(tk->heap);
+  for (size_t i = 0; i < n; i++) {
+    items[i] = (RMUtilTopKItem){entries[i].key, entries[i].len, entries[i].count};
+  }
+  qsort(items, n, sizeof(*items), topk_cmpItems);
+  return n;
+}
+
+int RMUtilTopK_Merge(RMUtilTopK *dst, const RMUtilTopK *src) {
+  if (dst->k != src->k || dst->width != src->width || dst->depth != src->depth ||
+      dst->decay != src->decay) {
+    return 0;
+  }
+  // the same key's counts add up, different keys cancel out
+  size_t n = (size_t)dst->width * dst->depth;
+  for (size_t i = 0; i < n; i++) {
+    topkBucket *a = &dst->buckets[i];
+    const topkBucket *b = &src->buckets[i];
+    if (a->fp == b->fp || !a->count) {
+      *a = (topkBucket){b->fp, sketch_satAdd(a->count, b->count)};
+    } else if (b->count > a->count) {
+      *a = (topkBucket){b->fp, b->count - a->count};
+    } else {
+      a->count -= b->count;
+    }
+  }
+  topkEntry *entries = topk_entries(src);
+  for (size_t i = 0; i < Priority_Queue_Size(src->heap); i++) {
+    topkEntry *e = &entries[i];
+    ssize_t pos = topk_find(dst, e->hash, e->key, e->len);
+    if (pos >= 0) {
+      topk_entries(dst)[pos].count += e->count;
+      Priority_Queue_Update(dst->heap, pos);
+    } else {
+      uint64_t est = topk_estimate(dst, e->hash);
+      topk_offer(dst, e->key, e->len, e->hash, est > e->count ? est : e->count);
+    }
+  }
+  return 1;
+}
+
+size_t RMUtilTopK_MemUsage(const RMUtilTopK *tk) {
+  size_t size = sizeof(*tk) + sizeof(PriorityQueue) + sizeof(Vector) +
+                tk->heap->v->cap * sizeof(topkEntry) +
+                (size_t)tk->width * tk->depth * sizeof(topkBucket);
+  topkEntry *entries = topk_entries(tk);
+  for (size_t i = 0; i < Priority_Queue_Size(tk->heap); i++) size += entries[i].len + 1;
+  return size;
+}
+
+/* Serialized top-k tracker, all little endian: k, the width and depth (32 bits each), the decay
+ * (a 64 bit double), the buckets' fingerprints and counts (32 bits each), then the number of top
+ * keys (32 bits) and for each one its count (64 bits), length (32 bits) and bytes */
+#define TOPK_HEADER_SIZE 20
+
+size_t RMUtilTopK_SerializedSize(const RMUtilTopK *tk) {
+  size_t size = TOPK_HEADER_SIZE + (size_t)tk->width * tk->depth * sizeof(topkBucket) + 4;
+  topkEntry *entries = topk_entries(tk);
+  for (size_t i = 0; i < Priority_Queue_Size(tk->heap); i++) size += 12 + entries[i].len;
+  return size;
+}
+
+void RMUtilTopK_Serialize(const RMUtilTopK *tk, char *buf) {
+  unsigned char *p = (unsigned char *)buf;
+  uint64_t decay;
+  memcpy(&decay, &tk->decay, sizeof(decay));
+  sketch_put(&p, tk->k, 4);
+  sketch_put(&p, tk->width, 4);
+  sketch_put(&p, tk->depth, 4);
+  sketch_put(&p, decay, 8);
+  size_t n = (size_t)tk->width * tk->depth;
+  for (size_t i = 0; i < n; i++) {
+    sketch_put(&p, tk->buckets[i].fp, 4);
+    sketch_put(&p, tk->buckets[i].count, 4);
+  }
+  topkEntry *entries = topk_entries(tk);
+  sketch_put(&p, Priority_Queue_Size(tk->heap), 4);
+  for (size_t i = 0; i < Priority_Queue_Size(tk->heap); i++) {
+    sketch_put(&p, entries[i].count, 8);
+    sketch_put(&p, entries[i].len, 4);
+    memcpy(p, entries[i].key, entries[i].len);
+    p += entries[i].len;
+  }
+}
+
+RMUtilTopK *RMUtilTopK_Deserialize(const char *buf, size_t len) {
+  const unsigned char *p = (const unsigned char *)buf, *end = p + len;
+  if (len < TOPK_HEADER_SIZE) return NULL;
+  uint32_t k = sketch_get(&p, 4), width = sketch_get(&p, 4), depth = sketch_get(&p, 4);
+  uint64_t bits = sketch_get(&p, 8), n = (uint64_t)width * depth;
+  double decay;
+  memcpy(&decay, &bits, sizeof(decay));
+  // by division, as the size of huge dimensions overflows. k is at most n, so the heap is bounded
+  // by the buffer too
+  size_t left = len - TOPK_HEADER_SIZE;
+  if (left < 4 || n > (left - 4) / sizeof(topkBucket)) return NULL;
+  RMUtilTopK *tk = RMUtilTopK_New(k, width, depth, decay);
+  if (!tk) return NULL;
+  for (size_t i = 0; i < n; i++) {
+    tk->buckets[i].fp = sketch_get(&p, 4);
+    tk->buckets[i].count = sketch_get(&p, 4);
+  }
+  uint32_t size = sketch_get(&p, 4);
+  if (size > k) goto err;
+  for (uint32_t i = 0; i < size; i++) {
+    if (end - p < 12) goto err;
+    uint64_t count = sketch_get(&p, 8);
+    uint32_t klen = sketch_get(&p, 4);
+    if ((size_t)(end - p) < klen) goto err;
+    const char *key = (const char *)p;
+    uint64_t hash = RMUtilHash_Bytes(key, klen, 0);
+    if (topk_find(tk, hash, key, klen) >= 0) goto err;
+    topkEntry e = {malloc(klen + 1), klen, hash, count};
+    memcpy(e.key, key, klen);
+    e.key[klen] = '\0';
+    Priority_Queue_Push(tk->heap, e);
+    p += klen;
+  }
+  if (p != end) goto err;
+  return tk;
+
+err:
+  RMUtilTopK_Free(tk);
+  return NULL;
+}
+
+void RMUtilTopK_RdbSave(RedisModuleIO *io, const RMUtilTopK *tk) {
+  size_t len = RMUtilTopK_SerializedSize(tk);
+  char *buf = malloc(len);
+  RMUtilTopK_Serialize(tk, buf);
+  RedisModule_SaveStringBuffer(io, buf, len);
+  free(buf);
+}
+
+RMUtilTopK *RMUtilTopK_RdbLoad(RedisModuleIO *io) {
+  size_t len;
+  char *buf = RedisModule_LoadStringBuffer(io, &len);
+  if (!buf) return NULL;
+  RMUtilTopK *tk = RMUtilTopK_Deserialize(buf, len);
+  RedisModule_Free(buf);
+  return tk;
+}
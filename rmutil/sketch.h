@@ -0,0 +1,136 @@
+#ifndef __RMUTIL_SKETCH_H__
+#define __RMUTIL_SKETCH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <redismodule.h>
+#include "hashmap.h"
+
+/** sketch.h - constant memory summaries of event streams.
+ *
+ *  - RMUtilCountMin estimates how many times each key was seen. Estimates are never lower than the
+ *    true count, and with probability 1 - delta at most eps * total higher. It uses conservative
+ *    update: an add only raises the counters that are below the key's new estimate, which makes
+ *    estimates much tighter on skewed streams.
+ *  - RMUtilHLL estimates the number of distinct keys, with a standard error of 1.04 / sqrt(2^p).
+ *    Small sets are stored as a sorted list of the non zero registers, switching to one byte per
+ *    register once that is smaller. Estimates use Ertl's improved estimator, which needs no bias
+ *    correction tables and is accurate across the whole range.
+ *  - RMUtilTopK tracks the k most frequent keys with HeavyKeeper: a Count-Min like table whose
+ *    buckets hold a key fingerprint, the counts of other keys colliding with it decaying
+ *    exponentially, so that buckets end up owned by the heavy hitters. The current top k are kept
+ *    in a PriorityQueue with the smallest count on top.
+ *
+ * Keys are given either as bytes, hashed with RMUtilHash_Bytes, or as a 64 bit hash the caller
+ * already has, which must be well mixed (e.g. from hashmap.h). Sketches built with the same
+ * parameters can be merged, e.g. to combine the sketches of several shards, and all serialize to
+ * a portable (little endian) form, validated when loaded.
+ */
+
+/* RMUtilCountMin - opaque Count-Min sketch */
+typedef struct RMUtilCountMin RMUtilCountMin;
+
+/* A sketch of depth rows of width counters each */
+RMUtilCountMin *RMUtilCountMin_New(uint32_t width, uint32_t depth);
+
+/* A sketch overestimating by at most eps times the total count with probability 1 - delta */
+RMUtilCountMin *RMUtilCountMin_NewForError(double eps, double delta);
+void RMUtilCountMin_Free(RMUtilCountMin *cm);
+
+/* Count a key n times. Returns its new estimate */
+uint32_t RMUtilCountMin_AddHash(RMUtilCountMin *cm, uint64_t hash, uint32_t n);
+uint32_t RMUtilCountMin_QueryHash(const RMUtilCountMin *cm, uint64_t hash);
+
+static inline uint32_t RMUtilCountMin_Add(RMUtilCountMin *cm, const void *key, size_t len,
+                                          uint32_t n) {
+  return RMUtilCountMin_AddHash(cm, RMUtilHash_Bytes(key, len, 0), n);
+}
+
+static inline uint32_t RMUtilCountMin_Query(const RMUtilCountMin *cm, const void *key, size_t len) {
+  return RMUtilCountMin_QueryHash(cm, RMUtilHash_Bytes(key, len, 0));
+}
+
+/* Return the sum of all the counts added */
+uint64_t RMUtilCountMin_Total(const RMUtilCountMin *cm);
+
+/* Add the counts of src to dst. The result still never underestimates. Returns 0 if their
+ * dimensions differ */
+int RMUtilCountMin_Merge(RMUtilCountMin *dst, const RMUtilCountMin *src);
+
+size_t RMUtilCountMin_MemUsage(const RMUtilCountMin *cm);
+size_t RMUtilCountMin_SerializedSize(const RMUtilCountMin *cm);
+void RMUtilCountMin_Serialize(const RMUtilCountMin *cm, char *buf);
+RMUtilCountMin *RMUtilCountMin_Deserialize(const char *buf, size_t len);
+void RMUtilCountMin_RdbSave(RedisModuleIO *io, const RMUtilCountMin *cm);
+RMUtilCountMin *RMUtilCountMin_RdbLoad(RedisModuleIO *io);
+
+/* RMUtilHLL - opaque HyperLogLog */
+typedef struct RMUtilHLL RMUtilHLL;
+
+#define RMUTIL_HLL_MIN_PRECISION 4
+#define RMUTIL_HLL_MAX_PRECISION 18
+
+/* A HyperLogLog of 2^p registers. Returns NULL if p is out of range */
+RMUtilHLL *RMUtilHLL_New(int p);
+void RMUtilHLL_Free(RMUtilHLL *h);
+
+/* Add a key. Returns 1 if the sketch changed */
+int RMUtilHLL_AddHash(RMUtilHLL *h, uint64_t hash);
+
+static inline int RMUtilHLL_Add(RMUtilHLL *h, const void *key, size_t len) {
+  return RMUtilHLL_AddHash(h, RMUtilHash_Bytes(key, len, 0));
+}
+
+/* Return the estimated number of distinct keys added */
+uint64_t RMUtilHLL_Count(const RMUtilHLL *h);
+
+/* Add the keys of src to dst. Returns 0 if their precisions differ */
+int RMUtilHLL_Merge(RMUtilHLL *dst, const RMUtilHLL *src);
+
+size_t RMUtilHLL_MemUsage(const RMUtilHLL *h);
+size_t RMUtilHLL_SerializedSize(const RMUtilHLL *h);
+void RMUtilHLL_Serialize(const RMUtilHLL *h, char *buf);
+RMUtilHLL *RMUtilHLL_Deserialize(const char *buf, size_t len);
+void RMUtilHLL_RdbSave(RedisModuleIO *io, const RMUtilHLL *h);
+RMUtilHLL *RMUtilHLL_RdbLoad(RedisModuleIO *io);
+
+/* RMUtilTopK - opaque top-k tracker */
+typedef struct RMUtilTopK RMUtilTopK;
+
+/* A key in the top k, and its estimated count */
+typedef struct {
+  const char *key;
+  size_t len;
+  uint64_t count;
+} RMUtilTopKItem;
+
+/* Track the k most frequent keys, with depth rows of width buckets. Collisions decay with
+ * probability decay^count. A width of a few times k, a depth of 4 to 5 and a decay of 0.9 work
+ * well. Returns NULL if k is more than width * depth, or if the tables can't be allocated */
+RMUtilTopK *RMUtilTopK_New(uint32_t k, uint32_t width, uint32_t depth, double decay);
+void RMUtilTopK_Free(RMUtilTopK *tk);
+
+/* Count a key. Returns 1 if it is in the top k */
+int RMUtilTopK_Add(RMUtilTopK *tk, const char *key, size_t len);
+
+/* Return 1 if the key is in the top k */
+int RMUtilTopK_Query(const RMUtilTopK *tk, const char *key, size_t len);
+
+/* Return the estimated count of a key */
+uint32_t RMUtilTopK_Count(const RMUtilTopK *tk, const char *key, size_t len);
+
+/* Fill items with the top keys, most frequent first, and return their number (at most k). The
+ * keys belong to the tracker, and are only valid until it is modified */
+size_t RMUtilTopK_List(const RMUtilTopK *tk, RMUtilTopKItem *items);
+
+/* Add the counts of src to dst, and merge their top keys. Returns 0 if their parameters differ */
+int RMUtilTopK_Merge(RMUtilTopK *dst, const RMUtilTopK *src);
+
+size_t RMUtilTopK_MemUsage(const RMUtilTopK *tk);
+size_t RMUtilTopK_SerializedSize(const RMUtilTopK *tk);
+void RMUtilTopK_Serialize(const RMUtilTopK *tk, char *buf);
+RMUtilTopK *RMUtilTopK_Deserialize(const char *buf, size_t len);
+void RMUtilTopK_RdbSave(RedisModuleIO *io, const RMUtilTopK *tk);
+RMUtilTopK *RMUtilTopK_RdbLoad(RedisModuleIO *io);
+
+#endif
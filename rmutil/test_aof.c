@@ -0,0 +1,181 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <redismodule.h>
+#include "mock_redis.h"
+#include "aof.h"
+#include "test.h"
+
+/* A module value of n arguments, the i-th one being i zero padded to len characters */
+typedef struct {
+  size_t n;
+  int len;
+} testValue;
+
+typedef struct {
+  const testValue *v;
+  size_t i;
+  char buf[64];
+} testIter;
+
+static RedisModuleType *testType;
+static RMUtilAofChunkOptions testOpts;
+static size_t testEmitted;
+
+static int testNext(void *p, const char **buf, size_t *len) {
+  testIter *it = p;
+  if (it->i == it->v->n) return 0;
+  *len = snprintf(it->buf, sizeof(it->buf), "%0*zu", it->v->len, it->i++);
+  *buf = it->buf;
+  return 1;
+}
+
+static void testRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+  testIter it = {.v = value};
+  testEmitted = RMUtil_ChunkedAofRewrite(aof, key, &testOpts, testNext, &it);
+}
+
+/* TEST.SET <key> <n> <len> */
+static int testSetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  long long n, len;
+  if (argc != 4) return RedisModule_WrongArity(ctx);
+  RedisModule_StringToLongLong(argv[2], &n);
+  RedisModule_StringToLongLong(argv[3], &len);
+  testValue *v = malloc(sizeof(*v));
+  v->n = n;
+  v->len = len;
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+  RedisModule_ModuleTypeSetValue(key, testType, v);
+  RedisModule_CloseKey(key);
+  return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+static int testOnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (RedisModule_Init(ctx, "testaof", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+  RedisModuleTypeMethods tm = {
+      .version = REDISMODULE_TYPE_METHOD_VERSION, .aof_rewrite = testRewrite, .free = free};
+  testType = RedisModule_CreateDataType(ctx, "test-list", 0, &tm);
+  if (testType == NULL) return REDISMODULE_ERR;
+  return RedisModule_CreateCommand(ctx, "test.set", testSetCommand, "write", 1, 1, 1);
+}
+
+static void setValue(const char *key, size_t n, int len) {
+  RedisModuleCallReply *r = RMUtilMock_Call("test.set", "cll", key, (long long)n, (long long)len);
+  RedisModule_FreeCallReply(r);
+}
+
+static const char *argAt(RedisModuleCallReply *cmd, size_t i) {
+  return RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(cmd, i), NULL);
+}
+
+/* Rewrite key, and check that it was emitted as n commands with sizes[i] arguments each, the
+ * first one create and the others append, carrying all the arguments in order */
+static int checkRewrite(const char *key, const char *create, const char *append,
+                        const size_t *sizes, size_t n) {
+  RedisModuleCallReply *r = RMUtilMock_RewriteAof(key);
+  ASSERT(r != NULL);
+  ASSERT_EQUAL(n, testEmitted);
+  ASSERT_EQUAL(n, RedisModule_CallReplyLength(r));
+  size_t next = 0;
+  for (size_t i = 0; i < n; i++) {
+    RedisModuleCallReply *cmd = RedisModule_CallReplyArrayElement(r, i);
+    ASSERT_EQUAL(sizes[i] + 2, RedisModule_CallReplyLength(cmd));
+    ASSERT_STRING_EQ(i ? append : create, argAt(cmd, 0));
+    ASSERT_STRING_EQ(key, argAt(cmd, 1));
+    for (size_t j = 0; j < sizes[i]; j++) {
+      ASSERT_EQUAL(next, strtoull(argAt(cmd, j + 2), NULL, 10));
+      next++;
+    }
+  }
+  RedisModule_FreeCallReply(r);
+  return 0;
+}
+
+int testChunkByCount() {
+  testOpts = (RMUtilAofChunkOptions){.createCmd = "TEST.CREATE", .appendCmd = "TEST.ADD"};
+  setValue("foo", 150, 4);
+  size_t sizes[] = {64, 64, 22};
+  if (checkRewrite("foo", "TEST.CREATE", "TEST.ADD", sizes, 3)) return -1;
+
+  // an exact multiple leaves no empty command behind
+  testOpts.maxElements = 50;
+  size_t exact[] = {50, 50, 50};
+  if (checkRewrite("foo", "TEST.CREATE", "TEST.ADD", exact, 3)) return -1;
+
+  // without an append command, create is used for all the chunks
+  testOpts.appendCmd = NULL;
+  if (checkRewrite("foo", "TEST.CREATE", "TEST.CREATE", exact, 3)) return -1;
+
+  // an empty value is still created
+  setValue("empty", 0, 4);
+  size_t none[] = {0};
+  if (checkRewrite("empty", "TEST.CREATE", "TEST.CREATE", none, 1)) return -1;
+
+  // invalid options emit nothing
+  testOpts.createCmd = NULL;
+  RedisModuleCallReply *r = RMUtilMock_RewriteAof("foo");
+  ASSERT_EQUAL(0, testEmitted);
+  ASSERT_EQUAL(0, RedisModule_CallReplyLength(r));
+  RedisModule_FreeCallReply(r);
+  RMUtilMock_FlushAll();
+  return 0;
+}
+
+int testChunkByBytes() {
+  // 10 bytes per argument: a command is cut once it carries at least 35 bytes
+  testOpts = (RMUtilAofChunkOptions){
+      .createCmd = "TEST.CREATE", .appendCmd = "TEST.ADD", .maxBytes = 35};
+  setValue("foo", 10, 10);
+  size_t sizes[] = {4, 4, 2};
+  if (checkRewrite("foo", "TEST.CREATE", "TEST.ADD", sizes, 3)) return -1;
+
+  // arguments larger than the limit are emitted whole, one per command
+  setValue("big", 3, 50);
+  size_t big[] = {1, 1, 1};
+  if (checkRewrite("big", "TEST.CREATE", "TEST.ADD", big, 3)) return -1;
+
+  // the count limit still applies with a byte limit
+  testOpts.maxElements = 3;
+  size_t both[] = {3, 3, 3, 1};
+  if (checkRewrite("foo", "TEST.CREATE", "TEST.ADD", both, 4)) return -1;
+  RMUtilMock_FlushAll();
+  return 0;
+}
+
+int testChunkElements() {
+  // field/value pairs: 3 pairs per command, 6 arguments
+  testOpts = (RMUtilAofChunkOptions){
+      .createCmd = "TEST.CREATE", .appendCmd = "TEST.ADD", .argsPerElement = 2, .maxElements = 3};
+  setValue("foo", 14, 4);
+  size_t sizes[] = {6, 6, 2};
+  if (checkRewrite("foo", "TEST.CREATE", "TEST.ADD", sizes, 3)) return -1;
+
+  // the byte limit is reached on the first argument of a pair, which is kept with the second
+  testOpts = (RMUtilAofChunkOptions){
+      .createCmd = "TEST.CREATE", .appendCmd = "TEST.ADD", .argsPerElement = 2, .maxBytes = 25};
+  setValue("foo", 10, 10);
+  size_t pairs[] = {4, 4, 2};
+  if (checkRewrite("foo", "TEST.CREATE", "TEST.ADD", pairs, 3)) return -1;
+
+  // triplets under a byte limit smaller than one of them
+  testOpts.argsPerElement = 3;
+  testOpts.maxBytes = 15;
+  setValue("foo", 9, 10);
+  size_t triplets[] = {3, 3, 3};
+  if (checkRewrite("foo", "TEST.CREATE", "TEST.ADD", triplets, 3)) return -1;
+  RMUtilMock_FlushAll();
+  return 0;
+}
+
+TEST_MAIN({
+  if (RMUtilMock_LoadModule(testOnLoad, NULL, 0) != REDISMODULE_OK) {
+    printf("Failed loading the test module\n");
+    return 1;
+  }
+  TESTFUNC(testChunkByCount);
+  TESTFUNC(testChunkByBytes);
+  TESTFUNC(testChunkElements);
+});
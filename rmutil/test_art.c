@@ -0,0 +1,228 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <redismodule.h>
+#include "art.h"
+#include "test.h"
+
+/* Keys are NUL terminated in the tests, but stored without the NUL */
+typedef struct {
+  char buf[48];
+  size_t len;
+} testKey;
+
+static int cmpKeys(const void *a, const void *b) {
+  const testKey *x = a, *y = b;
+  int cmp = memcmp(x->buf, y->buf, x->len < y->len ? x->len : y->len);
+  if (cmp) return cmp;
+  return x->len < y->len ? -1 : x->len > y->len;
+}
+
+/* Random keys over a small alphabet with long shared prefixes, so that they are prefixes of each
+ * other, share prefixes longer than a node stores, and fill all the node sizes */
+static size_t genKeys(testKey *keys, size_t n) {
+  static const char *prefixes[] = {"", "user:", "user:session:0123456789abcdef:", "x"};
+  for (size_t i = 0; i < n; i++) {
+    const char *p = prefixes[rand() % 4];
+    int len = strlen(p);
+    memcpy(keys[i].buf, p, len);
+    int extra = rand() % 6;
+    for (int j = 0; j < extra; j++) {
+      // mostly a few distinct bytes, sometimes any byte, to get node48/256
+      keys[i].buf[len++] = rand() % 8 ? 'a' + rand() % 4 : rand() % 256;
+    }
+    keys[i].len = len;
+  }
+  // sort and dedupe, as the reference
+  qsort(keys, n, sizeof(*keys), cmpKeys);
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (m && !cmpKeys(&keys[m - 1], &keys[i])) continue;
+    keys[m++] = keys[i];
+  }
+  return m;
+}
+
+int testBasic() {
+  RMUtilArt *t = RMUtilArt_New();
+  size_t empty = RMUtilArt_MemUsage(t);
+  ASSERT(RMUtilArt_Find(t, "foo", 3) == NULL);
+  ASSERT_EQUAL(0, RMUtilArt_Delete(t, "foo", 3, NULL));
+
+  ASSERT_EQUAL(1, RMUtilArt_Insert(t, "foo", 3, (void *)1, NULL));
+  ASSERT_EQUAL(1, RMUtilArt_Insert(t, "foobar", 6, (void *)2, NULL));
+  ASSERT_EQUAL(1, RMUtilArt_Insert(t, "fo", 2, (void *)3, NULL));
+  ASSERT_EQUAL(1, RMUtilArt_Insert(t, "", 0, (void *)4, NULL));
+  ASSERT_EQUAL(4, RMUtilArt_Size(t));
+  ASSERT(RMUtilArt_Find(t, "foo", 3) == (void *)1);
+  ASSERT(RMUtilArt_Find(t, "foobar", 6) == (void *)2);
+  ASSERT(RMUtilArt_Find(t, "fo", 2) == (void *)3);
+  ASSERT(RMUtilArt_Find(t, "", 0) == (void *)4);
+  ASSERT(RMUtilArt_Find(t, "f", 1) == NULL);
+  ASSERT(RMUtilArt_Find(t, "foob", 4) == NULL);
+  ASSERT(RMUtilArt_Find(t, "foobarbaz", 9) == NULL);
+
+  void *old = NULL;
+  ASSERT_EQUAL(0, RMUtilArt_Insert(t, "foo", 3, (void *)5, &old));
+  ASSERT(old == (void *)1);
+  ASSERT(RMUtilArt_Find(t, "foo", 3) == (void *)5);
+  ASSERT_EQUAL(4, RMUtilArt_Size(t));
+
+  ASSERT_EQUAL(1, RMUtilArt_Delete(t, "foo", 3, &old));
+  ASSERT(old == (void *)5);
+  ASSERT(RMUtilArt_Find(t, "foobar", 6) == (void *)2);
+  ASSERT(RMUtilArt_Find(t, "fo", 2) == (void *)3);
+  ASSERT_EQUAL(0, RMUtilArt_Delete(t, "foo", 3, NULL));
+  ASSERT_EQUAL(1, RMUtilArt_Delete(t, "", 0, NULL));
+  ASSERT_EQUAL(1, RMUtilArt_Delete(t, "foobar", 6, NULL));
+  ASSERT_EQUAL(1, RMUtilArt_Delete(t, "fo", 2, NULL));
+  ASSERT_EQUAL(0, RMUtilArt_Size(t));
+  ASSERT_EQUAL(empty, RMUtilArt_MemUsage(t));
+  RMUtilArt_Free(t, NULL);
+  return 0;
+}
+
+int testRandom() {
+  srand(1);
+  size_t n = 50000, wrong = 0;
+  testKey *keys = malloc(n * sizeof(*keys));
+  n = genKeys(keys, n);
+  // insert in random order
+  size_t *order = malloc(n * sizeof(*order));
+  for (size_t i = 0; i < n; i++) order[i] = i;
+  for (size_t i = n - 1; i > 0; i--) {
+    size_t j = rand() % (i + 1), tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  RMUtilArt *t = RMUtilArt_New();
+  size_t empty = RMUtilArt_MemUsage(t);
+  for (size_t i = 0; i < n; i++) {
+    testKey *k = &keys[order[i]];
+    if (!RMUtilArt_Insert(t, k->buf, k->len, (void *)(order[i] + 1), NULL)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(n, RMUtilArt_Size(t));
+  for (size_t i = 0; i < n; i++) {
+    if (RMUtilArt_Find(t, keys[i].buf, keys[i].len) != (void *)(i + 1)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+
+  // a full iteration returns the keys in order
+  RMUtilArtIterator *it = RMUtilArt_IterateFrom(t, "", 0);
+  const char *key;
+  size_t len, count = 0;
+  void *val;
+  while (RMUtilArtIterator_Next(it, &key, &len, &val)) {
+    if (count >= n || len != keys[count].len || memcmp(key, keys[count].buf, len) ||
+        val != (void *)(count + 1)) {
+      wrong++;
+    }
+    count++;
+  }
+  RMUtilArtIterator_Free(it);
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(n, count);
+
+  // lower bound seeks land on the first key >= the probe, whether the probe is in the tree or not
+  for (int i = 0; i < 2000; i++) {
+    testKey probe;
+    if (i % 2) {
+      probe = keys[rand() % n];
+    } else {
+      genKeys(&probe, 1);
+    }
+    testKey *lb = keys;
+    while (lb < keys + n && cmpKeys(lb, &probe) < 0) lb++;
+    it = RMUtilArt_IterateFrom(t, probe.buf, probe.len);
+    for (int j = 0; j < 3; j++, lb++) {
+      int ok = RMUtilArtIterator_Next(it, &key, &len, NULL);
+      if (ok != (lb < keys + n)) wrong++;
+      if (ok && (len != lb->len || memcmp(key, lb->buf, len))) wrong++;
+      if (!ok) break;
+    }
+    RMUtilArtIterator_Free(it);
+  }
+  ASSERT_EQUAL(0, wrong);
+
+  // prefix iteration returns exactly the keys with the prefix
+  const char *prefixes[] = {"", "user:", "user:session:0123", "user:session:0123456789abcdef:a",
+                            "x", "xa", "a", "zzz"};
+  for (int i = 0; i < sizeof(prefixes) / sizeof(*prefixes); i++) {
+    size_t plen = strlen(prefixes[i]), expected = 0;
+    for (size_t j = 0; j < n; j++) {
+      if (keys[j].len >= plen && !memcmp(keys[j].buf, prefixes[i], plen)) expected++;
+    }
+    count = 0;
+    it = RMUtilArt_IteratePrefix(t, prefixes[i], plen);
+    while (RMUtilArtIterator_Next(it, &key, &len, NULL)) {
+      if (len < plen || memcmp(key, prefixes[i], plen)) wrong++;
+      count++;
+    }
+    RMUtilArtIterator_Free(it);
+    if (count != expected) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+
+  // delete every other key, which shrinks and collapses nodes, and check the rest is intact
+  for (size_t i = 0; i < n; i += 2) {
+    void *old;
+    if (!RMUtilArt_Delete(t, keys[i].buf, keys[i].len, &old) || old != (void *)(i + 1)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(n / 2, RMUtilArt_Size(t));
+  for (size_t i = 0; i < n; i++) {
+    void *v = RMUtilArt_Find(t, keys[i].buf, keys[i].len);
+    if (v != (i % 2 ? (void *)(i + 1) : NULL)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+  count = 0;
+  it = RMUtilArt_IterateFrom(t, "", 0);
+  while (RMUtilArtIterator_Next(it, &key, &len, &val)) {
+    size_t idx = 2 * count + 1;
+    if (idx >= n || len != keys[idx].len || memcmp(key, keys[idx].buf, len)) wrong++;
+    count++;
+  }
+  RMUtilArtIterator_Free(it);
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(n / 2, count);
+
+  // and back to empty
+  for (size_t i = 1; i < n; i += 2) {
+    if (!RMUtilArt_Delete(t, keys[i].buf, keys[i].len, NULL)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(0, RMUtilArt_Size(t));
+  ASSERT_EQUAL(empty, RMUtilArt_MemUsage(t));
+
+  RMUtilArt_Free(t, NULL);
+  free(order);
+  free(keys);
+  return 0;
+}
+
+static int freed = 0;
+static void countFree(void *p) {
+  freed++;
+}
+
+int testFree() {
+  RMUtilArt *t = RMUtilArt_New();
+  char buf[16];
+  for (int i = 0; i < 1000; i++) {
+    int len = sprintf(buf, "k%d", i);
+    RMUtilArt_Insert(t, buf, len, buf, NULL);
+  }
+  ASSERT_EQUAL(1000, RMUtilArt_Size(t));
+  RMUtilArt_Free(t, countFree);
+  ASSERT_EQUAL(1000, freed);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testBasic);
+  TESTFUNC(testRandom);
+  TESTFUNC(testFree);
+});
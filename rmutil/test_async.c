@@ -0,0 +1,180 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <redismodule.h>
+#include "mock_redis.h"
+#include "async.h"
+#include "test.h"
+
+typedef struct {
+  long long n;
+  int wait;  // run until cancelled
+} testState;
+
+static RMUtilThreadPool *pool;
+static int freed, cancelled, contexts;
+
+static void testFree(void *p) {
+  __atomic_add_fetch(&freed, 1, __ATOMIC_SEQ_CST);
+  free(p);
+}
+
+static void testWork(RMUtilAsyncJob *job, void *pd) {
+  testState *st = pd;
+  RedisModuleCtx *ctx = RMUtilAsync_GetContext(job);
+  if (ctx) {
+    RedisModule_ThreadSafeContextLock(ctx);
+    __atomic_add_fetch(&contexts, 1, __ATOMIC_SEQ_CST);
+    RedisModule_ThreadSafeContextUnlock(ctx);
+  }
+  // give up after 10 seconds, so a broken cancellation fails the test instead of hanging it
+  for (int i = 0; st->wait && i < 10000 && !RMUtilAsync_Cancelled(job); i++) usleep(1000);
+  if (RMUtilAsync_Cancelled(job)) __atomic_add_fetch(&cancelled, 1, __ATOMIC_SEQ_CST);
+  st->n *= 2;
+}
+
+static int testReply(RedisModuleCtx *ctx, void *pd) {
+  return RedisModule_ReplyWithLongLong(ctx, ((testState *)pd)->n);
+}
+
+/* TEST.ASYNC|TEST.THREAD <n> [WAIT] - reply with n * 2, computed on the pool or on a new thread */
+static int testAsync(RedisModuleCtx *ctx, RedisModuleString **argv, int argc,
+                     RMUtilThreadPool *p) {
+  if (argc != 2 && argc != 3) return RedisModule_WrongArity(ctx);
+  testState *st = calloc(1, sizeof(*st));
+  RedisModule_StringToLongLong(argv[1], &st->n);
+  st->wait = argc == 3;
+  return RMUtil_AsyncCommand(ctx, p, testWork, testReply, testFree, st, 10000);
+}
+
+static int testAsyncCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  return testAsync(ctx, argv, argc, pool);
+}
+
+static int testThreadCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  return testAsync(ctx, argv, argc, NULL);
+}
+
+static int testOnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (RedisModule_Init(ctx, "testasync", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+  if (RedisModule_CreateCommand(ctx, "test.async", testAsyncCommand, "readonly", 0, 0, 0) ==
+      REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+  return RedisModule_CreateCommand(ctx, "test.thread", testThreadCommand, "readonly", 0, 0, 0);
+}
+
+/* Call a blocking command, which replies nothing until it's unblocked */
+static int callBlocking(const char *cmd, const char *n, const char *wait) {
+  RedisModuleCallReply *r =
+      wait ? RMUtilMock_Call(cmd, "cc", n, wait) : RMUtilMock_Call(cmd, "c", n);
+  ASSERT_EQUAL(REDISMODULE_REPLY_NULL, RedisModule_CallReplyType(r));
+  RedisModule_FreeCallReply(r);
+  return 0;
+}
+
+/* Run the event loop until all the clients are handled */
+static void drain() {
+  for (int i = 0; i < 10000 && RMUtilMock_BlockedClients(); i++) {
+    RMUtilMock_ProcessEvents();
+    if (RMUtilMock_BlockedClients()) usleep(1000);
+  }
+}
+
+static void setup() {
+  freed = cancelled = contexts = 0;
+}
+
+int testReplies() {
+  setup();
+  for (int i = 0; i < 10; i++) {
+    char n[16];
+    sprintf(n, "%d", i);
+    if (callBlocking(i % 2 ? "test.async" : "test.thread", n, NULL)) return -1;
+  }
+  RMUtilThreadPool_Wait(pool);
+  drain();
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+
+  // the replies come in the order the clients were blocked, once the event loop handled them
+  for (long long i = 0; i < 10; i++) {
+    RedisModuleCallReply *r = RMUtilMock_PopReply();
+    ASSERT(r != NULL);
+    ASSERT_EQUAL(i * 2, RedisModule_CallReplyInteger(r));
+    RedisModule_FreeCallReply(r);
+  }
+  ASSERT(RMUtilMock_PopReply() == NULL);
+  ASSERT_EQUAL(10, freed);
+  ASSERT_EQUAL(10, contexts);
+  ASSERT_EQUAL(0, cancelled);
+
+  // unblocked clients are not timed out
+  if (callBlocking("test.async", "1", NULL)) return -1;
+  RMUtilThreadPool_Wait(pool);
+  ASSERT_EQUAL(0, RMUtilMock_TimeoutClients());
+  drain();
+  RedisModuleCallReply *r = RMUtilMock_PopReply();
+  ASSERT_EQUAL(2, RedisModule_CallReplyInteger(r));
+  RedisModule_FreeCallReply(r);
+  ASSERT_EQUAL(11, freed);
+  return 0;
+}
+
+int testTimeout() {
+  setup();
+  if (callBlocking("test.async", "1", "WAIT")) return -1;
+  if (callBlocking("test.thread", "2", "WAIT")) return -1;
+  ASSERT_EQUAL(2, RMUtilMock_BlockedClients());
+  ASSERT_EQUAL(2, RMUtilMock_TimeoutClients());
+
+  // the timeout error is sent right away, while the work is still running
+  for (int i = 0; i < 2; i++) {
+    RedisModuleCallReply *r = RMUtilMock_PopReply();
+    ASSERT(r != NULL);
+    ASSERT_EQUAL(REDISMODULE_REPLY_ERROR, RedisModule_CallReplyType(r));
+    ASSERT_STRING_EQ(RMUTIL_ASYNC_TIMEOUT_ERROR, RedisModule_CallReplyStringPtr(r, NULL));
+    RedisModule_FreeCallReply(r);
+  }
+  ASSERT_EQUAL(0, freed);
+
+  // the work sees it was cancelled, and its private data is freed once, with no other reply
+  RMUtilThreadPool_Wait(pool);
+  drain();
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+  ASSERT_EQUAL(2, cancelled);
+  ASSERT_EQUAL(2, freed);
+  ASSERT(RMUtilMock_PopReply() == NULL);
+  return 0;
+}
+
+int testDisconnect() {
+  setup();
+  if (callBlocking("test.async", "1", "WAIT")) return -1;
+  if (callBlocking("test.thread", "2", "WAIT")) return -1;
+  ASSERT_EQUAL(2, RMUtilMock_DisconnectClients());
+  ASSERT_EQUAL(0, RMUtilMock_TimeoutClients());
+
+  RMUtilThreadPool_Wait(pool);
+  drain();
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+  ASSERT_EQUAL(2, cancelled);
+  ASSERT_EQUAL(2, freed);
+  ASSERT(RMUtilMock_PopReply() == NULL);
+  return 0;
+}
+
+TEST_MAIN({
+  pool = RMUtilThreadPool_New(&(RMUtilThreadPoolOptions){.numThreads = 2});
+  if (RMUtilMock_LoadModule(testOnLoad, NULL, 0) != REDISMODULE_OK) {
+    printf("Failed loading the test module\n");
+    return 1;
+  }
+  TESTFUNC(testReplies);
+  TESTFUNC(testTimeout);
+  TESTFUNC(testDisconnect);
+  RMUtilThreadPool_Free(pool);
+});
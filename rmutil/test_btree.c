@@ -0,0 +1,177 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "btree.h"
+#include "test.h"
+
+static void shuffle(size_t *a, size_t n) {
+  for (size_t i = 0; i < n; i++) a[i] = i;
+  for (size_t i = n - 1; i > 0; i--) {
+    size_t j = rand() % (i + 1), tmp = a[i];
+    a[i] = a[j];
+    a[j] = tmp;
+  }
+}
+
+/* Check the tree against the keys i * 0.5 for which present[i] is set, with value i + 1 */
+static size_t checkTree(RMUtilBTree *t, const char *present, size_t n) {
+  size_t wrong = 0, rank = 0;
+  for (size_t i = 0; i < n; i++) {
+    void *val = NULL;
+    int found = RMUtilBTree_Find(t, i * 0.5, &val);
+    if (found != present[i] || (found && val != (void *)(i + 1))) wrong++;
+    if (RMUtilBTree_Find(t, i * 0.5 + 0.25, NULL)) wrong++;
+    if (RMUtilBTree_Rank(t, i * 0.5) != rank) wrong++;
+    if (present[i]) {
+      double key;
+      if (!RMUtilBTree_Select(t, rank, &key, &val) || key != i * 0.5) wrong++;
+      rank++;
+    }
+  }
+  if (rank != RMUtilBTree_Size(t) || RMUtilBTree_Select(t, rank, NULL, NULL)) wrong++;
+
+  // full scans in both directions
+  RMUtilBTreeCursor *c = RMUtilBTree_Range(t, -INFINITY, INFINITY, 0);
+  double key, last = -INFINITY;
+  size_t count = 0;
+  while (RMUtilBTreeCursor_Next(c, &key, NULL)) {
+    if (key <= last || !present[(size_t)(key * 2)]) wrong++;
+    last = key;
+    count++;
+  }
+  RMUtilBTreeCursor_Free(c);
+  if (count != rank) wrong++;
+  c = RMUtilBTree_Range(t, -INFINITY, INFINITY, 1);
+  last = INFINITY;
+  count = 0;
+  while (RMUtilBTreeCursor_Next(c, &key, NULL)) {
+    if (key >= last) wrong++;
+    last = key;
+    count++;
+  }
+  RMUtilBTreeCursor_Free(c);
+  if (count != rank) wrong++;
+  return wrong;
+}
+
+/* Check range cursors with bounds between and on keys */
+static size_t checkRanges(RMUtilBTree *t, const char *present, size_t n) {
+  size_t wrong = 0;
+  for (int i = 0; i < 200; i++) {
+    double min = (rand() % (n + 20)) * 0.25 - 2, max = min + (rand() % 400) * 0.25;
+    size_t expected = 0;
+    for (size_t j = 0; j < n; j++) expected += present[j] && j * 0.5 >= min && j * 0.5 <= max;
+    for (int reverse = 0; reverse < 2; reverse++) {
+      RMUtilBTreeCursor *c = RMUtilBTree_Range(t, min, max, reverse);
+      double key, last = reverse ? INFINITY : -INFINITY;
+      size_t count = 0;
+      while (RMUtilBTreeCursor_Next(c, &key, NULL)) {
+        if (key < min || key > max || (reverse ? key >= last : key <= last)) wrong++;
+        last = key;
+        count++;
+      }
+      RMUtilBTreeCursor_Free(c);
+      if (count != expected) wrong++;
+    }
+  }
+  return wrong;
+}
+
+int testBTree() {
+  srand(1);
+  size_t n = 50000, *order = malloc(n * sizeof(size_t));
+  char *present = calloc(n, 1);
+  RMUtilBTree *t = RMUtilBTree_New();
+  size_t empty = RMUtilBTree_MemUsage(t);
+  ASSERT_EQUAL(0, RMUtilBTree_Find(t, 1, NULL));
+  ASSERT_EQUAL(0, RMUtilBTree_Delete(t, 1, NULL));
+  ASSERT_EQUAL(0, checkTree(t, present, n));
+
+  shuffle(order, n);
+  size_t wrong = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (!RMUtilBTree_Insert(t, order[i] * 0.5, (void *)(order[i] + 1), NULL)) wrong++;
+    present[order[i]] = 1;
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(n, RMUtilBTree_Size(t));
+  ASSERT_EQUAL(0, checkTree(t, present, n));
+  ASSERT_EQUAL(0, checkRanges(t, present, n));
+
+  void *old = NULL;
+  ASSERT_EQUAL(0, RMUtilBTree_Insert(t, 21, (void *)1234, &old));
+  ASSERT(old == (void *)43);
+  ASSERT_EQUAL(0, RMUtilBTree_Insert(t, 21, (void *)43, NULL));
+  ASSERT_EQUAL(n, RMUtilBTree_Size(t));
+
+  // delete most keys in random order, merging and refilling nodes
+  shuffle(order, n);
+  for (size_t i = 0; i < n * 9 / 10; i++) {
+    if (!RMUtilBTree_Delete(t, order[i] * 0.5, &old) || old != (void *)(order[i] + 1)) wrong++;
+    present[order[i]] = 0;
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(n - n * 9 / 10, RMUtilBTree_Size(t));
+  ASSERT_EQUAL(0, checkTree(t, present, n));
+  ASSERT_EQUAL(0, checkRanges(t, present, n));
+
+  for (size_t i = n * 9 / 10; i < n; i++) RMUtilBTree_Delete(t, order[i] * 0.5, NULL);
+  ASSERT_EQUAL(0, RMUtilBTree_Size(t));
+  ASSERT_EQUAL(empty, RMUtilBTree_MemUsage(t));
+  RMUtilBTree_Free(t, NULL);
+  free(present);
+  free(order);
+  return 0;
+}
+
+int testBulkLoad() {
+  Vector *v = NewVector(RMUtilBTreeEntry, 0);
+  RMUtilBTree *t = RMUtilBTree_BulkLoad(v);
+  ASSERT(t != NULL);
+  ASSERT_EQUAL(0, RMUtilBTree_Size(t));
+  RMUtilBTree_Free(t, NULL);
+
+  // sizes around node and level boundaries
+  size_t sizes[] = {1, 15, 16, 17, 31, 32, 33, 1024, 1025, 100000};
+  for (int s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+    size_t n = sizes[s];
+    char *present = malloc(n);
+    memset(present, 1, n);
+    Vector_Resize(v, n);
+    v->top = n;
+    RMUtilBTreeEntry *e = (RMUtilBTreeEntry *)v->data;
+    for (size_t i = 0; i < n; i++) e[i] = (RMUtilBTreeEntry){i * 0.5, (void *)(i + 1)};
+    t = RMUtilBTree_BulkLoad(v);
+    ASSERT_EQUAL(n, RMUtilBTree_Size(t));
+    ASSERT_EQUAL(0, checkTree(t, present, n));
+
+    // the tree stays consistent when modified afterwards
+    for (size_t i = 0; i < n; i += 3) {
+      RMUtilBTree_Delete(t, i * 0.5, NULL);
+      present[i] = 0;
+    }
+    ASSERT_EQUAL(0, checkTree(t, present, n));
+    for (size_t i = 0; i < n; i += 3) {
+      RMUtilBTree_Insert(t, i * 0.5, (void *)(i + 1), NULL);
+      present[i] = 1;
+    }
+    ASSERT_EQUAL(0, checkTree(t, present, n));
+    RMUtilBTree_Free(t, NULL);
+    free(present);
+  }
+
+  // unsorted or duplicate keys are rejected
+  RMUtilBTreeEntry *e = (RMUtilBTreeEntry *)v->data;
+  e[10].key = e[9].key;
+  ASSERT(RMUtilBTree_BulkLoad(v) == NULL);
+  e[10].key = NAN;
+  ASSERT(RMUtilBTree_BulkLoad(v) == NULL);
+  Vector_Free(v);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testBTree);
+  TESTFUNC(testBulkLoad);
+});
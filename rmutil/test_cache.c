@@ -0,0 +1,250 @@
+#define REDISMODULE_MAIN
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <redismodule.h>
+#include "cache.h"
+#include "test.h"
+
+/* Values are refcounted, so they can be used after another thread evicted them */
+typedef struct {
+  int refs;
+  int id;
+} value;
+
+static long liveValues = 0;
+
+static value *newValue(int id) {
+  value *v = malloc(sizeof(*v));
+  v->refs = 1;
+  v->id = id;
+  __atomic_add_fetch(&liveValues, 1, __ATOMIC_RELAXED);
+  return v;
+}
+
+static void retainValue(void *p) {
+  __atomic_add_fetch(&((value *)p)->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void releaseValue(void *p) {
+  value *v = p;
+  if (__atomic_sub_fetch(&v->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    free(v);
+    __atomic_sub_fetch(&liveValues, 1, __ATOMIC_RELAXED);
+  }
+}
+
+static RMUtilCacheType valueType = {.free = releaseValue, .retain = retainValue};
+
+/* Look key up, returning the id of its value or -1 */
+static int lookup(RMUtilCache *c, const char *key) {
+  value *v = RMUtilCache_Get(c, key, strlen(key));
+  if (!v) return -1;
+  int id = v->id;
+  releaseValue(v);
+  return id;
+}
+
+static void set(RMUtilCache *c, const char *key, int id, size_t size) {
+  value *v = newValue(id);
+  if (!RMUtilCache_Set(c, key, strlen(key), v, size)) releaseValue(v);
+}
+
+int testCache() {
+  RMUtilCacheOptions opts = {.maxBytes = 64 * 1024, .numShards = 1};
+  RMUtilCache *c = RMUtilCache_New("test", &valueType, &opts);
+  ASSERT_EQUAL(-1, lookup(c, "foo"));
+  set(c, "foo", 1, 100);
+  set(c, "bar", 2, 100);
+  ASSERT_EQUAL(1, lookup(c, "foo"));
+  ASSERT_EQUAL(2, lookup(c, "bar"));
+  // keys are byte strings
+  ASSERT(RMUtilCache_Get(c, "foo", 2) == NULL);
+
+  set(c, "foo", 3, 100);
+  ASSERT_EQUAL(3, lookup(c, "foo"));
+  ASSERT_EQUAL(2, liveValues);
+  ASSERT_EQUAL(1, RMUtilCache_Del(c, "foo", 3));
+  ASSERT_EQUAL(0, RMUtilCache_Del(c, "foo", 3));
+  ASSERT_EQUAL(-1, lookup(c, "foo"));
+  ASSERT_EQUAL(1, liveValues);
+
+  // too large for the budget: not taken, and the current value is kept
+  value *big = newValue(4);
+  ASSERT_EQUAL(0, RMUtilCache_Set(c, "big", 3, big, 64 * 1024));
+  ASSERT_EQUAL(1, big->refs);
+  ASSERT_EQUAL(0, RMUtilCache_Set(c, "bar", 3, big, 64 * 1024));
+  ASSERT_EQUAL(1, big->refs);
+  releaseValue(big);
+  ASSERT_EQUAL(2, lookup(c, "bar"));
+  ASSERT_EQUAL(1, liveValues);
+
+  RMUtilCacheStats st;
+  RMUtilCache_GetStats(c, &st);
+  ASSERT_EQUAL(4, st.hits);
+  ASSERT_EQUAL(3, st.misses);
+  ASSERT_EQUAL(1, st.entries);
+  ASSERT(st.bytes > 100 && st.bytes < 300);
+
+  // filling the cache keeps it within the budget
+  char key[32];
+  for (int i = 0; i < 10000; i++) {
+    sprintf(key, "key:%d", i);
+    set(c, key, i, 1000);
+  }
+  RMUtilCache_GetStats(c, &st);
+  ASSERT(st.bytes <= opts.maxBytes);
+  ASSERT(st.entries > 50 && st.entries < 64);
+  ASSERT_EQUAL(10001 - st.entries, st.evictions);
+  ASSERT_EQUAL(st.entries, liveValues);
+  // the most recent keys are the ones left
+  ASSERT_EQUAL(9999, lookup(c, "key:9999"));
+  ASSERT_EQUAL(-1, lookup(c, "key:100"));
+
+  RMUtilCache_Clear(c);
+  RMUtilCache_GetStats(c, &st);
+  ASSERT_EQUAL(0, st.entries);
+  ASSERT_EQUAL(0, st.bytes);
+  ASSERT_EQUAL(0, liveValues);
+  set(c, "foo", 1, 100);
+  RMUtilCache_Free(c);
+  ASSERT_EQUAL(0, liveValues);
+  return 0;
+}
+
+int testCacheScanResistance() {
+  RMUtilCacheOptions opts = {.maxBytes = 100 * 1100, .numShards = 4};
+  RMUtilCache *c = RMUtilCache_New("test", &valueType, &opts);
+  // a working set used over and over, then a scan of keys used once
+  char key[32];
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 40; i++) {
+      sprintf(key, "hot:%d", i);
+      if (lookup(c, key) < 0) set(c, key, i, 1000);
+    }
+  }
+  for (int i = 0; i < 5000; i++) {
+    sprintf(key, "scan:%d", i);
+    if (lookup(c, key) < 0) set(c, key, i, 1000);
+  }
+  int hot = 0;
+  for (int i = 0; i < 40; i++) {
+    sprintf(key, "hot:%d", i);
+    hot += lookup(c, key) == i;
+  }
+  // all of them, but those of a shard that got more than its share of the protected segment
+  ASSERT(hot >= 35);
+  RMUtilCache_Free(c);
+  ASSERT_EQUAL(0, liveValues);
+  return 0;
+}
+
+static float memoryRatio = 0;
+
+static float fakeUsedMemoryRatio(void) {
+  return memoryRatio;
+}
+
+int testCacheMemoryPressure() {
+  RMUtilCacheOptions opts = {.maxBytes = 1 << 20, .memoryWatermark = 0.8};
+  RMUtilCache *c = RMUtilCache_New("test", &valueType, &opts);
+  char key[32];
+  for (int i = 0; i < 10000; i++) {
+    sprintf(key, "key:%d", i);
+    set(c, key, i, 1000);
+  }
+  RMUtilCacheStats st;
+  RMUtilCache_GetStats(c, &st);
+  size_t full = st.bytes;
+  ASSERT(full > opts.maxBytes * 0.9);
+
+  // without the API, or below the watermark, nothing changes
+  ASSERT_EQUAL(0, RMUtilCache_CheckMemory(c));
+  RedisModule_GetUsedMemoryRatio = fakeUsedMemoryRatio;
+  memoryRatio = 0.5;
+  ASSERT_EQUAL(0, RMUtilCache_CheckMemory(c));
+
+  // halfway between the watermark and maxmemory: half the budget
+  memoryRatio = 0.9;
+  size_t freed = RMUtilCache_CheckMemory(c);
+  RMUtilCache_GetStats(c, &st);
+  ASSERT(st.limit > opts.maxBytes * 0.49 && st.limit < opts.maxBytes * 0.51);
+  ASSERT(st.bytes <= st.limit);
+  ASSERT_EQUAL(full - st.bytes, freed);
+  // new entries stay within the lowered budget
+  for (int i = 0; i < 1000; i++) {
+    sprintf(key, "new:%d", i);
+    set(c, key, i, 1000);
+  }
+  RMUtilCache_GetStats(c, &st);
+  ASSERT(st.bytes <= st.limit);
+
+  // at maxmemory the cache is emptied, and it gets its budget back when memory is freed
+  memoryRatio = 1.05;
+  RMUtilCache_CheckMemory(c);
+  RMUtilCache_GetStats(c, &st);
+  ASSERT_EQUAL(0, st.entries);
+  ASSERT_EQUAL(0, RMUtilCache_Set(c, "foo", 3, &st, 0));
+  memoryRatio = 0.2;
+  RMUtilCache_CheckMemory(c);
+  RMUtilCache_GetStats(c, &st);
+  ASSERT_EQUAL(opts.maxBytes, st.limit);
+  RedisModule_GetUsedMemoryRatio = NULL;
+  RMUtilCache_Free(c);
+  ASSERT_EQUAL(0, liveValues);
+  return 0;
+}
+
+#define NUM_THREADS 4
+#define OPS_PER_THREAD 200000
+
+static long badValues = 0;
+
+/* Get or compute the values of a skewed key space, using them after other threads evict them */
+static void *worker(void *arg) {
+  RMUtilCache *c = arg;
+  unsigned seed = (unsigned)(uintptr_t)pthread_self();
+  char key[32];
+  for (int i = 0; i < OPS_PER_THREAD; i++) {
+    int id = rand_r(&seed) % 1000;
+    id = id * id / 1000;
+    int len = sprintf(key, "key:%d", id);
+    value *v = RMUtilCache_Get(c, key, len);
+    if (!v) {
+      v = newValue(id);
+      retainValue(v);
+      if (!RMUtilCache_Set(c, key, len, v, 500)) releaseValue(v);
+    }
+    if (v->id != id) __atomic_add_fetch(&badValues, 1, __ATOMIC_RELAXED);
+    releaseValue(v);
+    if (i % 1000 == 0) RMUtilCache_Del(c, key, len);
+  }
+  return NULL;
+}
+
+int testCacheThreads() {
+  RMUtilCacheOptions opts = {.maxBytes = 300 * 1024, .numShards = 4};
+  RMUtilCache *c = RMUtilCache_New("test", &valueType, &opts);
+  pthread_t threads[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) pthread_create(&threads[i], NULL, worker, c);
+  for (int i = 0; i < NUM_THREADS; i++) pthread_join(threads[i], NULL);
+  ASSERT_EQUAL(0, badValues);
+
+  RMUtilCacheStats st;
+  RMUtilCache_GetStats(c, &st);
+  ASSERT_EQUAL(NUM_THREADS * OPS_PER_THREAD, st.hits + st.misses);
+  ASSERT(st.hits > st.misses);
+  ASSERT(st.bytes <= opts.maxBytes);
+  ASSERT_EQUAL(st.entries, liveValues);
+  RMUtilCache_Free(c);
+  ASSERT_EQUAL(0, liveValues);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testCache);
+  TESTFUNC(testCacheScanResistance);
+  TESTFUNC(testCacheMemoryPressure);
+  TESTFUNC(testCacheThreads);
+});
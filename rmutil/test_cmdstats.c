@@ -0,0 +1,142 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <redismodule.h>
+#include "mock_redis.h"
+#include "cmdstats.h"
+#include "test.h"
+
+#define NUM_FAST (RMUTIL_CMDSTATS_MAX_COMMANDS - 1)
+
+static int extraRegistered;
+
+/* Reply with the command name, so each trampoline can be checked to pass the arguments through.
+ * With an argument, take 300us first */
+static int testFastCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc > 1) usleep(300);
+  return RedisModule_ReplyWithString(ctx, argv[0]);
+}
+
+static int testSlowCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  usleep(5000);
+  return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+static int testOnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (RedisModule_Init(ctx, "testcmdstats", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+  char name[32];
+  for (int i = 0; i < NUM_FAST; i++) {
+    sprintf(name, "test.cmd%d", i);
+    RMUtil_RegisterTimedReadCmd(ctx, name, testFastCommand);
+  }
+  RMUtil_RegisterTimedWriteCmd(ctx, "test.slow", testSlowCommand);
+  // all the trampolines are taken
+  extraRegistered = RMUtil_CreateTimedCommand(ctx, "test.extra", testFastCommand, "readonly", 1,
+                                              1, 1) == REDISMODULE_OK;
+  return RMUtilCmdStats_RegisterInfoFunc(ctx);
+}
+
+/* Call test.cmd<i> i + 1 times */
+static int callAll() {
+  char name[32];
+  for (int i = 0; i < NUM_FAST; i++) {
+    sprintf(name, "test.cmd%d", i);
+    for (int j = 0; j <= i; j++) {
+      RedisModuleCallReply *r = RMUtilMock_Call(name, "");
+      const char *s = RedisModule_CallReplyStringPtr(r, NULL);
+      ASSERT(s != NULL);
+      ASSERT_STRING_EQ(name, s);
+      RedisModule_FreeCallReply(r);
+    }
+  }
+  return 0;
+}
+
+int testTrampolines() {
+  ASSERT_EQUAL(0, extraRegistered);
+  RedisModuleCallReply *r = RMUtilMock_Call("test.extra", "");
+  ASSERT_EQUAL(REDISMODULE_REPLY_ERROR, RedisModule_CallReplyType(r));
+  RedisModule_FreeCallReply(r);
+
+  if (callAll()) return -1;
+  // every command is recorded in its own histogram
+  char name[32];
+  for (int i = 0; i < NUM_FAST; i++) {
+    sprintf(name, "test.cmd%d", i);
+    const RMUtilHistogram *h = RMUtilCmdStats_Get(name);
+    ASSERT(h != NULL);
+    ASSERT_EQUAL(i + 1, h->count);
+  }
+  ASSERT_EQUAL(0, RMUtilCmdStats_Get("test.slow")->count);
+  ASSERT(RMUtilCmdStats_Get("TEST.CMD5") == RMUtilCmdStats_Get("test.cmd5"));
+  ASSERT(RMUtilCmdStats_Get("test.extra") == NULL);
+
+  RMUtilCmdStats_Reset();
+  ASSERT_EQUAL(0, RMUtilCmdStats_Get("test.cmd5")->count);
+  return 0;
+}
+
+int testInfo() {
+  RMUtilCmdStats_Reset();
+  if (callAll()) return -1;
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.slow", ""));
+
+  RedisModuleCallReply *r = RMUtilMock_Call("info", "");
+  const char *info = RedisModule_CallReplyStringPtr(r, NULL);
+  ASSERT(info != NULL);
+  ASSERT(strstr(info, "# testcmdstats_cmdstats\r\n") != NULL);
+  ASSERT(strstr(info, "testcmdstats_test.cmd0:calls=1,mean_usec=") != NULL);
+  ASSERT(strstr(info, "testcmdstats_test.cmd62:calls=63,mean_usec=") != NULL);
+
+  // the slow command took at least 5ms
+  const char *slow = strstr(info, "testcmdstats_test.slow:calls=1,");
+  ASSERT(slow != NULL);
+  double mean, p50, p99, p999, max;
+  ASSERT_EQUAL(5, sscanf(slow,
+                         "testcmdstats_test.slow:calls=1,mean_usec=%lf,p50_usec=%lf,p99_usec=%lf,"
+                         "p999_usec=%lf,max_usec=%lf\r\n",
+                         &mean, &p50, &p99, &p999, &max));
+  ASSERT(mean >= 5000);
+  ASSERT(max >= 5000);
+  ASSERT(p50 <= p99);
+  ASSERT(p99 <= p999);
+  RedisModule_FreeCallReply(r);
+  return 0;
+}
+
+int testLatencyMonitor() {
+  // disabled by default
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.slow", ""));
+  ASSERT_EQUAL(0, RMUtilMock_LatencySamples("test.slow"));
+
+  // only calls above the threshold are reported
+  RMUtilCmdStats_SetLatencyThreshold(2000);
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.slow", ""));
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.slow", ""));
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.cmd1", ""));
+  ASSERT_EQUAL(2, RMUtilMock_LatencySamples("test.slow"));
+  ASSERT_EQUAL(0, RMUtilMock_LatencySamples("test.cmd1"));
+
+  // calls of less than a millisecond are reported as 1ms, not dropped as 0
+  RMUtilCmdStats_SetLatencyThreshold(100);
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.cmd2", "c", "x"));
+  ASSERT_EQUAL(1, RMUtilMock_LatencySamples("test.cmd2"));
+
+  RMUtilCmdStats_SetLatencyThreshold(0);
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.slow", ""));
+  ASSERT_EQUAL(2, RMUtilMock_LatencySamples("test.slow"));
+  return 0;
+}
+
+TEST_MAIN({
+  if (RMUtilMock_LoadModule(testOnLoad, NULL, 0) != REDISMODULE_OK) {
+    printf("Failed loading the test module\n");
+    return 1;
+  }
+  TESTFUNC(testTrampolines);
+  TESTFUNC(testInfo);
+  TESTFUNC(testLatencyMonitor);
+});
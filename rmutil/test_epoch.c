@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <pthread.h>
+#include "epoch.h"
+#include "test.h"
+
+#define VERSION_LEN 64
+#define NUM_READERS 4
+
+/* every version holds VERSION_LEN copies of its number, and is poisoned when freed */
+typedef struct {
+  long vals[VERSION_LEN];
+} version;
+
+static long freed = 0;
+
+static version *newVersion(long n) {
+  version *v = malloc(sizeof(*v));
+  for (int i = 0; i < VERSION_LEN; i++) v->vals[i] = n;
+  return v;
+}
+
+static void freeVersion(void *p) {
+  version *v = p;
+  for (int i = 0; i < VERSION_LEN; i++) v->vals[i] = -1;
+  __atomic_add_fetch(&freed, 1, __ATOMIC_SEQ_CST);
+  free(v);
+}
+
+static RMUtilEpochDomain *domain;
+static RMUtilSnapshot *snap;
+static int stop = 0;
+static long torn = 0;
+
+void *reader(void *arg) {
+  long reads = 0, last = 0;
+  while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE) || reads == 0) {
+    RMUtilEpoch_Enter(domain);
+    const version *v = RMUtilSnapshot_Acquire(snap);
+    long first = v->vals[0];
+    // nested sections are fine
+    RMUtilEpoch_Enter(domain);
+    for (int i = 1; i < VERSION_LEN; i++) {
+      if (v->vals[i] != first) __atomic_add_fetch(&torn, 1, __ATOMIC_RELAXED);
+    }
+    RMUtilEpoch_Exit(domain);
+    // versions only move forward
+    if (first < last) __atomic_add_fetch(&torn, 1, __ATOMIC_RELAXED);
+    last = first;
+    RMUtilEpoch_Exit(domain);
+    reads++;
+  }
+  RMUtilEpoch_ThreadExit(domain);
+  return NULL;
+}
+
+int testSnapshot() {
+  domain = RMUtilEpoch_NewDomain();
+  snap = RMUtilSnapshot_New(domain, newVersion(0), freeVersion);
+
+  pthread_t threads[NUM_READERS];
+  for (int i = 0; i < NUM_READERS; i++) pthread_create(&threads[i], NULL, reader, NULL);
+  long n = 20000;
+  for (long i = 1; i <= n; i++) RMUtilSnapshot_Publish(snap, newVersion(i));
+  ASSERT_EQUAL(n, ((version *)RMUtilSnapshot_Get(snap))->vals[0]);
+  __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+  for (int i = 0; i < NUM_READERS; i++) pthread_join(threads[i], NULL);
+
+  ASSERT_EQUAL(0, torn);
+  ASSERT_EQUAL(0, RMUtilEpoch_NumThreads(domain));
+  // old versions are reclaimed as we go, not only at the end
+  ASSERT(__atomic_load_n(&freed, __ATOMIC_SEQ_CST) > 0);
+
+  RMUtilEpoch_Synchronize(domain);
+  ASSERT_EQUAL(n, freed);
+  RMUtilSnapshot_Free(snap);
+  RMUtilEpoch_Synchronize(domain);
+  ASSERT_EQUAL(n + 1, freed);
+  RMUtilEpoch_FreeDomain(domain);
+  return 0;
+}
+
+static int retired = 0;
+
+static void markFreed(void *p) {
+  *(int *)p = 1;
+}
+
+int testEpochPinning() {
+  domain = RMUtilEpoch_NewDomain();
+  // an object retired while a reader is inside a critical section outlives it
+  RMUtilEpoch_Enter(domain);
+  RMUtilEpoch_Retire(domain, &retired, markFreed);
+  ASSERT_EQUAL(0, RMUtilEpoch_Reclaim(domain));
+  ASSERT_EQUAL(0, retired);
+  RMUtilEpoch_Exit(domain);
+
+  ASSERT_EQUAL(1, RMUtilEpoch_Reclaim(domain));
+  ASSERT_EQUAL(1, retired);
+  RMUtilEpoch_ThreadExit(domain);
+  RMUtilEpoch_FreeDomain(domain);
+  return 0;
+}
+
+int testThreadExit() {
+  // the thread's cached record is the one of the last domain it entered, but ThreadExit releases
+  // its record in any of them
+  RMUtilEpochDomain *d1 = RMUtilEpoch_NewDomain(), *d2 = RMUtilEpoch_NewDomain();
+  RMUtilEpoch_Enter(d1);
+  RMUtilEpoch_Exit(d1);
+  RMUtilEpoch_Enter(d2);
+  RMUtilEpoch_Exit(d2);
+  ASSERT_EQUAL(1, RMUtilEpoch_NumThreads(d1));
+  ASSERT_EQUAL(1, RMUtilEpoch_NumThreads(d2));
+
+  RMUtilEpoch_ThreadExit(d1);
+  ASSERT_EQUAL(0, RMUtilEpoch_NumThreads(d1));
+  ASSERT_EQUAL(1, RMUtilEpoch_NumThreads(d2));
+  RMUtilEpoch_ThreadExit(d2);
+  ASSERT_EQUAL(0, RMUtilEpoch_NumThreads(d2));
+
+  // entering again takes a record again
+  RMUtilEpoch_Enter(d1);
+  RMUtilEpoch_Exit(d1);
+  ASSERT_EQUAL(1, RMUtilEpoch_NumThreads(d1));
+  RMUtilEpoch_ThreadExit(d1);
+  ASSERT_EQUAL(0, RMUtilEpoch_NumThreads(d1));
+  RMUtilEpoch_FreeDomain(d1);
+  RMUtilEpoch_FreeDomain(d2);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testSnapshot);
+  TESTFUNC(testEpochPinning);
+  TESTFUNC(testThreadExit);
+});
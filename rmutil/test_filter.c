@@ -0,0 +1,188 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <redismodule.h>
+#include "filter.h"
+#include "test.h"
+
+/* Keys 0..n are added, keys from 1<<40 on are never added */
+#define MISS(i) ((1ULL << 40) + (i))
+
+int testBloomSizing() {
+  // more keys or a lower rate take more room
+  ASSERT(RMUtilBloom_BytesFor(1000, 0.01) < RMUtilBloom_BytesFor(2000, 0.01));
+  ASSERT(RMUtilBloom_BytesFor(1000, 0.01) < RMUtilBloom_BytesFor(1000, 0.001));
+  ASSERT_EQUAL(32, RMUtilBloom_BytesFor(0, 0.01));
+
+  // about 10-11 bits per key for 1%, against 9.6 for a classic Bloom filter
+  size_t bytes = RMUtilBloom_BytesFor(1000000, 0.01);
+  ASSERT(bytes * 8 > 9600000 && bytes * 8 < 12500000);
+  double fpr = RMUtilBloom_FalsePositiveRate(bytes, 1000000);
+  ASSERT(fpr <= 0.01 && fpr > 0.009);
+  ASSERT(RMUtilBloom_FalsePositiveRate(bytes, 2000000) > 0.05);
+
+  // loads past INT_MAX: the same bits per key, and a single block is full
+  size_t large = RMUtilBloom_BytesFor(3000000000ULL, 0.01);
+  ASSERT(large / 3000.0 > bytes * 0.99 && large / 3000.0 < bytes * 1.01);
+  fpr = RMUtilBloom_FalsePositiveRate(large, 3000000000ULL);
+  ASSERT(fpr <= 0.01 && fpr > 0.009);
+  ASSERT(RMUtilBloom_FalsePositiveRate(32, 3000000000ULL) > 0.99);
+  return 0;
+}
+
+int testBloom() {
+  double rates[] = {0.05, 0.01, 0.001};
+  for (int r = 0; r < 3; r++) {
+    uint64_t n = 200000;
+    RMUtilBloom *b = RMUtilBloom_New(n, rates[r]);
+    uint64_t added = 0;
+    for (uint64_t i = 0; i < n; i++) added += RMUtilBloom_AddHash(b, RMUtilHash_U64(i));
+    ASSERT_EQUAL(added, RMUtilBloom_Count(b));
+    ASSERT(added > n * (1 - rates[r]) - 100);
+
+    // no false negatives, and about the expected rate of false positives
+    uint64_t missing = 0, positives = 0, tries = 1000000;
+    for (uint64_t i = 0; i < n; i++) missing += !RMUtilBloom_ContainsHash(b, RMUtilHash_U64(i));
+    for (uint64_t i = 0; i < tries; i++) {
+      positives += RMUtilBloom_ContainsHash(b, RMUtilHash_U64(MISS(i)));
+    }
+    ASSERT_EQUAL(0, missing);
+    double fpr = (double)positives / tries;
+    ASSERT(fpr < rates[r] * 1.2);
+    ASSERT(fpr > rates[r] * 0.5);
+    RMUtilBloom_Free(b);
+  }
+
+  RMUtilBloom *b = RMUtilBloom_New(100, 0.01);
+  ASSERT_EQUAL(0, RMUtilBloom_Contains(b, "foo", 3));
+  ASSERT_EQUAL(1, RMUtilBloom_Add(b, "foo", 3));
+  ASSERT_EQUAL(0, RMUtilBloom_Add(b, "foo", 3));
+  ASSERT_EQUAL(1, RMUtilBloom_Contains(b, "foo", 3));
+  RMUtilBloom_Free(b);
+  return 0;
+}
+
+int testBloomSerialize() {
+  RMUtilBloom *b = RMUtilBloom_New(10000, 0.01);
+  for (uint64_t i = 0; i < 10000; i++) RMUtilBloom_AddHash(b, RMUtilHash_U64(i));
+  size_t len = RMUtilBloom_SerializedSize(b);
+  char *buf = malloc(len);
+  RMUtilBloom_Serialize(b, buf);
+  RMUtilBloom *loaded = RMUtilBloom_Deserialize(buf, len);
+  ASSERT(loaded != NULL);
+  ASSERT_EQUAL(RMUtilBloom_Count(b), RMUtilBloom_Count(loaded));
+  size_t wrong = 0;
+  for (uint64_t i = 0; i < 20000; i++) {
+    uint64_t h = RMUtilHash_U64(i);
+    wrong += RMUtilBloom_ContainsHash(b, h) != RMUtilBloom_ContainsHash(loaded, h);
+  }
+  ASSERT_EQUAL(0, wrong);
+  RMUtilBloom_Free(loaded);
+
+  ASSERT(RMUtilBloom_Deserialize(buf, len - 1) == NULL);
+  ASSERT(RMUtilBloom_Deserialize(buf, 8) == NULL);
+  buf[0]++;
+  ASSERT(RMUtilBloom_Deserialize(buf, len) == NULL);
+  free(buf);
+  RMUtilBloom_Free(b);
+  return 0;
+}
+
+int testCuckoo() {
+  uint64_t n = 100000;
+  RMUtilCuckoo *c = RMUtilCuckoo_New(n);
+  ASSERT(RMUtilCuckoo_MemUsage(c) >= RMUtilCuckoo_BytesFor(n));
+  uint64_t failed = 0;
+  for (uint64_t i = 0; i < n; i++) failed += !RMUtilCuckoo_AddHash(c, RMUtilHash_U64(i));
+  ASSERT_EQUAL(0, failed);
+  ASSERT_EQUAL(n, RMUtilCuckoo_Count(c));
+
+  uint64_t missing = 0, positives = 0, tries = 1000000;
+  for (uint64_t i = 0; i < n; i++) missing += !RMUtilCuckoo_ContainsHash(c, RMUtilHash_U64(i));
+  for (uint64_t i = 0; i < tries; i++) {
+    positives += RMUtilCuckoo_ContainsHash(c, RMUtilHash_U64(MISS(i)));
+  }
+  ASSERT_EQUAL(0, missing);
+  ASSERT((double)positives / tries < RMUTIL_CUCKOO_FPR);
+
+  // delete the even keys
+  failed = 0;
+  for (uint64_t i = 0; i < n; i += 2) failed += !RMUtilCuckoo_DeleteHash(c, RMUtilHash_U64(i));
+  ASSERT_EQUAL(0, failed);
+  ASSERT_EQUAL(n / 2, RMUtilCuckoo_Count(c));
+  positives = missing = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    int found = RMUtilCuckoo_ContainsHash(c, RMUtilHash_U64(i));
+    if (i % 2) {
+      missing += !found;
+    } else {
+      positives += found;
+    }
+  }
+  ASSERT_EQUAL(0, missing);
+  ASSERT(positives < 10);
+  RMUtilCuckoo_Free(c);
+
+  // fill it up: inserts eventually fail, without losing keys
+  c = RMUtilCuckoo_New(1000);
+  uint64_t added = 0;
+  while (RMUtilCuckoo_AddHash(c, RMUtilHash_U64(added))) added++;
+  ASSERT_EQUAL(added, RMUtilCuckoo_Count(c));
+  ASSERT(added >= 1000);
+  missing = 0;
+  for (uint64_t i = 0; i < added; i++) missing += !RMUtilCuckoo_ContainsHash(c, RMUtilHash_U64(i));
+  ASSERT_EQUAL(0, missing);
+  // deleting makes room again
+  ASSERT_EQUAL(1, RMUtilCuckoo_DeleteHash(c, RMUtilHash_U64(0)));
+  ASSERT_EQUAL(1, RMUtilCuckoo_DeleteHash(c, RMUtilHash_U64(1)));
+  ASSERT_EQUAL(1, RMUtilCuckoo_AddHash(c, RMUtilHash_U64(0)));
+  RMUtilCuckoo_Free(c);
+
+  c = RMUtilCuckoo_New(10);
+  ASSERT_EQUAL(1, RMUtilCuckoo_Add(c, "foo", 3));
+  ASSERT_EQUAL(1, RMUtilCuckoo_Add(c, "foo", 3));
+  ASSERT_EQUAL(1, RMUtilCuckoo_Delete(c, "foo", 3));
+  ASSERT_EQUAL(1, RMUtilCuckoo_Contains(c, "foo", 3));
+  ASSERT_EQUAL(1, RMUtilCuckoo_Delete(c, "foo", 3));
+  ASSERT_EQUAL(0, RMUtilCuckoo_Contains(c, "foo", 3));
+  ASSERT_EQUAL(0, RMUtilCuckoo_Delete(c, "foo", 3));
+  RMUtilCuckoo_Free(c);
+  return 0;
+}
+
+int testCuckooSerialize() {
+  RMUtilCuckoo *c = RMUtilCuckoo_New(1000);
+  uint64_t added = 0;
+  while (RMUtilCuckoo_AddHash(c, RMUtilHash_U64(added))) added++;
+  size_t len = RMUtilCuckoo_SerializedSize(c);
+  char *buf = malloc(len);
+  RMUtilCuckoo_Serialize(c, buf);
+  RMUtilCuckoo *loaded = RMUtilCuckoo_Deserialize(buf, len);
+  ASSERT(loaded != NULL);
+  ASSERT_EQUAL(added, RMUtilCuckoo_Count(loaded));
+  size_t wrong = 0;
+  for (uint64_t i = 0; i < 2 * added; i++) {
+    uint64_t h = RMUtilHash_U64(i);
+    wrong += RMUtilCuckoo_ContainsHash(c, h) != RMUtilCuckoo_ContainsHash(loaded, h);
+  }
+  ASSERT_EQUAL(0, wrong);
+  RMUtilCuckoo_Free(loaded);
+
+  ASSERT(RMUtilCuckoo_Deserialize(buf, len - 1) == NULL);
+  ASSERT(RMUtilCuckoo_Deserialize(buf, 4) == NULL);
+  // not a power of 2
+  buf[0]--;
+  ASSERT(RMUtilCuckoo_Deserialize(buf, len) == NULL);
+  free(buf);
+  RMUtilCuckoo_Free(c);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testBloomSizing);
+  TESTFUNC(testBloom);
+  TESTFUNC(testBloomSerialize);
+  TESTFUNC(testCuckoo);
+  TESTFUNC(testCuckooSerialize);
+});
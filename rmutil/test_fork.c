@@ -0,0 +1,180 @@
+#define REDISMODULE_MAIN
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <redismodule.h>
+#include "mock_redis.h"
+#include "fork.h"
+#include "test.h"
+
+// what the child does: write childBytes bytes, sleep for childSleep seconds and exit with childExit
+static size_t childBytes;
+static int childSleep, childExit;
+
+static RMUtilForkJob *job;
+static RMUtilForkJobOptions opts;
+static int noData;
+
+static size_t received, corrupt;
+static int doneCalls, doneExit, doneSignal, doneTimedOut;
+
+static int testChild(RedisModuleCtx *ctx, RMUtilForkJob *j, void *pd) {
+  char buf[1000];
+  for (size_t off = 0; off < childBytes; off += sizeof(buf)) {
+    size_t n = childBytes - off < sizeof(buf) ? childBytes - off : sizeof(buf);
+    for (size_t i = 0; i < n; i++) buf[i] = (off + i) % 251;
+    if (RMUtilForkJob_Write(j, buf, n) != REDISMODULE_OK) return 100;
+  }
+  if (childSleep) sleep(childSleep);
+  return childExit;
+}
+
+static void testOnData(const char *buf, size_t len, void *pd) {
+  for (size_t i = 0; i < len; i++) corrupt += (unsigned char)buf[i] != (received + i) % 251;
+  received += len;
+}
+
+static void testOnDone(int exitcode, int bysignal, int timedOut, void *pd) {
+  doneCalls++;
+  doneExit = exitcode;
+  doneSignal = bysignal;
+  doneTimedOut = timedOut;
+}
+
+/* TEST.FORK - fork a job as set up by the test, and reply with 1 if it started */
+static int testForkCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  job = RMUtil_ForkJob(ctx, testChild, noData ? NULL : testOnData, testOnDone, NULL, &opts);
+  return RedisModule_ReplyWithLongLong(ctx, job != NULL);
+}
+
+static int testOnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (RedisModule_Init(ctx, "testfork", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+  return RedisModule_CreateCommand(ctx, "test.fork", testForkCommand, "readonly", 0, 0, 0);
+}
+
+static void setup(size_t bytes, int sleepSecs, int exitcode) {
+  childBytes = bytes;
+  childSleep = sleepSecs;
+  childExit = exitcode;
+  opts = (RMUtilForkJobOptions){0};
+  noData = 0;
+  received = corrupt = 0;
+  doneCalls = doneExit = doneSignal = doneTimedOut = 0;
+}
+
+static long long fork_() {
+  RedisModuleCallReply *r = RMUtilMock_Call("test.fork", "");
+  long long started = RedisModule_CallReplyInteger(r);
+  RedisModule_FreeCallReply(r);
+  return started;
+}
+
+/* Run the event loop until the done callback is called, for 10 seconds at most */
+static void waitDone() {
+  for (int i = 0; i < 10000 && !doneCalls; i++) {
+    if (!RMUtilMock_ProcessEvents()) usleep(1000);
+  }
+}
+
+int testMissingApi() {
+  // nothing is forked without a way to deliver the output, or to kill the child
+  setup(10, 0, 0);
+  int (*eventLoopAdd)(int, int, RedisModuleEventLoopFunc, void *) = RedisModule_EventLoopAdd;
+  RedisModule_EventLoopAdd = NULL;
+  ASSERT_EQUAL(0, fork_());
+  RedisModule_EventLoopAdd = eventLoopAdd;
+
+  int (*killForkChild)(int) = RedisModule_KillForkChild;
+  RedisModule_KillForkChild = NULL;
+  ASSERT_EQUAL(0, fork_());
+  RedisModule_KillForkChild = killForkChild;
+
+  // nor with a timeout that can't be set
+  RedisModuleTimerID (*createTimer)(RedisModuleCtx *, mstime_t, RedisModuleTimerProc, void *) =
+      RedisModule_CreateTimer;
+  RedisModule_CreateTimer = NULL;
+  opts.timeout_ms = 1000;
+  ASSERT_EQUAL(0, fork_());
+  RedisModule_CreateTimer = createTimer;
+
+  RMUtilMock_ProcessEvents();
+  ASSERT_EQUAL(0, doneCalls);
+  return 0;
+}
+
+int testOutput() {
+  // more than a pipe buffer, in odd sized chunks
+  setup(1000003, 0, 3);
+  opts.chunkSize = 4099;
+  ASSERT_EQUAL(1, fork_());
+  waitDone();
+  ASSERT_EQUAL(1, doneCalls);
+  ASSERT_EQUAL(3, doneExit);
+  ASSERT_EQUAL(0, doneSignal);
+  ASSERT_EQUAL(0, doneTimedOut);
+  ASSERT_EQUAL(1000003, received);
+  ASSERT_EQUAL(0, corrupt);
+
+  // without a data callback, the output is discarded
+  setup(100000, 0, 0);
+  noData = 1;
+  ASSERT_EQUAL(1, fork_());
+  waitDone();
+  ASSERT_EQUAL(1, doneCalls);
+  ASSERT_EQUAL(0, doneExit);
+  ASSERT_EQUAL(0, received);
+
+  // a timeout that is not reached
+  setup(10, 0, 0);
+  opts.timeout_ms = 10000;
+  ASSERT_EQUAL(1, fork_());
+  waitDone();
+  ASSERT_EQUAL(1, doneCalls);
+  ASSERT_EQUAL(0, doneTimedOut);
+  ASSERT_EQUAL(10, received);
+  return 0;
+}
+
+int testKill() {
+  setup(10, 10, 0);
+  ASSERT_EQUAL(1, fork_());
+  RMUtilForkJob *running = job;
+  // one child at a time
+  ASSERT_EQUAL(0, fork_());
+
+  RMUtilForkJob_Kill(running);
+  ASSERT_EQUAL(1, doneCalls);
+  ASSERT_EQUAL(SIGUSR1, doneSignal);
+  ASSERT_EQUAL(0, doneTimedOut);
+  ASSERT_EQUAL(0, RMUtilMock_ProcessEvents());
+  ASSERT_EQUAL(1, doneCalls);
+  return 0;
+}
+
+int testTimeout() {
+  // what the child wrote before it was killed is still delivered
+  setup(10, 10, 0);
+  opts.chunkSize = 10;
+  opts.timeout_ms = 50;
+  ASSERT_EQUAL(1, fork_());
+  waitDone();
+  ASSERT_EQUAL(1, doneCalls);
+  ASSERT_EQUAL(1, doneTimedOut);
+  ASSERT_EQUAL(SIGUSR1, doneSignal);
+  ASSERT_EQUAL(10, received);
+  return 0;
+}
+
+TEST_MAIN({
+  if (RMUtilMock_LoadModule(testOnLoad, NULL, 0) != REDISMODULE_OK) {
+    printf("Failed loading the test module\n");
+    return 1;
+  }
+  TESTFUNC(testMissingApi);
+  TESTFUNC(testOutput);
+  TESTFUNC(testKill);
+  TESTFUNC(testTimeout);
+});
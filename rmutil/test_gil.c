@@ -0,0 +1,156 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <redismodule.h>
+#include "gil.h"
+#include "test.h"
+
+/* A stand-in for the redis global lock */
+static pthread_mutex_t gil = PTHREAD_MUTEX_INITIALIZER;
+static int gilHeld = 0;
+static int dummyCtx;
+
+static RedisModuleCtx *stub_GetThreadSafeContext(RedisModuleBlockedClient *bc) {
+  return (RedisModuleCtx *)&dummyCtx;
+}
+static void stub_FreeThreadSafeContext(RedisModuleCtx *ctx) {
+}
+static void stub_Lock(RedisModuleCtx *ctx) {
+  pthread_mutex_lock(&gil);
+  gilHeld = 1;
+}
+static int stub_TryLock(RedisModuleCtx *ctx) {
+  if (pthread_mutex_trylock(&gil)) return REDISMODULE_ERR;
+  gilHeld = 1;
+  return REDISMODULE_OK;
+}
+static void stub_Unlock(RedisModuleCtx *ctx) {
+  gilHeld = 0;
+  pthread_mutex_unlock(&gil);
+}
+
+static void setupStubs() {
+  RedisModule_GetThreadSafeContext = stub_GetThreadSafeContext;
+  RedisModule_FreeThreadSafeContext = stub_FreeThreadSafeContext;
+  RedisModule_ThreadSafeContextLock = stub_Lock;
+  RedisModule_ThreadSafeContextTryLock = stub_TryLock;
+  RedisModule_ThreadSafeContextUnlock = stub_Unlock;
+}
+
+static long long counter = 0;
+static int unlockedRuns = 0;
+
+void incrTask(RedisModuleCtx *ctx, void *arg) {
+  if (!gilHeld || ctx != (RedisModuleCtx *)&dummyCtx) unlockedRuns++;
+  counter += (long long)(intptr_t)arg;
+}
+
+void slowTask(RedisModuleCtx *ctx, void *arg) {
+  counter++;
+  usleep(200);
+}
+
+static RMUtilGILExecutor *exec;
+
+void *submitter(void *arg) {
+  for (int i = 0; i < 10000; i++) RMUtilGILExecutor_Submit(exec, incrTask, (void *)(intptr_t)1);
+  return NULL;
+}
+
+int testGILExecutor() {
+  setupStubs();
+  exec = RMUtilGILExecutor_New(NULL, NULL);
+  ASSERT(exec != NULL);
+
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) pthread_create(&threads[i], NULL, submitter, NULL);
+  for (int i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+  RMUtilGILExecutor_Flush(exec);
+
+  ASSERT_EQUAL(40000, counter);
+  ASSERT_EQUAL(0, unlockedRuns);
+
+  RMUtilGILExecutorStats st;
+  RMUtilGILExecutor_GetStats(exec, &st);
+  ASSERT_EQUAL(40000, st.executed);
+  // closures are batched, so the lock is taken far less often than once per closure
+  ASSERT(st.batches > 0 && st.batches < st.executed);
+  RMUtilGILExecutor_Free(exec);
+  return 0;
+}
+
+int testGILExecutorBudget() {
+  counter = 0;
+  exec = RMUtilGILExecutor_New(
+      NULL, &(RMUtilGILExecutorOptions){.batchBudgetUs = 500, .maxTryLockAttempts = 1});
+
+  // the executor can't get the lock while we hold it, and backs off
+  pthread_mutex_lock(&gil);
+  for (int i = 0; i < 50; i++) RMUtilGILExecutor_Submit(exec, slowTask, NULL);
+  usleep(5000);
+  ASSERT_EQUAL(0, counter);
+  pthread_mutex_unlock(&gil);
+
+  RMUtilGILExecutor_Flush(exec);
+  ASSERT_EQUAL(50, counter);
+
+  RMUtilGILExecutorStats st;
+  RMUtilGILExecutor_GetStats(exec, &st);
+  ASSERT(st.tryLockFailures > 0);
+  // 50 closures of 200us don't fit in a single 500us batch
+  ASSERT(st.budgetExceeded > 0);
+  ASSERT(st.batches > 1);
+  RMUtilGILExecutor_Free(exec);
+  return 0;
+}
+
+// the main thread's turns with the lock so far, and the number each batch saw
+static int mainTurns, seenTurns[20];
+
+void turnTask(RedisModuleCtx *ctx, void *arg) {
+  seenTurns[counter++] = mainTurns;
+  usleep(200);
+}
+
+int testGILExecutorGiveBack() {
+  counter = mainTurns = 0;
+  exec = RMUtilGILExecutor_New(
+      NULL, &(RMUtilGILExecutorOptions){.maxBatch = 1, .minBackoffUs = 1000});
+  pthread_mutex_lock(&gil);
+  for (int i = 0; i < 20; i++) RMUtilGILExecutor_Submit(exec, turnTask, NULL);
+  pthread_mutex_unlock(&gil);
+
+  // a busy main thread, waiting for the lock again right after releasing it
+  while (__atomic_load_n(&counter, __ATOMIC_SEQ_CST) < 20) {
+    pthread_mutex_lock(&gil);
+    mainTurns++;
+    pthread_mutex_unlock(&gil);
+    usleep(10);
+  }
+  RMUtilGILExecutor_Flush(exec);
+
+  // every batch is cut short, and the main thread gets the lock before the next one
+  int missed = 0;
+  for (int i = 1; i < 20; i++) missed += seenTurns[i] == seenTurns[i - 1];
+  ASSERT_EQUAL(0, missed);
+  RMUtilGILExecutor_Free(exec);
+  return 0;
+}
+
+int testGILExecutorShutdown() {
+  counter = 0;
+  exec = RMUtilGILExecutor_New(NULL, &(RMUtilGILExecutorOptions){.maxBatch = 10});
+  for (int i = 0; i < 1000; i++) RMUtilGILExecutor_Submit(exec, incrTask, (void *)(intptr_t)1);
+  // pending closures all run before the executor is freed
+  RMUtilGILExecutor_Free(exec);
+  ASSERT_EQUAL(1000, counter);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testGILExecutor);
+  TESTFUNC(testGILExecutorBudget);
+  TESTFUNC(testGILExecutorGiveBack);
+  TESTFUNC(testGILExecutorShutdown);
+});
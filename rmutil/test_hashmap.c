@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include "hashmap.h"
+#include "test.h"
+
+#define intHash(k) RMUtilHash_U64(k)
+#define intEq(a, b) ((a) == (b))
+RMUTIL_HASHMAP_DEFINE(IntMap, uint64_t, uint64_t, intHash, intEq)
+
+#define strHash(k) RMUtilHash_Str(k)
+#define strEq(a, b) (!strcmp((a), (b)))
+RMUTIL_HASHMAP_DEFINE(StrMap, const char *, int, strHash, strEq)
+
+RMUTIL_INCHASHMAP_DEFINE(IncMap, uint64_t, uint64_t, intHash, intEq)
+
+int testIntMap() {
+  IntMap *m = IntMap_New(0);
+  ASSERT(IntMap_Get(m, 1) == NULL);
+  ASSERT_EQUAL(0, IntMap_Del(m, 1, NULL, NULL));
+
+  size_t n = 100000, wrong = 0;
+  for (uint64_t i = 0; i < n; i++) IntMap_Put(m, i * 7, i);
+  ASSERT_EQUAL(n, IntMap_Size(m));
+  for (uint64_t i = 0; i < n; i++) {
+    uint64_t *v = IntMap_Get(m, i * 7);
+    if (!v || *v != i) wrong++;
+    if (IntMap_Get(m, i * 7 + 1)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+
+  // overwriting doesn't add
+  int inserted;
+  *IntMap_Insert(m, 7, &inserted) = 1000;
+  ASSERT_EQUAL(0, inserted);
+  ASSERT_EQUAL(1000, *IntMap_Get(m, 7));
+  ASSERT_EQUAL(n, IntMap_Size(m));
+
+  // remove the odd ones
+  uint64_t oldkey, oldval;
+  ASSERT_EQUAL(1, IntMap_Del(m, 7, &oldkey, &oldval));
+  ASSERT(oldkey == 7 && oldval == 1000);
+  for (uint64_t i = 3; i < n; i += 2) IntMap_Del(m, i * 7, NULL, NULL);
+  ASSERT_EQUAL(n / 2, IntMap_Size(m));
+  for (uint64_t i = 0; i < n; i++) {
+    if ((IntMap_Get(m, i * 7) != NULL) != (i % 2 == 0)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+
+  // iteration sees every element once
+  size_t iter = 0, count = 0;
+  uint64_t key, *val, sum = 0;
+  while (IntMap_Next(m, &iter, &key, &val)) {
+    if (key != *val * 7) wrong++;
+    sum += *val;
+    count++;
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(n / 2, count);
+  ASSERT_EQUAL((n / 2) * (n / 2 - 1), sum);
+
+  ASSERT(IntMap_MemUsage(m) >= m->cap * (sizeof(IntMap_Entry) + 1));
+  IntMap_Clear(m);
+  ASSERT_EQUAL(0, IntMap_Size(m));
+  ASSERT(IntMap_Get(m, 0) == NULL);
+  IntMap_Free(m);
+  return 0;
+}
+
+int testIntMapChurn() {
+  // insert and delete keys over and over: DELETED markers are cleaned up, not grown over
+  IntMap *m = IntMap_New(1000);
+  size_t cap = m->cap, wrong = 0;
+  for (uint64_t i = 0; i < 1000000; i++) {
+    IntMap_Put(m, i, i);
+    if (i >= 500) {
+      if (!IntMap_Del(m, i - 500, NULL, NULL)) wrong++;
+    }
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(500, IntMap_Size(m));
+  ASSERT_EQUAL(cap, m->cap);
+  for (uint64_t i = 1000000 - 500; i < 1000000; i++) {
+    if (!IntMap_Get(m, i)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+  IntMap_Free(m);
+  return 0;
+}
+
+int testStrMap() {
+  StrMap *m = StrMap_New(4);
+  const char *words[] = {"foo", "bar", "baz", "a somewhat longer key than the others", ""};
+  for (int i = 0; i < 5; i++) StrMap_Put(m, words[i], i);
+  for (int i = 0; i < 5; i++) {
+    char buf[64];
+    strcpy(buf, words[i]);
+    // found by value, not by pointer
+    int *v = StrMap_Get(m, buf);
+    ASSERT(v != NULL);
+    ASSERT_EQUAL(i, *v);
+  }
+  ASSERT(StrMap_Get(m, "qux") == NULL);
+  StrMap_Free(m);
+
+  // hashes of different lengths and contents differ
+  ASSERT(RMUtilHash_Str("abc") != RMUtilHash_Str("abd"));
+  ASSERT(RMUtilHash_Bytes("abc", 3, 0) != RMUtilHash_Bytes("abc", 3, 1));
+  ASSERT(RMUtilHash_Bytes("\0", 1, 0) != RMUtilHash_Bytes("\0\0", 2, 0));
+  return 0;
+}
+
+int testIncMap() {
+  IncMap *m = IncMap_New(0);
+  size_t n = 200000, wrong = 0, rehashes = 0;
+  int wasRehashing = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    IncMap_Put(m, i, i * 2);
+    if (IncMap_IsRehashing(m) && !wasRehashing) rehashes++;
+    wasRehashing = IncMap_IsRehashing(m);
+    // everything inserted so far is found, whichever table it's in
+    if (i % 1000 == 0) {
+      for (uint64_t j = 0; j <= i; j++) {
+        uint64_t *v = IncMap_Get(m, j);
+        if (!v || *v != j * 2) wrong++;
+      }
+    }
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(n, IncMap_Size(m));
+  ASSERT(rehashes > 5);
+
+  // no single insertion migrates more than a few groups
+  while (IncMap_Size(m) < m->cur.cap - m->cur.cap / 8) IncMap_Put(m, n + IncMap_Size(m), 0);
+  size_t oldCap = m->cur.cap;
+  IncMap_Put(m, 3 * n, 0);
+  ASSERT(IncMap_IsRehashing(m));
+  ASSERT_EQUAL(oldCap, m->old.cap);
+  ASSERT(IncMap_RehashProgress(m) < 0.01);
+  size_t progressed = m->cursor;
+  IncMap_Del(m, 0, NULL, NULL);
+  ASSERT(m->cursor - progressed <= RMUTIL_INCHASHMAP_STEP_GROUPS * RMUTIL_HM_GROUP);
+
+  // iterating over both tables
+  ASSERT(IncMap_IsRehashing(m));
+  size_t iter = 0, count = 0;
+  uint64_t key, *val;
+  while (IncMap_Next(m, &iter, &key, &val)) count++;
+  ASSERT_EQUAL(IncMap_Size(m), count);
+
+  // deleting keys from either table
+  for (uint64_t i = 1; i < n; i += 2) {
+    if (!IncMap_Del(m, i, NULL, NULL)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+
+  // finish in the background
+  while (IncMap_RehashFor(m, 1000))
+    ;
+  ASSERT(!IncMap_IsRehashing(m));
+  ASSERT_EQUAL(1, IncMap_RehashProgress(m));
+  for (uint64_t i = 2; i < n; i += 2) {
+    if (!IncMap_Get(m, i) || IncMap_Get(m, i + 1)) wrong++;
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(m->cur.cap * (sizeof(IncMap_Table_Entry) + 1) + sizeof(*m), IncMap_MemUsage(m));
+  IncMap_Free(m);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testIntMap);
+  TESTFUNC(testIntMapChurn);
+  TESTFUNC(testStrMap);
+  TESTFUNC(testIncMap);
+});
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include "histogram.h"
+#include "test.h"
+
+int testHistogram() {
+  RMUtilHistogram *h = RMUtilHistogram_New();
+  ASSERT_EQUAL(0, RMUtilHistogram_Percentile(h, 50));
+
+  // small values are recorded exactly
+  for (uint64_t i = 0; i < 10; i++) RMUtilHistogram_Add(h, i);
+  ASSERT_EQUAL(10, h->count);
+  ASSERT_EQUAL(0, h->min);
+  ASSERT_EQUAL(9, h->max);
+  ASSERT_EQUAL(4, RMUtilHistogram_Percentile(h, 50));
+  ASSERT_EQUAL(9, RMUtilHistogram_Percentile(h, 100));
+
+  RMUtilHistogram_Reset(h);
+  for (uint64_t i = 1; i <= 100000; i++) RMUtilHistogram_Add(h, i * 1000);
+  ASSERT_EQUAL(100000, h->count);
+
+  // large values are within the relative error of the bucketing
+  double expected[][2] = {{50, 50000000}, {99, 99000000}, {99.9, 99900000}};
+  for (int i = 0; i < 3; i++) {
+    double v = RMUtilHistogram_Percentile(h, expected[i][0]);
+    double err = (v - expected[i][1]) / expected[i][1];
+    ASSERT(err < 1.0 / RMUTIL_HISTOGRAM_SUB_BUCKETS && err > -1.0 / RMUTIL_HISTOGRAM_SUB_BUCKETS);
+  }
+  ASSERT_EQUAL(100000000, RMUtilHistogram_Percentile(h, 100));
+  ASSERT_EQUAL(50000500, RMUtilHistogram_Mean(h));
+
+  RMUtilHistogram_Free(h);
+  return 0;
+}
+
+int testHistogramMerge() {
+  RMUtilHistogram *a = RMUtilHistogram_New();
+  RMUtilHistogram *b = RMUtilHistogram_New();
+  uint64_t big = 1 << 20;
+  for (uint64_t i = 0; i < 100; i++) RMUtilHistogram_Add(a, big);
+  for (uint64_t i = 0; i < 100; i++) RMUtilHistogram_Add(b, 5);
+
+  RMUtilHistogram_Merge(a, b);
+  ASSERT_EQUAL(200, a->count);
+  ASSERT_EQUAL(5, a->min);
+  ASSERT_EQUAL(big, a->max);
+  ASSERT_EQUAL(5, RMUtilHistogram_Percentile(a, 50));
+  ASSERT_EQUAL(big, RMUtilHistogram_Percentile(a, 51));
+
+  RMUtilHistogram_Free(a);
+  RMUtilHistogram_Free(b);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testHistogram);
+  TESTFUNC(testHistogramMerge);
+});
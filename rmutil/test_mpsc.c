@@ -0,0 +1,164 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <pthread.h>
+#include <poll.h>
+#include <redismodule.h>
+#include "mpsc.h"
+#include "test.h"
+
+#define NUM_PRODUCERS 4
+#define PER_PRODUCER 100000
+
+static RMUtilMPSCQueue *queue;
+static long long consumed = 0;
+static long long batches = 0;
+static size_t largestBatch = 0;
+static long lastSeen[NUM_PRODUCERS];
+static int outOfOrder = 0;
+
+/* items encode the producer and a per-producer sequence number */
+static void checkItem(void *item) {
+  long v = (long)(intptr_t)item - 1;
+  int p = v / PER_PRODUCER;
+  long seq = v % PER_PRODUCER;
+  if (seq != lastSeen[p] + 1) outOfOrder++;
+  lastSeen[p] = seq;
+  consumed++;
+}
+
+static void consume(void **items, size_t n, void *privdata) {
+  for (size_t i = 0; i < n; i++) checkItem(items[i]);
+  batches++;
+  if (n > largestBatch) largestBatch = n;
+}
+
+static void resetCounters() {
+  consumed = batches = largestBatch = outOfOrder = 0;
+  for (int i = 0; i < NUM_PRODUCERS; i++) lastSeen[i] = -1;
+}
+
+void *producer(void *arg) {
+  long p = (long)(intptr_t)arg;
+  for (long i = 0; i < PER_PRODUCER; i++) {
+    RMUtilMPSCQueue_Push(queue, (void *)(intptr_t)(p * PER_PRODUCER + i + 1));
+  }
+  return NULL;
+}
+
+int testMPSCQueue() {
+  // no event loop: the consumer drains by itself, concurrently with the producers
+  resetCounters();
+  queue = RMUtilMPSCQueue_New(consume, NULL, 0);
+  ASSERT(queue != NULL);
+  ASSERT(RMUtilMPSCQueue_Pop(queue) == NULL);
+
+  pthread_t threads[NUM_PRODUCERS];
+  for (long i = 0; i < NUM_PRODUCERS; i++) {
+    pthread_create(&threads[i], NULL, producer, (void *)(intptr_t)i);
+  }
+  while (consumed < NUM_PRODUCERS * PER_PRODUCER) RMUtilMPSCQueue_Drain(queue);
+  for (int i = 0; i < NUM_PRODUCERS; i++) pthread_join(threads[i], NULL);
+
+  ASSERT_EQUAL(NUM_PRODUCERS * PER_PRODUCER, consumed);
+  ASSERT_EQUAL(0, outOfOrder);
+  ASSERT(largestBatch <= RMUTIL_MPSC_DEFAULT_BATCH);
+  ASSERT(RMUtilMPSCQueue_Pop(queue) == NULL);
+  RMUtilMPSCQueue_Free(queue);
+  return 0;
+}
+
+/* A minimal single threaded event loop standing in for redis' */
+static pthread_mutex_t loopLock = PTHREAD_MUTEX_INITIALIZER;
+static RedisModuleEventLoopOneShotFunc oneShots[16];
+static void *oneShotData[16];
+static int numOneShots = 0;
+static int loopFd = -1;
+static RedisModuleEventLoopFunc loopFdFunc;
+static void *loopFdData;
+
+static int stub_AddOneShot(RedisModuleEventLoopOneShotFunc func, void *user_data) {
+  pthread_mutex_lock(&loopLock);
+  oneShots[numOneShots] = func;
+  oneShotData[numOneShots++] = user_data;
+  pthread_mutex_unlock(&loopLock);
+  return REDISMODULE_OK;
+}
+
+static int stub_Add(int fd, int mask, RedisModuleEventLoopFunc func, void *user_data) {
+  loopFd = fd;
+  loopFdFunc = func;
+  loopFdData = user_data;
+  return REDISMODULE_OK;
+}
+
+static int stub_Del(int fd, int mask) {
+  loopFd = -1;
+  return REDISMODULE_OK;
+}
+
+/* Run one iteration of the loop, returns the number of callbacks fired */
+static int runLoopOnce() {
+  int fired = 0;
+  pthread_mutex_lock(&loopLock);
+  int n = numOneShots;
+  RedisModuleEventLoopOneShotFunc funcs[16];
+  void *data[16];
+  for (int i = 0; i < n; i++) funcs[i] = oneShots[i], data[i] = oneShotData[i];
+  numOneShots = 0;
+  pthread_mutex_unlock(&loopLock);
+  for (int i = 0; i < n; i++, fired++) funcs[i](data[i]);
+
+  if (loopFd >= 0) {
+    struct pollfd pfd = {.fd = loopFd, .events = POLLIN};
+    if (poll(&pfd, 1, 0) == 1) {
+      loopFdFunc(loopFd, loopFdData, REDISMODULE_EVENTLOOP_READABLE);
+      fired++;
+    }
+  }
+  return fired;
+}
+
+static int testWakeups() {
+  resetCounters();
+  queue = RMUtilMPSCQueue_New(consume, NULL, 100);
+  ASSERT(queue != NULL);
+  for (long i = 0; i < 1000; i++) RMUtilMPSCQueue_Push(queue, (void *)(intptr_t)(i + 1));
+
+  // a single wakeup was scheduled, and each one drains a batch and schedules the next
+  int wakeups = 0, fired;
+  while ((fired = runLoopOnce()) > 0) wakeups += fired;
+  ASSERT_EQUAL(1000, consumed);
+  ASSERT_EQUAL(0, outOfOrder);
+  ASSERT_EQUAL(100, largestBatch);
+  ASSERT(wakeups >= 10 && wakeups <= 11);
+
+  // an idle queue is woken again by the next push
+  RMUtilMPSCQueue_Push(queue, (void *)(intptr_t)1001);
+  ASSERT(runLoopOnce() > 0);
+  ASSERT_EQUAL(1001, consumed);
+  RMUtilMPSCQueue_Free(queue);
+  return 0;
+}
+
+int testMPSCOneShot() {
+  RedisModule_EventLoopAddOneShot = stub_AddOneShot;
+  int rc = testWakeups();
+  RedisModule_EventLoopAddOneShot = NULL;
+  return rc;
+}
+
+int testMPSCPipe() {
+  RedisModule_EventLoopAdd = stub_Add;
+  RedisModule_EventLoopDel = stub_Del;
+  int rc = testWakeups();
+  ASSERT_EQUAL(-1, loopFd);
+  RedisModule_EventLoopAdd = NULL;
+  RedisModule_EventLoopDel = NULL;
+  return rc;
+}
+
+TEST_MAIN({
+  TESTFUNC(testMPSCQueue);
+  TESTFUNC(testMPSCOneShot);
+  TESTFUNC(testMPSCPipe);
+});
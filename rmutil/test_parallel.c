@@ -0,0 +1,160 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <redismodule.h>
+#include "parallel.h"
+#include "test.h"
+
+static RMUtilThreadPool *pool;
+static long long *squares;
+
+void squareRange(size_t from, size_t to, void *arg) {
+  for (size_t i = from; i < to; i++) squares[i] = (long long)i * i;
+}
+
+static long long total;
+
+void sumRange(size_t from, size_t to, void *arg) {
+  long long s = 0;
+  for (size_t i = from; i < to; i++) s += squares[i];
+  __atomic_add_fetch(&total, s, __ATOMIC_SEQ_CST);
+}
+
+/* a parallel loop started from within a job running on the same pool */
+void nestedJob(void *arg) {
+  RMUtil_ParallelFor(pool, 0, 1000000, 0, sumRange, NULL);
+}
+
+int testParallelFor() {
+  size_t n = 1000000;
+  squares = malloc(n * sizeof(*squares));
+  RMUtil_ParallelFor(pool, 0, n, 0, squareRange, NULL);
+
+  long long expected = 0;
+  size_t wrong = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (squares[i] != (long long)i * i) wrong++;
+    expected += (long long)i * i;
+  }
+  ASSERT_EQUAL(0, wrong);
+  RMUtil_ParallelFor(pool, 0, n, 1000, sumRange, NULL);
+  ASSERT_EQUAL(expected, total);
+
+  total = 0;
+  RMUtilThreadPool_Submit(pool, nestedJob, NULL);
+  RMUtilThreadPool_Wait(pool);
+  ASSERT_EQUAL(expected, total);
+
+  // sequential fallbacks
+  total = 0;
+  RMUtil_ParallelFor(NULL, 0, n, 0, sumRange, NULL);
+  ASSERT_EQUAL(expected, total);
+  total = 0;
+  RMUtil_ParallelFor(pool, 10, 10, 0, sumRange, NULL);
+  ASSERT_EQUAL(0, total);
+  free(squares);
+  return 0;
+}
+
+typedef struct {
+  int key;
+  int payload[2];
+} record;
+
+static int cmpInt(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return x < y ? -1 : x > y;
+}
+
+static int cmpRecord(const void *a, const void *b) {
+  return cmpInt(&((const record *)a)->key, &((const record *)b)->key);
+}
+
+int testParallelSort() {
+  size_t sizes[] = {100, RMUTIL_PARALLEL_SORT_THRESHOLD + 1, 1000003};
+  for (int s = 0; s < 3; s++) {
+    size_t n = sizes[s];
+    Vector *v = NewVector(int, n);
+    int *ref = malloc(n * sizeof(int));
+    srand(s);
+    for (size_t i = 0; i < n; i++) {
+      ref[i] = rand();
+      Vector_Push(v, ref[i]);
+    }
+    ASSERT_EQUAL(0, Vector_ParallelSort(v, cmpInt, pool));
+    qsort(ref, n, sizeof(int), cmpInt);
+    ASSERT_EQUAL(n, Vector_Size(v));
+    ASSERT(memcmp(ref, v->data, n * sizeof(int)) == 0);
+    Vector_Free(v);
+    free(ref);
+  }
+
+  // odd sized elements with lots of duplicates, keeping each record intact
+  size_t n = 500000;
+  Vector *v = NewVector(record, n);
+  for (size_t i = 0; i < n; i++) {
+    record r = {.key = rand() % 100};
+    r.payload[0] = r.key * 3;
+    r.payload[1] = -r.key;
+    __vector_PushPtr(v, &r);
+  }
+  ASSERT_EQUAL(0, Vector_ParallelSort(v, cmpRecord, pool));
+  record prev = {.key = -1}, cur;
+  size_t wrong = 0;
+  for (size_t i = 0; i < n; i++) {
+    Vector_Get(v, i, &cur);
+    if (prev.key > cur.key || cur.payload[0] != cur.key * 3 || cur.payload[1] != -cur.key) wrong++;
+    prev = cur;
+  }
+  ASSERT_EQUAL(0, wrong);
+  Vector_Free(v);
+  return 0;
+}
+
+#define cmpIntValue(a, b) (((a) > (b)) - ((a) < (b)))
+#define cmpRecordKey(a, b) cmpIntValue((a).key, (b).key)
+RMUTIL_PARALLELSORT_DEFINE(IntSort, int, cmpIntValue)
+RMUTIL_PARALLELSORT_DEFINE(RecordSort, record, cmpRecordKey)
+
+int testTypedParallelSort() {
+  size_t sizes[] = {0, 1, 100, RMUTIL_PARALLEL_SORT_THRESHOLD + 1, 1000003};
+  for (int s = 0; s < 5; s++) {
+    size_t n = sizes[s];
+    Vector *v = NewVector(int, n + 1);
+    int *ref = malloc((n + 1) * sizeof(int));
+    srand(s);
+    for (size_t i = 0; i < n; i++) {
+      ref[i] = rand();
+      Vector_Push(v, ref[i]);
+    }
+    ASSERT_EQUAL(0, IntSort_ParallelSortVector(v, pool));
+    qsort(ref, n, sizeof(int), cmpInt);
+    ASSERT(memcmp(ref, v->data, n * sizeof(int)) == 0);
+    Vector_Free(v);
+    free(ref);
+  }
+
+  // stable, with or without the pool: equal keys keep their original order
+  RMUtilThreadPool *pools[] = {pool, NULL};
+  for (int p = 0; p < 2; p++) {
+    size_t n = 500000;
+    record *recs = malloc(n * sizeof(*recs));
+    for (size_t i = 0; i < n; i++) recs[i] = (record){.key = rand() % 100, .payload = {i, -i}};
+    ASSERT_EQUAL(0, RecordSort_ParallelSort(recs, n, pools[p]));
+    size_t wrong = 0;
+    for (size_t i = 1; i < n; i++) {
+      if (recs[i - 1].key > recs[i].key || recs[i].payload[1] != -recs[i].payload[0]) wrong++;
+      if (recs[i - 1].key == recs[i].key && recs[i - 1].payload[0] > recs[i].payload[0]) wrong++;
+    }
+    ASSERT_EQUAL(0, wrong);
+    free(recs);
+  }
+  return 0;
+}
+
+TEST_MAIN({
+  pool = RMUtilThreadPool_New(&(RMUtilThreadPoolOptions){.numThreads = 4});
+  TESTFUNC(testParallelFor);
+  TESTFUNC(testParallelSort);
+  TESTFUNC(testTypedParallelSort);
+  RMUtilThreadPool_Free(pool);
+});
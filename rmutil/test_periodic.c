@@ -1,3 +1,4 @@
+#define REDISMODULE_MAIN
 #include <stdio.h>
 #include <redismodule.h>
 #include <unistd.h>
@@ -0,0 +1,230 @@
+#define REDISMODULE_MAIN
+#include <stdlib.h>
+#include <string.h>
+#include <redismodule.h>
+#include "postings.h"
+#include "vector.h"
+#include "test.h"
+
+static const RMUtilPostingsCodec codecs[] = {RMUTIL_POSTINGS_BITPACK, RMUTIL_POSTINGS_STREAMVBYTE,
+                                             RMUTIL_POSTINGS_VARINT};
+
+static uint64_t rnd(uint64_t *seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  return *seed;
+}
+
+/* Sorted values with gaps below maxGap, and a gap of about 2^40 every so often if wide */
+static uint64_t *sortedValues(size_t n, uint64_t maxGap, int wide, uint64_t seed) {
+  uint64_t *values = malloc(n * sizeof(uint64_t) + 1), x = rnd(&seed) % 1000;
+  for (size_t i = 0; i < n; i++) {
+    x += rnd(&seed) % maxGap;
+    if (wide && rnd(&seed) % 300 == 0) x += 1ULL << 40;
+    values[i] = x;
+  }
+  return values;
+}
+
+/* Check that the list decodes to values, as a whole, by block and by iteration */
+static int checkDecode(RMUtilPostings *p, const uint64_t *values, size_t n) {
+  ASSERT_EQUAL(n, RMUtilPostings_Count(p));
+  uint64_t *out = malloc(n * sizeof(uint64_t) + 1);
+  RMUtilPostings_Decode(p, out);
+  ASSERT(!memcmp(values, out, n * sizeof(uint64_t)));
+
+  uint64_t block[RMUTIL_POSTINGS_BLOCK];
+  size_t i = 0, got;
+  for (size_t b = 0; (got = RMUtilPostings_DecodeBlock(p, b, block)); b++) {
+    ASSERT(!memcmp(values + i, block, got * sizeof(uint64_t)));
+    i += got;
+  }
+  ASSERT_EQUAL(n, i);
+
+  RMUtilPostingsIterator *it = RMUtilPostings_Iterate(p);
+  uint64_t x;
+  for (i = 0; RMUtilPostingsIterator_Next(it, &x); i++) out[i] = x;
+  ASSERT_EQUAL(n, i);
+  ASSERT(!memcmp(values, out, n * sizeof(uint64_t)));
+  RMUtilPostingsIterator_Free(it);
+  free(out);
+  return 0;
+}
+
+int testPostings() {
+  uint64_t values[] = {3, 7, 7, 8, 1000, 1ULL << 50, UINT64_MAX};
+  for (int c = 0; c < 3; c++) {
+    RMUtilPostings *p = RMUtilPostings_Encode(values, 7, codecs[c]);
+    ASSERT_EQUAL(1, RMUtilPostings_NumBlocks(p));
+    if (checkDecode(p, values, 7)) return 1;
+    RMUtilPostings_Free(p);
+
+    p = RMUtilPostings_Encode(values, 0, codecs[c]);
+    ASSERT_EQUAL(0, RMUtilPostings_NumBlocks(p));
+    if (checkDecode(p, values, 0)) return 1;
+    RMUtilPostings_Free(p);
+  }
+  uint64_t unsorted[] = {1, 3, 2};
+  ASSERT(RMUtilPostings_Encode(unsorted, 3, RMUTIL_POSTINGS_BITPACK) == NULL);
+
+  Vector *v = NewVector(uint64_t, 4);
+  for (uint64_t i = 0; i < 300; i++) {
+    uint64_t x = i * i;
+    Vector_Push(v, x);
+  }
+  RMUtilPostings *p = RMUtilPostings_EncodeVector(v, RMUTIL_POSTINGS_BITPACK);
+  ASSERT_EQUAL(3, RMUtilPostings_NumBlocks(p));
+  if (checkDecode(p, (uint64_t *)v->data, 300)) return 1;
+  RMUtilPostings_Free(p);
+  Vector_Free(v);
+  v = NewVector(int, 4);
+  ASSERT(RMUtilPostings_EncodeVector(v, RMUTIL_POSTINGS_BITPACK) == NULL);
+  Vector_Free(v);
+  return 0;
+}
+
+int testPostingsRandom() {
+  // every bit width, partial blocks, runs of duplicates and spans over 32 bits
+  size_t sizes[] = {1, 127, 128, 129, 1000, 20000};
+  uint64_t gaps[] = {1, 2, 3, 100, 1 << 15, 1ULL << 25, 1ULL << 31, 1ULL << 34};
+  uint64_t seed = 1;
+  for (int s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+    for (int g = 0; g < sizeof(gaps) / sizeof(*gaps); g++) {
+      for (int wide = 0; wide < 2; wide++) {
+        uint64_t *values = sortedValues(sizes[s], gaps[g], wide, seed++);
+        for (int c = 0; c < 3; c++) {
+          RMUtilPostings *p = RMUtilPostings_Encode(values, sizes[s], codecs[c]);
+          if (checkDecode(p, values, sizes[s])) return 1;
+          RMUtilPostings_Free(p);
+        }
+        free(values);
+      }
+    }
+  }
+  return 0;
+}
+
+int testPostingsCompression() {
+  // dense ids take a byte or two each, rather than 8
+  size_t n = 100000;
+  uint64_t *values = sortedValues(n, 16, 0, 1);
+  size_t sizes[3];
+  for (int c = 0; c < 3; c++) {
+    RMUtilPostings *p = RMUtilPostings_Encode(values, n, codecs[c]);
+    sizes[c] = RMUtilPostings_MemUsage(p);
+    RMUtilPostings_Free(p);
+  }
+  ASSERT(sizes[0] < n * 8 / 10);
+  ASSERT(sizes[1] < n * 8 / 5);
+  ASSERT(sizes[2] < n * 8 / 5);
+  ASSERT(sizes[0] < sizes[1]);
+  free(values);
+
+  // all equal: only the skip table and headers
+  values = calloc(n, sizeof(uint64_t));
+  RMUtilPostings *p = RMUtilPostings_Encode(values, n, RMUTIL_POSTINGS_BITPACK);
+  ASSERT(RMUtilPostings_MemUsage(p) < n / 8);
+  if (checkDecode(p, values, n)) return 1;
+  RMUtilPostings_Free(p);
+  free(values);
+  return 0;
+}
+
+int testPostingsSkipTo() {
+  size_t n = 5000;
+  uint64_t *values = sortedValues(n, 50, 1, 7);
+  for (int c = 0; c < 3; c++) {
+    RMUtilPostings *p = RMUtilPostings_Encode(values, n, codecs[c]);
+    // seek forward in steps of every size, from within and past the current block
+    uint64_t seed = 3;
+    RMUtilPostingsIterator *it = RMUtilPostings_Iterate(p);
+    size_t i = 0;
+    uint64_t x;
+    for (;;) {
+      size_t step = rnd(&seed) % 3 ? rnd(&seed) % 10 : rnd(&seed) % 1000;
+      if (i + step >= n) break;
+      // a target between two values finds the next one
+      uint64_t target = values[i + step] - (values[i + step] && rnd(&seed) % 2);
+      size_t want = i + step;
+      while (want > i && values[want - 1] >= target) want--;
+      ASSERT_EQUAL(1, RMUtilPostingsIterator_SkipTo(it, target, &x));
+      ASSERT_EQUAL(values[want], x);
+      i = want + 1;
+    }
+    ASSERT_EQUAL(0, RMUtilPostingsIterator_SkipTo(it, values[n - 1] + 1, &x));
+    ASSERT_EQUAL(0, RMUtilPostingsIterator_Next(it, &x));
+    RMUtilPostingsIterator_Free(it);
+
+    // targets already passed return the next value
+    it = RMUtilPostings_Iterate(p);
+    size_t j = 1000;
+    while (j > 0 && values[j - 1] == values[1000]) j--;
+    ASSERT_EQUAL(1, RMUtilPostingsIterator_SkipTo(it, values[1000], &x));
+    ASSERT_EQUAL(1, RMUtilPostingsIterator_SkipTo(it, values[10], &x));
+    ASSERT_EQUAL(values[j + 1], x);
+    ASSERT_EQUAL(1, RMUtilPostingsIterator_Next(it, &x));
+    ASSERT_EQUAL(values[j + 2], x);
+    RMUtilPostingsIterator_Free(it);
+    RMUtilPostings_Free(p);
+  }
+  free(values);
+  return 0;
+}
+
+int testPostingsSerialize() {
+  size_t n = 1000;
+  uint64_t *values = sortedValues(n, 1000, 1, 5);
+  for (int c = 0; c < 3; c++) {
+    RMUtilPostings *p = RMUtilPostings_Encode(values, n, codecs[c]);
+    size_t len = RMUtilPostings_SerializedSize(p);
+    char *buf = malloc(len);
+    RMUtilPostings_Serialize(p, buf);
+    RMUtilPostings *q = RMUtilPostings_Deserialize(buf, len);
+    ASSERT(q != NULL);
+    if (checkDecode(q, values, n)) return 1;
+    RMUtilPostings_Free(q);
+
+    ASSERT(RMUtilPostings_Deserialize(buf, len - 1) == NULL);
+    ASSERT(RMUtilPostings_Deserialize(buf, 7) == NULL);
+    // corrupted bytes fail to load or load as another valid list, never crash
+    uint64_t seed = 9, *out = malloc(n * sizeof(uint64_t));
+    int failed = 0;
+    for (int i = 0; i < 2000; i++) {
+      size_t pos = rnd(&seed) % len;
+      char old = buf[pos];
+      buf[pos] ^= 1 << (rnd(&seed) % 8);
+      q = RMUtilPostings_Deserialize(buf, len);
+      if (q) {
+        if (RMUtilPostings_Count(q) <= n) RMUtilPostings_Decode(q, out);
+        RMUtilPostings_Free(q);
+      } else {
+        failed++;
+      }
+      buf[pos] = old;
+    }
+    ASSERT(failed > 0);
+    free(out);
+    free(buf);
+    RMUtilPostings_Free(p);
+  }
+
+  RMUtilPostings *p = RMUtilPostings_Encode(values, 0, RMUTIL_POSTINGS_VARINT);
+  char buf[8];
+  RMUtilPostings_Serialize(p, buf);
+  RMUtilPostings_Free(p);
+  p = RMUtilPostings_Deserialize(buf, 8);
+  ASSERT(p != NULL);
+  ASSERT_EQUAL(0, RMUtilPostings_Count(p));
+  RMUtilPostings_Free(p);
+  free(values);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testPostings);
+  TESTFUNC(testPostingsRandom);
+  TESTFUNC(testPostingsCompression);
+  TESTFUNC(testPostingsSkipTo);
+  TESTFUNC(testPostingsSerialize);
+});
@@ -31,6 +31,21 @@ int main(int argc, char **argv) {
     Priority_Queue_Top(pq, &n);
     assert(15 == n);
 
+    // change priorities in place
+    int *data = (int *) pq->v->data;
+    for (size_t i = 0; i < Priority_Queue_Size(pq); i++) {
+        if (data[i] == 1) {
+            data[i] = 30;
+            Priority_Queue_Update(pq, i);
+        }
+    }
+    Priority_Queue_Top(pq, &n);
+    assert(30 == n);
+    data[0] = 0;
+    Priority_Queue_Update(pq, 0);
+    Priority_Queue_Top(pq, &n);
+    assert(15 == n);
+
     Priority_Queue_Free(pq);
     printf("PASS!\n");
     return 0;
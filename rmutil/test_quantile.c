@@ -0,0 +1,194 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "quantile.h"
+#include "test.h"
+
+#define N 1000000
+
+static double qs[] = {0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999};
+#define NUM_QS (sizeof(qs) / sizeof(qs[0]))
+
+static int cmpDouble(const void *a, const void *b) {
+  double x = *(double *)a, y = *(double *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* A long tailed distribution, like latencies */
+static double *genValues(int n) {
+  double *xs = malloc(n * sizeof(double));
+  for (int i = 0; i < n; i++) {
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    xs[i] = exp(3 * sqrt(-2 * log(u)) * cos(2 * M_PI * rand() / RAND_MAX));
+  }
+  return xs;
+}
+
+/* The fraction of sorted values below x */
+static double rankOf(const double *sorted, int n, double x) {
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (sorted[mid] < x) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (double)lo / n;
+}
+
+/* The maximal rank error of td's quantiles, relative to sqrt(q * (1 - q)) which is how the k1
+ * scale function sizes centroids */
+static double tdigestError(RMUtilTDigest *td, const double *sorted, int n) {
+  double worst = 0;
+  for (int i = 0; i < NUM_QS; i++) {
+    double r = rankOf(sorted, n, RMUtilTDigest_Quantile(td, qs[i]));
+    double err = fabs(r - qs[i]) / sqrt(qs[i] * (1 - qs[i]));
+    if (err > worst) worst = err;
+  }
+  return worst;
+}
+
+int testTDigest() {
+  srand(1);
+  RMUtilTDigest *td = RMUtilTDigest_New(100);
+  ASSERT(isnan(RMUtilTDigest_Quantile(td, 0.5)));
+  ASSERT(isnan(RMUtilTDigest_CDF(td, 0.5)));
+  RMUtilTDigest_Add(td, 42);
+  ASSERT_EQUAL(42, RMUtilTDigest_Quantile(td, 0.5));
+  ASSERT_EQUAL(1, RMUtilTDigest_CDF(td, 42));
+  ASSERT_EQUAL(0, RMUtilTDigest_CDF(td, 41));
+  RMUtilTDigest_Free(td);
+
+  double *xs = genValues(N);
+  td = RMUtilTDigest_New(100);
+  RMUtilTDigest_AddBatch(td, xs, N / 2);
+  for (int i = N / 2; i < N; i++) RMUtilTDigest_Add(td, xs[i]);
+  RMUtilTDigest_Add(td, NAN);
+  ASSERT_EQUAL(N, RMUtilTDigest_Count(td));
+  ASSERT(RMUtilTDigest_MemUsage(td) < 16 * 1024);
+
+  double *sorted = malloc(N * sizeof(double));
+  memcpy(sorted, xs, N * sizeof(double));
+  qsort(sorted, N, sizeof(double), cmpDouble);
+  ASSERT_EQUAL(sorted[0], RMUtilTDigest_Min(td));
+  ASSERT_EQUAL(sorted[N - 1], RMUtilTDigest_Quantile(td, 1));
+
+  // about 0.2% off at the median, 0.05% at the ends
+  ASSERT(tdigestError(td, sorted, N) < 0.03);
+  double worst = 0;
+  for (int i = 0; i < NUM_QS; i++) {
+    double x = sorted[(int)(qs[i] * N)];
+    double err = fabs(RMUtilTDigest_CDF(td, x) - qs[i]) / sqrt(qs[i] * (1 - qs[i]));
+    if (err > worst) worst = err;
+  }
+  ASSERT(worst < 0.03);
+
+  // merging digests of parts of the values
+  RMUtilTDigest *parts[4], *merged = RMUtilTDigest_New(100);
+  for (int p = 0; p < 4; p++) {
+    parts[p] = RMUtilTDigest_New(100);
+    for (int i = p; i < N; i += 4) RMUtilTDigest_Add(parts[p], xs[i]);
+    // compress some of them before merging
+    if (p % 2) RMUtilTDigest_Quantile(parts[p], 0.5);
+    RMUtilTDigest_Merge(merged, parts[p]);
+    RMUtilTDigest_Free(parts[p]);
+  }
+  ASSERT_EQUAL(N, RMUtilTDigest_Count(merged));
+  ASSERT_EQUAL(sorted[0], RMUtilTDigest_Quantile(merged, 0));
+  ASSERT(tdigestError(merged, sorted, N) < 0.03);
+
+  RMUtilTDigest_Free(merged);
+  RMUtilTDigest_Free(td);
+  free(sorted);
+  free(xs);
+  return 0;
+}
+
+/* The maximal relative error of dd's quantiles */
+static double ddError(const RMUtilDDSketch *dd, const double *sorted, int n) {
+  double worst = 0;
+  for (int i = 0; i < NUM_QS; i++) {
+    double exact = sorted[(int)(qs[i] * (n - 1))];
+    double err = fabs(RMUtilDDSketch_Quantile(dd, qs[i]) - exact) / fabs(exact);
+    if (err > worst) worst = err;
+  }
+  return worst;
+}
+
+int testDDSketch() {
+  srand(2);
+  ASSERT(RMUtilDDSketch_New(0, 100) == NULL);
+  ASSERT(RMUtilDDSketch_New(1, 100) == NULL);
+
+  RMUtilDDSketch *dd = RMUtilDDSketch_New(0.01, 2048);
+  ASSERT(isnan(RMUtilDDSketch_Quantile(dd, 0.5)));
+  // values of both signs, and zeros
+  double *xs = genValues(N);
+  for (int i = 0; i < N; i++) {
+    if (i % 3 == 0) xs[i] = -xs[i];
+    if (i % 100 == 0) xs[i] = 0;
+    RMUtilDDSketch_Add(dd, xs[i]);
+  }
+  RMUtilDDSketch_Add(dd, INFINITY);
+  ASSERT_EQUAL(N, RMUtilDDSketch_Count(dd));
+  ASSERT(RMUtilDDSketch_MemUsage(dd) < 64 * 1024);
+
+  double *sorted = malloc(N * sizeof(double));
+  memcpy(sorted, xs, N * sizeof(double));
+  qsort(sorted, N, sizeof(double), cmpDouble);
+  ASSERT(ddError(dd, sorted, N) <= 0.01);
+  ASSERT_EQUAL(sorted[N - 1], RMUtilDDSketch_Max(dd));
+  ASSERT_EQUAL(0, RMUtilDDSketch_Quantile(dd, rankOf(sorted, N, 0) + 0.001));
+  double worst = 0;
+  for (int i = 0; i < NUM_QS; i++) {
+    double x = sorted[(int)(qs[i] * N)];
+    double err = fabs(RMUtilDDSketch_CDF(dd, x) - rankOf(sorted, N, x));
+    if (err > worst) worst = err;
+  }
+  ASSERT(worst < 0.01);
+
+  // merges are exact
+  RMUtilDDSketch *a = RMUtilDDSketch_New(0.01, 2048), *b = RMUtilDDSketch_New(0.01, 2048);
+  for (int i = 0; i < N; i++) RMUtilDDSketch_Add(i % 2 ? a : b, xs[i]);
+  ASSERT_EQUAL(1, RMUtilDDSketch_Merge(a, b));
+  ASSERT_EQUAL(N, RMUtilDDSketch_Count(a));
+  size_t wrong = 0;
+  for (int i = 0; i < NUM_QS; i++) {
+    wrong += RMUtilDDSketch_Quantile(a, qs[i]) != RMUtilDDSketch_Quantile(dd, qs[i]);
+  }
+  ASSERT_EQUAL(0, wrong);
+  RMUtilDDSketch *c = RMUtilDDSketch_New(0.02, 2048);
+  ASSERT_EQUAL(0, RMUtilDDSketch_Merge(a, c));
+  RMUtilDDSketch_Free(a);
+  RMUtilDDSketch_Free(b);
+  RMUtilDDSketch_Free(c);
+  RMUtilDDSketch_Free(dd);
+
+  // values over 30 orders of magnitude in few buckets: the low ones get merged, the high
+  // quantiles stay accurate
+  dd = RMUtilDDSketch_New(0.01, 256);
+  for (int i = 0; i < N; i++) {
+    xs[i] = pow(10, 30.0 * rand() / RAND_MAX - 15);
+    RMUtilDDSketch_Add(dd, xs[i]);
+  }
+  ASSERT(RMUtilDDSketch_MemUsage(dd) < 256 * sizeof(uint64_t) + 1024);
+  memcpy(sorted, xs, N * sizeof(double));
+  qsort(sorted, N, sizeof(double), cmpDouble);
+  double exact = sorted[(int)(0.99 * (N - 1))];
+  ASSERT(fabs(RMUtilDDSketch_Quantile(dd, 0.99) - exact) <= 0.01 * exact);
+  exact = sorted[(int)(0.999 * (N - 1))];
+  ASSERT(fabs(RMUtilDDSketch_Quantile(dd, 0.999) - exact) <= 0.01 * exact);
+  RMUtilDDSketch_Free(dd);
+
+  free(sorted);
+  free(xs);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testTDigest);
+  TESTFUNC(testDDSketch);
+});
@@ -0,0 +1,185 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <redismodule.h>
+#include "mock_redis.h"
+#include "resumable.h"
+#include "test.h"
+
+#define MAX_STEPS 100
+// 300us per step against a 1000us budget: a slice runs 4 steps at most
+#define STEP_US 300
+#define BUDGET_US 1000
+#define MAX_SLICE_STEPS 4
+
+typedef struct {
+  long long total;
+  int sleep;
+} testState;
+
+// the slice each step ran in: the number of yields and event loop iterations before it
+static size_t stepSlice[MAX_STEPS];
+static int steps, freed, iterations;
+static size_t baseYields;
+
+static int testStep(RedisModuleCtx *ctx, void *p) {
+  testState *st = p;
+  if (st->sleep) usleep(STEP_US);
+  stepSlice[steps++] = RMUtilMock_Yields() - baseYields + iterations;
+  return steps < st->total ? RMUTIL_RESUMABLE_CONTINUE : RMUTIL_RESUMABLE_DONE;
+}
+
+static int testReply(RedisModuleCtx *ctx, void *p) {
+  return RedisModule_ReplyWithLongLong(ctx, steps);
+}
+
+static void testFree(void *p) {
+  freed++;
+  free(p);
+}
+
+/* TEST.RUN <steps> AUTO|YIELD|BLOCK [FAST] */
+static int testRunCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 3 && argc != 4) return RedisModule_WrongArity(ctx);
+  testState *st = malloc(sizeof(*st));
+  RedisModule_StringToLongLong(argv[1], &st->total);
+  st->sleep = argc == 3;
+  const char *mode = RedisModule_StringPtrLen(argv[2], NULL);
+  RMUtilResumableOptions opts = {.budgetUs = BUDGET_US};
+  if (!strcmp(mode, "YIELD")) opts.mode = RMUTIL_RESUMABLE_YIELD;
+  if (!strcmp(mode, "BLOCK")) opts.mode = RMUTIL_RESUMABLE_BLOCK;
+  return RMUtil_RunResumable(ctx, testStep, testReply, testFree, st, &opts);
+}
+
+static int testOnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (RedisModule_Init(ctx, "testresumable", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+  return RedisModule_CreateCommand(ctx, "test.run", testRunCommand, "write", 0, 0, 0);
+}
+
+static void setup() {
+  steps = freed = iterations = 0;
+  baseYields = RMUtilMock_Yields();
+}
+
+/* Check that the steps ran in consecutive slices of at most MAX_SLICE_STEPS, and return the number
+ * of slices */
+static int countSlices() {
+  size_t slice = 0;
+  int inSlice = 0;
+  for (int i = 0; i < steps; i++) {
+    if (stepSlice[i] != slice) {
+      ASSERT_EQUAL(slice + 1, stepSlice[i]);
+      slice++;
+      inSlice = 0;
+    }
+    inSlice++;
+    ASSERT(inSlice <= MAX_SLICE_STEPS);
+  }
+  return slice + 1;
+}
+
+static int checkReply(RedisModuleCallReply *r, long long expected) {
+  ASSERT(r != NULL);
+  ASSERT_EQUAL(REDISMODULE_REPLY_INTEGER, RedisModule_CallReplyType(r));
+  ASSERT_EQUAL(expected, RedisModule_CallReplyInteger(r));
+  RedisModule_FreeCallReply(r);
+  return 0;
+}
+
+int testShort() {
+  setup();
+  if (checkReply(RMUtilMock_Call("test.run", "ccc", "3", "BLOCK", "FAST"), 3)) return -1;
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+  ASSERT_EQUAL(0, RMUtilMock_Yields() - baseYields);
+  ASSERT_EQUAL(1, freed);
+  return 0;
+}
+
+int testYield() {
+  const char *modes[] = {"YIELD", "AUTO"};
+  for (int m = 0; m < 2; m++) {
+    setup();
+    if (checkReply(RMUtilMock_Call("test.run", "cc", "20", modes[m]), 20)) return -1;
+    // a yield between every two slices, and none before the first or after the last one
+    int slices = countSlices();
+    if (slices < 0) return -1;
+    ASSERT(slices >= 20 / MAX_SLICE_STEPS);
+    ASSERT_EQUAL(slices - 1, RMUtilMock_Yields() - baseYields);
+    ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+    ASSERT_EQUAL(1, freed);
+  }
+  return 0;
+}
+
+int testBlock() {
+  setup();
+  RedisModuleCallReply *r = RMUtilMock_Call("test.run", "cc", "20", "BLOCK");
+  ASSERT_EQUAL(REDISMODULE_REPLY_NULL, RedisModule_CallReplyType(r));
+  RedisModule_FreeCallReply(r);
+  ASSERT_EQUAL(1, RMUtilMock_BlockedClients());
+
+  // the first slice runs in the command, then one per iteration of the event loop
+  while (RMUtilMock_BlockedClients() && iterations < 100) {
+    iterations++;
+    RMUtilMock_ProcessEvents();
+  }
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+  if (checkReply(RMUtilMock_PopReply(), 20)) return -1;
+  int slices = countSlices();
+  if (slices < 0) return -1;
+  ASSERT_EQUAL(iterations + 1, slices);
+  ASSERT_EQUAL(0, RMUtilMock_Yields() - baseYields);
+  ASSERT_EQUAL(1, freed);
+  return 0;
+}
+
+int testNoBlocking() {
+  // inside a transaction the client can't be blocked, the command yields instead
+  setup();
+  RMUtilMock_SetContextFlags(REDISMODULE_CTX_FLAGS_MULTI);
+  if (checkReply(RMUtilMock_Call("test.run", "cc", "20", "BLOCK"), 20)) return -1;
+  RMUtilMock_SetContextFlags(0);
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+  int slices = countSlices();
+  if (slices < 0) return -1;
+  ASSERT_EQUAL(slices - 1, RMUtilMock_Yields() - baseYields);
+  ASSERT_EQUAL(1, freed);
+  return 0;
+}
+
+int testDisconnect() {
+  setup();
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.run", "cc", "20", "BLOCK"));
+  iterations++;
+  RMUtilMock_ProcessEvents();
+  int before = steps;
+  ASSERT_EQUAL(1, RMUtilMock_DisconnectClients());
+
+  // the remaining steps are skipped, and the state is freed with no reply
+  while (RMUtilMock_BlockedClients() && iterations < 100) {
+    iterations++;
+    RMUtilMock_ProcessEvents();
+  }
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+  ASSERT_EQUAL(before, steps);
+  ASSERT(steps < 20);
+  ASSERT(RMUtilMock_PopReply() == NULL);
+  ASSERT_EQUAL(1, freed);
+  return 0;
+}
+
+TEST_MAIN({
+  if (RMUtilMock_LoadModule(testOnLoad, NULL, 0) != REDISMODULE_OK) {
+    printf("Failed loading the test module\n");
+    return 1;
+  }
+  TESTFUNC(testShort);
+  TESTFUNC(testYield);
+  TESTFUNC(testBlock);
+  TESTFUNC(testNoBlocking);
+  TESTFUNC(testDisconnect);
+});
@@ -0,0 +1,224 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+#include "test.h"
+
+#define ITEM(i) ((void *)(uintptr_t)(i))
+
+int testSPSCRing() {
+  ASSERT(RMUtilSPSCRing_New(0, 0) == NULL);
+  RMUtilSPSCRing *r = RMUtilSPSCRing_New(5, 0);
+  ASSERT_EQUAL(8, RMUtilSPSCRing_Capacity(r));
+  void *item;
+  ASSERT_EQUAL(0, RMUtilSPSCRing_Pop(r, &item));
+
+  size_t pushed = 0;
+  for (int i = 0; i < 8; i++) pushed += RMUtilSPSCRing_Push(r, ITEM(i));
+  ASSERT_EQUAL(8, pushed);
+  ASSERT_EQUAL(0, RMUtilSPSCRing_Push(r, ITEM(8)));
+  ASSERT_EQUAL(8, RMUtilSPSCRing_Size(r));
+  ASSERT_EQUAL(1, RMUtilSPSCRing_Pop(r, &item));
+  ASSERT_EQUAL(0, (uintptr_t)item);
+
+  // batches wrapping around the end of the slots, and partial ones
+  void *items[16], *out[16];
+  for (int i = 0; i < 16; i++) items[i] = ITEM(100 + i);
+  void *rest[8];
+  ASSERT_EQUAL(7, RMUtilSPSCRing_PopBatch(r, rest, 8));
+  ASSERT_EQUAL(7, (uintptr_t)rest[6]);
+  ASSERT_EQUAL(8, RMUtilSPSCRing_PushBatch(r, items, 16));
+  ASSERT_EQUAL(0, RMUtilSPSCRing_PushBatch(r, items, 1));
+  ASSERT_EQUAL(3, RMUtilSPSCRing_PopBatch(r, out, 3));
+  ASSERT_EQUAL(3, RMUtilSPSCRing_PushBatch(r, items + 8, 8));
+  ASSERT_EQUAL(8, RMUtilSPSCRing_PopBatch(r, out + 3, 16));
+  size_t wrong = 0;
+  for (int i = 0; i < 11; i++) wrong += out[i] != items[i];
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(0, RMUtilSPSCRing_Size(r));
+
+  // closing an empty ring
+  RMUtilSPSCRing_Close(r);
+  ASSERT_EQUAL(0, RMUtilSPSCRing_PopWait(r, out, 16));
+  ASSERT_EQUAL(8, RMUtilSPSCRing_PushWait(r, items, 16));
+  ASSERT_EQUAL(8, RMUtilSPSCRing_PopWait(r, out, 16));
+  RMUtilSPSCRing_Free(r);
+  return 0;
+}
+
+int testMPMCRing() {
+  ASSERT(RMUtilMPMCRing_New(0, 0) == NULL);
+  RMUtilMPMCRing *r = RMUtilMPMCRing_New(4, 0);
+  ASSERT_EQUAL(4, RMUtilMPMCRing_Capacity(r));
+  void *items[8] = {ITEM(1), ITEM(2), ITEM(3), ITEM(4), ITEM(5), ITEM(6)}, *out[8];
+  ASSERT_EQUAL(3, RMUtilMPMCRing_PushBatch(r, items, 3));
+  ASSERT_EQUAL(2, RMUtilMPMCRing_PopBatch(r, out, 2));
+  ASSERT_EQUAL(3, RMUtilMPMCRing_PushBatch(r, items + 3, 5));
+  ASSERT_EQUAL(0, RMUtilMPMCRing_Push(r, ITEM(7)));
+  ASSERT_EQUAL(4, RMUtilMPMCRing_Size(r));
+  ASSERT_EQUAL(4, RMUtilMPMCRing_PopBatch(r, out + 2, 8));
+  size_t wrong = 0;
+  for (int i = 0; i < 6; i++) wrong += out[i] != items[i];
+  ASSERT_EQUAL(0, wrong);
+  void *item;
+  ASSERT_EQUAL(0, RMUtilMPMCRing_Pop(r, &item));
+  RMUtilMPMCRing_Free(r);
+  return 0;
+}
+
+#define SPSC_ITEMS 1000000
+
+static long shortPushes = 0;
+
+static void *spscProducer(void *arg) {
+  RMUtilSPSCRing *r = arg;
+  void *batch[37];
+  uint64_t next = 1;
+  while (next <= SPSC_ITEMS) {
+    // batches of varying sizes, some larger than the ring
+    size_t n = next % 37 + 1;
+    if (n > SPSC_ITEMS - next + 1) n = SPSC_ITEMS - next + 1;
+    for (size_t i = 0; i < n; i++) batch[i] = ITEM(next + i);
+    shortPushes += RMUtilSPSCRing_PushWait(r, batch, n) != n;
+    next += n;
+  }
+  RMUtilSPSCRing_Close(r);
+  return NULL;
+}
+
+/* Transfer items between two threads, checking that none are lost, duplicated or reordered */
+static int transferSPSC(int flags) {
+  RMUtilSPSCRing *r = RMUtilSPSCRing_New(32, flags);
+  pthread_t t;
+  pthread_create(&t, NULL, spscProducer, r);
+  void *out[20];
+  uint64_t expected = 1;
+  size_t wrong = 0, n;
+  while ((n = RMUtilSPSCRing_PopWait(r, out, expected % 20 + 1)) > 0) {
+    for (size_t i = 0; i < n; i++) wrong += (uintptr_t)out[i] != expected++;
+  }
+  pthread_join(t, NULL);
+  ASSERT_EQUAL(0, shortPushes);
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(SPSC_ITEMS + 1, expected);
+  RMUtilSPSCRing_Free(r);
+  return 0;
+}
+
+int testSPSCRingThreads() {
+  ASSERT_EQUAL(0, transferSPSC(0));
+  ASSERT_EQUAL(0, transferSPSC(RMUTIL_RING_BLOCKING));
+  return 0;
+}
+
+#define NUM_PRODUCERS 4
+#define NUM_CONSUMERS 4
+#define PER_PRODUCER 200000
+
+typedef struct {
+  RMUtilMPMCRing *r;
+  int id;
+  /* consumers: the items seen, and the last sequence number seen per producer */
+  uint8_t *seen;
+  long outOfOrder;
+} mpmcThread;
+
+/* items encode the producer and a per-producer sequence number */
+static void *mpmcProducer(void *arg) {
+  mpmcThread *t = arg;
+  void *batch[16];
+  for (long i = 0; i < PER_PRODUCER;) {
+    size_t n = i % 2 ? 1 : 16;
+    if (n > PER_PRODUCER - i) n = PER_PRODUCER - i;
+    for (size_t j = 0; j < n; j++) batch[j] = ITEM(t->id * PER_PRODUCER + i + j + 1);
+    RMUtilMPMCRing_PushWait(t->r, batch, n);
+    i += n;
+  }
+  return NULL;
+}
+
+static void *mpmcConsumer(void *arg) {
+  mpmcThread *t = arg;
+  long last[NUM_PRODUCERS];
+  for (int i = 0; i < NUM_PRODUCERS; i++) last[i] = -1;
+  void *out[8];
+  size_t n;
+  while ((n = RMUtilMPMCRing_PopWait(t->r, out, t->id % 2 ? 1 : 8)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      long v = (uintptr_t)out[i] - 1;
+      int p = v / PER_PRODUCER;
+      // each consumer sees the items of a producer in order
+      if (v % PER_PRODUCER <= last[p]) t->outOfOrder++;
+      last[p] = v % PER_PRODUCER;
+      __atomic_add_fetch(&t->seen[v], 1, __ATOMIC_RELAXED);
+    }
+  }
+  return NULL;
+}
+
+static int transferMPMC(int flags) {
+  RMUtilMPMCRing *r = RMUtilMPMCRing_New(64, flags);
+  uint8_t *seen = calloc(NUM_PRODUCERS * PER_PRODUCER, 1);
+  mpmcThread producers[NUM_PRODUCERS], consumers[NUM_CONSUMERS];
+  pthread_t pt[NUM_PRODUCERS], ct[NUM_CONSUMERS];
+  for (int i = 0; i < NUM_CONSUMERS; i++) {
+    consumers[i] = (mpmcThread){.r = r, .id = i, .seen = seen};
+    pthread_create(&ct[i], NULL, mpmcConsumer, &consumers[i]);
+  }
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
+    producers[i] = (mpmcThread){.r = r, .id = i};
+    pthread_create(&pt[i], NULL, mpmcProducer, &producers[i]);
+  }
+  for (int i = 0; i < NUM_PRODUCERS; i++) pthread_join(pt[i], NULL);
+  RMUtilMPMCRing_Close(r);
+  long outOfOrder = 0;
+  for (int i = 0; i < NUM_CONSUMERS; i++) {
+    pthread_join(ct[i], NULL);
+    outOfOrder += consumers[i].outOfOrder;
+  }
+  ASSERT_EQUAL(0, outOfOrder);
+  size_t wrong = 0;
+  for (long i = 0; i < NUM_PRODUCERS * PER_PRODUCER; i++) wrong += seen[i] != 1;
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(0, RMUtilMPMCRing_Size(r));
+  free(seen);
+  RMUtilMPMCRing_Free(r);
+  return 0;
+}
+
+int testMPMCRingThreads() {
+  ASSERT_EQUAL(0, transferMPMC(0));
+  ASSERT_EQUAL(0, transferMPMC(RMUTIL_RING_BLOCKING));
+  return 0;
+}
+
+static void *blockedPop(void *arg) {
+  void *out[4];
+  return (void *)(uintptr_t)RMUtilMPMCRing_PopWait(arg, out, 4);
+}
+
+int testRingClose() {
+  // consumers sleeping on an empty ring are woken up by a push, then by closing it
+  RMUtilMPMCRing *r = RMUtilMPMCRing_New(16, RMUTIL_RING_BLOCKING);
+  pthread_t t[2];
+  for (int i = 0; i < 2; i++) pthread_create(&t[i], NULL, blockedPop, r);
+  RMUtilMPMCRing_Push(r, ITEM(1));
+  while (RMUtilMPMCRing_Size(r)) sched_yield();
+  RMUtilMPMCRing_Close(r);
+  void *ret[2];
+  for (int i = 0; i < 2; i++) pthread_join(t[i], &ret[i]);
+  ASSERT_EQUAL(1, (uintptr_t)ret[0] + (uintptr_t)ret[1]);
+  RMUtilMPMCRing_Free(r);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testSPSCRing);
+  TESTFUNC(testMPMCRing);
+  TESTFUNC(testSPSCRingThreads);
+  TESTFUNC(testMPMCRingThreads);
+  TESTFUNC(testRingClose);
+});
@@ -0,0 +1,248 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <redismodule.h>
+#include "roaring.h"
+#include "test.h"
+
+/* Reference sets are byte arrays over 16 chunks, spread over the 32 bit range */
+#define NUM_CHUNKS 16
+#define DOMAIN (NUM_CHUNKS << 16)
+
+static uint32_t toValue(uint32_t i) {
+  return ((i >> 16) * 0x1111) << 16 | (i & 0xffff);
+}
+
+/* Fill ref and r with a set mixing sparse, dense and run heavy chunks */
+static void genSet(RMUtilRoaring *r, char *ref) {
+  memset(ref, 0, DOMAIN);
+  for (int chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+    uint32_t base = chunk << 16;
+    switch (rand() % 4) {
+      case 0:
+        for (int i = 0; i < 65536; i++) ref[base + i] = rand() % 100 == 0;
+        break;
+      case 1:
+        for (int i = 0; i < 65536; i++) ref[base + i] = rand() % 2;
+        break;
+      case 2:
+        for (int i = 0; i < 65536;) {
+          int len = 1 + rand() % 2000;
+          memset(ref + base + i, rand() % 2, len > 65536 - i ? 65536 - i : len);
+          i += len;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  for (uint32_t i = 0; i < DOMAIN; i++) {
+    if (ref[i]) RMUtilRoaring_Add(r, toValue(i));
+  }
+}
+
+/* Count the differences between r and ref */
+static size_t compare(const RMUtilRoaring *r, const char *ref) {
+  size_t wrong = 0, card = 0;
+  RMUtilRoaringIterator *it = RMUtilRoaring_Iterate(r);
+  uint32_t x, i = 0;
+  while (RMUtilRoaringIterator_Next(it, &x)) {
+    while (i < DOMAIN && !ref[i]) i++;
+    if (i == DOMAIN || x != toValue(i)) wrong++;
+    i++;
+    card++;
+  }
+  RMUtilRoaringIterator_Free(it);
+  while (i < DOMAIN && !ref[i]) i++;
+  if (i != DOMAIN) wrong++;
+  if (card != RMUtilRoaring_Cardinality(r)) wrong++;
+
+  // membership everywhere, rank and select on a sample
+  uint64_t rank = 0;
+  for (i = 0; i < DOMAIN; i++) {
+    if (RMUtilRoaring_Contains(r, toValue(i)) != ref[i]) wrong++;
+    if (ref[i]) {
+      if (rank % 97 == 0 && (!RMUtilRoaring_Select(r, rank, &x) || x != toValue(i))) wrong++;
+      rank++;
+    }
+    if (i % 97 == 0 && RMUtilRoaring_Rank(r, toValue(i)) != rank) wrong++;
+  }
+  if (RMUtilRoaring_Select(r, rank, &x)) wrong++;
+  return wrong;
+}
+
+int testBasic() {
+  RMUtilRoaring *r = RMUtilRoaring_New();
+  ASSERT_EQUAL(0, RMUtilRoaring_Cardinality(r));
+  ASSERT_EQUAL(0, RMUtilRoaring_Contains(r, 0));
+  ASSERT_EQUAL(1, RMUtilRoaring_Add(r, 0));
+  ASSERT_EQUAL(1, RMUtilRoaring_Add(r, 0xffffffff));
+  ASSERT_EQUAL(1, RMUtilRoaring_Add(r, 70000));
+  ASSERT_EQUAL(0, RMUtilRoaring_Add(r, 70000));
+  ASSERT_EQUAL(3, RMUtilRoaring_Cardinality(r));
+  ASSERT_EQUAL(1, RMUtilRoaring_Contains(r, 0xffffffff));
+  ASSERT_EQUAL(0, RMUtilRoaring_Contains(r, 69999));
+  ASSERT_EQUAL(2, RMUtilRoaring_Rank(r, 70000));
+  ASSERT_EQUAL(3, RMUtilRoaring_Rank(r, 0xffffffff));
+  uint32_t x;
+  ASSERT(RMUtilRoaring_Select(r, 2, &x) && x == 0xffffffff);
+  ASSERT_EQUAL(1, RMUtilRoaring_Remove(r, 70000));
+  ASSERT_EQUAL(0, RMUtilRoaring_Remove(r, 70000));
+  ASSERT_EQUAL(2, RMUtilRoaring_Cardinality(r));
+
+  // a chunk turns into a bitmap past 4096 values, and back into an array below
+  size_t small = RMUtilRoaring_MemUsage(r);
+  for (uint32_t i = 0; i < 10000; i++) RMUtilRoaring_Add(r, 1 << 20 | i * 3);
+  ASSERT_EQUAL(10002, RMUtilRoaring_Cardinality(r));
+  size_t large = RMUtilRoaring_MemUsage(r);
+  ASSERT(large >= small + 8192);
+  for (uint32_t i = 0; i < 9000; i++) RMUtilRoaring_Remove(r, 1 << 20 | i * 3);
+  ASSERT_EQUAL(1002, RMUtilRoaring_Cardinality(r));
+  ASSERT(RMUtilRoaring_MemUsage(r) < large);
+  ASSERT_EQUAL(1, RMUtilRoaring_Contains(r, 1 << 20 | 9999 * 3));
+
+  // long runs are much smaller as run containers
+  for (uint32_t i = 0; i < 60000; i++) RMUtilRoaring_Add(r, 2 << 20 | i);
+  large = RMUtilRoaring_MemUsage(r);
+  RMUtilRoaring_RunOptimize(r);
+  ASSERT(RMUtilRoaring_MemUsage(r) < large - 8000);
+  ASSERT_EQUAL(61002, RMUtilRoaring_Cardinality(r));
+  ASSERT_EQUAL(1, RMUtilRoaring_Contains(r, 2 << 20 | 59999));
+  ASSERT_EQUAL(0, RMUtilRoaring_Contains(r, 2 << 20 | 60000));
+  RMUtilRoaring_Free(r);
+  return 0;
+}
+
+int testRandom() {
+  srand(1);
+  char *ref = malloc(DOMAIN);
+  for (int round = 0; round < 3; round++) {
+    RMUtilRoaring *r = RMUtilRoaring_New();
+    genSet(r, ref);
+    ASSERT_EQUAL(0, compare(r, ref));
+
+    // remove a random part and add it back, going through container conversions
+    size_t wrong = 0;
+    for (uint32_t i = 0; i < DOMAIN; i++) {
+      if (rand() % 3 == 0 && RMUtilRoaring_Remove(r, toValue(i)) != ref[i]) wrong++;
+      if (rand() % 3 == 0) ref[i] = 0;
+    }
+    for (uint32_t i = 0; i < DOMAIN; i++) {
+      if (ref[i]) {
+        RMUtilRoaring_Add(r, toValue(i));
+      } else {
+        RMUtilRoaring_Remove(r, toValue(i));
+      }
+    }
+    ASSERT_EQUAL(0, wrong);
+    ASSERT_EQUAL(0, compare(r, ref));
+    RMUtilRoaring_RunOptimize(r);
+    ASSERT_EQUAL(0, compare(r, ref));
+    RMUtilRoaring_Free(r);
+  }
+  free(ref);
+  return 0;
+}
+
+int testOps() {
+  srand(2);
+  char *refA = malloc(DOMAIN), *refB = malloc(DOMAIN), *expected = malloc(DOMAIN);
+  for (int round = 0; round < 4; round++) {
+    RMUtilRoaring *a = RMUtilRoaring_New(), *b = RMUtilRoaring_New();
+    genSet(a, refA);
+    genSet(b, refB);
+    // mix in run containers on either side
+    if (round & 1) RMUtilRoaring_RunOptimize(a);
+    if (round & 2) RMUtilRoaring_RunOptimize(b);
+
+    RMUtilRoaring *r = RMUtilRoaring_And(a, b);
+    for (int i = 0; i < DOMAIN; i++) expected[i] = refA[i] && refB[i];
+    ASSERT_EQUAL(0, compare(r, expected));
+    RMUtilRoaring_Free(r);
+
+    r = RMUtilRoaring_Or(a, b);
+    for (int i = 0; i < DOMAIN; i++) expected[i] = refA[i] || refB[i];
+    ASSERT_EQUAL(0, compare(r, expected));
+    RMUtilRoaring_Free(r);
+
+    r = RMUtilRoaring_AndNot(a, b);
+    for (int i = 0; i < DOMAIN; i++) expected[i] = refA[i] && !refB[i];
+    ASSERT_EQUAL(0, compare(r, expected));
+    RMUtilRoaring_Free(r);
+
+    // the inputs are left alone, and copies are independent
+    RMUtilRoaring *c = RMUtilRoaring_Copy(a);
+    RMUtilRoaring_Free(a);
+    ASSERT_EQUAL(0, compare(c, refA));
+    ASSERT_EQUAL(0, compare(b, refB));
+    RMUtilRoaring_Free(b);
+    RMUtilRoaring_Free(c);
+  }
+
+  // a tiny set against a large one takes the galloping path
+  RMUtilRoaring *a = RMUtilRoaring_New(), *b = RMUtilRoaring_New();
+  for (uint32_t i = 0; i < 4000; i++) RMUtilRoaring_Add(a, i * 2);
+  RMUtilRoaring_Add(b, 10);
+  RMUtilRoaring_Add(b, 11);
+  RMUtilRoaring_Add(b, 7998);
+  RMUtilRoaring *r = RMUtilRoaring_And(b, a);
+  ASSERT_EQUAL(2, RMUtilRoaring_Cardinality(r));
+  ASSERT(RMUtilRoaring_Contains(r, 10) && RMUtilRoaring_Contains(r, 7998));
+  RMUtilRoaring_Free(r);
+  RMUtilRoaring_Free(a);
+  RMUtilRoaring_Free(b);
+
+  free(refA);
+  free(refB);
+  free(expected);
+  return 0;
+}
+
+int testSerialize() {
+  srand(3);
+  char *ref = malloc(DOMAIN);
+  RMUtilRoaring *r = RMUtilRoaring_New();
+  genSet(r, ref);
+  RMUtilRoaring_RunOptimize(r);
+
+  size_t len = RMUtilRoaring_SerializedSize(r);
+  char *buf = malloc(len);
+  RMUtilRoaring_Serialize(r, buf);
+  RMUtilRoaring *loaded = RMUtilRoaring_Deserialize(buf, len);
+  ASSERT(loaded != NULL);
+  ASSERT_EQUAL(0, compare(loaded, ref));
+  RMUtilRoaring_Free(loaded);
+
+  // truncated, padded or corrupted buffers are rejected
+  ASSERT(RMUtilRoaring_Deserialize(buf, len - 1) == NULL);
+  ASSERT(RMUtilRoaring_Deserialize(buf, 3) == NULL);
+  char *padded = malloc(len + 1);
+  memcpy(padded, buf, len);
+  ASSERT(RMUtilRoaring_Deserialize(padded, len + 1) == NULL);
+  free(padded);
+  buf[6] = 9;
+  ASSERT(RMUtilRoaring_Deserialize(buf, len) == NULL);
+  free(buf);
+
+  RMUtilRoaring *empty = RMUtilRoaring_New();
+  char emptyBuf[4];
+  ASSERT_EQUAL(4, RMUtilRoaring_SerializedSize(empty));
+  RMUtilRoaring_Serialize(empty, emptyBuf);
+  loaded = RMUtilRoaring_Deserialize(emptyBuf, 4);
+  ASSERT(loaded != NULL);
+  ASSERT_EQUAL(0, RMUtilRoaring_Cardinality(loaded));
+  RMUtilRoaring_Free(loaded);
+  RMUtilRoaring_Free(empty);
+
+  RMUtilRoaring_Free(r);
+  free(ref);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testBasic);
+  TESTFUNC(testRandom);
+  TESTFUNC(testOps);
+  TESTFUNC(testSerialize);
+});
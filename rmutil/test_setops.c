@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "setops.h"
+#include "test.h"
+
+/* Fill arr with n random strictly increasing values, gaps averaging gap */
+static size_t genU32(uint32_t *arr, size_t n, uint32_t gap) {
+  uint32_t x = rand() % gap;
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = x;
+    x += 1 + rand() % (2 * gap);
+  }
+  return n;
+}
+
+static size_t genU64(uint64_t *arr, size_t n, uint64_t gap) {
+  // spread the values over the high bits too
+  uint64_t x = (uint64_t)rand() << 32;
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = x;
+    x += 1 + (uint64_t)(rand() % (2 * gap)) * 0x100000001ULL;
+  }
+  return n;
+}
+
+/* Count the values of out that are not the intersection of a and b */
+#define DEFINE_CHECK(T, S)                                                                       \
+  static size_t checkIntersect##S(const T *a, size_t na, const T *b, size_t nb, const T *out,    \
+                                  size_t n) {                                                    \
+    size_t wrong = 0, k = 0, j = 0;                                                              \
+    for (size_t i = 0; i < na; i++) {                                                            \
+      while (j < nb && b[j] < a[i]) j++;                                                         \
+      if (j < nb && b[j] == a[i]) {                                                              \
+        if (k >= n || out[k] != a[i]) wrong++;                                                   \
+        k++;                                                                                     \
+      }                                                                                          \
+    }                                                                                            \
+    return wrong + (k != n);                                                                     \
+  }
+
+DEFINE_CHECK(uint32_t, U32)
+DEFINE_CHECK(uint64_t, U64)
+
+typedef size_t (*kernelU32)(const uint32_t *, size_t, const uint32_t *, size_t, uint32_t *);
+typedef size_t (*kernelU64)(const uint64_t *, size_t, const uint64_t *, size_t, uint64_t *);
+
+int testIntersect() {
+  srand(1);
+  kernelU32 k32[] = {RMUtil_IntersectMergeU32, RMUtil_IntersectGallopU32, RMUtil_IntersectSIMDU32,
+                     RMUtil_IntersectU32};
+  kernelU64 k64[] = {RMUtil_IntersectMergeU64, RMUtil_IntersectGallopU64, RMUtil_IntersectSIMDU64,
+                     RMUtil_IntersectU64};
+  size_t sizes[] = {0, 1, 3, 4, 7, 100, 1000, 10000};
+  int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  uint32_t *a32 = malloc(10000 * 4), *b32 = malloc(10000 * 4), *o32 = malloc(10000 * 4);
+  uint64_t *a64 = malloc(10000 * 8), *b64 = malloc(10000 * 8), *o64 = malloc(10000 * 8);
+  uint32_t *c32 = malloc(10000 * 4);
+  uint64_t *c64 = malloc(10000 * 8);
+
+  size_t wrong = 0;
+  for (int x = 0; x < nsizes; x++) {
+    for (int y = 0; y < nsizes; y++) {
+      size_t na = sizes[x], nb = sizes[y];
+      // scale the gaps so that the ranges overlap whatever the sizes
+      uint32_t ga = 2 + 20000 / (na ? na : 1), gb = 2 + 20000 / (nb ? nb : 1);
+      genU32(a32, na, ga);
+      genU32(b32, nb, gb);
+      genU64(a64, na, ga);
+      genU64(b64, nb, gb);
+      for (int k = 0; k < 4; k++) {
+        size_t n = k32[k](a32, na, b32, nb, o32);
+        wrong += checkIntersectU32(a32, na, b32, nb, o32, n);
+        n = k64[k](a64, na, b64, nb, o64);
+        wrong += checkIntersectU64(a64, na, b64, nb, o64, n);
+
+        // out may be a
+        memcpy(c32, a32, na * 4);
+        n = k32[k](c32, na, b32, nb, c32);
+        wrong += checkIntersectU32(a32, na, b32, nb, c32, n);
+        memcpy(c64, a64, na * 8);
+        n = k64[k](c64, na, b64, nb, c64);
+        wrong += checkIntersectU64(a64, na, b64, nb, c64, n);
+      }
+    }
+  }
+  ASSERT_EQUAL(0, wrong);
+
+  // identical inputs
+  genU32(a32, 1000, 3);
+  ASSERT_EQUAL(1000, RMUtil_IntersectSIMDU32(a32, 1000, a32, 1000, o32));
+  ASSERT(!memcmp(a32, o32, 1000 * 4));
+
+  free(a32);
+  free(b32);
+  free(o32);
+  free(c32);
+  free(a64);
+  free(b64);
+  free(o64);
+  free(c64);
+  return 0;
+}
+
+int testUnion() {
+  srand(2);
+  uint32_t a[1000], b[500], out[1500];
+  genU32(a, 1000, 4);
+  genU32(b, 500, 8);
+  size_t n = RMUtil_UnionU32(a, 1000, b, 500, out);
+  size_t wrong = 0, i = 0, j = 0;
+  for (size_t k = 0; k < n; k++) {
+    if (k && out[k] <= out[k - 1]) wrong++;
+    uint32_t expected = j == 500 || (i < 1000 && a[i] <= b[j]) ? a[i] : b[j];
+    if (out[k] != expected) wrong++;
+    if (i < 1000 && a[i] == expected) i++;
+    if (j < 500 && b[j] == expected) j++;
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT(i == 1000 && j == 500);
+
+  uint64_t c[3] = {1, 5, 1ULL << 40}, d[2] = {5, 6}, out64[5];
+  ASSERT_EQUAL(4, RMUtil_UnionU64(c, 3, d, 2, out64));
+  ASSERT(out64[0] == 1 && out64[1] == 5 && out64[2] == 6 && out64[3] == 1ULL << 40);
+  ASSERT_EQUAL(2, RMUtil_UnionU64(c, 0, d, 2, out64));
+  return 0;
+}
+
+/* A vector of the multiples of m below max */
+static Vector *multiples(size_t elemSize, uint64_t m, uint64_t max) {
+  Vector *v = __newVectorSize(elemSize, 1);
+  Vector_Resize(v, max / m + 1);
+  for (uint64_t x = 0; x < max; x += m) {
+    if (elemSize == 4) {
+      ((uint32_t *)v->data)[v->top++] = x;
+    } else {
+      ((uint64_t *)v->data)[v->top++] = x;
+    }
+  }
+  return v;
+}
+
+int testVector() {
+  size_t sizes[] = {4, 8};
+  for (int s = 0; s < 2; s++) {
+    size_t es = sizes[s];
+    Vector *vs[4] = {multiples(es, 2, 100000), multiples(es, 3, 100000), multiples(es, 5, 100000),
+                     multiples(es, 7, 100000)};
+    Vector *out = __newVectorSize(es, 1);
+
+    // multiples of 30
+    ASSERT_EQUAL(3334, Vector_IntersectSorted(out, vs, 3));
+    size_t wrong = 0;
+    for (int i = 0; i < 3334; i++) {
+      uint64_t x = es == 4 ? ((uint32_t *)out->data)[i] : ((uint64_t *)out->data)[i];
+      if (x != (uint64_t)i * 30) wrong++;
+    }
+    ASSERT_EQUAL(0, wrong);
+    ASSERT_EQUAL(Vector_Size(vs[0]), Vector_IntersectSorted(out, vs, 1));
+
+    // multiples of any of 2, 3, 5 or 7
+    int n = Vector_UnionSorted(out, vs, 4);
+    int expected = 0;
+    for (uint64_t x = 0; x < 100000; x++) {
+      if (x % 2 && x % 3 && x % 5 && x % 7) continue;
+      uint64_t y = es == 4 ? ((uint32_t *)out->data)[expected] : ((uint64_t *)out->data)[expected];
+      if (y != x) wrong++;
+      expected++;
+    }
+    ASSERT_EQUAL(expected, n);
+    ASSERT_EQUAL(0, wrong);
+    // multiples of 2 or 3
+    ASSERT_EQUAL(66667, Vector_UnionSorted(out, vs, 2));
+    ASSERT_EQUAL(0, Vector_UnionSorted(out, vs, 0));
+
+    for (int i = 0; i < 4; i++) Vector_Free(vs[i]);
+    Vector_Free(out);
+  }
+
+  // mismatched element sizes
+  Vector *v32 = multiples(4, 2, 10), *v64 = multiples(8, 2, 10), *out = __newVectorSize(4, 1);
+  Vector *vs[2] = {v32, v64};
+  ASSERT_EQUAL(-1, Vector_IntersectSorted(out, vs, 2));
+  ASSERT_EQUAL(-1, Vector_UnionSorted(out, vs, 2));
+  Vector_Free(v32);
+  Vector_Free(v64);
+  Vector_Free(out);
+  return 0;
+}
+
+/* A vector of n values, of elemSize bytes each */
+static Vector *fromValues(size_t elemSize, const uint64_t *vals, size_t n) {
+  Vector *v = __newVectorSize(elemSize, 1);
+  Vector_Resize(v, n + 1);
+  for (size_t i = 0; i < n; i++) {
+    if (elemSize == 4) {
+      ((uint32_t *)v->data)[v->top++] = vals[i];
+    } else {
+      ((uint64_t *)v->data)[v->top++] = vals[i];
+    }
+  }
+  return v;
+}
+
+/* Intersect the vectors and count the values of the result that differ from expected */
+static size_t checkVectors(size_t elemSize, uint64_t **vals, size_t *sizes, int nv,
+                           const uint64_t *expected, size_t nexpected) {
+  Vector *vs[8], *out = __newVectorSize(elemSize, 1);
+  for (int i = 0; i < nv; i++) vs[i] = fromValues(elemSize, vals[i], sizes[i]);
+  size_t n = Vector_IntersectSorted(out, vs, nv), wrong = n != nexpected;
+  for (size_t i = 0; i < n && i < nexpected; i++) {
+    uint64_t x = elemSize == 4 ? ((uint32_t *)out->data)[i] : ((uint64_t *)out->data)[i];
+    wrong += x != expected[i];
+  }
+  for (int i = 0; i < nv; i++) Vector_Free(vs[i]);
+  Vector_Free(out);
+  return wrong;
+}
+
+int testVectorInPlace() {
+  // from the second vector on, the running result is intersected in place, and the SIMD kernel
+  // compares the same block of it against several blocks of the next vector
+  uint64_t a[] = {1, 3, 5, 8, 10, 11, 13, 16, 19, 21, 23, 24, 27, 30};
+  uint64_t b[] = {2, 4, 6, 9, 11, 14, 16, 19, 20, 21, 22};
+  uint64_t c[] = {1, 3, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 16, 18, 20};
+  uint64_t *vals[8] = {a, b, c};
+  size_t sizes[8] = {14, 11, 15};
+  uint64_t expected[1000] = {11, 16};
+  ASSERT_EQUAL(0, checkVectors(4, vals, sizes, 3, expected, 2));
+  ASSERT_EQUAL(0, checkVectors(8, vals, sizes, 3, expected, 2));
+
+  // random subsets of a small range, within the ratio the SIMD kernel is picked for, against
+  // the values found in all of them
+  srand(3);
+  for (int i = 0; i < 8; i++) vals[i] = malloc(1000 * sizeof(uint64_t));
+  size_t wrong = 0;
+  for (int round = 0; round < 200; round++) {
+    int nv = 3 + round % 6;
+    int count[1000] = {0};
+    for (int i = 0; i < nv; i++) {
+      // keep 1 value in 1 to 4
+      int keep = 1 + rand() % 4;
+      sizes[i] = 0;
+      for (uint64_t x = 0; x < 1000; x++) {
+        if (rand() % keep) continue;
+        vals[i][sizes[i]++] = x;
+        count[x]++;
+      }
+    }
+    size_t nexpected = 0;
+    for (uint64_t x = 0; x < 1000; x++) {
+      if (count[x] == nv) expected[nexpected++] = x;
+    }
+    wrong += checkVectors(4, vals, sizes, nv, expected, nexpected);
+    wrong += checkVectors(8, vals, sizes, nv, expected, nexpected);
+  }
+  for (int i = 0; i < 8; i++) free(vals[i]);
+  ASSERT_EQUAL(0, wrong);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testIntersect);
+  TESTFUNC(testUnion);
+  TESTFUNC(testVector);
+  TESTFUNC(testVectorInPlace);
+});
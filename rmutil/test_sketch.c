@@ -0,0 +1,255 @@
+#define REDISMODULE_MAIN
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <redismodule.h>
+#include "sketch.h"
+#include "test.h"
+
+/* A skewed stream: key i has about 1/(i+1) of the weight of key 0 */
+static uint32_t zipfKey(uint32_t numKeys) {
+  double u = (double)rand() / RAND_MAX;
+  return (uint32_t)(exp(u * log(numKeys + 1.0)) - 1);
+}
+
+int testCountMin() {
+  srand(1);
+  const uint32_t numKeys = 100000, n = 1000000;
+  uint32_t *truth = calloc(numKeys, sizeof(uint32_t));
+  RMUtilCountMin *a = RMUtilCountMin_NewForError(0.001, 0.01);
+  RMUtilCountMin *b = RMUtilCountMin_NewForError(0.001, 0.01);
+  ASSERT(RMUtilCountMin_MemUsage(a) < 64 * 1024);
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t key = zipfKey(numKeys);
+    truth[key]++;
+    RMUtilCountMin_AddHash(i % 2 ? a : b, RMUtilHash_U64(key), 1);
+  }
+  ASSERT_EQUAL(1, RMUtilCountMin_Merge(a, b));
+  ASSERT_EQUAL(n, RMUtilCountMin_Total(a));
+
+  // never below, and rarely more than eps * n above
+  size_t under = 0, over = 0;
+  for (uint32_t key = 0; key < numKeys; key++) {
+    uint32_t est = RMUtilCountMin_QueryHash(a, RMUtilHash_U64(key));
+    under += est < truth[key];
+    over += est > truth[key] + n * 0.001;
+  }
+  ASSERT_EQUAL(0, under);
+  ASSERT(over < numKeys / 100);
+
+  // conservative update estimates are exact for the heavy keys
+  RMUtilCountMin *c = RMUtilCountMin_NewForError(0.001, 0.01);
+  for (int i = 0; i < 100; i++) RMUtilCountMin_Add(c, "foo", 3, 2);
+  ASSERT_EQUAL(200, RMUtilCountMin_Query(c, "foo", 3));
+  ASSERT_EQUAL(0, RMUtilCountMin_Query(c, "bar", 3));
+
+  size_t len = RMUtilCountMin_SerializedSize(a);
+  char *buf = malloc(len);
+  RMUtilCountMin_Serialize(a, buf);
+  RMUtilCountMin *loaded = RMUtilCountMin_Deserialize(buf, len);
+  ASSERT(loaded != NULL);
+  size_t wrong = 0;
+  for (uint32_t key = 0; key < numKeys; key += 7) {
+    uint64_t h = RMUtilHash_U64(key);
+    wrong += RMUtilCountMin_QueryHash(a, h) != RMUtilCountMin_QueryHash(loaded, h);
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(n, RMUtilCountMin_Total(loaded));
+  ASSERT(RMUtilCountMin_Deserialize(buf, len - 1) == NULL);
+  free(buf);
+  RMUtilCountMin *small = RMUtilCountMin_New(10, 2);
+  ASSERT_EQUAL(0, RMUtilCountMin_Merge(c, small));
+  RMUtilCountMin_Free(small);
+
+  RMUtilCountMin_Free(loaded);
+  RMUtilCountMin_Free(a);
+  RMUtilCountMin_Free(b);
+  RMUtilCountMin_Free(c);
+  free(truth);
+  return 0;
+}
+
+static int closeTo(uint64_t est, uint64_t n, double err) {
+  return fabs((double)est - n) <= n * err + 1;
+}
+
+int testHLL() {
+  ASSERT(RMUtilHLL_New(3) == NULL);
+  ASSERT(RMUtilHLL_New(19) == NULL);
+
+  RMUtilHLL *h = RMUtilHLL_New(14);
+  ASSERT_EQUAL(0, RMUtilHLL_Count(h));
+  size_t sparseMem = 0;
+  uint64_t n = 0;
+  for (uint64_t target = 10; target <= 1000000; target *= 10) {
+    for (; n < target; n++) RMUtilHLL_AddHash(h, RMUtilHash_U64(n));
+    // the standard error is 0.8% at p = 14
+    ASSERT(closeTo(RMUtilHLL_Count(h), n, 0.03));
+    if (n == 1000) sparseMem = RMUtilHLL_MemUsage(h);
+  }
+  // 1000 keys are still sparse, 1M are dense
+  ASSERT(sparseMem < 1 << 14);
+  ASSERT(RMUtilHLL_MemUsage(h) >= 1 << 14);
+  // adding keys again changes nothing
+  ASSERT_EQUAL(0, RMUtilHLL_AddHash(h, RMUtilHash_U64(5)));
+  RMUtilHLL_Add(h, "foo", 3);
+  ASSERT_EQUAL(0, RMUtilHLL_Add(h, "foo", 3));
+  RMUtilHLL_Free(h);
+
+  // merges of sparse and dense sketches, overlapping by half
+  uint64_t sizes[] = {100, 3000, 100000};
+  for (int x = 0; x < 3; x++) {
+    for (int y = 0; y < 3; y++) {
+      RMUtilHLL *a = RMUtilHLL_New(14), *b = RMUtilHLL_New(14);
+      for (uint64_t i = 0; i < sizes[x]; i++) RMUtilHLL_AddHash(a, RMUtilHash_U64(i));
+      for (uint64_t i = sizes[x] / 2; i < sizes[x] / 2 + sizes[y]; i++) {
+        RMUtilHLL_AddHash(b, RMUtilHash_U64(i));
+      }
+      uint64_t expected = sizes[x] / 2 + (sizes[x] / 2 > sizes[y] ? sizes[x] / 2 : sizes[y]);
+      ASSERT_EQUAL(1, RMUtilHLL_Merge(a, b));
+      ASSERT(closeTo(RMUtilHLL_Count(a), expected, 0.03));
+
+      // round trip
+      size_t len = RMUtilHLL_SerializedSize(a);
+      char *buf = malloc(len);
+      RMUtilHLL_Serialize(a, buf);
+      RMUtilHLL *loaded = RMUtilHLL_Deserialize(buf, len);
+      ASSERT(loaded != NULL);
+      ASSERT_EQUAL(RMUtilHLL_Count(a), RMUtilHLL_Count(loaded));
+      ASSERT(RMUtilHLL_Deserialize(buf, len - 1) == NULL);
+      buf[0] = 20;
+      ASSERT(RMUtilHLL_Deserialize(buf, len) == NULL);
+      free(buf);
+      RMUtilHLL_Free(loaded);
+      RMUtilHLL_Free(a);
+      RMUtilHLL_Free(b);
+    }
+  }
+
+  // a sparse merge leaves dst with room for what was allocated, and it can keep adding
+  RMUtilHLL *a = RMUtilHLL_New(14), *b = RMUtilHLL_New(14);
+  for (uint64_t i = 0; i < 5; i++) {
+    RMUtilHLL_AddHash(a, RMUtilHash_U64(i));
+    RMUtilHLL_AddHash(b, RMUtilHash_U64(i + 5));
+  }
+  ASSERT_EQUAL(1, RMUtilHLL_Merge(a, b));
+  for (uint64_t i = 10; i < 20; i++) RMUtilHLL_AddHash(a, RMUtilHash_U64(i));
+  ASSERT_EQUAL(20, RMUtilHLL_Count(a));
+  RMUtilHLL_Free(a);
+  RMUtilHLL_Free(b);
+
+  a = RMUtilHLL_New(10), b = RMUtilHLL_New(12);
+  ASSERT_EQUAL(0, RMUtilHLL_Merge(a, b));
+  RMUtilHLL_Free(a);
+  RMUtilHLL_Free(b);
+  return 0;
+}
+
+/* Feed n events to tk: 10 heavy keys getting 2% of them each, and many light ones */
+static void feedTopK(RMUtilTopK *tk, int n) {
+  char key[32];
+  for (int i = 0; i < n; i++) {
+    int r = rand() % 100;
+    if (r < 20) {
+      sprintf(key, "heavy:%d", r / 2);
+    } else {
+      sprintf(key, "light:%d", rand() % 100000);
+    }
+    RMUtilTopK_Add(tk, key, strlen(key));
+  }
+}
+
+static int countHeavy(const RMUtilTopK *tk) {
+  RMUtilTopKItem items[10];
+  size_t n = RMUtilTopK_List(tk, items), heavy = 0;
+  for (size_t i = 0; i < n; i++) {
+    heavy += !strncmp(items[i].key, "heavy:", 6);
+    if (i && items[i].count > items[i - 1].count) return -1;
+  }
+  return heavy;
+}
+
+int testTopK() {
+  srand(3);
+  ASSERT(RMUtilTopK_New(10, 100, 4, 1.5) == NULL);
+  RMUtilTopK *a = RMUtilTopK_New(10, 80, 4, 0.9), *b = RMUtilTopK_New(10, 80, 4, 0.9);
+  feedTopK(a, 200000);
+  ASSERT_EQUAL(10, countHeavy(a));
+  ASSERT_EQUAL(1, RMUtilTopK_Query(a, "heavy:3", 7));
+  ASSERT_EQUAL(0, RMUtilTopK_Query(a, "light:3", 7));
+  // each heavy key got about 4000 events
+  uint32_t count = RMUtilTopK_Count(a, "heavy:3", 7);
+  ASSERT(count > 3500 && count < 4500);
+
+  feedTopK(b, 200000);
+  ASSERT_EQUAL(1, RMUtilTopK_Merge(a, b));
+  ASSERT_EQUAL(10, countHeavy(a));
+  count = RMUtilTopK_Count(a, "heavy:3", 7);
+  ASSERT(count > 7000 && count < 9000);
+
+  size_t len = RMUtilTopK_SerializedSize(a);
+  char *buf = malloc(len);
+  RMUtilTopK_Serialize(a, buf);
+  RMUtilTopK *loaded = RMUtilTopK_Deserialize(buf, len);
+  ASSERT(loaded != NULL);
+  RMUtilTopKItem items[10], loadedItems[10];
+  ASSERT_EQUAL(10, RMUtilTopK_List(a, items));
+  ASSERT_EQUAL(10, RMUtilTopK_List(loaded, loadedItems));
+  size_t wrong = 0;
+  for (int i = 0; i < 10; i++) {
+    wrong += items[i].count != loadedItems[i].count;
+    wrong += RMUtilTopK_Query(loaded, items[i].key, items[i].len) != 1;
+  }
+  ASSERT_EQUAL(0, wrong);
+  ASSERT_EQUAL(RMUtilTopK_Count(a, "heavy:3", 7), RMUtilTopK_Count(loaded, "heavy:3", 7));
+  ASSERT(RMUtilTopK_Deserialize(buf, len - 1) == NULL);
+  ASSERT(RMUtilTopK_Deserialize(buf, 10) == NULL);
+  free(buf);
+
+  // dimensions whose size overflows, and a k past the number of buckets
+  unsigned char huge[32] = {0};
+  huge[0] = 1;
+  huge[7] = 0x80;  // width 2^31
+  huge[11] = 0x40; // depth 2^30
+  memcpy(huge + 12, &(double){0.9}, 8);
+  ASSERT(RMUtilTopK_Deserialize((char *)huge, sizeof(huge)) == NULL);
+  memset(huge + 4, 0, 8);
+  huge[3] = 0x40; // k 2^30
+  huge[4] = huge[8] = 1;
+  ASSERT(RMUtilTopK_Deserialize((char *)huge, sizeof(huge)) == NULL);
+  huge[3] = 0;
+  RMUtilTopK *tiny = RMUtilTopK_Deserialize((char *)huge, sizeof(huge));
+  ASSERT(tiny != NULL);
+  RMUtilTopK_Free(tiny);
+  ASSERT(RMUtilTopK_New(5, 2, 2, 0.9) == NULL);
+
+  RMUtilTopK *c = RMUtilTopK_New(5, 80, 4, 0.9);
+  ASSERT_EQUAL(0, RMUtilTopK_Merge(a, c));
+  RMUtilTopK_Free(c);
+  RMUtilTopK_Free(loaded);
+  RMUtilTopK_Free(a);
+  RMUtilTopK_Free(b);
+  return 0;
+}
+
+/* Add agrees with Query, also for top keys whose buckets were taken over by other keys */
+int testTopKDecayedKeys() {
+  RMUtilTopK *tk = RMUtilTopK_New(4, 4, 1, 0.9);
+  char key[32];
+  int mismatches = 0;
+  for (int i = 0; i < 100000; i++) {
+    int len = sprintf(key, "key:%d", rand() % (i % 1000 < 500 ? 4 : 1000));
+    mismatches += RMUtilTopK_Add(tk, key, len) != RMUtilTopK_Query(tk, key, len);
+  }
+  ASSERT_EQUAL(0, mismatches);
+  RMUtilTopK_Free(tk);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testCountMin);
+  TESTFUNC(testHLL);
+  TESTFUNC(testTopK);
+  TESTFUNC(testTopKDecayedKeys);
+});
@@ -0,0 +1,73 @@
+#define REDISMODULE_MAIN
+#include <stdio.h>
+#include <redismodule.h>
+#include "threadpool.h"
+#include "test.h"
+
+static RMUtilThreadPool *pool;
+static long long counter = 0;
+
+void incrJob(void *arg) {
+  __atomic_add_fetch(&counter, (long long)(intptr_t)arg, __ATOMIC_SEQ_CST);
+}
+
+/* Recursively split a range into sub-jobs, adding one for each leaf */
+typedef struct {
+  int from, to;
+} rangeArg;
+
+void splitJob(void *arg) {
+  rangeArg *r = arg;
+  if (r->to - r->from <= 1) {
+    __atomic_add_fetch(&counter, r->to - r->from, __ATOMIC_SEQ_CST);
+  } else {
+    int mid = (r->from + r->to) / 2;
+    rangeArg *left = malloc(sizeof(*left)), *right = malloc(sizeof(*right));
+    *left = (rangeArg){r->from, mid};
+    *right = (rangeArg){mid, r->to};
+    RMUtilThreadPool_Submit(pool, splitJob, left);
+    RMUtilThreadPool_Submit(pool, splitJob, right);
+  }
+  free(r);
+}
+
+int testThreadPool() {
+  pool = RMUtilThreadPool_New(&(RMUtilThreadPoolOptions){.numThreads = 4});
+  ASSERT(pool != NULL);
+  ASSERT_EQUAL(4, RMUtilThreadPool_NumThreads(pool));
+  ASSERT_EQUAL(-1, RMUtilThreadPool_WorkerIndex(pool));
+
+  for (int i = 0; i < 10000; i++) {
+    ASSERT_EQUAL(REDISMODULE_OK, RMUtilThreadPool_Submit(pool, incrJob, (void *)(intptr_t)1));
+  }
+  RMUtilThreadPool_Wait(pool);
+  ASSERT_EQUAL(10000, counter);
+
+  // jobs submitted from within jobs go through the workers' deques and get stolen
+  counter = 0;
+  rangeArg *r = malloc(sizeof(*r));
+  *r = (rangeArg){0, 100000};
+  RMUtilThreadPool_Submit(pool, splitJob, r);
+  RMUtilThreadPool_Wait(pool);
+  ASSERT_EQUAL(100000, counter);
+
+  RMUtilThreadPool_Free(pool);
+  return 0;
+}
+
+int testThreadPoolShutdown() {
+  // pending jobs are all run before the pool is freed
+  counter = 0;
+  pool = RMUtilThreadPool_New(&(RMUtilThreadPoolOptions){.numThreads = 2, .pinThreads = 1});
+  for (int i = 0; i < 1000; i++) {
+    RMUtilThreadPool_Submit(pool, incrJob, (void *)(intptr_t)2);
+  }
+  RMUtilThreadPool_Free(pool);
+  ASSERT_EQUAL(2000, counter);
+  return 0;
+}
+
+TEST_MAIN({
+  TESTFUNC(testThreadPool);
+  TESTFUNC(testThreadPoolShutdown);
+});
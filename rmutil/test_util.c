@@ -0,0 +1,147 @@
+#define REDISMODULE_MAIN
+#define REDISMODULE_SDK_RLEC
+#include <stdlib.h>
+#include <string.h>
+#include <redismodule.h>
+#include "mock_redis.h"
+#include "util.h"
+#include "test.h"
+
+static RedisModuleType *testType;
+static int readyCalls, keysOnSwap, privdataFreed;
+
+static void testFreePrivdata(void *p) {
+  privdataFreed++;
+  free(p);
+}
+
+/* Reply with the value of each key, or the status of the keys that don't hold one */
+static int testMGetReady(RedisModuleCtx *ctx, RedisModuleString **keynames, size_t n, void *pd) {
+  readyCalls++;
+  for (size_t i = 0; i < n; i++) keysOnSwap += !RedisModule_IsKeyInRam(ctx, keynames[i]);
+
+  RedisModuleKey *keys[n];
+  void *values[n];
+  int statuses[n];
+  RMUtil_OpenKeysWithType(ctx, keynames, n, NULL, testType, keys, values, statuses);
+  RedisModule_ReplyWithArray(ctx, n);
+  for (size_t i = 0; i < n; i++) {
+    if (statuses[i] == RMUTIL_VALUE_OK) {
+      RedisModule_ReplyWithLongLong(ctx, *(long long *)values[i]);
+    } else {
+      RedisModule_ReplyWithLongLong(ctx, -statuses[i]);
+    }
+  }
+  RMUtil_CloseKeys(keys, n);
+  return REDISMODULE_OK;
+}
+
+/* TEST.MGET <key> ... */
+static int testMGetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 2) return RedisModule_WrongArity(ctx);
+  return RMUtil_WhenKeysInRam(ctx, argv + 1, argc - 1, testMGetReady, malloc(1),
+                              testFreePrivdata);
+}
+
+/* TEST.SET <key> <n> */
+static int testSetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 3) return RedisModule_WrongArity(ctx);
+  long long *v = malloc(sizeof(*v));
+  RedisModule_StringToLongLong(argv[2], v);
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+  RedisModule_ModuleTypeSetValue(key, testType, v);
+  RedisModule_CloseKey(key);
+  return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+static int testOnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (RedisModule_Init(ctx, "testutil", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+  RedisModuleTypeMethods tm = {.version = REDISMODULE_TYPE_METHOD_VERSION, .free = free};
+  testType = RedisModule_CreateDataType(ctx, "test-type", 0, &tm);
+  if (testType == NULL) return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "test.set", testSetCommand, "write", 1, 1, 1) ==
+      REDISMODULE_ERR) {
+    return REDISMODULE_ERR;
+  }
+  return RedisModule_CreateCommand(ctx, "test.mget", testMGetCommand, "readonly", 1, -1, 1);
+}
+
+/* Check a TEST.MGET reply of foo, a missing key, bar and a string */
+static int checkReply(RedisModuleCallReply *r) {
+  ASSERT_EQUAL(REDISMODULE_REPLY_ARRAY, RedisModule_CallReplyType(r));
+  ASSERT_EQUAL(4, RedisModule_CallReplyLength(r));
+  long long expected[] = {1, -RMUTIL_VALUE_MISSING, 2, -RMUTIL_VALUE_MISMATCH};
+  for (size_t i = 0; i < 4; i++) {
+    RedisModuleCallReply *e = RedisModule_CallReplyArrayElement(r, i);
+    ASSERT_EQUAL(expected[i], RedisModule_CallReplyInteger(e));
+  }
+  RedisModule_FreeCallReply(r);
+  return 0;
+}
+
+static void setup() {
+  RMUtilMock_FlushAll();
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.set", "cc", "foo", "1"));
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.set", "cc", "bar", "2"));
+  RedisModule_FreeCallReply(RMUtilMock_Call("set", "cc", "str", "x"));
+  readyCalls = keysOnSwap = privdataFreed = 0;
+}
+
+int testKeysInRam() {
+  setup();
+  if (checkReply(RMUtilMock_Call("test.mget", "cccc", "foo", "nokey", "bar", "str"))) return -1;
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+  ASSERT_EQUAL(1, readyCalls);
+  ASSERT_EQUAL(1, privdataFreed);
+  return 0;
+}
+
+int testKeysOnSwap() {
+  setup();
+  ASSERT_EQUAL(1, RMUtilMock_SwapOut("foo"));
+  ASSERT_EQUAL(1, RMUtilMock_SwapOut("bar"));
+
+  // the client waits for both keys to be loaded, and is then replied to
+  RedisModuleCallReply *r = RMUtilMock_Call("test.mget", "cccc", "foo", "nokey", "bar", "str");
+  ASSERT_EQUAL(REDISMODULE_REPLY_NULL, RedisModule_CallReplyType(r));
+  RedisModule_FreeCallReply(r);
+  ASSERT_EQUAL(1, RMUtilMock_BlockedClients());
+  ASSERT_EQUAL(0, readyCalls);
+  ASSERT(RMUtilMock_ProcessEvents() > 0);
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+  ASSERT_EQUAL(1, readyCalls);
+  ASSERT_EQUAL(0, keysOnSwap);
+  ASSERT_EQUAL(1, privdataFreed);
+  if (checkReply(RMUtilMock_PopReply())) return -1;
+  ASSERT(RMUtilMock_PopReply() == NULL);
+
+  // once loaded, they are read right away
+  if (checkReply(RMUtilMock_Call("test.mget", "cccc", "foo", "nokey", "bar", "str"))) return -1;
+  ASSERT_EQUAL(2, readyCalls);
+  return 0;
+}
+
+int testDisconnectWhileLoading() {
+  setup();
+  RMUtilMock_SwapOut("bar");
+  RedisModule_FreeCallReply(RMUtilMock_Call("test.mget", "cccc", "foo", "nokey", "bar", "str"));
+  ASSERT_EQUAL(1, RMUtilMock_DisconnectClients());
+  ASSERT(RMUtilMock_ProcessEvents() > 0);
+  ASSERT_EQUAL(0, RMUtilMock_BlockedClients());
+  ASSERT_EQUAL(0, readyCalls);
+  ASSERT_EQUAL(1, privdataFreed);
+  ASSERT(RMUtilMock_PopReply() == NULL);
+  return 0;
+}
+
+TEST_MAIN({
+  if (RMUtilMock_LoadModule(testOnLoad, NULL, 0) != REDISMODULE_OK) {
+    printf("Failed loading the test module\n");
+    return 1;
+  }
+  TESTFUNC(testKeysInRam);
+  TESTFUNC(testKeysOnSwap);
+  TESTFUNC(testDisconnectWhileLoading);
+});
@@ -0,0 +1,383 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "threadpool.h"
+#include "alloc.h"
+
+typedef struct tpJob {
+  RMUtilThreadPoolFunc func;
+  void *arg;
+  RedisModuleBlockedClient *bc;
+  struct tpJob *next;  // link in the injection queue
+} tpJob;
+
+/* A Chase-Lev work-stealing deque (Le et al., "Correct and Efficient Work-Stealing for Weak
+ * Memory Models"). The owner pushes and takes at the bottom, thieves steal from the top */
+typedef struct tpArray {
+  int64_t size;
+  struct tpArray *retired;  // arrays replaced by a resize, freed with the deque
+  tpJob *buf[];
+} tpArray;
+
+typedef struct {
+  int64_t top;
+  char __pad1[64 - sizeof(int64_t)];
+  int64_t bottom;
+  char __pad2[64 - sizeof(int64_t)];
+  tpArray *array;
+} tpDeque;
+
+typedef struct {
+  RMUtilThreadPool *pool;
+  int index;
+  pthread_t thread;
+  uint32_t seed;
+  tpDeque deque;
+} tpWorker;
+
+struct RMUtilThreadPool {
+  int numThreads;
+  tpWorker *workers;
+
+  // injection queue for jobs submitted from outside the pool
+  pthread_mutex_t lock;
+  tpJob *head, *tail;
+
+  // sleeping workers wait on wakeup, RMUtilThreadPool_Wait waits on done
+  pthread_cond_t wakeup;
+  pthread_cond_t done;
+  int sleeping;
+
+  int64_t queued;       // jobs in the queues, not yet taken
+  int64_t outstanding;  // jobs submitted and not yet finished
+  int shutdown;
+};
+
+static __thread tpWorker *currentWorker = NULL;
+
+#define TP_STEAL_ABORT ((tpJob *)1)
+
+static tpArray *tpArray_New(int64_t size) {
+  tpArray *a = malloc(sizeof(*a) + size * sizeof(tpJob *));
+  a->size = size;
+  a->retired = NULL;
+  return a;
+}
+
+static void tpDeque_Init(tpDeque *q) {
+  q->top = q->bottom = 0;
+  q->array = tpArray_New(64);
+}
+
+static void tpDeque_Free(tpDeque *q) {
+  tpArray *a = q->array;
+  while (a) {
+    tpArray *next = a->retired;
+    free(a);
+    a = next;
+  }
+}
+
+static tpArray *tpDeque_Grow(tpDeque *q, tpArray *a, int64_t top, int64_t bottom) {
+  tpArray *n = tpArray_New(a->size * 2);
+  for (int64_t i = top; i < bottom; i++) {
+    n->buf[i & (n->size - 1)] = a->buf[i & (a->size - 1)];
+  }
+  // thieves may still be reading from the old array, so keep it around until the deque is freed
+  n->retired = a;
+  __atomic_store_n(&q->array, n, __ATOMIC_RELEASE);
+  return n;
+}
+
+/* Owner only */
+static void tpDeque_Push(tpDeque *q, tpJob *job) {
+  int64_t b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED);
+  int64_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+  tpArray *a = __atomic_load_n(&q->array, __ATOMIC_RELAXED);
+  if (b - t > a->size - 1) {
+    a = tpDeque_Grow(q, a, t, b);
+  }
+  __atomic_store_n(&a->buf[b & (a->size - 1)], job, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+/* Owner only */
+static tpJob *tpDeque_Take(tpDeque *q) {
+  int64_t b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED) - 1;
+  tpArray *a = __atomic_load_n(&q->array, __ATOMIC_RELAXED);
+  __atomic_store_n(&q->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t t = __atomic_load_n(&q->top, __ATOMIC_RELAXED);
+
+  tpJob *job = NULL;
+  if (t <= b) {
+    job = __atomic_load_n(&a->buf[b & (a->size - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+      // last element, race against the thieves for it
+      if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST,
+                                       __ATOMIC_RELAXED)) {
+        job = NULL;
+      }
+      __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  } else {
+    __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return job;
+}
+
+/* Any thread. Returns NULL if empty, TP_STEAL_ABORT if we lost a race and should retry */
+static tpJob *tpDeque_Steal(tpDeque *q) {
+  int64_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t b = __atomic_load_n(&q->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b) return NULL;
+
+  tpArray *a = __atomic_load_n(&q->array, __ATOMIC_ACQUIRE);
+  tpJob *job = __atomic_load_n(&a->buf[t & (a->size - 1)], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return TP_STEAL_ABORT;
+  }
+  return job;
+}
+
+static tpJob *tp_popInjected(RMUtilThreadPool *p) {
+  if (__atomic_load_n(&p->head, __ATOMIC_RELAXED) == NULL) return NULL;
+  pthread_mutex_lock(&p->lock);
+  tpJob *job = p->head;
+  if (job) {
+    __atomic_store_n(&p->head, job->next, __ATOMIC_RELAXED);
+    if (p->head == NULL) p->tail = NULL;
+  }
+  pthread_mutex_unlock(&p->lock);
+  return job;
+}
+
+static tpJob *tp_steal(RMUtilThreadPool *p, tpWorker *self) {
+  uint32_t x = self ? self->seed : (uint32_t)(uintptr_t)&x;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  if (self) self->seed = x;
+
+  int n = p->numThreads;
+  int retry;
+  do {
+    retry = 0;
+    for (int i = 0; i < n; i++) {
+      tpWorker *victim = &p->workers[(x + i) % n];
+      if (victim == self) continue;
+      tpJob *job = tpDeque_Steal(&victim->deque);
+      if (job == TP_STEAL_ABORT) {
+        retry = 1;
+      } else if (job) {
+        return job;
+      }
+    }
+  } while (retry);
+  return NULL;
+}
+
+/* Find the next job for the calling thread: its own deque, then the injection queue, then the
+ * other workers' deques */
+static tpJob *tp_findJob(RMUtilThreadPool *p, tpWorker *self) {
+  tpJob *job = NULL;
+  if (self) job = tpDeque_Take(&self->deque);
+  if (!job) job = tp_popInjected(p);
+  if (!job) job = tp_steal(p, self);
+  if (job) __atomic_sub_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+  return job;
+}
+
+static void tp_runJob(RMUtilThreadPool *p, tpJob *job) {
+  job->func(job->arg);
+  if (job->bc) {
+    RedisModule_UnblockClient(job->bc, job->arg);
+  }
+  free(job);
+
+  if (__atomic_sub_fetch(&p->outstanding, 1, __ATOMIC_SEQ_CST) == 0) {
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_broadcast(&p->done);
+    pthread_mutex_unlock(&p->lock);
+  }
+}
+
+static void *tp_workerLoop(void *arg) {
+  tpWorker *w = arg;
+  RMUtilThreadPool *p = w->pool;
+  currentWorker = w;
+
+  for (;;) {
+    tpJob *job = tp_findJob(p, w);
+    if (job) {
+      tp_runJob(p, job);
+      continue;
+    }
+
+    // a job may be in flight between being counted and being pushed, spin a little before sleeping
+    if (__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) > 0) {
+      sched_yield();
+      continue;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    while (__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0 && !p->shutdown) {
+      __atomic_add_fetch(&p->sleeping, 1, __ATOMIC_SEQ_CST);
+      pthread_cond_wait(&p->wakeup, &p->lock);
+      __atomic_sub_fetch(&p->sleeping, 1, __ATOMIC_SEQ_CST);
+    }
+    int exiting = p->shutdown && __atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0;
+    pthread_mutex_unlock(&p->lock);
+    if (exiting) break;
+  }
+  return NULL;
+}
+
+static void tp_pinThread(tpWorker *w, const RMUtilThreadPoolOptions *opts) {
+#ifdef __linux__
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int cpu = opts->cpus && opts->numCpus > 0 ? opts->cpus[w->index % opts->numCpus]
+                                            : (int)(w->index % (ncpus > 0 ? ncpus : 1));
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(w->thread, sizeof(set), &set);
+#endif
+}
+
+RMUtilThreadPool *RMUtilThreadPool_New(const RMUtilThreadPoolOptions *opts) {
+  RMUtilThreadPoolOptions defaults = {0};
+  if (opts == NULL) opts = &defaults;
+
+  RMUtilThreadPool *p = calloc(1, sizeof(*p));
+  p->numThreads = opts->numThreads;
+  if (p->numThreads <= 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    p->numThreads = n > 0 ? (int)n : 1;
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->wakeup, NULL);
+  pthread_cond_init(&p->done, NULL);
+
+  p->workers = calloc(p->numThreads, sizeof(tpWorker));
+  for (int i = 0; i < p->numThreads; i++) {
+    tpWorker *w = &p->workers[i];
+    w->pool = p;
+    w->index = i;
+    w->seed = 2463534242u + i * 7919;
+    tpDeque_Init(&w->deque);
+  }
+  for (int i = 0; i < p->numThreads; i++) {
+    pthread_create(&p->workers[i].thread, NULL, tp_workerLoop, &p->workers[i]);
+    if (opts->pinThreads) tp_pinThread(&p->workers[i], opts);
+  }
+  return p;
+}
+
+int RMUtilThreadPool_NumThreads(RMUtilThreadPool *p) {
+  return p->numThreads;
+}
+
+int RMUtilThreadPool_WorkerIndex(RMUtilThreadPool *p) {
+  return currentWorker && currentWorker->pool == p ? currentWorker->index : -1;
+}
+
+static int tp_submitJob(RMUtilThreadPool *p, tpJob *job) {
+  int fromWorker = currentWorker && currentWorker->pool == p;
+  // jobs running during shutdown may still split into sub-jobs, only outside callers are refused
+  if (!fromWorker && __atomic_load_n(&p->shutdown, __ATOMIC_RELAXED)) {
+    free(job);
+    return REDISMODULE_ERR;
+  }
+  __atomic_add_fetch(&p->outstanding, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+
+  if (fromWorker) {
+    tpDeque_Push(&currentWorker->deque, job);
+    // sleepers check queued and wait under the lock, so sleeping can only be trusted under it
+    pthread_mutex_lock(&p->lock);
+    if (p->sleeping) pthread_cond_signal(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    return REDISMODULE_OK;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  job->next = NULL;
+  if (p->tail) {
+    p->tail->next = job;
+  } else {
+    __atomic_store_n(&p->head, job, __ATOMIC_RELAXED);
+  }
+  p->tail = job;
+  if (p->sleeping) pthread_cond_signal(&p->wakeup);
+  pthread_mutex_unlock(&p->lock);
+  return REDISMODULE_OK;
+}
+
+int RMUtilThreadPool_Submit(RMUtilThreadPool *p, RMUtilThreadPoolFunc func, void *arg) {
+  tpJob *job = malloc(sizeof(*job));
+  *job = (tpJob){.func = func, .arg = arg};
+  return tp_submitJob(p, job);
+}
+
+int RMUtilThreadPool_SubmitBlocking(RMUtilThreadPool *p, RedisModuleCtx *ctx,
+                                    RMUtilThreadPoolFunc work, void *arg,
+                                    RedisModuleCmdFunc reply_callback,
+                                    RedisModuleCmdFunc timeout_callback,
+                                    void (*free_privdata)(RedisModuleCtx *, void *),
+                                    long long timeout_ms) {
+  RedisModuleBlockedClient *bc =
+      RedisModule_BlockClient(ctx, reply_callback, timeout_callback, free_privdata, timeout_ms);
+  if (bc == NULL) {
+    return REDISMODULE_ERR;
+  }
+
+  tpJob *job = malloc(sizeof(*job));
+  *job = (tpJob){.func = work, .arg = arg, .bc = bc};
+  if (tp_submitJob(p, job) == REDISMODULE_ERR) {
+    RedisModule_AbortBlock(bc);
+    return REDISMODULE_ERR;
+  }
+  return REDISMODULE_OK;
+}
+
+void RMUtilThreadPool_Wait(RMUtilThreadPool *p) {
+  pthread_mutex_lock(&p->lock);
+  while (__atomic_load_n(&p->outstanding, __ATOMIC_SEQ_CST) > 0) {
+    pthread_cond_wait(&p->done, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+int RMUtilThreadPool_RunPending(RMUtilThreadPool *p) {
+  tpWorker *self = currentWorker && currentWorker->pool == p ? currentWorker : NULL;
+  tpJob *job = tp_findJob(p, self);
+  if (job == NULL) return 0;
+  tp_runJob(p, job);
+  return 1;
+}
+
+void RMUtilThreadPool_Free(RMUtilThreadPool *p) {
+  pthread_mutex_lock(&p->lock);
+  __atomic_store_n(&p->shutdown, 1, __ATOMIC_RELAXED);
+  pthread_cond_broadcast(&p->wakeup);
+  pthread_mutex_unlock(&p->lock);
+
+  for (int i = 0; i < p->numThreads; i++) {
+    pthread_join(p->workers[i].thread, NULL);
+  }
+  for (int i = 0; i < p->numThreads; i++) {
+    tpDeque_Free(&p->workers[i].deque);
+  }
+  free(p->workers);
+  pthread_cond_destroy(&p->wakeup);
+  pthread_cond_destroy(&p->done);
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+}
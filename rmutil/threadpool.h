@@ -0,0 +1,73 @@
+#ifndef __RMUTIL_THREADPOOL_H__
+#define __RMUTIL_THREADPOOL_H__
+
+#include <redismodule.h>
+
+/** threadpool.h - a work-stealing thread pool for offloading work from the main thread.
+ *
+ * Each worker owns a deque of jobs. Jobs submitted by a worker (e.g. a job splitting itself into
+ * sub-jobs) go to the bottom of that worker's deque, and the worker pops them back LIFO. Jobs
+ * submitted from any other thread (usually the redis main thread) go to a shared injection queue.
+ * An idle worker first drains its own deque, then the injection queue, and then steals the oldest
+ * jobs from the top of the other workers' deques, so load spreads without a central bottleneck.
+ *
+ * RMUtilThreadPool_SubmitBlocking ties a job to a blocked client: the client is blocked, the job
+ * runs on the pool, and the client is unblocked with the job's argument as its private data, so
+ * the reply callback can send the result from the main thread.
+ */
+
+/* RMUtilThreadPoolFunc - a job to run on the pool */
+typedef void (*RMUtilThreadPoolFunc)(void *arg);
+
+/* RMUtilThreadPool - opaque thread pool */
+typedef struct RMUtilThreadPool RMUtilThreadPool;
+
+typedef struct {
+  /* Number of worker threads. 0 means the number of online CPUs */
+  int numThreads;
+  /* If set, pin worker i to CPU cpus[i % numCpus], or to CPU i % <online CPUs> if cpus is NULL.
+   * Only supported on linux, ignored elsewhere */
+  int pinThreads;
+  const int *cpus;
+  int numCpus;
+} RMUtilThreadPoolOptions;
+
+/* Create and start a new pool. opts may be NULL for the defaults */
+RMUtilThreadPool *RMUtilThreadPool_New(const RMUtilThreadPoolOptions *opts);
+
+/* Return the number of worker threads of the pool */
+int RMUtilThreadPool_NumThreads(RMUtilThreadPool *p);
+
+/* Return the index of the calling worker thread in the pool, or -1 if the caller is not one of
+ * the pool's workers */
+int RMUtilThreadPool_WorkerIndex(RMUtilThreadPool *p);
+
+/* Submit a job to run func(arg) on the pool. Can be called from any thread, including from
+ * within a job. Returns REDISMODULE_ERR if the pool is shutting down */
+int RMUtilThreadPool_Submit(RMUtilThreadPool *p, RMUtilThreadPoolFunc func, void *arg);
+
+/* Block the calling client, run work(arg) on the pool, and then unblock the client with arg as
+ * its private data. The callbacks and timeout are those of RedisModule_BlockClient. Call it from
+ * a command handler, which should then return REDISMODULE_OK without replying.
+ * Returns REDISMODULE_ERR if the client could not be blocked or the pool is shutting down, in
+ * which case the client is not left blocked */
+int RMUtilThreadPool_SubmitBlocking(RMUtilThreadPool *p, RedisModuleCtx *ctx,
+                                    RMUtilThreadPoolFunc work, void *arg,
+                                    RedisModuleCmdFunc reply_callback,
+                                    RedisModuleCmdFunc timeout_callback,
+                                    void (*free_privdata)(RedisModuleCtx *, void *),
+                                    long long timeout_ms);
+
+/* Wait until all the jobs submitted so far, and the jobs they submitted, have finished. Must not
+ * be called from one of the pool's own workers */
+void RMUtilThreadPool_Wait(RMUtilThreadPool *p);
+
+/* Run a single pending job on the calling thread, if there is one. Returns 1 if a job was run.
+ * Useful for workers waiting on sub-jobs, which should help instead of blocking */
+int RMUtilThreadPool_RunPending(RMUtilThreadPool *p);
+
+/* Stop accepting new jobs, let the workers finish all the pending ones, join them and free the
+ * pool. Must not be called from one of the pool's own workers */
+void RMUtilThreadPool_Free(RMUtilThreadPool *p);
+
+#endif
@@ -251,6 +251,126 @@ int RedisModule_TryGetValue(RedisModuleKey *key, const RedisModuleType *type, vo
   }
 }
 
+#ifdef REDISMODULE_SDK_RLEC
+/* A client blocked until the keys it needs are loaded from swap */
+typedef struct {
+  RedisModuleBlockedClient *bc;
+  RedisModuleString **keynames;
+  size_t n;
+  size_t pending;
+  RMUtilKeysReadyFunc ready;
+  void *privdata;
+  void (*freePrivdata)(void *);
+} rmutilKeysWait;
+
+static int rmutil_keysWaitReply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  rmutilKeysWait *w = RedisModule_GetBlockedClientPrivateData(ctx);
+  return w->ready(ctx, w->keynames, w->n, w->privdata);
+}
+
+static void rmutil_keysWaitFree(RedisModuleCtx *ctx, void *p) {
+  rmutilKeysWait *w = p;
+  for (size_t i = 0; i < w->n; i++) {
+    RedisModule_FreeString(NULL, w->keynames[i]);
+  }
+  free(w->keynames);
+  if (w->freePrivdata && w->privdata) w->freePrivdata(w->privdata);
+  free(w);
+}
+
+/* The client is unblocked by the last prefetch to complete, even if it disconnected meanwhile, so
+ * the wait state outlives all the callbacks */
+static void rmutil_prefetchDone(RedisModuleCtx *ctx, RedisModuleString *key, void *user_data) {
+  rmutilKeysWait *w = user_data;
+  if (--w->pending == 0) {
+    RedisModule_UnblockClient(w->bc, w);
+  }
+}
+
+/* Prefetch the keys that are on swap, and block the client until all of them are in RAM. Returns 0
+ * if there is nothing to wait for */
+static int rmutil_waitForKeys(RedisModuleCtx *ctx, RedisModuleString **keynames, size_t n,
+                              RMUtilKeysReadyFunc ready, void *privdata,
+                              void (*freePrivdata)(void *)) {
+  if (RedisModule_SwapPrefetchKey == NULL || RedisModule_IsKeyInRam == NULL ||
+      RedisModule_BlockClient == NULL) {
+    return 0;
+  }
+  if (RedisModule_GetContextFlags &&
+      (RedisModule_GetContextFlags(ctx) & (REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA |
+                                           REDISMODULE_CTX_FLAGS_DENY_BLOCKING))) {
+    return 0;
+  }
+  size_t missing = 0;
+  for (size_t i = 0; i < n; i++) {
+    missing += !RedisModule_IsKeyInRam(ctx, keynames[i]);
+  }
+  if (missing == 0) {
+    return 0;
+  }
+
+  rmutilKeysWait *w = calloc(1, sizeof(*w));
+  *w = (rmutilKeysWait){.n = n, .ready = ready, .privdata = privdata, .freePrivdata = freePrivdata};
+  w->bc = RedisModule_BlockClient(ctx, rmutil_keysWaitReply, NULL, rmutil_keysWaitFree, 0);
+  if (w->bc == NULL) {
+    free(w);
+    return 0;
+  }
+  w->keynames = malloc(n * sizeof(*w->keynames));
+  for (size_t i = 0; i < n; i++) {
+    RedisModule_RetainString(NULL, keynames[i]);
+    w->keynames[i] = keynames[i];
+  }
+
+  // hold a reference while issuing, in case a prefetch completes right away
+  w->pending = 1;
+  for (size_t i = 0; i < n; i++) {
+    if (!RedisModule_IsKeyInRam(ctx, keynames[i]) &&
+        RedisModule_SwapPrefetchKey(ctx, keynames[i], rmutil_prefetchDone, w, 0) ==
+            REDISMODULE_OK) {
+      w->pending++;
+    }
+  }
+  rmutil_prefetchDone(ctx, NULL, w);
+  return 1;
+}
+#endif
+
+int RMUtil_WhenKeysInRam(RedisModuleCtx *ctx, RedisModuleString **keynames, size_t n,
+                         RMUtilKeysReadyFunc ready, void *privdata, void (*freePrivdata)(void *)) {
+#ifdef REDISMODULE_SDK_RLEC
+  if (rmutil_waitForKeys(ctx, keynames, n, ready, privdata, freePrivdata)) {
+    return REDISMODULE_OK;
+  }
+#endif
+  int rc = ready(ctx, keynames, n, privdata);
+  if (freePrivdata && privdata) freePrivdata(privdata);
+  return rc;
+}
+
+size_t RMUtil_OpenKeysWithType(RedisModuleCtx *ctx, RedisModuleString **keynames, size_t n,
+                               const int *modes, const RedisModuleType *type, RedisModuleKey **keys,
+                               void **values, int *statuses) {
+  size_t found = 0;
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = RedisModule_OpenKey(ctx, keynames[i], modes ? modes[i] : REDISMODULE_READ);
+    values[i] = NULL;
+    statuses[i] = RedisModule_TryGetValue(keys[i], type, &values[i]);
+    if (statuses[i] == RMUTIL_VALUE_OK) {
+      found++;
+    }
+  }
+  return found;
+}
+
+void RMUtil_CloseKeys(RedisModuleKey **keys, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (keys[i] != NULL) {
+      RedisModule_CloseKey(keys[i]);
+    }
+  }
+}
+
 RedisModuleString **RMUtil_ParseVarArgs(RedisModuleString **argv, int argc, int offset,
                                         const char *keyword, size_t *nargs) {
   if (offset > argc) {
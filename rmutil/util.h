@@ -76,6 +76,8 @@ RedisModuleString **RMUtil_ParseVarArgs(RedisModuleString **argv, int argc, int
  * Default implementation of an AoF rewrite function that simply calls DUMP/RESTORE
  * internally. To use this function, pass it as the .aof_rewrite value in
  * RedisModuleTypeMethods
+ * This holds the entire serialized value in memory, for large values see
+ * RMUtil_ChunkedAofRewrite in aof.h
  */
 void RMUtil_DefaultAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value);
 
@@ -148,4 +150,46 @@ typedef enum {
  */
 int RedisModule_TryGetValue(RedisModuleKey *key, const RedisModuleType *type, void **out);
 
+/**
+ * Open a batch of keys and match each of them against a module type, as RedisModule_TryGetValue
+ * does for a single key.
+ * Keys on swap are loaded one at a time as they are opened: call it from the callback of
+ * RMUtil_WhenKeysInRam to have them loaded together first.
+ * @param keynames the names of the keys to open
+ * @param n the number of keys
+ * @param modes per-key open modes, or NULL to open all keys with REDISMODULE_READ
+ * @param type the pointer to the type to match to
+ * @param[out] keys will be set to the opened keys, release them with RMUtil_CloseKeys
+ * @param[out] values will be set to the value of each key whose status is RMUTIL_VALUE_OK, NULL
+ * otherwise
+ * @param[out] statuses will be set to a value in the @ref RMUtil_TryGetValueStatus enum per key
+ * @return the number of keys whose status is RMUTIL_VALUE_OK
+ */
+size_t RMUtil_OpenKeysWithType(RedisModuleCtx *ctx, RedisModuleString **keynames, size_t n,
+                               const int *modes, const RedisModuleType *type, RedisModuleKey **keys,
+                               void **values, int *statuses);
+
+/* RMUtilKeysReadyFunc - called by RMUtil_WhenKeysInRam once the keys are in RAM, with a context
+ * that can open them and reply. Returns like a command handler */
+typedef int (*RMUtilKeysReadyFunc)(RedisModuleCtx *ctx, RedisModuleString **keynames, size_t n,
+                                   void *privdata);
+
+/**
+ * Run ready once a batch of keys is in RAM, typically to open them with RMUtil_OpenKeysWithType
+ * and reply. Call it from a command handler and return its return value.
+ * On enterprise builds (REDISMODULE_SDK_RLEC) the keys that are on swap are prefetched together,
+ * and the client is blocked until the last of them is loaded; ready is then called from the
+ * reply callback of the blocked client. If all the keys are in RAM, or the client can't be blocked
+ * (MULTI, scripts), ready is called right away.
+ * @param keynames the names of the keys, retained until ready is called
+ * @param privdata passed to ready, then freed with freePrivdata (if not NULL) - also if the client
+ * disconnected before the keys were loaded
+ * @return the return value of ready if it was called right away, REDISMODULE_OK otherwise
+ */
+int RMUtil_WhenKeysInRam(RedisModuleCtx *ctx, RedisModuleString **keynames, size_t n,
+                         RMUtilKeysReadyFunc ready, void *privdata, void (*freePrivdata)(void *));
+
+/* Close keys opened by RMUtil_OpenKeysWithType. NULL keys are skipped */
+void RMUtil_CloseKeys(RedisModuleKey **keys, size_t n);
+
 #endif